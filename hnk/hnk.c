@@ -25,11 +25,90 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <string.h>
+#include <math.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "hnk.h"
 
 #include "slog.h"
 
+/*
+ * Tables with at least this many k per height fill split counts a row at a
+ * time with Kronecker substitution rather than term by term.
+ */
+#define KRONECKER_MIN_K 64
+
+#define HNK_BINARY_MAGIC "HNKBIN"
+#define HNK_BINARY_VERSION 1
+
+/*
+ * Binary table file header, followed by the tables (root first, then
+ * subtrees depth first). Each table is its dimensions, maxk per height,
+ * storage per height and row flags, then per height the limb counts and
+ * limbs of the memoized counts and the ratios. Everything after the int
+ * arrays is 8 byte aligned so rows can be used in place from a mapping.
+ */
+typedef struct {
+  char magic[8];
+  int version;
+  int limb_bytes;
+  long long byteorder;
+} hnk_binary_header_t;
+
+#define HNK_BINARY_BYTEORDER 0x0102030405060708LL
+
+#define HNK_BINARY_COUNTS 0x1
+#define HNK_BINARY_RATIOS 0x2
+
+/*
+ * Flat double tables of ratios and log counts for all heights, row h
+ * occupies [offset[h], offset[h + 1]).
+ */
+typedef struct {
+  int *offset;
+  double *ratio;
+  double *loghnk;
+} flat_table_t;
+
+/*
+ * File mapping from hnk_restore_binary, referenced by every table with
+ * entries inside it and unmapped when the last reference is released.
+ */
+typedef struct {
+  int refcount;
+  void *base;
+  size_t length;
+} hnk_map_t;
+
+static void
+map_release(hnk_map_t *m)
+{
+  if (m != NULL) {
+    m->refcount --;
+    if (m->refcount <= 0) {
+      munmap(m->base, m->length);
+      free(m);
+    }
+  }
+}
+
+static void
+flat_table_destroy(flat_table_t *flat)
+{
+  if (flat != NULL) {
+    free(flat->offset);
+    free(flat->ratio);
+    free(flat->loghnk);
+    free(flat);
+  }
+}
+
 struct _hnk {
   int refcount;
   
@@ -46,11 +125,26 @@ struct _hnk {
    */
   mpz_t **counts;
 
+  /*
+   * Per entry published flags for counts [maxh + 1][maxk + 1], set once an
+   * entry is complete so that readers can skip the lock.
+   */
+  unsigned char **ready;
+
   /*
    * Memoization of power of 2 splits [maxh + 1][maxk + 1][log2 max split]
    */
   mpz_t ***split_counts;
 
+  /*
+   * Memoization of whole rows of splits [maxh + 1][maxk + 1], row h holds
+   * A(x)^power_n[h] (shifted by one for the root) where A(x) is the subtree
+   * counts at h - 1.
+   */
+  int kronecker;
+  mpz_t **powers;
+  int *power_n;
+
   int nsubtree;
   hnk_t **subtree;
 
@@ -62,12 +156,25 @@ struct _hnk {
    */
   double **ratios;
 
-  mpf_t r;
-  mpf_t n;
-  mpf_t d;
+  /*
+   * Built by hnk_build_log_table, serves ratio queries without GMP
+   */
+  flat_table_t *flat;
 
-  mpz_t a;
-  mpz_t b;
+  /*
+   * Concurrent mode: misses are filled in under the (non recursive) table
+   * mutex, hits on memoized entries are lock free. PRECOMPUTE_CONCURRENT
+   * marks tables switched on only for the duration of hnk_precompute.
+   */
+  int concurrent;
+  pthread_mutex_t mutex;
+
+  /*
+   * Mapping from hnk_restore_binary, memoized entries inside it are used
+   * in place and never freed individually. Subtrees restored from the same
+   * file each hold a reference.
+   */
+  hnk_map_t *map;
 };
 
 static int 
@@ -78,7 +185,115 @@ memoize_count(hnk_t *t,
 static int
 memoize_ratio(hnk_t *t,
 	      int h,
-	      int k);
+	      int k,
+	      double *ratio);
+
+static int
+init_mutex(hnk_t *t)
+{
+  t->concurrent = 0;
+  
+  return (pthread_mutex_init(&(t->mutex), NULL) == 0) ? 0 : -1;
+}
+
+static void
+hnk_lock(hnk_t *t)
+{
+  if (t->concurrent) {
+    pthread_mutex_lock(&(t->mutex));
+  }
+}
+
+static void
+hnk_unlock(hnk_t *t)
+{
+  if (t->concurrent) {
+    pthread_mutex_unlock(&(t->mutex));
+  }
+}
+
+/*
+ * Lock free test of whether counts[h][k] has been published.
+ */
+static int
+count_ready(hnk_t *t,
+	    int h,
+	    int k)
+{
+  unsigned char *row;
+
+  row = __atomic_load_n(&(t->ready[h]), __ATOMIC_ACQUIRE);
+  if (row == NULL) {
+    return 0;
+  }
+
+  return __atomic_load_n(&(row[k]), __ATOMIC_ACQUIRE);
+}
+
+static int
+in_map(hnk_t *t,
+       const void *p)
+{
+  return (t->map != NULL &&
+	  (const char*)p >= (const char*)t->map->base &&
+	  (const char*)p < (const char*)t->map->base + t->map->length);
+}
+
+/*
+ * Stores a computed split count unless another thread beat us to it. The
+ * value is deterministic so either copy is correct.
+ */
+static void
+publish_split_count(hnk_t *t,
+		    mpz_t entry,
+		    mpz_t s)
+{
+  hnk_lock(t);
+  if (mpz_sgn(entry) < 0) {
+    mpz_set(entry, s);
+  }
+  hnk_unlock(t);
+}
+
+/*
+ * Allocates the counts row for height h, the ready row is published last so
+ * that lock free readers never see a partially initialised row.
+ */
+static int
+allocate_count_row(hnk_t *t,
+		   int h)
+{
+  int maxk_storage;
+  int i;
+  unsigned char *row;
+  
+  maxk_storage = hnk_get_maxk_at_h_storage(t, h);
+  if (maxk_storage < 0) {
+    ERROR("failed to get maxk for storage");
+    return -1;
+  }
+    
+  t->counts[h] = (mpz_t*)malloc(sizeof(mpz_t) * (maxk_storage + 1));
+  if (t->counts[h] == NULL) {
+    ERROR("failed to allocate table entry");
+    return -1;
+  }
+
+  row = (unsigned char*)malloc(sizeof(unsigned char) * (maxk_storage + 1));
+  if (row == NULL) {
+    ERROR("failed to allocate ready entry");
+    return -1;
+  }
+    
+  for (i = 0; i <= maxk_storage; i ++) {
+    mpz_init_set_si(t->counts[h][i], -1);
+    row[i] = 0;
+  }
+
+  __atomic_store_n(&(t->ready[h]), row, __ATOMIC_RELEASE);
+  
+  return 0;
+}
 
 static int 
 nsplits(int maxsplit)
@@ -178,6 +393,34 @@ hnk_create(int maxh,
     t->counts[i] = NULL;
   }
 
+  t->ready = (unsigned char**)malloc(sizeof(unsigned char*) * (maxh + 1));
+  if (t->ready == NULL) {
+    return NULL;
+  }
+
+  for (i = 0; i <= maxh; i ++) {
+    t->ready[i] = NULL;
+  }
+
+  t->kronecker = 1;
+  t->flat = NULL;
+  t->map = NULL;
+  
+  t->powers = (mpz_t**)malloc(sizeof(mpz_t*) * (maxh + 1));
+  if (t->powers == NULL) {
+    return NULL;
+  }
+
+  t->power_n = (int*)malloc(sizeof(int) * (maxh + 1));
+  if (t->power_n == NULL) {
+    return NULL;
+  }
+
+  for (i = 0; i <= maxh; i ++) {
+    t->powers[i] = NULL;
+    t->power_n[i] = 0;
+  }
+
   t->split_counts = (mpz_t***)malloc(sizeof(mpz_t**) * (maxh + 1));
   if (t->split_counts == NULL) {
     return NULL;
@@ -209,12 +452,10 @@ hnk_create(int maxh,
     t->nsubtree = 1;
   }
 
-  mpf_init(t->r);
-  mpf_init(t->n);
-  mpf_init(t->d);
-
-  mpz_init(t->a);
-  mpz_init(t->b);
+  if (init_mutex(t) < 0) {
+    ERROR("failed to initialise mutex");
+    return NULL;
+  }
 
   return t;
 }
@@ -289,6 +530,34 @@ hnk_create_aggregate_empty(int maxh,
     t->counts[i] = NULL;
   }
 
+  t->ready = (unsigned char**)malloc(sizeof(unsigned char*) * (maxh + 1));
+  if (t->ready == NULL) {
+    return NULL;
+  }
+
+  for (i = 0; i <= maxh; i ++) {
+    t->ready[i] = NULL;
+  }
+
+  t->kronecker = 1;
+  t->flat = NULL;
+  t->map = NULL;
+  
+  t->powers = (mpz_t**)malloc(sizeof(mpz_t*) * (maxh + 1));
+  if (t->powers == NULL) {
+    return NULL;
+  }
+
+  t->power_n = (int*)malloc(sizeof(int) * (maxh + 1));
+  if (t->power_n == NULL) {
+    return NULL;
+  }
+
+  for (i = 0; i <= maxh; i ++) {
+    t->powers[i] = NULL;
+    t->power_n[i] = 0;
+  }
+
   t->split_counts = (mpz_t***)malloc(sizeof(mpz_t**) * (maxh + 1));
   if (t->split_counts == NULL) {
     return NULL;
@@ -314,12 +583,10 @@ hnk_create_aggregate_empty(int maxh,
     return NULL;
   }
 
-  mpf_init(t->r);
-  mpf_init(t->n);
-  mpf_init(t->d);
-
-  mpz_init(t->a);
-  mpz_init(t->b);
+  if (init_mutex(t) < 0) {
+    ERROR("failed to initialise mutex");
+    return NULL;
+  }
 
   return t;
 }
@@ -605,19 +872,14 @@ static int hnk_restore_stream(hnk_t *t,
 	/*
 	 * Allocate counts
 	 */
-	t->counts[i] = (mpz_t*)malloc(sizeof(mpz_t) * (maxk_storage + 1));
-	if (t->counts[i] == NULL) {
-	  ERROR("failed to allocate table entry");
+	if (allocate_count_row(t, i) < 0) {
 	  return -1;
 	}
-    
-	for (j = 0; j <= maxk_storage; j ++) {
-	  mpz_init_set_si(t->counts[i][j], -1);
-	}
       }
 
       for (j = 0; j <= maxk_storage; j ++) {
 	mpz_inp_raw(t->counts[i][j], fp);
+	t->ready[i][j] = (mpz_sgn(t->counts[i][j]) >= 0);
       }
     }
   }
@@ -782,117 +1044,779 @@ int hnk_restore(hnk_t *t,
   return 0;
 }
 
+static int
+write_padding(FILE *fp)
+{
+  static const char zeros[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+  long n;
 
-void
-hnk_destroy(hnk_t *t)
+  n = ftell(fp);
+  if (n < 0) {
+    return -1;
+  }
+
+  if ((n % 8) != 0) {
+    if (fwrite(zeros, 1, 8 - (n % 8), fp) != 8 - (n % 8)) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+static int
+hnk_save_binary_stream(hnk_t *t,
+		       FILE *fp)
 {
+  int dims[4];
+  int *storage;
+  int *flags;
+  long long *sizes;
   int i;
   int j;
-  int k;
-  int ns;
-  int maxk_storage;
+  int n;
 
-  if (t != NULL) {
+  dims[0] = t->maxh;
+  dims[1] = t->maxk;
+  dims[2] = t->maxsplit;
+  dims[3] = t->nsubtree;
 
-    t->refcount --;
-    if (t->refcount <= 0) {
+  storage = (int*)malloc(sizeof(int) * (t->maxh + 1));
+  flags = (int*)malloc(sizeof(int) * (t->maxh + 1));
+  sizes = (long long*)malloc(sizeof(long long) * (t->maxk + 1));
+  if (storage == NULL || flags == NULL || sizes == NULL) {
+    ERROR("failed to allocate buffers");
+    goto fail;
+  }
+  
+  for (i = 0; i <= t->maxh; i ++) {
+    hnk_get_maxk_at_h(t, i);
+    storage[i] = hnk_get_maxk_at_h_storage(t, i);
 
-      for (i = 0; i <= t->maxh; i ++) {
+    flags[i] = 0;
+    if (t->ready[i] != NULL) {
+      flags[i] |= HNK_BINARY_COUNTS;
+    }
+    if (t->ratios[i] != NULL) {
+      flags[i] |= HNK_BINARY_RATIOS;
+    }
+  }
 
-	if (t->counts[i] != NULL) {
-	  maxk_storage = hnk_get_maxk_at_h_storage(t, i);
-	  for (j = 0; j <= maxk_storage; j ++) {
-	    mpz_clear(t->counts[i][j]);
-	  }
-	  free(t->counts[i]);
-	}
-      }
-      
-      free(t->counts);
-      
-      ns = t->nsplits;
-      for (i = 0; i <= t->maxh; i ++) {
-	if (t->split_counts[i] != NULL) {
-	  maxk_storage = hnk_get_maxk_at_h_storage(t, i);
-	  for (j = 0; j <= maxk_storage; j ++) {
-	    if (t->split_counts[i][j] != NULL) {
-	      for (k = 0; k < ns; k ++) {
-		mpz_clear(t->split_counts[i][j][k]);
-	      }
-	      free(t->split_counts[i][j]);
-	    }
-	  }
-	  free(t->split_counts[i]);
+  if (fwrite(dims, sizeof(int), 4, fp) != 4 ||
+      fwrite(t->maxk_at_h, sizeof(int), t->maxh + 1, fp) != (t->maxh + 1) ||
+      fwrite(storage, sizeof(int), t->maxh + 1, fp) != (t->maxh + 1) ||
+      fwrite(flags, sizeof(int), t->maxh + 1, fp) != (t->maxh + 1) ||
+      write_padding(fp) < 0) {
+    ERROR("failed to write table header");
+    goto fail;
+  }
+
+  /*
+   * Counts as raw limbs, -1 size for entries not memoized
+   */
+  for (i = 0; i <= t->maxh; i ++) {
+    if (flags[i] & HNK_BINARY_COUNTS) {
+
+      n = storage[i] + 1;
+      for (j = 0; j < n; j ++) {
+	if (t->ready[i][j]) {
+	  sizes[j] = mpz_size(t->counts[i][j]);
+	} else {
+	  sizes[j] = -1;
 	}
       }
-      
-      free(t->split_counts);
-      
-      for (i = 0; i <= t->maxh; i ++) {
-	if (t->ratios[i] != NULL) {
-	  free(t->ratios[i]);
-	}
+
+      if (fwrite(sizes, sizeof(long long), n, fp) != n) {
+	ERROR("failed to write count sizes");
+	goto fail;
       }
-      free(t->ratios);
-      
-      free(t->maxk_at_h_storage);
-      free(t->maxk_at_h);
-      
-      mpf_clear(t->r);
-      mpf_clear(t->n);
-      mpf_clear(t->d);
-      
-      mpz_clear(t->a);
-      mpz_clear(t->b);
-      
-      if (t->nsubtree > 0) {
-	for (i = 0; i < t->nsubtree; i ++) {
-	  hnk_destroy(t->subtree[i]);
+
+      for (j = 0; j < n; j ++) {
+	if (sizes[j] > 0) {
+	  if (fwrite(mpz_limbs_read(t->counts[i][j]), sizeof(mp_limb_t), sizes[j], fp) != sizes[j]) {
+	    ERROR("failed to write count limbs");
+	    goto fail;
+	  }
 	}
-	free(t->subtree);
       }
-      
-      free(t);
     }
   }
-}
 
-int
-hnk_get_maxk_at_h(hnk_t *t, 
-		  int h)
-{
-  if (h < 0 || h > t->maxh) {
-    /* ERROR("hnk_get_maxk_at_h: invalid height %d\n", h); */
-    return -1;
+  /*
+   * Ratios
+   */
+  for (i = 0; i <= t->maxh; i ++) {
+    if (flags[i] & HNK_BINARY_RATIOS) {
+      n = storage[i] + 1;
+      if (fwrite(t->ratios[i], sizeof(double), n, fp) != n) {
+	ERROR("failed to write ratios");
+	goto fail;
+      }
+    }
   }
 
-  if (t->maxk_at_h[h] < 0) {
+  /*
+   * Subtrees
+   */
+  for (i = 0; i < t->nsubtree; i ++) {
 
-    t->maxk_at_h[h] = (t->cmaxk)(t, h, 1);
+    j = (t->subtree[i] != t);
+    if (fwrite(&j, sizeof(int), 1, fp) != 1 ||
+	write_padding(fp) < 0) {
+      ERROR("failed to write subtree flag");
+      goto fail;
+    }
 
+    if (j) {
+      if (hnk_save_binary_stream(t->subtree[i], fp) < 0) {
+	ERROR("failed to write subtree");
+	goto fail;
+      }
+    }
   }
 
-  return t->maxk_at_h[h];
+  free(storage);
+  free(flags);
+  free(sizes);
+  return 0;
+
+ fail:
+  free(storage);
+  free(flags);
+  free(sizes);
+  return -1;
 }
 
-int
-hnk_get_maxk_at_h_storage(hnk_t *t, 
-			  int h)
+int hnk_save_binary(hnk_t *t,
+		    const char *filename)
 {
-  if (h < 0 || h > t->maxh) {
-    return -1;
+  FILE *fp;
+  hnk_binary_header_t header;
+
+  if (t == NULL) {
+    ERROR("NULL hnk passed");
+    return -1;
+  }
+  
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, HNK_BINARY_MAGIC, strlen(HNK_BINARY_MAGIC));
+  header.version = HNK_BINARY_VERSION;
+  header.limb_bytes = sizeof(mp_limb_t);
+  header.byteorder = HNK_BINARY_BYTEORDER;
+  
+  fp = fopen(filename, "wb");
+  if (fp == NULL) {
+    ERROR("failed to create file");
+    return -1;
+  }
+
+  if (fwrite(&header, sizeof(header), 1, fp) != 1 ||
+      hnk_save_binary_stream(t, fp) < 0) {
+    ERROR("failed to save to file");
+    fclose(fp);
+    return -1;
+  }
+
+  if (fclose(fp) != 0) {
+    ERROR("failed to close file");
+    return -1;
+  }
+  
+  return 0;
+}
+
+/*
+ * Returns a pointer to the next n bytes of the mapping or NULL if the file
+ * is truncated.
+ */
+static const char *
+map_take(hnk_t *t,
+	 size_t *offset,
+	 size_t n)
+{
+  const char *p;
+
+  if (*offset + n > t->map->length) {
+    return NULL;
+  }
+
+  p = (const char*)t->map->base + *offset;
+  *offset += n;
+
+  return p;
+}
+
+static int
+hnk_restore_binary_table(hnk_t *t,
+			 size_t *offset)
+{
+  const int *dims;
+  const int *maxk_at_h;
+  const int *storage;
+  const int *flags;
+  const long long *sizes;
+  const char *p;
+  unsigned char *row;
+  int i;
+  int j;
+  int n;
+
+  dims = (const int*)map_take(t, offset, sizeof(int) * 4);
+  if (dims == NULL) {
+    ERROR("truncated table header");
+    return -1;
+  }
+
+  if (dims[0] != t->maxh ||
+      dims[1] != t->maxk ||
+      dims[2] != t->maxsplit ||
+      dims[3] != t->nsubtree) {
+    ERROR("table mismatch: %d %d %d %d != %d %d %d %d",
+	  dims[0], dims[1], dims[2], dims[3],
+	  t->maxh, t->maxk, t->maxsplit, t->nsubtree);
+    return -1;
+  }
+
+  maxk_at_h = (const int*)map_take(t, offset, sizeof(int) * (t->maxh + 1));
+  storage = (const int*)map_take(t, offset, sizeof(int) * (t->maxh + 1));
+  flags = (const int*)map_take(t, offset, sizeof(int) * (t->maxh + 1));
+  if (flags == NULL) {
+    ERROR("truncated table header");
+    return -1;
+  }
+  *offset = (*offset + 7) & ~((size_t)7);
+
+  for (i = 0; i <= t->maxh; i ++) {
+    if (hnk_get_maxk_at_h(t, i) != maxk_at_h[i] ||
+	hnk_get_maxk_at_h_storage(t, i) != storage[i]) {
+      ERROR("maxk mismatch at height %d", i);
+      return -1;
+    }
+  }
+
+  /*
+   * Counts, used in place as read only integers
+   */
+  for (i = 0; i <= t->maxh; i ++) {
+    if (flags[i] & HNK_BINARY_COUNTS) {
+
+      n = storage[i] + 1;
+      sizes = (const long long*)map_take(t, offset, sizeof(long long) * n);
+      if (sizes == NULL) {
+	ERROR("truncated count sizes");
+	return -1;
+      }
+
+      if (t->counts[i] == NULL) {
+	t->counts[i] = (mpz_t*)malloc(sizeof(mpz_t) * n);
+	row = (unsigned char*)malloc(sizeof(unsigned char) * n);
+	if (t->counts[i] == NULL || row == NULL) {
+	  ERROR("failed to allocate table entry");
+	  return -1;
+	}
+      } else {
+	row = NULL;
+      }
+
+      for (j = 0; j < n; j ++) {
+	
+	if (sizes[j] >= 0) {
+	  p = map_take(t, offset, sizeof(mp_limb_t) * sizes[j]);
+	  if (p == NULL) {
+	    ERROR("truncated count limbs");
+	    return -1;
+	  }
+
+	  if (row != NULL) {
+	    if (sizes[j] > 0) {
+	      mpz_roinit_n(t->counts[i][j], (const mp_limb_t*)p, sizes[j]);
+	    } else {
+	      /* Zero has no limbs to point at */
+	      mpz_init(t->counts[i][j]);
+	    }
+	    row[j] = 1;
+	  }
+	} else if (row != NULL) {
+	  mpz_init_set_si(t->counts[i][j], -1);
+	  row[j] = 0;
+	}
+      }
+
+      if (row != NULL) {
+	__atomic_store_n(&(t->ready[i]), row, __ATOMIC_RELEASE);
+      }
+    }
+  }
+
+  /*
+   * Ratios, mapped copy on write so unset entries can still be memoized
+   */
+  for (i = 0; i <= t->maxh; i ++) {
+    if (flags[i] & HNK_BINARY_RATIOS) {
+
+      n = storage[i] + 1;
+      p = map_take(t, offset, sizeof(double) * n);
+      if (p == NULL) {
+	ERROR("truncated ratios");
+	return -1;
+      }
+
+      if (t->ratios[i] == NULL) {
+	__atomic_store_n(&(t->ratios[i]), (double*)p, __ATOMIC_RELEASE);
+      }
+    }
+  }
+
+  /*
+   * Subtrees
+   */
+  for (i = 0; i < t->nsubtree; i ++) {
+
+    p = map_take(t, offset, sizeof(int));
+    if (p == NULL) {
+      ERROR("truncated subtree flag");
+      return -1;
+    }
+    *offset = (*offset + 7) & ~((size_t)7);
+
+    if (*((const int*)p)) {
+
+      if (t->subtree[i]->map == NULL) {
+	t->subtree[i]->map = t->map;
+	t->map->refcount ++;
+      } else if (t->subtree[i]->map != t->map) {
+	ERROR("subtree already restored from another file");
+	return -1;
+      }
+      
+      if (hnk_restore_binary_table(t->subtree[i], offset) < 0) {
+	ERROR("failed to restore subtree");
+	return -1;
+      }
+    }
+  }
+
+  return 0;
+}
+
+int hnk_restore_binary(hnk_t *t,
+		       const char *filename)
+{
+  int fd;
+  struct stat st;
+  void *base;
+  hnk_map_t *map;
+  hnk_binary_header_t header;
+  size_t offset;
+
+  if (t == NULL) {
+    ERROR("NULL hnk passed");
+    return -1;
+  }
+
+  if (t->map != NULL) {
+    ERROR("table already restored from a binary file");
+    return -1;
+  }
+  
+  fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    ERROR("failed to open file");
+    return -1;
+  }
+
+  if (fstat(fd, &st) < 0 || st.st_size < sizeof(header)) {
+    ERROR("failed to stat file or file too small");
+    close(fd);
+    return -1;
+  }
+
+  /*
+   * Private writable mapping: pages are shared through the page cache
+   * between processes until (if ever) a missing ratio is filled in.
+   */
+  base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    ERROR("failed to map file");
+    return -1;
+  }
+
+  memcpy(&header, base, sizeof(header));
+  if (strncmp(header.magic, HNK_BINARY_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != HNK_BINARY_VERSION ||
+      header.limb_bytes != sizeof(mp_limb_t) ||
+      header.byteorder != HNK_BINARY_BYTEORDER) {
+    ERROR("not a compatible binary hnk file");
+    munmap(base, st.st_size);
+    return -1;
+  }
+
+  map = (hnk_map_t*)malloc(sizeof(hnk_map_t));
+  if (map == NULL) {
+    ERROR("failed to allocate mapping");
+    munmap(base, st.st_size);
+    return -1;
+  }
+  map->refcount = 1;
+  map->base = base;
+  map->length = st.st_size;
+  t->map = map;
+
+  offset = sizeof(header);
+  if (hnk_restore_binary_table(t, &offset) < 0) {
+    ERROR("failed to restore from file");
+    /* Entries may already point into the mapping so it is kept */
+    return -1;
+  }
+
+  return 0;
+}
+
+void
+hnk_destroy(hnk_t *t)
+{
+  int i;
+  int j;
+  int k;
+  int ns;
+  int maxk_storage;
+
+  if (t != NULL) {
+
+    t->refcount --;
+    if (t->refcount <= 0) {
+
+      for (i = 0; i <= t->maxh; i ++) {
+
+	if (t->counts[i] != NULL) {
+	  maxk_storage = hnk_get_maxk_at_h_storage(t, i);
+	  for (j = 0; j <= maxk_storage; j ++) {
+	    if (!in_map(t, mpz_limbs_read(t->counts[i][j]))) {
+	      mpz_clear(t->counts[i][j]);
+	    }
+	  }
+	  free(t->counts[i]);
+	  free(t->ready[i]);
+	}
+      }
+      
+      free(t->counts);
+      free(t->ready);
+      
+      ns = t->nsplits;
+      for (i = 0; i <= t->maxh; i ++) {
+	if (t->split_counts[i] != NULL) {
+	  maxk_storage = hnk_get_maxk_at_h_storage(t, i);
+	  for (j = 0; j <= maxk_storage; j ++) {
+	    if (t->split_counts[i][j] != NULL) {
+	      for (k = 0; k < ns; k ++) {
+		mpz_clear(t->split_counts[i][j][k]);
+	      }
+	      free(t->split_counts[i][j]);
+	    }
+	  }
+	  free(t->split_counts[i]);
+	}
+      }
+      
+      free(t->split_counts);
+
+      for (i = 0; i <= t->maxh; i ++) {
+	if (t->powers[i] != NULL) {
+	  maxk_storage = hnk_get_maxk_at_h_storage(t, i);
+	  for (j = 0; j <= maxk_storage; j ++) {
+	    mpz_clear(t->powers[i][j]);
+	  }
+	  free(t->powers[i]);
+	}
+      }
+      free(t->powers);
+      free(t->power_n);
+      
+      for (i = 0; i <= t->maxh; i ++) {
+	if (t->ratios[i] != NULL && !in_map(t, t->ratios[i])) {
+	  free(t->ratios[i]);
+	}
+      }
+      free(t->ratios);
+
+      flat_table_destroy(t->flat);
+      
+      free(t->maxk_at_h_storage);
+      free(t->maxk_at_h);
+      
+      pthread_mutex_destroy(&(t->mutex));
+      
+      if (t->nsubtree > 0) {
+	for (i = 0; i < t->nsubtree; i ++) {
+	  hnk_destroy(t->subtree[i]);
+	}
+	free(t->subtree);
+      }
+
+      map_release(t->map);
+      
+      free(t);
+    }
+  }
+}
+
+int
+hnk_set_concurrent(hnk_t *t,
+		   int concurrent)
+{
+  int i;
+  
+  if (t == NULL) {
+    ERROR("NULL hnk passed");
+    return -1;
   }
 
-  if (t->maxk_at_h_storage[h] < 0) {
+  t->concurrent = concurrent;
 
-    t->maxk_at_h_storage[h] = (t->cmaxk)(t, h, 1);
-    if (t->maxk_at_h_storage[h] > t->maxk) {
-      t->maxk_at_h_storage[h] = t->maxk;
+  for (i = 0; i < t->nsubtree; i ++) {
+    if (t->subtree[i] != NULL && t->subtree[i] != t) {
+      if (hnk_set_concurrent(t->subtree[i], concurrent) < 0) {
+	return -1;
+      }
+    }
+  }
+
+  return 0;
+}
+
+int
+hnk_set_kronecker(hnk_t *t,
+		  int kronecker)
+{
+  int i;
+  
+  if (t == NULL) {
+    ERROR("NULL hnk passed");
+    return -1;
+  }
+
+  t->kronecker = kronecker;
+
+  for (i = 0; i < t->nsubtree; i ++) {
+    if (t->subtree[i] != NULL && t->subtree[i] != t) {
+      if (hnk_set_kronecker(t->subtree[i], kronecker) < 0) {
+	return -1;
+      }
+    }
+  }
+
+  return 0;
+}
+
+typedef struct {
+  hnk_t *t;
+  int h;
+  int kmax;
+  int next;
+  int failed;
+} precompute_level_t;
+
+#define PRECOMPUTE_CONCURRENT 2
+
+/*
+ * Changes the concurrent flag of the table and its subtrees from one value
+ * to another, leaving tables with any other setting as they are.
+ */
+static void
+swap_concurrent(hnk_t *t, int from, int to)
+{
+  int i;
+
+  if (t->concurrent == from) {
+    t->concurrent = to;
+  }
+
+  for (i = 0; i < t->nsubtree; i ++) {
+    if (t->subtree[i] != NULL && t->subtree[i] != t) {
+      swap_concurrent(t->subtree[i], from, to);
+    }
+  }
+}
+
+static void *
+precompute_worker(void *arg)
+{
+  precompute_level_t *level = (precompute_level_t*)arg;
+  int k;
+
+  /*
+   * k handed out in increasing order so that the smaller split counts a
+   * larger k depends upon are usually already memoized.
+   */
+  for (k = __atomic_fetch_add(&(level->next), 1, __ATOMIC_RELAXED);
+       k <= level->kmax;
+       k = __atomic_fetch_add(&(level->next), 1, __ATOMIC_RELAXED)) {
+
+    if (memoize_count(level->t, level->h, k) < 0) {
+      __atomic_store_n(&(level->failed), 1, __ATOMIC_RELAXED);
+      break;
+    }
+  }
+
+  return NULL;
+}
+
+int
+hnk_precompute(hnk_t *t,
+	       int nthreads)
+{
+  precompute_level_t level;
+  pthread_t *threads;
+  int nstarted;
+  int maxk;
+  int h;
+  int i;
+  int k;
+  double ratio;
+
+  if (t == NULL) {
+    ERROR("NULL hnk passed");
+    return -1;
+  }
+
+  if (nthreads < 1) {
+    nthreads = 1;
+  }
+
+  for (i = 0; i < t->nsubtree; i ++) {
+    if (t->subtree[i] != NULL && t->subtree[i] != t) {
+      if (hnk_precompute(t->subtree[i], nthreads) < 0) {
+	ERROR("failed to precompute subtree");
+	return -1;
+      }
+    }
+  }
+
+  threads = NULL;
+  if (nthreads > 1) {
+    threads = (pthread_t*)malloc(sizeof(pthread_t) * (nthreads - 1));
+    if (threads == NULL) {
+      ERROR("failed to allocate threads");
+      return -1;
+    }
+  }
+
+  if (nthreads > 1) {
+    swap_concurrent(t, 0, PRECOMPUTE_CONCURRENT);
+  }
+
+  level.t = t;
+  level.failed = 0;
+  
+  for (h = 0; h <= t->maxh && !level.failed; h ++) {
+
+    /*
+     * All k at height h depend only on height h - 1 (and smaller split
+     * counts at h), so levels are filled in order with k shared out across
+     * the threads.
+     */
+    maxk = hnk_get_maxk_at_h(t, h);
+    if (maxk < 0) {
+      ERROR("failed to get maxk");
+      level.failed = 1;
+      break;
+    }
+    
+    level.h = h;
+    level.kmax = hnk_get_maxk_at_h_storage(t, h);
+    level.next = 0;
+
+    nstarted = 0;
+    for (i = 0; i < nthreads - 1; i ++) {
+      if (pthread_create(&(threads[i]), NULL, precompute_worker, &level) != 0) {
+	break;
+      }
+      nstarted ++;
+    }
+
+    precompute_worker(&level);
+
+    for (i = 0; i < nstarted; i ++) {
+      pthread_join(threads[i], NULL);
+    }
+
+    if (level.failed) {
+      ERROR("failed to compute hnk at height %d", h);
+      break;
     }
 
+    /*
+     * Ratios are cheap once the counts are in, the ratio at k needs the
+     * count at k + 1 so skip the last stored k unless it is the true max.
+     */
+    for (k = 0; k <= level.kmax; k ++) {
+      if (k < level.kmax || k == maxk) {
+	if (memoize_ratio(t, h, k, &ratio) < 0) {
+	  ERROR("failed to compute ratio at %d %d", h, k);
+	  level.failed = 1;
+	  break;
+	}
+      }
+    }
   }
 
-  return t->maxk_at_h_storage[h];
+  if (nthreads > 1) {
+    swap_concurrent(t, PRECOMPUTE_CONCURRENT, 0);
+  }
+  free(threads);
+
+  return level.failed ? -1 : 0;
+}
+
+int
+hnk_get_maxk_at_h(hnk_t *t, 
+		  int h)
+{
+  int maxk;
+  
+  if (h < 0 || h > t->maxh) {
+    /* ERROR("hnk_get_maxk_at_h: invalid height %d\n", h); */
+    return -1;
+  }
+
+  maxk = __atomic_load_n(&(t->maxk_at_h[h]), __ATOMIC_RELAXED);
+  if (maxk < 0) {
+
+    /*
+     * Deterministic so concurrent callers racing here store the same value
+     */
+    maxk = (t->cmaxk)(t, h, 1);
+    __atomic_store_n(&(t->maxk_at_h[h]), maxk, __ATOMIC_RELAXED);
+
+  }
+
+  return maxk;
+}
+
+int
+hnk_get_maxk_at_h_storage(hnk_t *t, 
+			  int h)
+{
+  int maxk;
+  
+  if (h < 0 || h > t->maxh) {
+    return -1;
+  }
+
+  maxk = __atomic_load_n(&(t->maxk_at_h_storage[h]), __ATOMIC_RELAXED);
+  if (maxk < 0) {
+
+    maxk = (t->cmaxk)(t, h, 1);
+    if (maxk > t->maxk) {
+      maxk = t->maxk;
+    }
+    __atomic_store_n(&(t->maxk_at_h_storage[h]), maxk, __ATOMIC_RELAXED);
+
+  }
+
+  return maxk;
 }
 
 int
@@ -938,86 +1862,254 @@ hnk_is_hnk_memoized(hnk_t *t,
     return 0;
   }
   
-  if (t->counts[h] == NULL) {
-    return 0;
+  if (k < 0 || k > hnk_get_maxk_at_h_storage(t, h)) {
+    return 0;
+  }
+
+  return count_ready(t, h, k);
+}
+
+int
+hnk_highest_memoized_k(hnk_t *t,
+		       int h)
+{
+  int i;
+  int maxk_storage;
+  
+  if (h < 0 || h > t->maxh) {
+    return 0;
+  }
+  
+  maxk_storage = hnk_get_maxk_at_h_storage(t, h);
+  if (maxk_storage < 0) {
+    return -1;
+  }
+
+  for (i = maxk_storage; i >= 0; i --) {
+
+    if (count_ready(t, h, i) && mpz_sgn(t->counts[h][i]) > 0) {
+      return i;
+    }
+  }
+
+  return 0;
+}
+
+
+/*
+ * Returns ratio of hnk(k+1)/hnk(k) for given k
+ */
+int
+hnk_get_kplus1_ratio(hnk_t *t, 
+		     int h, 
+		     int k, 
+		     double *ratio)
+{
+  int maxk;
+  int i;
+  flat_table_t *flat;
+
+  if (h < 0 || h > t->maxh) {
+    ERROR("h out of range (%d)", h);
+    return -1;
+  }
+
+  flat = __atomic_load_n(&(t->flat), __ATOMIC_ACQUIRE);
+  if (flat != NULL && k >= 0) {
+    i = flat->offset[h] + k;
+    if (i < flat->offset[h + 1] && flat->ratio[i] >= 0.0) {
+      *ratio = flat->ratio[i];
+      return 0;
+    }
+  }
+
+  maxk = hnk_get_maxk_at_h(t, h);
+  if (maxk < 0) {
+    ERROR("failed to get maxk");
+    return -1;
+  }
+  if (k < 0 || k > maxk) {
+    *ratio = 0.0;
+    return 0;
+  }
+
+  if (memoize_ratio(t,
+		    h,
+		    k,
+		    ratio) < 0) {
+    ERROR("failed to memoize");
+    return -1;
+  }
+
+  return 0;
+}
+
+static double
+log_mpz(mpz_t z)
+{
+  long e;
+  double d;
+  
+  if (mpz_sgn(z) <= 0) {
+    return -INFINITY;
+  }
+
+  d = mpz_get_d_2exp(&e, z);
+  return log(d) + (double)e * M_LN2;
+}
+
+int
+hnk_build_log_table(hnk_t *t)
+{
+  flat_table_t *flat;
+  int maxk;
+  int maxk_storage;
+  int h;
+  int k;
+  int i;
+  double ratio;
+
+  if (t == NULL) {
+    ERROR("NULL hnk passed");
+    return -1;
+  }
+
+  if (t->flat != NULL) {
+    return 0;
+  }
+
+  flat = (flat_table_t*)malloc(sizeof(flat_table_t));
+  if (flat == NULL) {
+    ERROR("failed to allocate table");
+    return -1;
+  }
+  flat->ratio = NULL;
+  flat->loghnk = NULL;
+  
+  flat->offset = (int*)malloc(sizeof(int) * (t->maxh + 2));
+  if (flat->offset == NULL) {
+    ERROR("failed to allocate offsets");
+    goto fail;
   }
 
-  if (k < 0 || k > t->maxk_at_h[h]) {
-    return 0;
+  flat->offset[0] = 0;
+  for (h = 0; h <= t->maxh; h ++) {
+    maxk_storage = hnk_get_maxk_at_h_storage(t, h);
+    if (maxk_storage < 0) {
+      ERROR("failed to get maxk for storage");
+      goto fail;
+    }
+    flat->offset[h + 1] = flat->offset[h] + maxk_storage + 1;
   }
 
-  if (mpz_sgn(t->counts[h][k]) < 0) {
-    return 0;
+  flat->ratio = (double*)malloc(sizeof(double) * flat->offset[t->maxh + 1]);
+  flat->loghnk = (double*)malloc(sizeof(double) * flat->offset[t->maxh + 1]);
+  if (flat->ratio == NULL || flat->loghnk == NULL) {
+    ERROR("failed to allocate table rows");
+    goto fail;
+  }
+
+  for (h = 0; h <= t->maxh; h ++) {
+
+    maxk = hnk_get_maxk_at_h(t, h);
+    maxk_storage = flat->offset[h + 1] - flat->offset[h] - 1;
+    
+    for (k = 0; k <= maxk_storage; k ++) {
+      i = flat->offset[h] + k;
+
+      if (memoize_count(t, h, k) < 0) {
+	ERROR("failed to compute hnk for %d %d", h, k);
+	goto fail;
+      }
+      flat->loghnk[i] = log_mpz(t->counts[h][k]);
+
+      /*
+       * The ratio at the last stored k needs the count beyond storage so is
+       * left to the slow path unless k is the true maximum.
+       */
+      flat->ratio[i] = -1.0;
+      if (k < maxk_storage || k == maxk) {
+	if (memoize_ratio(t, h, k, &ratio) < 0) {
+	  ERROR("failed to compute ratio for %d %d", h, k);
+	  goto fail;
+	}
+	flat->ratio[i] = ratio;
+      }
+    }
   }
 
-  return 1;
+  __atomic_store_n(&(t->flat), flat, __ATOMIC_RELEASE);
+  
+  return 0;
+
+ fail:
+  flat_table_destroy(flat);
+  return -1;
 }
 
 int
-hnk_highest_memoized_k(hnk_t *t,
-		       int h)
+hnk_get_log_hnk(hnk_t *t,
+		int h,
+		int k,
+		double *loghnk)
 {
+  flat_table_t *flat;
   int i;
-  int maxk_storage;
-  
+  mpz_t a;
+
   if (h < 0 || h > t->maxh) {
-    return 0;
+    ERROR("h out of range (%d)", h);
+    return -1;
   }
   
-  if (t->counts[h] == NULL) {
-    return 0;
+  flat = __atomic_load_n(&(t->flat), __ATOMIC_ACQUIRE);
+  if (flat != NULL && k >= 0) {
+    i = flat->offset[h] + k;
+    if (i < flat->offset[h + 1]) {
+      *loghnk = flat->loghnk[i];
+      return 0;
+    }
   }
 
-  maxk_storage = hnk_get_maxk_at_h_storage(t, h);
-  if (maxk_storage < 0) {
+  mpz_init(a);
+  if (hnk_get_hnk(t, h, k, a) < 0) {
+    mpz_clear(a);
     return -1;
   }
-
-  for (i = maxk_storage; i >= 0; i --) {
-
-    if (mpz_sgn(t->counts[h][i]) > 0) {
-      return i;
-    }
-  }
+  *loghnk = log_mpz(a);
+  mpz_clear(a);
 
   return 0;
 }
 
-
-/*
- * Returns ratio of hnk(k+1)/hnk(k) for given k
- */
 int
-hnk_get_kplus1_ratio(hnk_t *t, 
-		     int h, 
-		     int k, 
-		     double *ratio)
+hnk_get_kplus1_log_ratio(hnk_t *t,
+			 int h,
+			 int k,
+			 double *logratio)
 {
-  int maxk;
+  flat_table_t *flat;
+  int i;
+  double ratio;
 
   if (h < 0 || h > t->maxh) {
     ERROR("h out of range (%d)", h);
     return -1;
   }
 
-  maxk = hnk_get_maxk_at_h(t, h);
-  if (maxk < 0) {
-    ERROR("failed to get maxk");
-    return -1;
-  }
-  if (k < 0 || k > maxk) {
-    *ratio = 0.0;
-    return 0;
+  flat = __atomic_load_n(&(t->flat), __ATOMIC_ACQUIRE);
+  if (flat != NULL && k >= 0) {
+    i = flat->offset[h] + k;
+    if (i + 1 < flat->offset[h + 1]) {
+      *logratio = flat->loghnk[i + 1] - flat->loghnk[i];
+      return 0;
+    }
   }
 
-  if (memoize_ratio(t,
-		    h,
-		    k) < 0) {
-    ERROR("failed to memoize");
+  if (hnk_get_kplus1_ratio(t, h, k, &ratio) < 0) {
     return -1;
   }
-
-  *ratio = t->ratios[h][k];
+  *logratio = log(ratio);
 
   return 0;
 }
@@ -1081,8 +2173,8 @@ memoize_count(hnk_t *t,
 	      int k)
 {
   int maxk;
-  int i;
-  int maxk_storage;
+  int r;
+  mpz_t v;
 
   if (h < 0 || h > t->maxh) {
     ERROR("invalid h");
@@ -1099,39 +2191,46 @@ memoize_count(hnk_t *t,
     return -1;
   }
 
+  if (count_ready(t, h, k)) {
+    return 0;
+  }
+
+  hnk_lock(t);
+  r = 0;
   if (t->counts[h] == NULL) {
     
     /*
      * Initialise table now for this height
      */
-    maxk_storage = hnk_get_maxk_at_h_storage(t, h);
-    if (maxk_storage < 0) {
-      ERROR("failed to get maxk for storage");
-      return -1;
-    }
-    
-    t->counts[h] = (mpz_t*)malloc(sizeof(mpz_t) * (maxk_storage + 1));
-    if (t->counts[h] == NULL) {
-      ERROR("failed to allocate table entry");
-      return -1;
-    }
-    
-    for (i = 0; i <= maxk_storage; i ++) {
-      mpz_init_set_si(t->counts[h][i], -1);
-    }
+    r = allocate_count_row(t, h);
     
   }
+  hnk_unlock(t);
 
-  if (mpz_sgn(t->counts[h][k]) < 0) {
-    /* 
-     * Not been set yet
-     */
-    if ((t->chnk)(t, h, k, t->counts[h][k]) < 0) {
-      ERROR("failed to compute hnk for %d, %d",
-	    h, k);
-      return -1;
-    }
+  if (r < 0) {
+    return -1;
+  }
+
+  /* 
+   * Not been set yet, computed without holding the lock so that other
+   * entries can be filled in concurrently.
+   */
+  mpz_init(v);
+  if ((t->chnk)(t, h, k, v) < 0) {
+    ERROR("failed to compute hnk for %d, %d",
+	  h, k);
+    mpz_clear(v);
+    return -1;
+  }
+
+  hnk_lock(t);
+  if (!t->ready[h][k]) {
+    mpz_set(t->counts[h][k], v);
+    __atomic_store_n(&(t->ready[h][k]), 1, __ATOMIC_RELEASE);
   }
+  hnk_unlock(t);
+  
+  mpz_clear(v);
 
   return 0;
 }
@@ -1139,11 +2238,18 @@ memoize_count(hnk_t *t,
 static int
 memoize_ratio(hnk_t *t,
 	      int h,
-	      int k)
+	      int k,
+	      double *ratio)
 {
   int maxk;
   int i;
   int maxk_storage;
+  double *row;
+  double v;
+  mpf_t r;
+  mpf_t n;
+  mpf_t d;
+  int result;
 
   if (h < 0 || h > t->maxh) {
     ERROR("h out of range (%d)", h);
@@ -1161,6 +2267,17 @@ memoize_ratio(hnk_t *t,
     return -1;
   }
 
+  row = __atomic_load_n(&(t->ratios[h]), __ATOMIC_ACQUIRE);
+  if (row != NULL) {
+    __atomic_load(&(row[k]), &v, __ATOMIC_ACQUIRE);
+    if (v >= 0.0) {
+      *ratio = v;
+      return 0;
+    }
+  }
+
+  hnk_lock(t);
+
   if (t->ratios[h] == NULL) {
     
     /*
@@ -1169,46 +2286,65 @@ memoize_ratio(hnk_t *t,
     maxk_storage = hnk_get_maxk_at_h_storage(t, h);
     if (maxk_storage < 0) {
       ERROR("failed to get maxk for storage");
+      hnk_unlock(t);
       return -1;
     }
 
-    t->ratios[h] = (double*)malloc(sizeof(double) * (maxk_storage + 1));
-    if (t->ratios[h] == NULL) {
+    row = (double*)malloc(sizeof(double) * (maxk_storage + 1));
+    if (row == NULL) {
       ERROR("failed to allocate table entry");
+      hnk_unlock(t);
       return -1;
     }
     
     for (i = 0; i <= maxk_storage; i ++) {
-      t->ratios[h][i] = -1.0;
+      row[i] = -1.0;
     }
-    
+
+    __atomic_store_n(&(t->ratios[h]), row, __ATOMIC_RELEASE);
   }
+  row = t->ratios[h];
 
-  if (t->ratios[h][k] < 0.0) {
-    /* 
-     * Not been set yet
-     */
-    if (memoize_count(t, h, k) < 0) { 
-      ERROR("failed to memoize den: %d", k);
-      return -1;
-    }
-    mpf_set_z(t->d, t->counts[h][k]);
+  hnk_unlock(t);
 
+  /* 
+   * Not been set yet, scratch is local so callers on other tables (or
+   * other threads) cannot clobber it.
+   */
+  mpf_init(r);
+  mpf_init(n);
+  mpf_init(d);
+
+  result = 0;
+  if (memoize_count(t, h, k) < 0) { 
+    ERROR("failed to memoize den: %d", k);
+    result = -1;
+  } else {
+    mpf_set_z(d, t->counts[h][k]);
+    
     if (k == maxk) {
-      mpf_set_ui(t->n, 0);
+      mpf_set_ui(n, 0);
     } else if (memoize_count(t, h, k + 1) < 0) {
       ERROR("failed to memoize num: %d", k);
-      return -1;
+      result = -1;
     } else {
-      mpf_set_z(t->n, t->counts[h][k + 1]);
+      mpf_set_z(n, t->counts[h][k + 1]);
     }
+  }
 
-    mpf_div(t->r, t->n, t->d);
-
-    t->ratios[h][k] = mpf_get_d(t->r);
+  if (result == 0) {
+    mpf_div(r, n, d);
+    
+    v = mpf_get_d(r);
+    __atomic_store(&(row[k]), &v, __ATOMIC_RELEASE);
+    *ratio = v;
   }
+  
+  mpf_clear(r);
+  mpf_clear(n);
+  mpf_clear(d);
 
-  return 0;
+  return result;
 }
 
 static int
@@ -1226,6 +2362,7 @@ memoize_split_count(hnk_t *t,
 
   int si;
   int ns;
+  int computed;
 
   int maxk_storage;
 
@@ -1240,17 +2377,21 @@ memoize_split_count(hnk_t *t,
     return -1;
   }
 
+  hnk_lock(t);
+  
   if (t->split_counts[h] == NULL) {
 
     maxk_storage = hnk_get_maxk_at_h_storage(t, h);
     if (maxk_storage < 0) {
       ERROR("failed to get maxk for storage");
+      hnk_unlock(t);
       return -1;
     }
     
     t->split_counts[h] = (mpz_t **)malloc(sizeof(mpz_t*) * (maxk_storage + 1));
     if (t->split_counts[h] == NULL) {
       ERROR("failed to allocate k array");
+      hnk_unlock(t);
       return -1;
     }
     
@@ -1265,6 +2406,7 @@ memoize_split_count(hnk_t *t,
     t->split_counts[h][k] = (mpz_t*)malloc(sizeof(mpz_t) * ns);
     if (t->split_counts[h][k] == NULL) {
       ERROR("failed to allocate split array");
+      hnk_unlock(t);
       return -1;
     }
 
@@ -1275,7 +2417,10 @@ memoize_split_count(hnk_t *t,
 
   si = splitindex(nsplit);
 
-  if (mpz_sgn(t->split_counts[h][k][si]) < 0) {
+  computed = (mpz_sgn(t->split_counts[h][k][si]) >= 0);
+  hnk_unlock(t);
+
+  if (!computed) {
 
     /*
      * Need to compute
@@ -1319,7 +2464,7 @@ memoize_split_count(hnk_t *t,
 	mpz_set(s, a);
       }
       
-      mpz_set(t->split_counts[h][k][si], s);
+      publish_split_count(t, t->split_counts[h][k][si], s);
       
       mpz_clear(a);
       mpz_clear(b);
@@ -1388,7 +2533,7 @@ memoize_split_count(hnk_t *t,
 	mpz_set(s, a);
       }
       
-      mpz_set(t->split_counts[h][k][si], s);
+      publish_split_count(t, t->split_counts[h][k][si], s);
       
       mpz_clear(a);
       mpz_clear(b);
@@ -1400,6 +2545,310 @@ memoize_split_count(hnk_t *t,
   return 0;
 }
 
+static size_t
+max_bits(mpz_t *a,
+	 int n)
+{
+  size_t m;
+  size_t b;
+  int i;
+
+  m = 0;
+  for (i = 0; i < n; i ++) {
+    b = mpz_sizeinbase(a[i], 2);
+    if (b > m) {
+      m = b;
+    }
+  }
+
+  return m;
+}
+
+/*
+ * Packs non-negative coefficients into x, one per slot limbs.
+ */
+static void
+kronecker_pack(mpz_t x,
+	       mpz_t *a,
+	       int na,
+	       size_t slot)
+{
+  mp_limb_t *p;
+  size_t n;
+  int i;
+
+  p = mpz_limbs_write(x, na * slot);
+  memset(p, 0, sizeof(mp_limb_t) * na * slot);
+  
+  for (i = 0; i < na; i ++) {
+    n = mpz_size(a[i]);
+    if (n > 0) {
+      memcpy(p + i * slot, mpz_limbs_read(a[i]), sizeof(mp_limb_t) * n);
+    }
+  }
+  
+  mpz_limbs_finish(x, na * slot);
+}
+
+/*
+ * r = a * b truncated to nr coefficients with a single big integer product,
+ * r must not alias a or b.
+ */
+static void
+kronecker_mul(mpz_t *r,
+	      int nr,
+	      mpz_t *a,
+	      int na,
+	      mpz_t *b,
+	      int nb)
+{
+  mpz_t x;
+  mpz_t y;
+  const mp_limb_t *p;
+  mp_limb_t *q;
+  size_t bits;
+  size_t slot;
+  size_t n;
+  size_t offset;
+  size_t m;
+  int i;
+
+  if (na > nr) {
+    na = nr;
+  }
+  if (nb > nr) {
+    nb = nr;
+  }
+
+  /*
+   * Slots wide enough that no coefficient of the product overflows
+   */
+  bits = max_bits(a, na) + max_bits(b, nb) + 1;
+  for (i = (na < nb ? na : nb); i > 0; i >>= 1) {
+    bits ++;
+  }
+  slot = (bits + GMP_NUMB_BITS - 1)/GMP_NUMB_BITS;
+
+  mpz_init(x);
+  kronecker_pack(x, a, na, slot);
+  if (a == b && na == nb) {
+    mpz_mul(x, x, x);
+  } else {
+    mpz_init(y);
+    kronecker_pack(y, b, nb, slot);
+    mpz_mul(x, x, y);
+    mpz_clear(y);
+  }
+
+  p = mpz_limbs_read(x);
+  n = mpz_size(x);
+  for (i = 0; i < nr; i ++) {
+    offset = i * slot;
+    if (offset >= n) {
+      mpz_set_ui(r[i], 0);
+    } else {
+      m = n - offset;
+      if (m > slot) {
+	m = slot;
+      }
+      q = mpz_limbs_write(r[i], m);
+      memcpy(q, p + offset, sizeof(mp_limb_t) * m);
+      mpz_limbs_finish(r[i], m);
+    }
+  }
+
+  mpz_clear(x);
+}
+
+/*
+ * r = a^n truncated to nr coefficients by repeated squaring.
+ */
+static int
+kronecker_power(mpz_t *r,
+		int nr,
+		mpz_t *a,
+		int na,
+		int n)
+{
+  mpz_t *base;
+  mpz_t *tmp;
+  int nbase;
+  int nacc;
+  int m;
+  int i;
+
+  base = (mpz_t*)malloc(sizeof(mpz_t) * nr);
+  tmp = (mpz_t*)malloc(sizeof(mpz_t) * nr);
+  if (base == NULL || tmp == NULL) {
+    ERROR("failed to allocate power workspace");
+    free(base);
+    free(tmp);
+    return -1;
+  }
+
+  nbase = (na < nr) ? na : nr;
+  for (i = 0; i < nr; i ++) {
+    if (i < nbase) {
+      mpz_init_set(base[i], a[i]);
+    } else {
+      mpz_init(base[i]);
+    }
+    mpz_init(tmp[i]);
+    mpz_set_ui(r[i], 0);
+  }
+  mpz_set_ui(r[0], 1);
+  nacc = 1;
+
+  while (n > 0) {
+
+    if (n & 1) {
+      m = nacc + nbase - 1;
+      if (m > nr) {
+	m = nr;
+      }
+      kronecker_mul(tmp, m, r, nacc, base, nbase);
+      for (i = 0; i < m; i ++) {
+	mpz_swap(r[i], tmp[i]);
+      }
+      nacc = m;
+    }
+
+    n >>= 1;
+    if (n > 0) {
+      m = 2 * nbase - 1;
+      if (m > nr) {
+	m = nr;
+      }
+      kronecker_mul(tmp, m, base, nbase, base, nbase);
+      for (i = 0; i < m; i ++) {
+	mpz_swap(base[i], tmp[i]);
+      }
+      nbase = m;
+    }
+  }
+
+  for (i = 0; i < nr; i ++) {
+    mpz_clear(base[i]);
+    mpz_clear(tmp[i]);
+  }
+  free(base);
+  free(tmp);
+
+  return 0;
+}
+
+/*
+ * The nsplit way split count for k is the coefficient of x^(k - 1) in
+ * A(x)^nsplit where A(x) is the subtree counts at h - 1, so a whole row
+ * costs a few big integer products instead of O(k^2) small ones. Returns 0
+ * with the row, 1 if the row does not apply (small table or a different
+ * nsplit already memoized at h) and -1 on error.
+ */
+static int
+memoize_power_row(hnk_t *t,
+		  hnk_t *subtree,
+		  int h,
+		  int nsplit,
+		  mpz_t **prow)
+{
+  mpz_t *row;
+  mpz_t *a;
+  int maxk_storage;
+  int na;
+  int j;
+  int r;
+
+  maxk_storage = hnk_get_maxk_at_h_storage(t, h);
+  if (maxk_storage < KRONECKER_MIN_K) {
+    return 1;
+  }
+  
+  row = __atomic_load_n(&(t->powers[h]), __ATOMIC_ACQUIRE);
+  if (row != NULL) {
+    if (t->power_n[h] != nsplit) {
+      return 1;
+    }
+    
+    *prow = row;
+    return 0;
+  }
+
+  /*
+   * Subtree counts are gathered before taking the lock as the subtree may
+   * be this table.
+   */
+  na = hnk_get_maxk_at_h(subtree, h - 1);
+  j = hnk_get_maxk_at_h_storage(subtree, h - 1);
+  if (na < 0 || j < 0) {
+    ERROR("failed to get subtree maxk");
+    return -1;
+  }
+  if (j < na) {
+    na = j;
+  }
+  if (maxk_storage - 1 < na) {
+    na = maxk_storage - 1;
+  }
+  na ++;
+
+  a = (mpz_t*)malloc(sizeof(mpz_t) * na);
+  if (a == NULL) {
+    ERROR("failed to allocate subtree counts");
+    return -1;
+  }
+
+  r = 0;
+  for (j = 0; j < na; j ++) {
+    mpz_init(a[j]);
+    if (r == 0 && hnk_get_hnk(subtree, h - 1, j, a[j]) < 0) {
+      ERROR("failed to get subtree count (%d %d)", h - 1, j);
+      r = -1;
+    }
+  }
+
+  hnk_lock(t);
+  
+  if (r == 0 && t->powers[h] == NULL) {
+
+    row = (mpz_t*)malloc(sizeof(mpz_t) * (maxk_storage + 1));
+    if (row == NULL) {
+      ERROR("failed to allocate power row");
+      r = -1;
+    } else {
+      for (j = 0; j <= maxk_storage; j ++) {
+	mpz_init(row[j]);
+      }
+
+      mpz_set_ui(row[0], 1);
+      if (kronecker_power(row + 1, maxk_storage, a, na, nsplit) < 0) {
+	r = -1;
+	for (j = 0; j <= maxk_storage; j ++) {
+	  mpz_clear(row[j]);
+	}
+	free(row);
+      } else {
+	t->power_n[h] = nsplit;
+	__atomic_store_n(&(t->powers[h]), row, __ATOMIC_RELEASE);
+      }
+    }
+  }
+
+  if (r == 0) {
+    row = t->powers[h];
+    r = (t->power_n[h] == nsplit) ? 0 : 1;
+  }
+  
+  hnk_unlock(t);
+
+  for (j = 0; j < na; j ++) {
+    mpz_clear(a[j]);
+  }
+  free(a);
+
+  *prow = row;
+  return r;
+}
+
 int
 hnk_general_split(hnk_t *t,
 		  hnk_t *subtree,
@@ -1413,6 +2862,8 @@ hnk_general_split(hnk_t *t,
   int jmax;
   int maxk;
   mpz_t a, b, c, s;
+  mpz_t *row;
+  int r;
 
   if (k == 0 ||
       k == 1) {
@@ -1434,6 +2885,19 @@ hnk_general_split(hnk_t *t,
     return 0;
   }
 
+  if (t->kronecker && nsplit >= 2) {
+    r = memoize_power_row(t, subtree, h, nsplit, &row);
+    if (r < 0) {
+      ERROR("failed to compute split row");
+      return -1;
+    }
+
+    if (r == 0 && k <= hnk_get_maxk_at_h_storage(t, h)) {
+      mpz_set(count, row[k]);
+      return 0;
+    }
+  }
+
   switch (nsplit) {
     
   case 0:
@@ -1725,6 +3189,7 @@ memoize_aggregate_split_count(hnk_t *t,
 
   int si;
   int ns;
+  int computed;
 
   int i;
   int ileft;
@@ -1739,10 +3204,13 @@ memoize_aggregate_split_count(hnk_t *t,
     return -1;
   }
 
+  hnk_lock(t);
+  
   if (t->split_counts[h] == NULL) {
     t->split_counts[h] = (mpz_t **)malloc(sizeof(mpz_t*) * (t->maxk + 1));
     if (t->split_counts[h] == NULL) {
       ERROR("failed to allocate k array");
+      hnk_unlock(t);
       return -1;
     }
     for (j = 0; j <= t->maxk; j ++) {
@@ -1756,6 +3224,7 @@ memoize_aggregate_split_count(hnk_t *t,
     t->split_counts[h][k] = (mpz_t*)malloc(sizeof(mpz_t) * ns);
     if (t->split_counts[h][k] == NULL) {
       ERROR("failed to allocate split array");
+      hnk_unlock(t);
       return -1;
     }
 
@@ -1768,10 +3237,14 @@ memoize_aggregate_split_count(hnk_t *t,
   if (si < 0 || si >= t->nsplits) {
     ERROR("index out of range %d (%d)",
 	  si, t->nsplits);
+    hnk_unlock(t);
     return -1;
   }
 
-  if (mpz_sgn(t->split_counts[h][k][si]) < 0) {
+  computed = (mpz_sgn(t->split_counts[h][k][si]) >= 0);
+  hnk_unlock(t);
+
+  if (!computed) {
 
     /*
      * Need to compute, first compute the split 
@@ -1839,7 +3312,7 @@ memoize_aggregate_split_count(hnk_t *t,
 	mpz_set(s, a);
       }
       
-      mpz_set(t->split_counts[h][k][si], s);
+      publish_split_count(t, t->split_counts[h][k][si], s);
       
       mpz_clear(a);
       mpz_clear(b);
@@ -1905,7 +3378,7 @@ memoize_aggregate_split_count(hnk_t *t,
 	mpz_set(s, a);
       }
       
-      mpz_set(t->split_counts[h][k][si], s);
+      publish_split_count(t, t->split_counts[h][k][si], s);
       
       mpz_clear(a);
       mpz_clear(b);
@@ -1916,4 +3389,3 @@ memoize_aggregate_split_count(hnk_t *t,
 
   return 0;
 }
-
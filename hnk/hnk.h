@@ -80,9 +80,51 @@ int hnk_save(hnk_t *t,
 int hnk_restore(hnk_t *t,
 		const char *filename);
 
+/*
+ * Binary table cache. Restoring maps the file and uses the memoized counts
+ * and ratios in place, so processes restoring the same file share the
+ * pages. The table (and its subtrees) must be freshly created, entries not
+ * in the file are computed as usual. Subtrees must not outlive the table
+ * restored into as it owns the mapping.
+ */
+int hnk_save_binary(hnk_t *t,
+		    const char *filename);
+
+int hnk_restore_binary(hnk_t *t,
+		       const char *filename);
+
 void
 hnk_destroy(hnk_t *t);
 
+/*
+ * Enables (or disables) concurrent mode on a table and all its subtrees so
+ * that a single table may be shared between threads. Lookups of memoized
+ * entries are lock free, misses are computed under a per table lock. Must
+ * be set before the table is shared, save/restore/destroy remain single
+ * threaded.
+ */
+int
+hnk_set_concurrent(hnk_t *t,
+		   int concurrent);
+
+/*
+ * Eagerly fills the counts and ratios of a table (and its subtrees) height
+ * by height, sharing the k at each height across nthreads threads. The
+ * concurrent setting of the table and each subtree is restored on return.
+ */
+int
+hnk_precompute(hnk_t *t,
+	       int nthreads);
+
+/*
+ * Enables (default) or disables computing whole rows of split counts with
+ * Kronecker substitution on a table and its subtrees. Only used for tables
+ * with large maxk, results are identical either way.
+ */
+int
+hnk_set_kronecker(hnk_t *t,
+		  int kronecker);
+
 int
 hnk_get_maxk_at_h(hnk_t *t, 
 		  int h);
@@ -115,6 +157,29 @@ hnk_get_kplus1_ratio(hnk_t *t,
 		     int k, 
 		     double *ratio);
 
+/*
+ * Precomputes log hnk and the k + 1 ratio for every stored (h, k) into flat
+ * double arrays, after which the ratio and log queries below are served
+ * without GMP. Build before sharing a table between threads.
+ */
+int
+hnk_build_log_table(hnk_t *t);
+
+int
+hnk_get_log_hnk(hnk_t *t,
+		int h,
+		int k,
+		double *loghnk);
+
+/*
+ * Returns log(hnk(k+1)/hnk(k)) for given k
+ */
+int
+hnk_get_kplus1_log_ratio(hnk_t *t,
+			 int h,
+			 int k,
+			 double *logratio);
+
 int
 hnk_get_subtree_maxk_at_h(hnk_t *t, 
 			  int h);
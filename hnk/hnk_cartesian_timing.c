@@ -23,6 +23,7 @@
 //
 //
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "hnk.h"
 #include "hnk_cartesian.h"
@@ -32,6 +33,7 @@ int main(int argc, char *argv[])
   int dim;
   int h;
   int kmax;
+  int nthreads;
 
   hnk_t *t;
   mpz_t a;
@@ -40,6 +42,11 @@ int main(int argc, char *argv[])
   dim = 3;
   h = 5;
   kmax = 1000;
+  nthreads = 0;
+
+  if (argc > 1) {
+    nthreads = atoi(argv[1]);
+  }
 
   switch(dim) {
   case 2:
@@ -62,6 +69,11 @@ int main(int argc, char *argv[])
     return -1;
   }
 
+  if (nthreads > 0 && hnk_precompute(t, nthreads) < 0) {
+    fprintf(stderr, "error: failed to precompute tree\n");
+    return -1;
+  }
+
   mpz_init(a);
 
   for (i = 1; i <= 1000; i ++) {
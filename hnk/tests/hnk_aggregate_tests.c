@@ -196,6 +196,60 @@ START_TEST (test_hnk_aggregate_ternary)
 }
 END_TEST
 
+START_TEST (test_hnk_aggregate_restore_shared)
+{
+  hnk_t *aggregate;
+  hnk_t *binary;
+  hnk_t *restored;
+  hnk_t *other;
+  hnk_t *shared;
+
+  int h;
+  int i;
+
+  mpz_t a;
+  mpz_t b;
+
+  binary = hnk_create(5, 100, 2, binary_tree_maxk_at_h, binary_tree_hnk, NULL);
+  ck_assert(binary != NULL);
+  aggregate = hnk_create_aggregate(6, 100, 2, 2, binary, binary);
+  ck_assert_ptr_ne(aggregate, NULL);
+  ck_assert(hnk_precompute(aggregate, 1) == 0);
+  ck_assert(hnk_save_binary(aggregate, "hnk_aggregate_binary.data") == 0);
+
+  /*
+   * The shared subtree keeps the mapping alive after the table it was
+   * restored through is destroyed
+   */
+  shared = hnk_create(5, 100, 2, binary_tree_maxk_at_h, binary_tree_hnk, NULL);
+  ck_assert(shared != NULL);
+  restored = hnk_create_aggregate(6, 100, 2, 2, shared, shared);
+  other = hnk_create_aggregate(6, 100, 2, 2, shared, shared);
+  ck_assert_ptr_ne(restored, NULL);
+  ck_assert_ptr_ne(other, NULL);
+  ck_assert(hnk_restore_binary(restored, "hnk_aggregate_binary.data") == 0);
+  hnk_destroy(restored);
+
+  mpz_init(a);
+  mpz_init(b);
+
+  for (h = 0; h <= 5; h ++) {
+    for (i = 0; i <= hnk_get_maxk_at_h(binary, h); i ++) {
+      ck_assert(hnk_is_hnk_memoized(shared, h, i) == 1);
+      ck_assert(hnk_get_hnk(binary, h, i, a) == 0);
+      ck_assert(hnk_get_hnk(shared, h, i, b) == 0);
+      ck_assert(mpz_cmp(a, b) == 0);
+    }
+  }
+
+  mpz_clear(a);
+  mpz_clear(b);
+  hnk_destroy(other);
+  hnk_destroy(aggregate);
+  remove("hnk_aggregate_binary.data");
+}
+END_TEST
+
 Suite *
 hnk_aggregate_suite (void)
 {
@@ -207,6 +261,7 @@ hnk_aggregate_suite (void)
   tcase_add_test (tc_core, test_hnk_aggregate_create);
   tcase_add_test (tc_core, test_hnk_aggregate_binary);
   tcase_add_test (tc_core, test_hnk_aggregate_ternary);
+  tcase_add_test (tc_core, test_hnk_aggregate_restore_shared);
   suite_add_tcase (s, tc_core);
 
   return s;
@@ -25,6 +25,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <check.h>
+#include <math.h>
 
 #include "hnk.h"
 #include "hnk_standard.h"
@@ -99,6 +100,122 @@ START_TEST (test_hnk_btree_saveload)
 END_TEST
 
 
+START_TEST (test_hnk_btree_saveload_binary)
+{
+  hnk_t *t;
+  hnk_t *u;
+  mpz_t a;
+  mpz_t b;
+  double ra;
+  double rb;
+  int k;
+
+  t = hnk_create(6,
+		 100,
+		 2,
+		 binary_tree_maxk_at_h,
+		 binary_tree_hnk,
+		 NULL);
+  ck_assert(t != NULL);
+
+  mpz_init(a);
+  mpz_init(b);
+
+  for (k = 0; k < 50; k ++) {
+    ck_assert(hnk_get_hnk(t, 6, k, a) == 0);
+    ck_assert(hnk_get_kplus1_ratio(t, 6, k, &ra) == 0);
+  }
+
+  ck_assert(hnk_save_binary(t, "hnk_btree_binary.data") == 0);
+
+  u = hnk_create(6,
+		 100,
+		 2,
+		 binary_tree_maxk_at_h,
+		 binary_tree_hnk,
+		 NULL);
+  ck_assert(u != NULL);
+  
+  ck_assert(hnk_restore_binary(u, "hnk_btree_binary.data") == 0);
+  /* The ratio at 49 needs the count at 50 */
+  ck_assert(hnk_is_hnk_memoized(u, 6, 50) == 1);
+  ck_assert(hnk_is_hnk_memoized(u, 6, 51) == 0);
+  ck_assert(hnk_highest_memoized_k(u, 6) == 50);
+
+  /*
+   * Memoized entries come from the file, the rest are computed on demand
+   */
+  for (k = 0; k <= 100; k ++) {
+    ck_assert(hnk_get_hnk(t, 6, k, a) == 0);
+    ck_assert(hnk_get_hnk(u, 6, k, b) == 0);
+    ck_assert(mpz_cmp(a, b) == 0);
+    
+    if (k < 100) {
+      ck_assert(hnk_get_kplus1_ratio(t, 6, k, &ra) == 0);
+      ck_assert(hnk_get_kplus1_ratio(u, 6, k, &rb) == 0);
+      ck_assert(ra == rb);
+    }
+  }
+
+  ck_assert(hnk_restore_binary(u, "hnk_btree_binary.data") == -1);
+  
+  hnk_destroy(t);
+  hnk_destroy(u);
+  mpz_clear(a);
+  mpz_clear(b);
+}
+END_TEST
+
+START_TEST (test_hnk_btree_log_table)
+{
+  hnk_t *t;
+  hnk_t *u;
+  mpz_t a;
+  double r;
+  double rl;
+  double l;
+  double ll;
+  int h;
+  int k;
+  int maxk;
+
+  t = hnk_create(8, 200, 2, binary_tree_maxk_at_h, binary_tree_hnk, NULL);
+  ck_assert(t != NULL);
+  u = hnk_create(8, 200, 2, binary_tree_maxk_at_h, binary_tree_hnk, NULL);
+  ck_assert(u != NULL);
+
+  ck_assert(hnk_build_log_table(t) == 0);
+
+  mpz_init(a);
+  
+  for (h = 0; h <= 8; h ++) {
+    maxk = hnk_get_maxk_at_h_storage(t, h);
+    for (k = 0; k < maxk; k ++) {
+
+      /* Table ratios are the GMP ratios exactly */
+      ck_assert(hnk_get_kplus1_ratio(t, h, k, &r) == 0);
+      ck_assert(hnk_get_kplus1_ratio(u, h, k, &rl) == 0);
+      ck_assert(r == rl);
+
+      ck_assert(hnk_get_kplus1_log_ratio(t, h, k, &l) == 0);
+      ck_assert(hnk_get_kplus1_log_ratio(u, h, k, &ll) == 0);
+      ck_assert(fabs(l - ll) < 1.0e-9 * (1.0 + fabs(ll)));
+
+      ck_assert(hnk_get_hnk(u, h, k, a) == 0);
+      ck_assert(hnk_get_log_hnk(t, h, k, &l) == 0);
+      ck_assert(fabs(l - log(mpz_get_d(a))) < 1.0e-9 * (1.0 + l));
+    }
+
+    ck_assert(hnk_get_kplus1_ratio(t, h, hnk_get_maxk_at_h(t, h) + 1, &r) == 0);
+    ck_assert(r == 0.0);
+  }
+
+  mpz_clear(a);
+  hnk_destroy(t);
+  hnk_destroy(u);
+}
+END_TEST
+
 START_TEST (test_hnk_btree_h3)
 {
   hnk_t *btree;
@@ -168,6 +285,8 @@ hnk_btree_suite (void)
   TCase *tc_core = tcase_create ("Core");
   tcase_add_test (tc_core, test_hnk_btree_create);
   tcase_add_test (tc_core, test_hnk_btree_saveload);
+  tcase_add_test (tc_core, test_hnk_btree_saveload_binary);
+  tcase_add_test (tc_core, test_hnk_btree_log_table);
   tcase_add_test (tc_core, test_hnk_btree_h3);
   suite_add_tcase (s, tc_core);
 
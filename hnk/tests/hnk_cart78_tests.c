@@ -219,6 +219,105 @@ START_TEST (test_hnk_cart78_h6)
 }
 END_TEST
 
+/*
+ * Whole row Kronecker split counts must agree exactly with the term by term
+ * convolution.
+ */
+START_TEST (test_hnk_cart78_kronecker)
+{
+  hnk_t *fast;
+  hnk_t *slow;
+  hnk_t *bfast;
+  hnk_t *bslow;
+  int h;
+  int k;
+  int maxk;
+  mpz_t a;
+  mpz_t b;
+
+  fast = hnk_cartesian_78_create(4, 300);
+  ck_assert_ptr_ne(fast, NULL);
+  slow = hnk_cartesian_78_create(4, 300);
+  ck_assert_ptr_ne(slow, NULL);
+  ck_assert(hnk_set_kronecker(slow, 0) == 0);
+
+  bfast = hnk_create_binary_tree(10, 500);
+  ck_assert_ptr_ne(bfast, NULL);
+  bslow = hnk_create_binary_tree(10, 500);
+  ck_assert_ptr_ne(bslow, NULL);
+  ck_assert(hnk_set_kronecker(bslow, 0) == 0);
+
+  mpz_init(a);
+  mpz_init(b);
+
+  for (h = 0; h <= 4; h ++) {
+    maxk = hnk_get_maxk_at_h_storage(fast, h);
+    for (k = 0; k <= maxk; k ++) {
+      ck_assert(hnk_get_hnk(fast, h, k, a) == 0);
+      ck_assert(hnk_get_hnk(slow, h, k, b) == 0);
+      ck_assert(mpz_cmp(a, b) == 0);
+    }
+  }
+
+  for (h = 0; h <= 10; h ++) {
+    maxk = hnk_get_maxk_at_h_storage(bfast, h);
+    for (k = 0; k <= maxk; k ++) {
+      ck_assert(hnk_get_hnk(bfast, h, k, a) == 0);
+      ck_assert(hnk_get_hnk(bslow, h, k, b) == 0);
+      ck_assert(mpz_cmp(a, b) == 0);
+    }
+  }
+
+  mpz_clear(a);
+  mpz_clear(b);
+  hnk_destroy(fast);
+  hnk_destroy(slow);
+  hnk_destroy(bfast);
+  hnk_destroy(bslow);
+}
+END_TEST
+
+START_TEST (test_hnk_cart78_saveload_binary)
+{
+  hnk_t *t;
+  hnk_t *u;
+  int k;
+  mpz_t a;
+  mpz_t b;
+
+  t = hnk_cartesian_78_create(4, 200);
+  ck_assert_ptr_ne(t, NULL);
+  ck_assert(hnk_precompute(t, 1) == 0);
+  ck_assert(hnk_save_binary(t, "hnk_cart78_binary.data") == 0);
+
+  u = hnk_cartesian_78_create(4, 200);
+  ck_assert_ptr_ne(u, NULL);
+  ck_assert(hnk_restore_binary(u, "hnk_cart78_binary.data") == 0);
+
+  mpz_init(a);
+  mpz_init(b);
+
+  for (k = 0; k <= 200; k ++) {
+    ck_assert(hnk_is_hnk_memoized(u, 4, k) == 1);
+    ck_assert(hnk_get_hnk(t, 4, k, a) == 0);
+    ck_assert(hnk_get_hnk(u, 4, k, b) == 0);
+    ck_assert(mpz_cmp(a, b) == 0);
+
+    /* Subtree is created with maxk - 1 */
+    if (k < 200) {
+      ck_assert(hnk_get_subtree_hnk(t, 3, k, a) == 0);
+      ck_assert(hnk_get_subtree_hnk(u, 3, k, b) == 0);
+      ck_assert(mpz_cmp(a, b) == 0);
+    }
+  }
+
+  mpz_clear(a);
+  mpz_clear(b);
+  hnk_destroy(t);
+  hnk_destroy(u);
+}
+END_TEST
+
 Suite *
 hnk_cart78_suite (void)
 {
@@ -231,6 +330,8 @@ hnk_cart78_suite (void)
   tcase_add_test (tc_core, test_hnk_cart78_h4);
   tcase_add_test (tc_core, test_hnk_cart78_h5);
   tcase_add_test (tc_core, test_hnk_cart78_h6);
+  tcase_add_test (tc_core, test_hnk_cart78_kronecker);
+  tcase_add_test (tc_core, test_hnk_cart78_saveload_binary);
   suite_add_tcase (s, tc_core);
 
   return s;
@@ -0,0 +1,265 @@
+//
+//    HNK Library : A library for computing combinations of arrangements of
+//    general trees for the Trans-dimensional Tree algorithm. See
+//
+//      R Hawkins and M Sambridge, "Geophysical imaging using trans-dimensional trees",
+//      Geophysical Journal International, 2015, 203:2, 972 - 1000,
+//      https://doi.org/10.1093/gji/ggv326
+//    
+//    Copyright (C) 2014 - 2018 Rhys Hawkins
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <check.h>
+
+#include "hnk.h"
+#include "hnk_standard.h"
+#include "hnk_cartesian.h"
+
+#define NTHREADS 8
+#define MAXH 6
+#define MAXK 100
+
+typedef struct {
+  hnk_t *shared;
+  hnk_t *reference;
+  int seed;
+  int failures;
+} worker_t;
+
+/*
+ * Each thread walks every (h, k) in its own pseudo random order comparing
+ * the shared table against a private, single threaded one.
+ */
+static void *
+worker(void *arg)
+{
+  worker_t *w = (worker_t*)arg;
+  mpz_t a;
+  mpz_t b;
+  double ra;
+  double rb;
+  int h;
+  int k;
+  int maxk;
+  int i;
+  int n;
+  unsigned int seed;
+
+  mpz_init(a);
+  mpz_init(b);
+  seed = w->seed;
+  
+  n = (MAXH + 1) * (MAXK + 1);
+  for (i = 0; i < 4 * n; i ++) {
+
+    seed = seed * 1103515245 + 12345;
+    h = (seed >> 16) % (MAXH + 1);
+    seed = seed * 1103515245 + 12345;
+    k = (seed >> 16) % (MAXK + 1);
+
+    /* Ratio at k needs hnk at k + 1 so stay below the storage limit */
+    maxk = hnk_get_maxk_at_h(w->shared, h);
+    if (maxk >= MAXK) {
+      maxk = MAXK - 1;
+    }
+    if (k > maxk) {
+      k = maxk;
+    }
+    
+    if (hnk_get_hnk(w->shared, h, k, a) < 0 ||
+	hnk_get_hnk(w->reference, h, k, b) < 0 ||
+	mpz_cmp(a, b) != 0) {
+      w->failures ++;
+    }
+
+    if (hnk_get_kplus1_ratio(w->shared, h, k, &ra) < 0 ||
+	hnk_get_kplus1_ratio(w->reference, h, k, &rb) < 0 ||
+	ra != rb) {
+      w->failures ++;
+    }
+  }
+
+  mpz_clear(a);
+  mpz_clear(b);
+  
+  return NULL;
+}
+
+static void
+run_workers(hnk_t *shared,
+	    hnk_t **references)
+{
+  pthread_t threads[NTHREADS];
+  worker_t workers[NTHREADS];
+  int i;
+
+  ck_assert(hnk_set_concurrent(shared, 1) == 0);
+  
+  for (i = 0; i < NTHREADS; i ++) {
+    workers[i].shared = shared;
+    workers[i].reference = references[i];
+    workers[i].seed = 17 * i + 3;
+    workers[i].failures = 0;
+    
+    ck_assert(pthread_create(&threads[i], NULL, worker, &workers[i]) == 0);
+  }
+
+  for (i = 0; i < NTHREADS; i ++) {
+    ck_assert(pthread_join(threads[i], NULL) == 0);
+    ck_assert(workers[i].failures == 0);
+  }
+}
+
+START_TEST (test_hnk_concurrent_btree)
+{
+  hnk_t *shared;
+  hnk_t *references[NTHREADS];
+  int i;
+
+  shared = hnk_create(MAXH, MAXK, 2, binary_tree_maxk_at_h, binary_tree_hnk, NULL);
+  ck_assert_ptr_ne(shared, NULL);
+
+  for (i = 0; i < NTHREADS; i ++) {
+    references[i] = hnk_create(MAXH, MAXK, 2, binary_tree_maxk_at_h, binary_tree_hnk, NULL);
+    ck_assert_ptr_ne(references[i], NULL);
+  }
+
+  run_workers(shared, references);
+
+  ck_assert(hnk_is_hnk_memoized(shared, MAXH, MAXK - 1) == 1);
+  
+  for (i = 0; i < NTHREADS; i ++) {
+    hnk_destroy(references[i]);
+  }
+  hnk_destroy(shared);
+}
+END_TEST
+
+START_TEST (test_hnk_concurrent_aggregate)
+{
+  hnk_t *shared;
+  hnk_t *binary;
+  hnk_t *ternary;
+  hnk_t *references[NTHREADS];
+  hnk_t *rbinary;
+  hnk_t *rternary;
+  int i;
+
+  binary = hnk_create(MAXH - 1, MAXK, 2, binary_tree_maxk_at_h, binary_tree_hnk, NULL);
+  ck_assert_ptr_ne(binary, NULL);
+  ternary = hnk_create(MAXH - 1, MAXK, 3, ternary_tree_maxk_at_h, ternary_tree_hnk, NULL);
+  ck_assert_ptr_ne(ternary, NULL);
+  
+  shared = hnk_create_aggregate(MAXH, MAXK, 3, 3, binary, ternary, binary);
+  ck_assert_ptr_ne(shared, NULL);
+
+  for (i = 0; i < NTHREADS; i ++) {
+    rbinary = hnk_create(MAXH - 1, MAXK, 2, binary_tree_maxk_at_h, binary_tree_hnk, NULL);
+    ck_assert_ptr_ne(rbinary, NULL);
+    rternary = hnk_create(MAXH - 1, MAXK, 3, ternary_tree_maxk_at_h, ternary_tree_hnk, NULL);
+    ck_assert_ptr_ne(rternary, NULL);
+  
+    references[i] = hnk_create_aggregate(MAXH, MAXK, 3, 3, rbinary, rternary, rbinary);
+    ck_assert_ptr_ne(references[i], NULL);
+  }
+
+  run_workers(shared, references);
+
+  for (i = 0; i < NTHREADS; i ++) {
+    hnk_destroy(references[i]);
+  }
+  hnk_destroy(shared);
+}
+END_TEST
+
+START_TEST (test_hnk_concurrent_precompute)
+{
+  hnk_t *precomputed;
+  hnk_t *lazy;
+  mpz_t a;
+  mpz_t b;
+  double ra;
+  double rb;
+  int h;
+  int k;
+  int maxk;
+
+  precomputed = hnk_cartesian_78_create(4, 200);
+  ck_assert_ptr_ne(precomputed, NULL);
+  lazy = hnk_cartesian_78_create(4, 200);
+  ck_assert_ptr_ne(lazy, NULL);
+
+  ck_assert(hnk_precompute(precomputed, NTHREADS) == 0);
+
+  mpz_init(a);
+  mpz_init(b);
+  
+  for (h = 0; h <= 4; h ++) {
+    maxk = hnk_get_maxk_at_h_storage(precomputed, h);
+    ck_assert(hnk_highest_memoized_k(precomputed, h) == maxk);
+
+    for (k = 0; k <= maxk; k ++) {
+      ck_assert(hnk_is_hnk_memoized(precomputed, h, k) == 1);
+      ck_assert(hnk_get_hnk(precomputed, h, k, a) == 0);
+      ck_assert(hnk_get_hnk(lazy, h, k, b) == 0);
+      ck_assert(mpz_cmp(a, b) == 0);
+
+      if (k < maxk) {
+	ck_assert(hnk_get_kplus1_ratio(precomputed, h, k, &ra) == 0);
+	ck_assert(hnk_get_kplus1_ratio(lazy, h, k, &rb) == 0);
+	ck_assert(ra == rb);
+      }
+    }
+  }
+
+  mpz_clear(a);
+  mpz_clear(b);
+  hnk_destroy(precomputed);
+  hnk_destroy(lazy);
+}
+END_TEST
+
+Suite *
+hnk_concurrent_suite (void)
+{
+  Suite *s = suite_create ("HNK Concurrent");
+
+  /* Core test case */
+  TCase *tc_core = tcase_create ("Core");
+  tcase_add_test (tc_core, test_hnk_concurrent_btree);
+  tcase_add_test (tc_core, test_hnk_concurrent_aggregate);
+  tcase_add_test (tc_core, test_hnk_concurrent_precompute);
+  suite_add_tcase (s, tc_core);
+
+  return s;
+}
+
+int main (void) 
+{
+  int number_failed;
+  Suite *s = hnk_concurrent_suite ();
+  SRunner *sr = srunner_create (s);
+
+  srunner_set_fork_status (sr, CK_NOFORK);
+
+  srunner_run_all (sr, CK_VERBOSE);
+  number_failed = srunner_ntests_failed (sr);
+  srunner_free (sr);
+  return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -26,12 +26,51 @@
 #include <limits.h>
 
 #include <time.h>
+#include <pthread.h>
 
-#include "slog.h"
+#include <fcntl.h>
+#include <unistd.h>
 
-static char *log_file = NULL;
+#include "slog.h"
 
-static char *timestamp(void);
+/*
+ * Size of the per-thread message staging buffer
+ */
+#define SLOG_STAGE_SIZE 1024
+
+int slog_level = SLOG_DEBUG;
+
+/*
+ * The output file descriptor (-1 for stderr) opened with O_APPEND. Each
+ * finished message is written with a single write so that lines from other
+ * threads and other processes appending to the same file never interleave.
+ * log_mutex guards replacing the descriptor.
+ */
+static int log_fd = -1;
+static pthread_mutex_t log_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t log_once = PTHREAD_ONCE_INIT;
+
+/*
+ * Per-thread staging for large messages, large_message_level is -1 when
+ * the current message is filtered out.
+ */
+static __thread char *large_message = NULL;
+static __thread int large_message_size = 0;
+static __thread int large_message_length = -1;
+static __thread int large_message_level = -1;
+
+/*
+ * Per-thread staging for SLOGSTART/SLOGEND blocks
+ */
+static __thread FILE *block_fp = NULL;
+static __thread char *block_buffer = NULL;
+static __thread size_t block_size = 0;
+
+static const char *timestamp(void);
+static void log_init(void);
+static int log_write(const char *buffer, int length);
+static int large_message_vappend(const char *msg, va_list ap);
+static int large_message_append(const char *msg, ...);
 
 static const char *LEVEL_MESSAGE[] = {
   "error",
@@ -40,46 +79,79 @@ static const char *LEVEL_MESSAGE[] = {
   "debug",
   ""
 };
-  
+
+void slog_set_level(int level)
+{
+  slog_level = level;
+}
+
 int slog_set_output_file(const char *filename,
 			 int flags)
 {
-  FILE *fp;
+  int fd;
+  int old;
+  char begin[128];
+  int length;
 
-  if (log_file != NULL) {
-    free(log_file);
+  pthread_once(&log_once, log_init);
+
+  if (flags & SLOG_FLAGS_CLEAR) {
+    fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+  } else {
+    fd = open(filename, O_WRONLY | O_CREAT | O_APPEND, 0644);
   }
 
-  log_file = malloc(sizeof(char) * PATH_MAX);
-  if (log_file == NULL) {
-    fprintf(stderr, "slog_set_output_file: failed to allocate log file buffer\n");
+  if (fd < 0) {
+    fprintf(stderr, "log: failed to create/open log file\n");
     return -1;
   }
 
-  if (flags && SLOG_FLAGS_CLEAR) {
-    fp = fopen(filename, "w");
-  } else {
-    fp = fopen(filename, "a");
+  pthread_mutex_lock(&log_mutex);
+  old = log_fd;
+  log_fd = fd;
+  pthread_mutex_unlock(&log_mutex);
+
+  if (old >= 0) {
+    close(old);
   }
 
-  if (fp == NULL) {
-    free(log_file);
-    log_file = NULL;
-    fprintf(stderr, "log: failed to create/open log file\n");
-    return -1;
+  length = snprintf(begin, sizeof(begin), "%s: begin\n", timestamp());
+  return log_write(begin, length);
+}
+
+int slog_flush(void)
+{
+  int r;
+  
+  pthread_once(&log_once, log_init);
+
+  /*
+   * Messages are written as they are logged, this only pushes them to disk
+   */
+  r = 0;
+  pthread_mutex_lock(&log_mutex);
+  if (log_fd >= 0) {
+    r = fsync(log_fd);
   }
+  pthread_mutex_unlock(&log_mutex);
+
+  return r;
+}
+
+void slog_close(void)
+{
+  int fd;
   
-  fprintf(fp, "%s: begin\n", timestamp());
-  fclose(fp);
+  pthread_once(&log_once, log_init);
 
-  if (realpath(filename, log_file) == NULL) {
-    fprintf(stderr, "slog_set_output_file: failed to get absolution file name\n");
-    free(log_file);
-    log_file = NULL;
-    return -1;
+  pthread_mutex_lock(&log_mutex);
+  fd = log_fd;
+  log_fd = -1;
+  pthread_mutex_unlock(&log_mutex);
+
+  if (fd >= 0) {
+    close(fd);
   }
-  
-  return 0;
 }
 
 int slog(int level,
@@ -106,54 +178,85 @@ int vslog(int level,
 	  const char *msg,
 	  va_list ap)
 {
-  FILE *fp;
-  
-  if (log_file != NULL) {
-    fp = fopen(log_file, "a");
-    if (fp == NULL) {
-      fprintf(stderr, "slog: failed to open log file in append mode %s, %s\n", log_file, strerror(errno));
+  char stage[SLOG_STAGE_SIZE];
+  char *buffer;
+  int header;
+  int length;
+  int r;
+  va_list aq;
+
+  if (level > slog_level) {
+    return 0;
+  }
+
+  /*
+   * Format the whole line into the thread's stack so that it is written
+   * with a single locked write, falling back to the heap for long lines
+   */
+  header = snprintf(stage, sizeof(stage), "%s:%s:%s:%s:%4d:",
+		    timestamp(),
+		    LEVEL_MESSAGE[level],
+		    source_file,
+		    function,
+		    lineno);
+  if (header < 0) {
+    return -1;
+  }
+
+  buffer = stage;
+  va_copy(aq, ap);
+  if (header < (int)sizeof(stage)) {
+    length = vsnprintf(stage + header, sizeof(stage) - header, msg, aq);
+  } else {
+    length = vsnprintf(NULL, 0, msg, aq);
+  }
+  va_end(aq);
+  if (length < 0) {
+    return -1;
+  }
+
+  length += header;
+  if (length + 1 >= (int)sizeof(stage)) {
+    buffer = malloc(length + 2);
+    if (buffer == NULL) {
+      fprintf(stderr, "slog: failed to allocate message buffer\n");
       return -1;
     }
-  } else {
-    fp = stderr;
+
+    header = snprintf(buffer, length + 2, "%s:%s:%s:%s:%4d:",
+		      timestamp(),
+		      LEVEL_MESSAGE[level],
+		      source_file,
+		      function,
+		      lineno);
+    length = header + vsnprintf(buffer + header, length + 2 - header, msg, ap);
   }
 
-  fprintf(fp, "%s:%s:%s:%s:%4d:",
-	  timestamp(),
-	  LEVEL_MESSAGE[level],
-	  source_file,
-	  function,
-	  lineno);
+  buffer[length] = '\n';
+  length ++;
 
-  vfprintf(fp, msg, ap);
-  fprintf(fp, "\n");
-  
-  if (log_file != NULL) {
-    fclose(fp);
+  r = log_write(buffer, length);
+
+  if (buffer != stage) {
+    free(buffer);
   }
 
-  return 0;
+  return r;
 }
 
-static FILE *slogopen = NULL;
-
 FILE *slogstart(const char *source_file,
 		 const char *function,
 		 int lineno)
 {
-  if (slogopen == NULL) {
-    if (log_file != NULL) {
-      slogopen = fopen(log_file, "a");
-      if (slogopen == NULL) {
-	fprintf(stderr, "slog: failed to open log file in append mode %s, %s\n", log_file, strerror(errno));
-	return NULL;
-      }
-    } else {
-      slogopen = stderr;
+  if (block_fp == NULL) {
+    block_fp = open_memstream(&block_buffer, &block_size);
+    if (block_fp == NULL) {
+      fprintf(stderr, "slogstart: failed to create staging stream\n");
+      return stderr;
     }
   }
 
-  fprintf(slogopen,
+  fprintf(block_fp,
 	  "%s:%s:%s:%s:%4d:\n",
 	  timestamp(),
 	  "LONG",
@@ -161,26 +264,25 @@ FILE *slogstart(const char *source_file,
 	  function,
 	  lineno);
 
-  return slogopen;
+  return block_fp;
 }
 
 void slogend()
 {
-  if (slogopen != NULL) {
+  if (block_fp != NULL) {
 
-    fprintf(slogopen, "\n");
-    
-    if (slogopen != stderr) {
-      fclose(slogopen);
+    fprintf(block_fp, "\n");
+
+    if (fclose(block_fp) == 0) {
+      log_write(block_buffer, (int)block_size);
     }
-    slogopen = NULL;
+    free(block_buffer);
+
+    block_fp = NULL;
+    block_buffer = NULL;
+    block_size = 0;
   }
 }
-  
-		   
-
-
-static FILE *large_message_fp = NULL;
 
 int slog_large_message_start(int level,
 			     const char *source_file,
@@ -190,92 +292,207 @@ int slog_large_message_start(int level,
 			     ...)
 {
   va_list ap;
-    
-  if (log_file != NULL) {
-    large_message_fp = fopen(log_file, "a");
-    if (large_message_fp == NULL) {
-      fprintf(stderr, "log: failed to open log file in append mode\n");
-      return -1;
-    }
-  } else {
-    large_message_fp = stderr;
+  int r;
+
+  if (level > slog_level) {
+    large_message_level = -1;
+    large_message_length = 0;
+    return 0;
   }
 
-  fprintf(large_message_fp, "%s:%s:%s:%s:%4d:",
-	  timestamp(),
-	  LEVEL_MESSAGE[level],
-	  source_file,
-	  function,
-	  lineno);
+  large_message_level = level;
+  large_message_length = 0;
 
+  if (large_message_append("%s:%s:%s:%s:%4d:",
+			   timestamp(),
+			   LEVEL_MESSAGE[level],
+			   source_file,
+			   function,
+			   lineno) < 0) {
+    return -1;
+  }
+  
   va_start(ap, msg);
-  vfprintf(large_message_fp, msg, ap);
+  r = large_message_vappend(msg, ap);
   va_end(ap);
+  if (r < 0) {
+    return -1;
+  }
 
-  fprintf(large_message_fp, "\n  ");
-
-  return 0;
+  return large_message_append("\n  ");
 }
 
 int slog_large_message_write(const char *msg, ...)
 {
   va_list ap;
+  int r;
   
-  if (large_message_fp == NULL) {
+  if (large_message_length < 0) {
     fprintf(stderr, "slog_large_message_write: unassigned output\n");
     return -1;
   }
+
+  if (large_message_level < 0) {
+    return 0;
+  }
   
   va_start(ap, msg);
-  vfprintf(large_message_fp, msg, ap);
+  r = large_message_vappend(msg, ap);
   va_end(ap);
 
-  return 0;
+  return r;
 }
 
 int slog_large_message_newline(void)
 {
-  if (large_message_fp == NULL) {
+  if (large_message_length < 0) {
     fprintf(stderr, "slog_large_message_write: unassigned output\n");
     return -1;
   }
 
-  fprintf(large_message_fp, "\n  ");
-  return 0;
+  if (large_message_level < 0) {
+    return 0;
+  }
+
+  return large_message_append("\n  ");
 }
 
 int slog_large_message_end(void)
 {
-  if (large_message_fp == NULL) {
+  int r;
+  
+  if (large_message_length < 0) {
     fprintf(stderr, "slog_large_message_write: unassigned output\n");
     return -1;
   }
 
-  fprintf(large_message_fp, "\n");
+  if (large_message_level < 0) {
+    large_message_length = -1;
+    return 0;
+  }
 
-  if (large_message_fp != stderr) {
-    fclose(large_message_fp);
+  if (large_message_append("\n") < 0) {
+    return -1;
   }
-  large_message_fp = NULL;
+
+  r = log_write(large_message, large_message_length);
+  large_message_length = -1;
+  large_message_level = -1;
+  
+  return r;
+}
+
+static int large_message_vappend(const char *msg, va_list ap)
+{
+  int length;
+  int size;
+  char *p;
+  va_list aq;
+
+  va_copy(aq, ap);
+  length = vsnprintf(large_message + large_message_length,
+		     large_message_size - large_message_length,
+		     msg,
+		     aq);
+  va_end(aq);
+  if (length < 0) {
+    return -1;
+  }
+
+  if (large_message_length + length >= large_message_size) {
+
+    size = large_message_size > 0 ? large_message_size : SLOG_STAGE_SIZE;
+    while (large_message_length + length >= size) {
+      size *= 2;
+    }
+    
+    p = realloc(large_message, size);
+    if (p == NULL) {
+      fprintf(stderr, "slog: failed to allocate large message buffer\n");
+      return -1;
+    }
+    large_message = p;
+    large_message_size = size;
+
+    vsnprintf(large_message + large_message_length,
+	      large_message_size - large_message_length,
+	      msg,
+	      ap);
+  }
+
+  large_message_length += length;
   return 0;
 }
 
-static char *timestamp(void)
+static int large_message_append(const char *msg, ...)
+{
+  va_list ap;
+  int r;
+
+  va_start(ap, msg);
+  r = large_message_vappend(msg, ap);
+  va_end(ap);
+
+  return r;
+}
+
+static void log_init(void)
+{
+  atexit(slog_close);
+}
+
+static int log_write(const char *buffer, int length)
+{
+  ssize_t n;
+  int fd;
+  int r;
+
+  pthread_once(&log_once, log_init);
+
+  pthread_mutex_lock(&log_mutex);
+  
+  fd = log_fd >= 0 ? log_fd : STDERR_FILENO;
+  r = 0;
+  while (length > 0) {
+    n = write(fd, buffer, length);
+    if (n < 0) {
+      if (errno == EINTR) {
+	continue;
+      }
+      r = -1;
+      break;
+    }
+    buffer += n;
+    length -= n;
+  }
+  
+  pthread_mutex_unlock(&log_mutex);
+
+  return r;
+}
+
+/*
+ * Timestamps are formatted at most once a second per thread
+ */
+static const char *timestamp(void)
 {
   const char *TIME_FORMAT = "%Y-%m-%d %H:%M:%S";
-  static char buffer[256];
+  static __thread char buffer[64];
+  static __thread time_t last = (time_t)-1;
   time_t tmp;
-  struct tm *t;
+  struct tm t;
 
   tmp = time(NULL);
-  t = localtime(&tmp);
+  if (tmp != last) {
+    localtime_r(&tmp, &t);
   
-  if (strftime(buffer, sizeof(buffer), TIME_FORMAT, t) == 0) {
-    fprintf(stderr, "log::timestamp: failed to format time\n");
-    return NULL;
+    if (strftime(buffer, sizeof(buffer), TIME_FORMAT, &t) == 0) {
+      fprintf(stderr, "log::timestamp: failed to format time\n");
+      buffer[0] = '\0';
+    }
+
+    last = tmp;
   }
 
   return buffer;
 }
-
-
@@ -35,16 +35,43 @@ enum {
   SLOG_DEBUG
 };
 
+/*
+ * Messages above SLOG_LEVEL are compiled out, define it before including to
+ * change the default of all levels.
+ */
+#ifndef SLOG_LEVEL
+#define SLOG_LEVEL SLOG_DEBUG
+#endif
+
+/*
+ * Runtime level, messages above this are skipped without formatting
+ */
+extern int slog_level;
+
+void slog_set_level(int level);
+
+#define SLOG_COMPILED(level) ((level) <= SLOG_LEVEL)
+#define SLOG_ENABLED(level) (SLOG_COMPILED(level) && (level) <= slog_level)
+
 /*
  * By default, logs go to stderr, this redirects to a file which is optionally overwritten.
+ * The file is kept open for appending and each message is written with a single write
+ * so that several processes may share the same log file.
  */
 int slog_set_output_file(const char *filename,
 			 int flags);
 
-#define ERROR(fmt, ...) slog(SLOG_ERROR, __FILE__, __FUNCTION__, __LINE__, fmt, ##__VA_ARGS__)
-#define WARNING(fmt, ...) slog(SLOG_WARNING, __FILE__, __FUNCTION__, __LINE__, fmt, ##__VA_ARGS__)
-#define INFO(fmt, ...) slog(SLOG_INFO, __FILE__, __FUNCTION__, __LINE__, fmt, ##__VA_ARGS__)
-#define DEBUG(fmt, ...) slog(SLOG_WARNING, __FILE__, __FUNCTION__, __LINE__, fmt, ##__VA_ARGS__)
+/*
+ * Output is not buffered, slog_flush syncs the output file to disk. slog_close closes the
+ * output file and logging reverts to stderr, it is registered with atexit.
+ */
+int slog_flush(void);
+void slog_close(void);
+
+#define ERROR(fmt, ...) (SLOG_ENABLED(SLOG_ERROR) ? slog(SLOG_ERROR, __FILE__, __FUNCTION__, __LINE__, fmt, ##__VA_ARGS__) : 0)
+#define WARNING(fmt, ...) (SLOG_ENABLED(SLOG_WARNING) ? slog(SLOG_WARNING, __FILE__, __FUNCTION__, __LINE__, fmt, ##__VA_ARGS__) : 0)
+#define INFO(fmt, ...) (SLOG_ENABLED(SLOG_INFO) ? slog(SLOG_INFO, __FILE__, __FUNCTION__, __LINE__, fmt, ##__VA_ARGS__) : 0)
+#define DEBUG(fmt, ...) (SLOG_ENABLED(SLOG_DEBUG) ? slog(SLOG_DEBUG, __FILE__, __FUNCTION__, __LINE__, fmt, ##__VA_ARGS__) : 0)
 
 int slog(int level,
 	 const char *source_file,
@@ -60,10 +87,15 @@ int vslog(int level,
 	  const char *msg,
 	  va_list ap);
 
-#define INFO_LARGE_START(fmt, ...) slog_large_message_start(SLOG_INFO, __FILE__, __FUNCTION__, __LINE__, fmt, ##__VA_ARGS__)
-#define INFO_LARGE_WRITE(fmt, ...) slog_large_message_write(fmt, ##__VA_ARGS__)
-#define INFO_LARGE_NEWLINE() slog_large_message_newline()
-#define INFO_LARGE_END() slog_large_message_end()
+/*
+ * Large messages are staged per thread and written as a whole by INFO_LARGE_END. The
+ * runtime level is checked once by slog_large_message_start and the rest of a filtered
+ * message is discarded.
+ */
+#define INFO_LARGE_START(fmt, ...) (SLOG_COMPILED(SLOG_INFO) ? slog_large_message_start(SLOG_INFO, __FILE__, __FUNCTION__, __LINE__, fmt, ##__VA_ARGS__) : 0)
+#define INFO_LARGE_WRITE(fmt, ...) (SLOG_COMPILED(SLOG_INFO) ? slog_large_message_write(fmt, ##__VA_ARGS__) : 0)
+#define INFO_LARGE_NEWLINE() (SLOG_COMPILED(SLOG_INFO) ? slog_large_message_newline() : 0)
+#define INFO_LARGE_END() (SLOG_COMPILED(SLOG_INFO) ? slog_large_message_end() : 0)
 
 int slog_large_message_start(int level,
 			     const char *source_file,
@@ -78,6 +110,10 @@ int slog_large_message_newline(void);
 
 int slog_large_message_end(void);
 
+/*
+ * Direct access to an output stream staged per thread and written as a whole
+ * by SLOGEND.
+ */
 #define SLOGSTART() slogstart(__FILE__, __FUNCTION__, __LINE__)
 #define SLOGEND() slogend()
 
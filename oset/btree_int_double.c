@@ -0,0 +1,601 @@
+//
+//    Ordered set library, used for maintaining arbitrary tree based models
+//    
+//    Copyright (C) 2014 - 2018 Rhys Hawkins
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "btree_int_double.h"
+
+#include "slog.h"
+
+/*
+ * Maximum no. of keys in a leaf or children of a branch
+ */
+#define BTREE_ORDER 64
+
+typedef struct {
+  int leaf;
+  int n;
+} btree_node_t;
+
+typedef struct {
+  btree_node_t h;
+  int keys[BTREE_ORDER];
+  double values[BTREE_ORDER];
+} btree_leaf_t;
+
+/*
+ * keys[i] is the smallest key in children[i] and counts[i] the no. of
+ * elements below it.
+ */
+typedef struct {
+  btree_node_t h;
+  int keys[BTREE_ORDER];
+  int counts[BTREE_ORDER];
+  btree_node_t *children[BTREE_ORDER];
+} btree_branch_t;
+
+struct _btree_int_double {
+  int count;
+  btree_node_t *root;
+};
+
+static btree_node_t *node_create(int leaf);
+static void node_free(btree_node_t *node);
+static btree_node_t *node_clone(const btree_node_t *node);
+static int node_count(const btree_node_t *node);
+static int node_min_key(const btree_node_t *node);
+static int node_search(const int *keys, int n, int key);
+static int branch_child(const btree_branch_t *b, int key);
+static int node_insert(btree_node_t *node, int key, double value, btree_node_t **split);
+static int node_remove(btree_node_t *node, int key);
+static double *node_find(btree_node_t *node, int key);
+
+btree_int_double_t *
+btree_int_double_create(void)
+{
+  btree_int_double_t *t;
+
+  t = malloc(sizeof(btree_int_double_t));
+  if (t == NULL) {
+    ERROR("failed to allocate struct");
+    return NULL;
+  }
+
+  t->count = 0;
+  t->root = NULL;
+
+  return t;
+}
+
+void
+btree_int_double_destroy(btree_int_double_t *t)
+{
+  if (t != NULL) {
+    node_free(t->root);
+    free(t);
+  }
+}
+
+int
+btree_int_double_clear(btree_int_double_t *t)
+{
+  node_free(t->root);
+  t->root = NULL;
+  t->count = 0;
+
+  return 0;
+}
+
+int
+btree_int_double_clone(btree_int_double_t *dest,
+		       const btree_int_double_t *src)
+{
+  btree_node_t *root;
+
+  root = NULL;
+  if (src->root != NULL) {
+    root = node_clone(src->root);
+    if (root == NULL) {
+      ERROR("failed to clone nodes");
+      return -1;
+    }
+  }
+
+  node_free(dest->root);
+  dest->root = root;
+  dest->count = src->count;
+
+  return 0;
+}
+
+int
+btree_int_double_count(const btree_int_double_t *t)
+{
+  return t->count;
+}
+
+int
+btree_int_double_insert(btree_int_double_t *t, int key, double value)
+{
+  btree_node_t *split;
+  btree_branch_t *root;
+  int r;
+
+  if (t->root == NULL) {
+    t->root = node_create(1);
+    if (t->root == NULL) {
+      return -1;
+    }
+  }
+
+  r = node_insert(t->root, key, value, &split);
+  if (r < 0) {
+    return -1;
+  }
+
+  if (split != NULL) {
+    /*
+     * Grow a new root above the split
+     */
+    root = (btree_branch_t*)node_create(0);
+    if (root == NULL) {
+      return -1;
+    }
+
+    root->h.n = 2;
+    root->children[0] = t->root;
+    root->children[1] = split;
+    root->counts[0] = node_count(t->root);
+    root->counts[1] = node_count(split);
+    root->keys[0] = node_min_key(t->root);
+    root->keys[1] = node_min_key(split);
+
+    t->root = &(root->h);
+  }
+
+  t->count += r;
+  return r;
+}
+
+int
+btree_int_double_remove(btree_int_double_t *t, int key)
+{
+  btree_node_t *old;
+  int r;
+
+  if (t->root == NULL) {
+    return 0;
+  }
+
+  r = node_remove(t->root, key);
+  t->count -= r;
+
+  /*
+   * Collapse single child roots
+   */
+  while (t->root != NULL) {
+    if (t->root->n == 0) {
+      node_free(t->root);
+      t->root = NULL;
+    } else if (!t->root->leaf && t->root->n == 1) {
+      old = t->root;
+      t->root = ((btree_branch_t*)old)->children[0];
+      free(old);
+    } else {
+      break;
+    }
+  }
+
+  return r;
+}
+
+int
+btree_int_double_get(const btree_int_double_t *t, int key, double *value)
+{
+  double *v;
+
+  if (t->root == NULL) {
+    return -1;
+  }
+
+  v = node_find(t->root, key);
+  if (v == NULL) {
+    return -1;
+  }
+
+  *value = *v;
+  return 0;
+}
+
+int
+btree_int_double_set(btree_int_double_t *t, int key, double value)
+{
+  double *v;
+
+  if (t->root == NULL) {
+    return -1;
+  }
+
+  v = node_find(t->root, key);
+  if (v == NULL) {
+    return -1;
+  }
+
+  *v = value;
+  return 0;
+}
+
+int
+btree_int_double_is_element(const btree_int_double_t *t, int key)
+{
+  if (t->root == NULL) {
+    return 0;
+  }
+
+  return node_find(t->root, key) != NULL;
+}
+
+int
+btree_int_double_nth(const btree_int_double_t *t, int i, int *key, double *value)
+{
+  const btree_node_t *node;
+  const btree_branch_t *b;
+  const btree_leaf_t *l;
+  int c;
+
+  if (i < 0 || i >= t->count) {
+    return -1;
+  }
+
+  node = t->root;
+  while (!node->leaf) {
+    b = (const btree_branch_t*)node;
+    for (c = 0; c < b->h.n - 1 && i >= b->counts[c]; c ++) {
+      i -= b->counts[c];
+    }
+    node = b->children[c];
+  }
+
+  l = (const btree_leaf_t*)node;
+  *key = l->keys[i];
+  *value = l->values[i];
+
+  return 0;
+}
+
+/*
+ * Internal functions
+ */
+
+static btree_node_t *node_create(int leaf)
+{
+  btree_node_t *node;
+
+  if (leaf) {
+    node = malloc(sizeof(btree_leaf_t));
+  } else {
+    node = malloc(sizeof(btree_branch_t));
+  }
+
+  if (node == NULL) {
+    ERROR("failed to allocate node");
+    return NULL;
+  }
+
+  node->leaf = leaf;
+  node->n = 0;
+
+  return node;
+}
+
+static void node_free(btree_node_t *node)
+{
+  btree_branch_t *b;
+  int i;
+
+  if (node != NULL) {
+    if (!node->leaf) {
+      b = (btree_branch_t*)node;
+      for (i = 0; i < b->h.n; i ++) {
+	node_free(b->children[i]);
+      }
+    }
+
+    free(node);
+  }
+}
+
+static btree_node_t *node_clone(const btree_node_t *node)
+{
+  btree_node_t *c;
+  btree_branch_t *b;
+  int i;
+
+  c = node_create(node->leaf);
+  if (c == NULL) {
+    return NULL;
+  }
+
+  if (node->leaf) {
+    memcpy(c, node, sizeof(btree_leaf_t));
+  } else {
+    memcpy(c, node, sizeof(btree_branch_t));
+
+    b = (btree_branch_t*)c;
+    for (i = 0; i < b->h.n; i ++) {
+      b->children[i] = node_clone(((const btree_branch_t*)node)->children[i]);
+      if (b->children[i] == NULL) {
+	b->h.n = i;
+	node_free(c);
+	return NULL;
+      }
+    }
+  }
+
+  return c;
+}
+
+static int node_count(const btree_node_t *node)
+{
+  const btree_branch_t *b;
+  int i;
+  int c;
+
+  if (node->leaf) {
+    return node->n;
+  }
+
+  b = (const btree_branch_t*)node;
+  c = 0;
+  for (i = 0; i < b->h.n; i ++) {
+    c += b->counts[i];
+  }
+
+  return c;
+}
+
+static int node_min_key(const btree_node_t *node)
+{
+  if (node->leaf) {
+    return ((const btree_leaf_t*)node)->keys[0];
+  }
+
+  return ((const btree_branch_t*)node)->keys[0];
+}
+
+/*
+ * Index of the first key >= key
+ */
+static int node_search(const int *keys, int n, int key)
+{
+  int lo;
+  int hi;
+  int c;
+
+  lo = 0;
+  hi = n;
+  while (lo < hi) {
+    c = (lo + hi)/2;
+    if (keys[c] < key) {
+      lo = c + 1;
+    } else {
+      hi = c;
+    }
+  }
+
+  return lo;
+}
+
+/*
+ * Index of the child whose key range contains key
+ */
+static int branch_child(const btree_branch_t *b, int key)
+{
+  int c;
+
+  c = node_search(b->keys, b->h.n, key);
+  if (c == b->h.n || b->keys[c] > key) {
+    c --;
+  }
+  if (c < 0) {
+    c = 0;
+  }
+
+  return c;
+}
+
+static int node_insert(btree_node_t *node, int key, double value, btree_node_t **split)
+{
+  btree_leaf_t *l;
+  btree_leaf_t *nl;
+  btree_branch_t *b;
+  btree_branch_t *nb;
+  btree_node_t *child_split;
+  int i;
+  int c;
+  int h;
+  int r;
+
+  *split = NULL;
+
+  if (node->leaf) {
+    l = (btree_leaf_t*)node;
+
+    i = node_search(l->keys, l->h.n, key);
+    if (i < l->h.n && l->keys[i] == key) {
+      return 0;
+    }
+
+    if (l->h.n == BTREE_ORDER) {
+      /*
+       * Split in half and insert into the appropriate side
+       */
+      nl = (btree_leaf_t*)node_create(1);
+      if (nl == NULL) {
+	return -1;
+      }
+
+      h = BTREE_ORDER/2;
+      nl->h.n = BTREE_ORDER - h;
+      memcpy(nl->keys, l->keys + h, sizeof(int) * nl->h.n);
+      memcpy(nl->values, l->values + h, sizeof(double) * nl->h.n);
+      l->h.n = h;
+
+      *split = &(nl->h);
+      if (i > h) {
+	l = nl;
+	i -= h;
+      }
+    }
+
+    memmove(l->keys + i + 1, l->keys + i, sizeof(int) * (l->h.n - i));
+    memmove(l->values + i + 1, l->values + i, sizeof(double) * (l->h.n - i));
+    l->keys[i] = key;
+    l->values[i] = value;
+    l->h.n ++;
+
+    return 1;
+  }
+
+  b = (btree_branch_t*)node;
+  c = branch_child(b, key);
+
+  r = node_insert(b->children[c], key, value, &child_split);
+  if (r <= 0) {
+    return r;
+  }
+
+  if (key < b->keys[c]) {
+    b->keys[c] = key;
+  }
+
+  if (child_split == NULL) {
+    b->counts[c] ++;
+    return 1;
+  }
+
+  b->counts[c] = node_count(b->children[c]);
+
+  /*
+   * Add the new child after c, splitting this branch if full
+   */
+  i = c + 1;
+  if (b->h.n == BTREE_ORDER) {
+    nb = (btree_branch_t*)node_create(0);
+    if (nb == NULL) {
+      return -1;
+    }
+
+    h = BTREE_ORDER/2;
+    nb->h.n = BTREE_ORDER - h;
+    memcpy(nb->keys, b->keys + h, sizeof(int) * nb->h.n);
+    memcpy(nb->counts, b->counts + h, sizeof(int) * nb->h.n);
+    memcpy(nb->children, b->children + h, sizeof(btree_node_t*) * nb->h.n);
+    b->h.n = h;
+
+    *split = &(nb->h);
+    if (i > h) {
+      b = nb;
+      i -= h;
+    }
+  }
+
+  memmove(b->keys + i + 1, b->keys + i, sizeof(int) * (b->h.n - i));
+  memmove(b->counts + i + 1, b->counts + i, sizeof(int) * (b->h.n - i));
+  memmove(b->children + i + 1, b->children + i, sizeof(btree_node_t*) * (b->h.n - i));
+  b->children[i] = child_split;
+  b->counts[i] = node_count(child_split);
+  b->keys[i] = node_min_key(child_split);
+  b->h.n ++;
+
+  return 1;
+}
+
+/*
+ * Removes key, nodes which become empty are freed rather than merged with
+ * their neighbours.
+ */
+static int node_remove(btree_node_t *node, int key)
+{
+  btree_leaf_t *l;
+  btree_branch_t *b;
+  btree_node_t *child;
+  int i;
+  int c;
+
+  if (node->leaf) {
+    l = (btree_leaf_t*)node;
+
+    i = node_search(l->keys, l->h.n, key);
+    if (i == l->h.n || l->keys[i] != key) {
+      return 0;
+    }
+
+    memmove(l->keys + i, l->keys + i + 1, sizeof(int) * (l->h.n - i - 1));
+    memmove(l->values + i, l->values + i + 1, sizeof(double) * (l->h.n - i - 1));
+    l->h.n --;
+
+    return 1;
+  }
+
+  b = (btree_branch_t*)node;
+  c = branch_child(b, key);
+  child = b->children[c];
+
+  if (node_remove(child, key) == 0) {
+    return 0;
+  }
+
+  b->counts[c] --;
+
+  if (child->n == 0) {
+    node_free(child);
+    
+    memmove(b->keys + c, b->keys + c + 1, sizeof(int) * (b->h.n - c - 1));
+    memmove(b->counts + c, b->counts + c + 1, sizeof(int) * (b->h.n - c - 1));
+    memmove(b->children + c, b->children + c + 1, sizeof(btree_node_t*) * (b->h.n - c - 1));
+    b->h.n --;
+    
+  } else {
+    b->keys[c] = node_min_key(child);
+  }
+
+  return 1;
+}
+
+static double *node_find(btree_node_t *node, int key)
+{
+  btree_leaf_t *l;
+  int i;
+
+  while (!node->leaf) {
+    node = ((btree_branch_t*)node)->children[branch_child((btree_branch_t*)node, key)];
+  }
+
+  l = (btree_leaf_t*)node;
+  i = node_search(l->keys, l->h.n, key);
+  if (i < l->h.n && l->keys[i] == key) {
+    return l->values + i;
+  }
+
+  return NULL;
+}
@@ -0,0 +1,74 @@
+//
+//    Ordered set library, used for maintaining arbitrary tree based models
+//    
+//    Copyright (C) 2014 - 2018 Rhys Hawkins
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+#ifndef btree_int_double_h
+#define btree_int_double_h
+
+/*
+ * An order statistic B+-tree of int keys with double values. Keys are kept
+ * sorted in contiguous leaf arrays and branches store the element count of
+ * each child so that insert, remove, lookup and access to the i'th smallest
+ * key are all O(log n).
+ */
+typedef struct _btree_int_double btree_int_double_t;
+
+btree_int_double_t *
+btree_int_double_create(void);
+
+void
+btree_int_double_destroy(btree_int_double_t *t);
+
+int
+btree_int_double_clear(btree_int_double_t *t);
+
+int
+btree_int_double_clone(btree_int_double_t *dest,
+		       const btree_int_double_t *src);
+
+int
+btree_int_double_count(const btree_int_double_t *t);
+
+/*
+ * Returns 1 if inserted, 0 if already present and -1 on error
+ */
+int
+btree_int_double_insert(btree_int_double_t *t, int key, double value);
+
+/*
+ * Returns 1 if removed, 0 if not present
+ */
+int
+btree_int_double_remove(btree_int_double_t *t, int key);
+
+int
+btree_int_double_get(const btree_int_double_t *t, int key, double *value);
+
+int
+btree_int_double_set(btree_int_double_t *t, int key, double value);
+
+int
+btree_int_double_is_element(const btree_int_double_t *t, int key);
+
+/*
+ * The i'th smallest key (from 0) and its value
+ */
+int
+btree_int_double_nth(const btree_int_double_t *t, int i, int *key, double *value);
+
+#endif /* btree_int_double_h */
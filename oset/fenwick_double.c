@@ -0,0 +1,147 @@
+//
+//    Ordered set library, used for maintaining arbitrary tree based models
+//    
+//    Copyright (C) 2014 - 2018 Rhys Hawkins
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fenwick_double.h"
+
+#include "slog.h"
+
+/*
+ * Stored 1-based: tree[i] holds the sum of slots (i - lowbit(i)) .. (i - 1)
+ */
+struct _fenwick_double {
+  int n;
+  int top;
+  double *tree;
+};
+
+fenwick_double_t *
+fenwick_double_create(int n)
+{
+  fenwick_double_t *f;
+
+  if (n <= 0) {
+    ERROR("invalid size");
+    return NULL;
+  }
+
+  f = malloc(sizeof(fenwick_double_t));
+  if (f == NULL) {
+    ERROR("failed to allocate memory");
+    return NULL;
+  }
+
+  f->n = n;
+
+  f->top = 1;
+  while ((f->top << 1) <= n) {
+    f->top <<= 1;
+  }
+
+  f->tree = malloc(sizeof(double) * (n + 1));
+  if (f->tree == NULL) {
+    ERROR("failed to allocate tree");
+    fenwick_double_destroy(f);
+    return NULL;
+  }
+  memset(f->tree, 0, sizeof(double) * (n + 1));
+
+  return f;
+}
+
+void
+fenwick_double_destroy(fenwick_double_t *f)
+{
+  if (f != NULL) {
+    free(f->tree);
+    free(f);
+  }
+}
+
+int
+fenwick_double_size(const fenwick_double_t *f)
+{
+  return f->n;
+}
+
+int
+fenwick_double_clone(fenwick_double_t *dest,
+		     const fenwick_double_t *src)
+{
+  if (dest->n != src->n) {
+    ERROR("size mismatch");
+    return -1;
+  }
+
+  memcpy(dest->tree, src->tree, sizeof(double) * (src->n + 1));
+  return 0;
+}
+
+void
+fenwick_double_clear(fenwick_double_t *f)
+{
+  memset(f->tree, 0, sizeof(double) * (f->n + 1));
+}
+
+void
+fenwick_double_add(fenwick_double_t *f, int i, double dv)
+{
+  for (i ++; i <= f->n; i += (i & (-i))) {
+    f->tree[i] += dv;
+  }
+}
+
+double
+fenwick_double_prefix(const fenwick_double_t *f, int i)
+{
+  double sum;
+
+  if (i >= f->n) {
+    i = f->n - 1;
+  }
+
+  sum = 0.0;
+  for (i ++; i > 0; i -= (i & (-i))) {
+    sum += f->tree[i];
+  }
+
+  return sum;
+}
+
+int
+fenwick_double_find(const fenwick_double_t *f, double v, double *remainder)
+{
+  int i;
+  int step;
+
+  i = 0;
+  for (step = f->top; step > 0; step >>= 1) {
+    if (i + step <= f->n && f->tree[i + step] <= v) {
+      i += step;
+      v -= f->tree[i];
+    }
+  }
+
+  *remainder = v;
+  return i;
+}
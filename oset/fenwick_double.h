@@ -0,0 +1,63 @@
+//
+//    Ordered set library, used for maintaining arbitrary tree based models
+//    
+//    Copyright (C) 2014 - 2018 Rhys Hawkins
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+#ifndef fenwick_double_h
+#define fenwick_double_h
+
+/*
+ * A Fenwick (binary indexed) tree of doubles over a fixed no. of slots,
+ * giving O(log n) point updates, prefix sums and inverse prefix search.
+ * Used for weighted selection over the depths of a multiset.
+ */
+typedef struct _fenwick_double fenwick_double_t;
+
+fenwick_double_t *
+fenwick_double_create(int n);
+
+void
+fenwick_double_destroy(fenwick_double_t *f);
+
+int
+fenwick_double_size(const fenwick_double_t *f);
+
+int
+fenwick_double_clone(fenwick_double_t *dest,
+		     const fenwick_double_t *src);
+
+void
+fenwick_double_clear(fenwick_double_t *f);
+
+void
+fenwick_double_add(fenwick_double_t *f, int i, double dv);
+
+/*
+ * Sum of slots 0 .. i inclusive, 0 if i < 0
+ */
+double
+fenwick_double_prefix(const fenwick_double_t *f, int i);
+
+/*
+ * Smallest slot i whose inclusive prefix sum exceeds v, with v less the sum
+ * of the slots before i returned in remainder. Returns n if v is not less
+ * than the total.
+ */
+int
+fenwick_double_find(const fenwick_double_t *f, double v, double *remainder);
+
+#endif /* fenwick_double_h */
@@ -24,21 +24,34 @@
 #include <math.h>
 
 #include "multiset_int.h"
+#include "fenwick_double.h"
 
 #include "slog.h"
 
 static const int DEPTH_INCREMENT = 16;
+static const int WEIGHT_REBUILD = 4096;
 static const int SET_INCREMENT = 1024;
 
 struct _multiset_int {
   int depth_size;
 
+  /* Weighted depth selection state, see depth_weights_prepare */
+  double depthweight;
+  double *weight;
+  fenwick_double_t *fw;
+  int fw_updates;
+
   int *set_size;
   int *set_n;
   int **s;
 };
 
 static int multiset_int_expand_depth(multiset_int_t *s, int depth);
+static int depth_weights_prepare(multiset_int_t *s, double depthweight);
+static void depth_weights_update(multiset_int_t *s, int depth, int delta);
+static void depth_weights_invalidate(multiset_int_t *s);
+static void depth_weights_destroy(multiset_int_t *s);
+
 static int multiset_int_expand_set(multiset_int_t *s, int depth);
 
 static int multiset_int_find_exact(int *s, 
@@ -65,6 +78,11 @@ multiset_int_create(void)
   
   s->depth_size = DEPTH_INCREMENT;
 
+  s->depthweight = 0.0;
+  s->weight = NULL;
+  s->fw = NULL;
+  s->fw_updates = 0;
+
   s->set_size = malloc(sizeof(int) * DEPTH_INCREMENT);
   if (s->set_size == NULL) {
     ERROR("failed to allocate set size");
@@ -115,6 +133,8 @@ multiset_int_destroy(multiset_int_t *s)
     }
     free(s->s);
 
+    depth_weights_destroy(s);
+
     free(s->set_n);
     free(s->set_size);
     free(s);
@@ -134,6 +154,7 @@ multiset_int_clear(multiset_int_t *s)
     s->set_n[i] = 0;
     memset(s->s[i], 0, sizeof(int) * s->set_size[i]);
   }
+  depth_weights_invalidate(s);
 
   return 0;
 }
@@ -172,10 +193,56 @@ multiset_int_insert(multiset_int_t *s, int index, int depth)
 
   s->s[depth][ii] = index;
   s->set_n[depth] ++;
+  depth_weights_update(s, depth, 1);
 
   return 1;
 }
 
+int
+multiset_int_assign_depth(multiset_int_t *s, int depth, const int *indices, int n)
+{
+  int i;
+
+  if (depth < 0 || n < 0) {
+    return -1;
+  }
+
+  if (depth >= s->depth_size) {
+    if (multiset_int_expand_depth(s, depth) < 0) {
+      return -1;
+    }
+  }
+
+  for (i = 1; i < n; i ++) {
+    if (indices[i] <= indices[i - 1]) {
+      ERROR("indices not strictly ascending at %d", i);
+      return -1;
+    }
+  }
+
+  while (s->set_size[depth] < n) {
+    if (multiset_int_expand_set(s, depth) < 0) {
+      return -1;
+    }
+  }
+
+  memcpy(s->s[depth], indices, sizeof(int) * n);
+  s->set_n[depth] = n;
+  depth_weights_invalidate(s);
+
+  return 0;
+}
+
+void
+multiset_int_swap(multiset_int_t *a, multiset_int_t *b)
+{
+  multiset_int_t tmp;
+
+  tmp = *a;
+  *a = *b;
+  *b = tmp;
+}
+
 int
 multiset_int_remove(multiset_int_t *s, int index, int depth)
 {
@@ -196,6 +263,7 @@ multiset_int_remove(multiset_int_t *s, int index, int depth)
       s->s[depth][j] = s->s[depth][j + 1];
     }
     s->set_n[depth] --;
+    depth_weights_update(s, depth, -1);
     return 1;
   }
 
@@ -437,37 +505,43 @@ multiset_int_choose_index_weighted(multiset_int_t *s,
   int j;
   double sum;
   double v;
-  double dv;
 
-  sum = 0.0;
+  if (depth_weights_prepare(s, depthweight) < 0) {
+    return -1;
+  }
 
   depthlimit = s->depth_size - 1;
   if (maxdepth >= 0 && maxdepth < depthlimit) {
     depthlimit = maxdepth;
   }
 
-  for (i = 0; i <= depthlimit; i ++) {
-    sum += (double)s->set_n[i] * pow((double)(i + 1), depthweight);
+  sum = fenwick_double_prefix(s->fw, depthlimit);
+  if (sum <= 0.0) {
+    return -1;
   }
 
-  v = sum * u;
-
-  for (i = 0; i <= depthlimit; i ++) {
-    dv = (double)s->set_n[i] * pow((double)(i + 1), depthweight);
-    if (v < dv) {
-      /* This depth */
-      j = (int)(v/dv * (double)s->set_n[i]);
-      *index = s->s[i][j];
-      *depth = i;
-      *prob = pow((double)(i + 1), depthweight)/sum;
-
-      return 0;
-    } else {
-      v -= dv;
+  i = fenwick_double_find(s->fw, sum * u, &v);
+  if (i > depthlimit || s->set_n[i] == 0) {
+    /* Rounding at the top of the range, take the last element */
+    for (i = depthlimit; i >= 0 && s->set_n[i] == 0; i --);
+    if (i < 0) {
+      return -1;
     }
+    v = (double)s->set_n[i] * s->weight[i];
   }
 
-  return -1;
+  j = (int)(v/s->weight[i]);
+  if (j < 0) {
+    j = 0;
+  } else if (j >= s->set_n[i]) {
+    j = s->set_n[i] - 1;
+  }
+
+  *index = s->s[i][j];
+  *depth = i;
+  *prob = s->weight[i]/sum;
+
+  return 0;
 }
 
 int
@@ -479,23 +553,19 @@ multiset_int_reverse_choose_index_weighted(multiset_int_t *s,
 					   double *prob)
 {
   int depthlimit;
-  int i;
-  double sum;
-
 
   if (multiset_int_is_element(s, index, depth)) {
 
-    sum = 0.0;
+    if (depth_weights_prepare(s, depthweight) < 0) {
+      return -1;
+    }
+
     depthlimit = s->depth_size - 1;
     if (maxdepth >= 0 && maxdepth < depthlimit) {
       depthlimit = maxdepth;
     }
     
-    for (i = 0; i <= depthlimit; i ++) {
-      sum += (double)s->set_n[i] * pow((double)(i + 1), depthweight);
-    }
-    
-    *prob = pow((double)(depth + 1), depthweight)/sum;
+    *prob = s->weight[depth]/fenwick_double_prefix(s->fw, depthlimit);
 
     return 0;
   }
@@ -589,6 +659,7 @@ multiset_int_read(multiset_int_t *s, FILE *fp)
       }
     }
   }
+  depth_weights_invalidate(s);
 
   return 0;
     
@@ -598,6 +669,80 @@ multiset_int_read(multiset_int_t *s, FILE *fp)
  * Internal functions
  */
 
+/*
+ * Cached per-depth weights for weighted selection, allocated on first use.
+ * Insert/remove keep the Fenwick sums of set_n[d] * weight[d] up to date and
+ * the sums are recomputed from the counts every WEIGHT_REBUILD updates to
+ * stop rounding drift accumulating.
+ */
+static int depth_weights_prepare(multiset_int_t *s, double depthweight)
+{
+  int i;
+
+  if (s->fw == NULL) {
+    s->fw = fenwick_double_create(s->depth_size);
+    if (s->fw == NULL) {
+      ERROR("failed to create depth weight sums");
+      return -1;
+    }
+
+    s->weight = malloc(sizeof(double) * s->depth_size);
+    if (s->weight == NULL) {
+      ERROR("failed to allocate depth weights");
+      fenwick_double_destroy(s->fw);
+      s->fw = NULL;
+      return -1;
+    }
+
+    s->depthweight = depthweight;
+    for (i = 0; i < s->depth_size; i ++) {
+      s->weight[i] = pow((double)(i + 1), depthweight);
+    }
+    s->fw_updates = WEIGHT_REBUILD;
+  }
+
+  if (depthweight != s->depthweight) {
+    s->depthweight = depthweight;
+    for (i = 0; i < s->depth_size; i ++) {
+      s->weight[i] = pow((double)(i + 1), depthweight);
+    }
+    s->fw_updates = WEIGHT_REBUILD;
+  }
+
+  if (s->fw_updates >= WEIGHT_REBUILD) {
+    fenwick_double_clear(s->fw);
+    for (i = 0; i < s->depth_size; i ++) {
+      if (s->set_n[i] > 0) {
+	fenwick_double_add(s->fw, i, (double)s->set_n[i] * s->weight[i]);
+      }
+    }
+    s->fw_updates = 0;
+  }
+
+  return 0;
+}
+
+static void depth_weights_update(multiset_int_t *s, int depth, int delta)
+{
+  if (s->fw != NULL) {
+    fenwick_double_add(s->fw, depth, (double)delta * s->weight[depth]);
+    s->fw_updates ++;
+  }
+}
+
+static void depth_weights_invalidate(multiset_int_t *s)
+{
+  s->fw_updates = WEIGHT_REBUILD;
+}
+
+static void depth_weights_destroy(multiset_int_t *s)
+{
+  fenwick_double_destroy(s->fw);
+  s->fw = NULL;
+  free(s->weight);
+  s->weight = NULL;
+}
+
 static int multiset_int_expand_depth(multiset_int_t *s, int depth)
 {
   /*
@@ -657,6 +802,9 @@ static int multiset_int_expand_depth(multiset_int_t *s, int depth)
   s->s = new_s;
   s->depth_size = newdepth_size;
 
+  /* Weight sums are sized by depth, recreated on next use */
+  depth_weights_destroy(s);
+
   return 0;
 }
 
@@ -39,6 +39,19 @@ multiset_int_insert(multiset_int_t *s, int index, int depth);
 int
 multiset_int_remove(multiset_int_t *s, int index, int depth);
 
+/*
+ * Replaces the contents of a depth with n strictly ascending indices,
+ * copying them in without any insertion searches.
+ */
+int
+multiset_int_assign_depth(multiset_int_t *s, int depth, const int *indices, int n);
+
+/*
+ * Exchanges the contents of two sets
+ */
+void
+multiset_int_swap(multiset_int_t *a, multiset_int_t *b);
+
 int
 multiset_int_total_count(const multiset_int_t *s);
 
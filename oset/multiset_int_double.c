@@ -24,21 +24,59 @@
 #include <math.h>
 
 #include "multiset_int_double.h"
+#include "fenwick_double.h"
+
+#ifdef MULTISET_INT_DOUBLE_BTREE
+#include "btree_int_double.h"
+#endif
 
 #include "slog.h"
 
 static const int DEPTH_INCREMENT = 16;
+static const int WEIGHT_REBUILD = 4096;
+#ifndef MULTISET_INT_DOUBLE_BTREE
 static const int SET_INCREMENT = 1024;
+#endif
 
+/*
+ * Each depth is stored as a sorted array with O(n) insert/remove, or when
+ * built with MULTISET_INT_DOUBLE_BTREE as an order statistic B+-tree with
+ * O(log n) operations throughout.
+ */
 struct _multiset_int_double {
   int depth_size;
 
-  int *set_size;
+  /* Weighted depth selection state, see depth_weights_prepare */
+  double depthweight;
+  double *weight;
+  fenwick_double_t *fw;
+  int fw_updates;
+
   int *set_n;
+#ifdef MULTISET_INT_DOUBLE_BTREE
+  btree_int_double_t **t;
+#else
+  int *set_size;
   int **s;
   double **v;
+#endif
 };
 
+static int depth_weights_prepare(multiset_int_double_t *s, double depthweight);
+static void depth_weights_update(multiset_int_double_t *s, int depth, int delta);
+static void depth_weights_invalidate(multiset_int_double_t *s);
+static void depth_weights_destroy(multiset_int_double_t *s);
+
+static int depth_insert(multiset_int_double_t *s, int depth, int index, double value);
+static int depth_remove(multiset_int_double_t *s, int depth, int index);
+static int depth_get(const multiset_int_double_t *s, int depth, int index, double *value);
+static int depth_set(multiset_int_double_t *s, int depth, int index, double value);
+static int depth_nth(const multiset_int_double_t *s, int depth, int i, int *index, double *value);
+static int depth_reserve(multiset_int_double_t *s, int depth, int size);
+static int depth_assign(multiset_int_double_t *s, int depth, const int *indices, const double *values, int n);
+
+#ifndef MULTISET_INT_DOUBLE_BTREE
+
 static int multiset_int_double_expand_set(multiset_int_double_t *s, int depth, int minsize);
 
 static int multiset_int_double_find_exact(int *s, 
@@ -50,6 +88,7 @@ static int multiset_int_double_find_insertion_index(int *s,
 						    int idx,
 						    int start,
 						    int end);
+#endif
 
 multiset_int_double_t *
 multiset_int_double_create(void)
@@ -65,14 +104,10 @@ multiset_int_double_create(void)
   
   s->depth_size = DEPTH_INCREMENT;
 
-  s->set_size = malloc(sizeof(int) * DEPTH_INCREMENT);
-  if (s->set_size == NULL) {
-    ERROR("failed to allocate set size");
-    return NULL;
-  }
-  for (i = 0; i < s->depth_size; i ++) {
-    s->set_size[i] = SET_INCREMENT;
-  }
+  s->depthweight = 0.0;
+  s->weight = NULL;
+  s->fw = NULL;
+  s->fw_updates = 0;
 
   s->set_n = malloc(sizeof(int) * DEPTH_INCREMENT);
   if (s->set_n == NULL) {
@@ -83,6 +118,30 @@ multiset_int_double_create(void)
     s->set_n[i] = 0;
   }
 
+#ifdef MULTISET_INT_DOUBLE_BTREE
+  s->t = malloc(sizeof(btree_int_double_t *) * DEPTH_INCREMENT);
+  if (s->t == NULL) {
+    ERROR("failed to allocate tree array");
+    return NULL;
+  }
+
+  for (i = 0; i < s->depth_size; i ++) {
+    s->t[i] = btree_int_double_create();
+    if (s->t[i] == NULL) {
+      ERROR("failed to allocate tree");
+      return NULL;
+    }
+  }
+#else
+  s->set_size = malloc(sizeof(int) * DEPTH_INCREMENT);
+  if (s->set_size == NULL) {
+    ERROR("failed to allocate set size");
+    return NULL;
+  }
+  for (i = 0; i < s->depth_size; i ++) {
+    s->set_size[i] = SET_INCREMENT;
+  }
+
   s->s = malloc(sizeof(int *) * DEPTH_INCREMENT);
   if (s->s == NULL) {
     ERROR("failed to allocate set array");
@@ -114,7 +173,7 @@ multiset_int_double_create(void)
 
     memset(s->v[i], 0, sizeof(double) * SET_INCREMENT);
   }
-
+#endif
 
   return s;
 }
@@ -127,6 +186,12 @@ multiset_int_double_destroy(multiset_int_double_t *s)
 
   if (s != NULL) {
 
+#ifdef MULTISET_INT_DOUBLE_BTREE
+    for (i = 0; i < s->depth_size; i ++) {
+      btree_int_double_destroy(s->t[i]);
+    }
+    free(s->t);
+#else
     for (i = 0; i < s->depth_size; i ++) {
       free(s->v[i]);
     }
@@ -137,8 +202,12 @@ multiset_int_double_destroy(multiset_int_double_t *s)
     }
     free(s->s);
 
-    free(s->set_n);
     free(s->set_size);
+#endif
+
+    depth_weights_destroy(s);
+    
+    free(s->set_n);
     free(s);
   }
 }
@@ -154,9 +223,14 @@ multiset_int_double_clear(multiset_int_double_t *s)
 
   for (i = 0; i < s->depth_size; i ++) {
     s->set_n[i] = 0;
+#ifdef MULTISET_INT_DOUBLE_BTREE
+    btree_int_double_clear(s->t[i]);
+#else
     memset(s->s[i], 0, sizeof(int) * s->set_size[i]);
     memset(s->v[i], 0, sizeof(double) * s->set_size[i]);
+#endif
   }
+  depth_weights_invalidate(s);
 
   return 0;
 }
@@ -166,7 +240,9 @@ multiset_int_double_clone(multiset_int_double_t *dest,
 			  const multiset_int_double_t *src)
 {
   int d;
+#ifndef MULTISET_INT_DOUBLE_BTREE
   int j;
+#endif
 
   if (dest->depth_size != src->depth_size) {
     ERROR("depth size mismatch");
@@ -175,6 +251,12 @@ multiset_int_double_clone(multiset_int_double_t *dest,
 
   for (d = 0; d < dest->depth_size; d ++) {
 
+#ifdef MULTISET_INT_DOUBLE_BTREE
+    if (btree_int_double_clone(dest->t[d], src->t[d]) < 0) {
+      ERROR("failed to clone tree");
+      return -1;
+    }
+#else
     if (dest->set_size[d] < src->set_size[d]) {
       if (multiset_int_double_expand_set(dest, d, src->set_size[d]) < 0) {
 	ERROR("failed to expand dest set");
@@ -186,107 +268,103 @@ multiset_int_double_clone(multiset_int_double_t *dest,
       dest->s[d][j] = src->s[d][j];
       dest->v[d][j] = src->v[d][j];
     }
+#endif
     dest->set_n[d] = src->set_n[d];
   }
 
+  if (src->fw != NULL && depth_weights_prepare(dest, src->depthweight) == 0) {
+    if (fenwick_double_clone(dest->fw, src->fw) < 0) {
+      return -1;
+    }
+    dest->fw_updates = src->fw_updates;
+  } else {
+    depth_weights_invalidate(dest);
+  }
+
   return 0;
 }
 
 int
 multiset_int_double_insert(multiset_int_double_t *s, int index, int depth, double value)
 {
-  int ii;
-  int j;
+  int r;
 
   if (depth >= s->depth_size) {
     return -1;
   }
 
-  if (s->set_n[depth] == s->set_size[depth]) {
-    if (multiset_int_double_expand_set(s, depth, s->set_n[depth] + 1) < 0) {
+  r = depth_insert(s, depth, index, value);
+  if (r > 0) {
+    s->set_n[depth] ++;
+    depth_weights_update(s, depth, 1);
+  }
+
+  return r;
+}
+
+int
+multiset_int_double_assign_depth(multiset_int_double_t *s,
+				 int depth,
+				 const int *indices,
+				 const double *values,
+				 int n)
+{
+  int i;
+  
+  if (depth < 0 || depth >= s->depth_size || n < 0) {
+    return -1;
+  }
+
+  for (i = 1; i < n; i ++) {
+    if (indices[i] <= indices[i - 1]) {
+      ERROR("indices not strictly ascending at %d", i);
       return -1;
     }
   }
 
-  ii = multiset_int_double_find_insertion_index(s->s[depth], 
-						index,
-						0,
-						s->set_n[depth] - 1);
-  /* Negative means index was already present */
-  if (ii < 0) {
-    return 0;
+  if (depth_assign(s, depth, indices, values, n) < 0) {
+    return -1;
   }
 
-  /* Shift tail indices back 1 to make room */
-  for (j = s->set_n[depth]; j > ii; j --) {
-    s->s[depth][j] = s->s[depth][j - 1];
-    s->v[depth][j] = s->v[depth][j - 1];
-  }
+  s->set_n[depth] = n;
+  depth_weights_invalidate(s);
 
-  s->s[depth][ii] = index;
-  s->v[depth][ii] = value;
-  s->set_n[depth] ++;
+  return 0;
+}
 
-  return 1;
+void
+multiset_int_double_swap(multiset_int_double_t *a,
+			 multiset_int_double_t *b)
+{
+  multiset_int_double_t tmp;
+
+  tmp = *a;
+  *a = *b;
+  *b = tmp;
 }
 
 int
 multiset_int_double_get(const multiset_int_double_t *s, int index, int depth, double *value)
 {
-  int di;
-
-  di = multiset_int_double_find_exact(s->s[depth], 
-				      index,
-				      0,
-				      s->set_n[depth] - 1);
-  
-  if (di >= 0) {
-    *value = s->v[depth][di];
-    return 0;
-  }
-
-  return -1;
+  return depth_get(s, depth, index, value);
 }
 
 int
 multiset_int_double_set(multiset_int_double_t *s, int index, int depth, double value)
 {
-  int di;
-
-  di = multiset_int_double_find_exact(s->s[depth], 
-			       index,
-			       0,
-			       s->set_n[depth] - 1);
-
-  if (di >= 0) {
-    s->v[depth][di] = value;
-    return 0;
-  }
-
-  return -1;
+  return depth_set(s, depth, index, value);
 }
 
 int
 multiset_int_double_remove(multiset_int_double_t *s, int index, int depth)
 {
-  int di;
-  int j;
-
   if (depth < 0 || depth >= s->depth_size) {
     return -1;
   }
 
-  di = multiset_int_double_find_exact(s->s[depth], 
-			       index,
-			       0,
-			       s->set_n[depth] - 1);
-
-  if (di >= 0) { 
-    for (j = di; j < (s->set_n[depth] - 1); j ++) {
-      s->s[depth][j] = s->s[depth][j + 1];
-      s->v[depth][j] = s->v[depth][j + 1];
-    }
+  if (depth_remove(s, depth, index) > 0) {
     s->set_n[depth] --;
+    depth_weights_update(s, depth, -1);
     return 1;
   }
 
@@ -366,6 +444,8 @@ multiset_int_double_nonempty_count(const multiset_int_double_t *s, int maxdepth)
 int 
 multiset_int_double_is_element(const multiset_int_double_t *s, int index, int depth)
 {
+  double v;
+  
   if (s == NULL ||
       depth < 0 ||
       depth >= s->depth_size) {
@@ -376,10 +456,7 @@ multiset_int_double_is_element(const multiset_int_double_t *s, int index, int de
     return 0;
   }
 
-  return (multiset_int_double_find_exact(s->s[depth], 
-				  index,
-				  0, 
-				  s->set_n[depth] - 1) >= 0);
+  return depth_get(s, depth, index, &v) == 0;
 }
 
 int
@@ -392,9 +469,7 @@ multiset_int_double_nth_element(const multiset_int_double_t *s, int depth, int i
     return -1;
   }
 
-  *index = s->s[depth][i];
-  *value = s->v[depth][i];
-  return 0;
+  return depth_nth(s, depth, i, index, value);
 }
 
 int 
@@ -451,6 +526,7 @@ multiset_int_double_choose_index(const multiset_int_double_t *s,
 				 int *nindices)
 {
   int j;
+  double v;
 
   if (s == NULL ||
       depth < 0 ||
@@ -463,7 +539,9 @@ multiset_int_double_choose_index(const multiset_int_double_t *s,
   }
   
   j = (int)(u * (double)s->set_n[depth]);
-  *index = s->s[depth][j];
+  if (depth_nth(s, depth, j, index, &v) < 0) {
+    return -1;
+  }
   *nindices = s->set_n[depth];
 
   return 0;
@@ -481,6 +559,7 @@ multiset_int_double_choose_index_globally(const multiset_int_double_t *s,
   int cindices;
   int i;
   int j;
+  double v;
 
   cindices = 0;
 
@@ -502,7 +581,9 @@ multiset_int_double_choose_index_globally(const multiset_int_double_t *s,
   for (i = 0; i <= depthlimit; i ++) {
 
     if (s->set_n[i] > j) {
-      *index = s->s[i][j];
+      if (depth_nth(s, i, j, index, &v) < 0) {
+	return -1;
+      }
       *depth = i;
       *nindices = cindices;
       return 0;
@@ -516,7 +597,7 @@ multiset_int_double_choose_index_globally(const multiset_int_double_t *s,
 }
 
 int 
-multiset_int_double_choose_index_weighted(const multiset_int_double_t *s,
+multiset_int_double_choose_index_weighted(multiset_int_double_t *s,
 					  double u,
 					  int maxdepth,
 					  double depthweight,
@@ -529,41 +610,49 @@ multiset_int_double_choose_index_weighted(const multiset_int_double_t *s,
   int j;
   double sum;
   double v;
-  double dv;
 
-  sum = 0.0;
+  if (depth_weights_prepare(s, depthweight) < 0) {
+    return -1;
+  }
 
   depthlimit = s->depth_size - 1;
   if (maxdepth >= 0 && maxdepth < depthlimit) {
     depthlimit = maxdepth;
   }
 
-  for (i = 0; i <= depthlimit; i ++) {
-    sum += (double)s->set_n[i] * pow((double)(i + 1), depthweight);
+  sum = fenwick_double_prefix(s->fw, depthlimit);
+  if (sum <= 0.0) {
+    return -1;
   }
 
-  v = sum * u;
+  i = fenwick_double_find(s->fw, sum * u, &v);
+  if (i > depthlimit || s->set_n[i] == 0) {
+    /* Rounding at the top of the range, take the last element */
+    for (i = depthlimit; i >= 0 && s->set_n[i] == 0; i --);
+    if (i < 0) {
+      return -1;
+    }
+    v = (double)s->set_n[i] * s->weight[i];
+  }
 
-  for (i = 0; i <= depthlimit; i ++) {
-    dv = (double)s->set_n[i] * pow((double)(i + 1), depthweight);
-    if (v < dv) {
-      /* This depth */
-      j = (int)(v/dv * (double)s->set_n[i]);
-      *index = s->s[i][j];
-      *depth = i;
-      *prob = pow((double)(i + 1), depthweight)/sum;
+  j = (int)(v/s->weight[i]);
+  if (j < 0) {
+    j = 0;
+  } else if (j >= s->set_n[i]) {
+    j = s->set_n[i] - 1;
+  }
 
-      return 0;
-    } else {
-      v -= dv;
-    }
+  if (depth_nth(s, i, j, index, &v) < 0) {
+    return -1;
   }
+  *depth = i;
+  *prob = s->weight[i]/sum;
 
-  return -1;
+  return 0;
 }
 
 int
-multiset_int_double_reverse_choose_index_weighted(const multiset_int_double_t *s,
+multiset_int_double_reverse_choose_index_weighted(multiset_int_double_t *s,
 						  int maxdepth,
 						  double depthweight,
 						  int index,
@@ -571,23 +660,19 @@ multiset_int_double_reverse_choose_index_weighted(const multiset_int_double_t *s
 						  double *prob)
 {
   int depthlimit;
-  int i;
-  double sum;
-
 
   if (multiset_int_double_is_element(s, index, depth)) {
 
-    sum = 0.0;
+    if (depth_weights_prepare(s, depthweight) < 0) {
+      return -1;
+    }
+
     depthlimit = s->depth_size - 1;
     if (maxdepth >= 0 && maxdepth < depthlimit) {
       depthlimit = maxdepth;
     }
     
-    for (i = 0; i <= depthlimit; i ++) {
-      sum += (double)s->set_n[i] * pow((double)(i + 1), depthweight);
-    }
-    
-    *prob = pow((double)(depth + 1), depthweight)/sum;
+    *prob = s->weight[depth]/fenwick_double_prefix(s->fw, depthlimit);
 
     return 0;
   }
@@ -600,12 +685,15 @@ multiset_int_double_dump(const multiset_int_double_t *s)
 {
   int d;
   int i;
+  int index;
+  double value;
 
   for (d = 0; d < s->depth_size; d ++) {
     if (s->set_n[d] > 0) {
       printf("Depth %d:\n  ", d);
       for (i = 0; i < s->set_n[d]; i ++) {
-	printf("(%d, %f) ", s->s[d][i], s->v[d][i]);
+	depth_nth(s, d, i, &index, &value);
+	printf("(%d, %f) ", index, value);
       }
       printf("\n");
     }
@@ -617,6 +705,8 @@ multiset_int_double_write(const multiset_int_double_t *s, FILE *fp)
 {
   int d;
   int i;
+  int index;
+  double value;
 
   fprintf(fp, "%d\n", s->depth_size);
 
@@ -625,7 +715,8 @@ multiset_int_double_write(const multiset_int_double_t *s, FILE *fp)
     fprintf(fp, "%d %d\n", d, s->set_n[d]);
 
     for (i = 0; i < s->set_n[d]; i ++) {
-      fprintf(fp, "%d %.9g\n", s->s[d][i], s->v[d][i]);
+      depth_nth(s, d, i, &index, &value);
+      fprintf(fp, "%d %.9g\n", index, value);
     }
   }
 
@@ -642,6 +733,9 @@ multiset_int_double_read(multiset_int_double_t *s, FILE *fp)
   int di;
   int dc;
 
+  int index;
+  double value;
+
   multiset_int_double_clear(s);
 
   if (fscanf(fp, "%d\n", &maxd) != 1) {
@@ -666,22 +760,23 @@ multiset_int_double_read(multiset_int_double_t *s, FILE *fp)
       return -1;
     }
 
-    if (dc > s->set_size[d]) {
-      if (multiset_int_double_expand_set(s, d, dc) < 0) {
-	ERROR("failed to expand set");
-	return -1;
-      }
+    if (depth_reserve(s, d, dc) < 0) {
+      ERROR("failed to expand set");
+      return -1;
     }
     
     for (j = 0; j < dc; j ++) {
 
-      if (fscanf(fp, "%d %lf\n", &(s->s[d][j]), &(s->v[d][j])) != 2) {
+      if (fscanf(fp, "%d %lf\n", &index, &value) != 2) {
 	ERROR("failed to read set element");
 	return -1;
       }
-    }
 
-    s->set_n[d] = dc;
+      if (multiset_int_double_insert(s, index, d, value) < 0) {
+	ERROR("failed to insert set element");
+	return -1;
+      }
+    }
   }
 
   return 0;
@@ -694,6 +789,8 @@ multiset_int_double_write_binary(multiset_int_double_t *s,
 {
   int d;
   int i;
+  int index;
+  double value;
 
   if (write_function(&(s->depth_size), sizeof(int), 1, fp) != 1) {
     ERROR("failed to write header");
@@ -713,12 +810,14 @@ multiset_int_double_write_binary(multiset_int_double_t *s,
 
     for (i = 0; i < s->set_n[d]; i ++) {
 
-      if (write_function(&(s->s[d][i]), sizeof(int), 1, fp) != 1) {
+      depth_nth(s, d, i, &index, &value);
+      
+      if (write_function(&index, sizeof(int), 1, fp) != 1) {
 	ERROR("failed to write index");
 	return -1;
       }
       
-      if (write_function(&(s->v[d][i]), sizeof(double), 1, fp) != 1) {
+      if (write_function(&value, sizeof(double), 1, fp) != 1) {
 	ERROR("failed to write value");
 	return -1;
       }
@@ -736,7 +835,10 @@ multiset_int_double_read_binary(multiset_int_double_t *s,
   int depth;
   int d;
   int di;
+  int dc;
   int i;
+  int index;
+  double value;
   
   multiset_int_double_clear(s);
 
@@ -762,29 +864,32 @@ multiset_int_double_read_binary(multiset_int_double_t *s,
       return -1;
     }
 
-    if (read_function(&(s->set_n[d]), sizeof(int), 1, fp) != 1) {
+    if (read_function(&dc, sizeof(int), 1, fp) != 1) {
       ERROR("failed to read depth count");
       return -1;
     }
 
-    if (s->set_n[d] > s->set_size[d]) {
-      if (multiset_int_double_expand_set(s, d, s->set_n[d]) < 0) {
-	ERROR("failed to expand set");
-	return -1;
-      }
+    if (depth_reserve(s, d, dc) < 0) {
+      ERROR("failed to expand set");
+      return -1;
     }
 								  
-    for (i = 0; i < s->set_n[d]; i ++) {
+    for (i = 0; i < dc; i ++) {
 
-      if (read_function(&(s->s[d][i]), sizeof(int), 1, fp) != 1) {
+      if (read_function(&index, sizeof(int), 1, fp) != 1) {
 	ERROR("failed to read index");
 	return -1;
       }
       
-      if (read_function(&(s->v[d][i]), sizeof(double), 1, fp) != 1) {
+      if (read_function(&value, sizeof(double), 1, fp) != 1) {
 	ERROR("failed to read value");
 	return -1;
       }
+
+      if (multiset_int_double_insert(s, index, d, value) < 0) {
+	ERROR("failed to insert value");
+	return -1;
+      }
     }
   }
 
@@ -797,6 +902,240 @@ multiset_int_double_read_binary(multiset_int_double_t *s,
  * Internal functions
  */
 
+/*
+ * Cached per-depth weights for weighted selection, allocated on first use.
+ * Insert/remove keep the Fenwick sums of set_n[d] * weight[d] up to date and
+ * the sums are recomputed from the counts every WEIGHT_REBUILD updates to
+ * stop rounding drift accumulating.
+ */
+static int depth_weights_prepare(multiset_int_double_t *s, double depthweight)
+{
+  int i;
+
+  if (s->fw == NULL) {
+    s->fw = fenwick_double_create(s->depth_size);
+    if (s->fw == NULL) {
+      ERROR("failed to create depth weight sums");
+      return -1;
+    }
+
+    s->weight = malloc(sizeof(double) * s->depth_size);
+    if (s->weight == NULL) {
+      ERROR("failed to allocate depth weights");
+      fenwick_double_destroy(s->fw);
+      s->fw = NULL;
+      return -1;
+    }
+
+    s->depthweight = depthweight;
+    for (i = 0; i < s->depth_size; i ++) {
+      s->weight[i] = pow((double)(i + 1), depthweight);
+    }
+    s->fw_updates = WEIGHT_REBUILD;
+  }
+
+  if (depthweight != s->depthweight) {
+    s->depthweight = depthweight;
+    for (i = 0; i < s->depth_size; i ++) {
+      s->weight[i] = pow((double)(i + 1), depthweight);
+    }
+    s->fw_updates = WEIGHT_REBUILD;
+  }
+
+  if (s->fw_updates >= WEIGHT_REBUILD) {
+    fenwick_double_clear(s->fw);
+    for (i = 0; i < s->depth_size; i ++) {
+      if (s->set_n[i] > 0) {
+	fenwick_double_add(s->fw, i, (double)s->set_n[i] * s->weight[i]);
+      }
+    }
+    s->fw_updates = 0;
+  }
+
+  return 0;
+}
+
+static void depth_weights_update(multiset_int_double_t *s, int depth, int delta)
+{
+  if (s->fw != NULL) {
+    fenwick_double_add(s->fw, depth, (double)delta * s->weight[depth]);
+    s->fw_updates ++;
+  }
+}
+
+static void depth_weights_invalidate(multiset_int_double_t *s)
+{
+  s->fw_updates = WEIGHT_REBUILD;
+}
+
+static void depth_weights_destroy(multiset_int_double_t *s)
+{
+  fenwick_double_destroy(s->fw);
+  s->fw = NULL;
+  free(s->weight);
+  s->weight = NULL;
+}
+
+#ifdef MULTISET_INT_DOUBLE_BTREE
+
+static int depth_insert(multiset_int_double_t *s, int depth, int index, double value)
+{
+  return btree_int_double_insert(s->t[depth], index, value);
+}
+
+static int depth_remove(multiset_int_double_t *s, int depth, int index)
+{
+  return btree_int_double_remove(s->t[depth], index);
+}
+
+static int depth_get(const multiset_int_double_t *s, int depth, int index, double *value)
+{
+  return btree_int_double_get(s->t[depth], index, value);
+}
+
+static int depth_set(multiset_int_double_t *s, int depth, int index, double value)
+{
+  return btree_int_double_set(s->t[depth], index, value);
+}
+
+static int depth_nth(const multiset_int_double_t *s, int depth, int i, int *index, double *value)
+{
+  return btree_int_double_nth(s->t[depth], i, index, value);
+}
+
+static int depth_reserve(multiset_int_double_t *s, int depth, int size)
+{
+  return 0;
+}
+
+static int depth_assign(multiset_int_double_t *s, int depth, const int *indices, const double *values, int n)
+{
+  int i;
+
+  /* Ascending inserts always land in the last leaf */
+  btree_int_double_clear(s->t[depth]);
+  for (i = 0; i < n; i ++) {
+    if (btree_int_double_insert(s->t[depth], indices[i], values[i]) != 1) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+#else
+
+static int depth_insert(multiset_int_double_t *s, int depth, int index, double value)
+{
+  int ii;
+  int j;
+
+  if (s->set_n[depth] == s->set_size[depth]) {
+    if (multiset_int_double_expand_set(s, depth, s->set_n[depth] + 1) < 0) {
+      return -1;
+    }
+  }
+
+  ii = multiset_int_double_find_insertion_index(s->s[depth], 
+						index,
+						0,
+						s->set_n[depth] - 1);
+  /* Negative means index was already present */
+  if (ii < 0) {
+    return 0;
+  }
+
+  /* Shift tail indices back 1 to make room */
+  for (j = s->set_n[depth]; j > ii; j --) {
+    s->s[depth][j] = s->s[depth][j - 1];
+    s->v[depth][j] = s->v[depth][j - 1];
+  }
+
+  s->s[depth][ii] = index;
+  s->v[depth][ii] = value;
+
+  return 1;
+}
+
+static int depth_remove(multiset_int_double_t *s, int depth, int index)
+{
+  int di;
+  int j;
+
+  di = multiset_int_double_find_exact(s->s[depth], 
+				      index,
+				      0,
+				      s->set_n[depth] - 1);
+
+  if (di >= 0) { 
+    for (j = di; j < (s->set_n[depth] - 1); j ++) {
+      s->s[depth][j] = s->s[depth][j + 1];
+      s->v[depth][j] = s->v[depth][j + 1];
+    }
+    return 1;
+  }
+
+  return 0;
+}
+
+static int depth_get(const multiset_int_double_t *s, int depth, int index, double *value)
+{
+  int di;
+
+  di = multiset_int_double_find_exact(s->s[depth], 
+				      index,
+				      0,
+				      s->set_n[depth] - 1);
+  
+  if (di >= 0) {
+    *value = s->v[depth][di];
+    return 0;
+  }
+
+  return -1;
+}
+
+static int depth_set(multiset_int_double_t *s, int depth, int index, double value)
+{
+  int di;
+
+  di = multiset_int_double_find_exact(s->s[depth], 
+				      index,
+				      0,
+				      s->set_n[depth] - 1);
+
+  if (di >= 0) {
+    s->v[depth][di] = value;
+    return 0;
+  }
+
+  return -1;
+}
+
+static int depth_nth(const multiset_int_double_t *s, int depth, int i, int *index, double *value)
+{
+  *index = s->s[depth][i];
+  *value = s->v[depth][i];
+  return 0;
+}
+
+static int depth_reserve(multiset_int_double_t *s, int depth, int size)
+{
+  return multiset_int_double_expand_set(s, depth, size);
+}
+
+static int depth_assign(multiset_int_double_t *s, int depth, const int *indices, const double *values, int n)
+{
+  if (multiset_int_double_expand_set(s, depth, n) < 0) {
+    return -1;
+  }
+
+  memcpy(s->s[depth], indices, sizeof(int) * n);
+  memcpy(s->v[depth], values, sizeof(double) * n);
+
+  return 0;
+}
+
 static int multiset_int_double_expand_set(multiset_int_double_t *s, int depth, int minsize)
 {
   int new_size;
@@ -905,3 +1244,4 @@ static int multiset_int_double_find_insertion_index(int *s,
   }
 }
 
+#endif /* MULTISET_INT_DOUBLE_BTREE */
@@ -40,6 +40,24 @@ multiset_int_double_clone(multiset_int_double_t *dest,
 int
 multiset_int_double_insert(multiset_int_double_t *s, int index, int depth, double value);
 
+/*
+ * Replaces the contents of a depth with n entries whose indices are
+ * strictly ascending, copying them in without any insertion searches.
+ */
+int
+multiset_int_double_assign_depth(multiset_int_double_t *s,
+				 int depth,
+				 const int *indices,
+				 const double *values,
+				 int n);
+
+/*
+ * Exchanges the contents of two sets
+ */
+void
+multiset_int_double_swap(multiset_int_double_t *a,
+			 multiset_int_double_t *b);
+
 int
 multiset_int_double_get(const multiset_int_double_t *s, int index, int depth, double *value);
 
@@ -90,7 +108,7 @@ multiset_int_double_choose_index_globally(const multiset_int_double_t *s,
 					  int *nindices);
 
 int 
-multiset_int_double_choose_index_weighted(const multiset_int_double_t *s,
+multiset_int_double_choose_index_weighted(multiset_int_double_t *s,
 					  double u,
 					  int maxdepth,
 					  double depthweight,
@@ -99,7 +117,7 @@ multiset_int_double_choose_index_weighted(const multiset_int_double_t *s,
 					  double *prob);
 
 int
-multiset_int_double_reverse_choose_index_weighted(const multiset_int_double_t *s,
+multiset_int_double_reverse_choose_index_weighted(multiset_int_double_t *s,
 						  int maxdepth,
 						  double depthweight,
 						  int index,
@@ -0,0 +1,170 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <check.h>
+
+#include "btree_int_double.h"
+
+#define KEY_RANGE 20000
+
+START_TEST (test_btree_int_double_create)
+{
+  btree_int_double_t *t;
+
+  t = btree_int_double_create();
+  ck_assert_ptr_ne(t, NULL);
+  ck_assert(btree_int_double_count(t) == 0);
+
+  btree_int_double_destroy(t);
+}
+END_TEST
+
+/*
+ * Random inserts and removes checked against a flat presence array.
+ */
+START_TEST (test_btree_int_double_random)
+{
+  btree_int_double_t *t;
+  double *ref;
+  int *present;
+  int i;
+  int j;
+  int k;
+  int n;
+  int key;
+  double value;
+
+  t = btree_int_double_create();
+  ck_assert_ptr_ne(t, NULL);
+
+  ref = malloc(sizeof(double) * KEY_RANGE);
+  present = malloc(sizeof(int) * KEY_RANGE);
+  for (i = 0; i < KEY_RANGE; i ++) {
+    present[i] = 0;
+  }
+
+  srand(1234);
+  n = 0;
+  for (i = 0; i < 200000; i ++) {
+
+    k = rand() % KEY_RANGE;
+
+    if ((rand() % 3) != 0) {
+      value = (double)rand()/(double)RAND_MAX;
+      ck_assert(btree_int_double_insert(t, k, value) == !present[k]);
+      if (!present[k]) {
+	ref[k] = value;
+	present[k] = 1;
+	n ++;
+      }
+    } else {
+      ck_assert(btree_int_double_remove(t, k) == present[k]);
+      if (present[k]) {
+	present[k] = 0;
+	n --;
+      }
+    }
+
+    ck_assert(btree_int_double_count(t) == n);
+  }
+
+  j = 0;
+  for (i = 0; i < KEY_RANGE; i ++) {
+    ck_assert(btree_int_double_is_element(t, i) == present[i]);
+
+    if (present[i]) {
+      ck_assert(btree_int_double_get(t, i, &value) == 0);
+      ck_assert(value == ref[i]);
+
+      ck_assert(btree_int_double_nth(t, j, &key, &value) == 0);
+      ck_assert(key == i);
+      ck_assert(value == ref[i]);
+      j ++;
+    } else {
+      ck_assert(btree_int_double_get(t, i, &value) == -1);
+      ck_assert(btree_int_double_set(t, i, 1.0) == -1);
+    }
+  }
+  ck_assert(j == n);
+  ck_assert(btree_int_double_nth(t, n, &key, &value) == -1);
+
+  /* Remove everything, tree should collapse back to empty */
+  for (i = 0; i < KEY_RANGE; i ++) {
+    ck_assert(btree_int_double_remove(t, i) == present[i]);
+  }
+  ck_assert(btree_int_double_count(t) == 0);
+
+  free(ref);
+  free(present);
+  btree_int_double_destroy(t);
+}
+END_TEST
+
+START_TEST (test_btree_int_double_clone)
+{
+  btree_int_double_t *a;
+  btree_int_double_t *b;
+  int i;
+  int key;
+  double value;
+
+  a = btree_int_double_create();
+  ck_assert_ptr_ne(a, NULL);
+  b = btree_int_double_create();
+  ck_assert_ptr_ne(b, NULL);
+
+  for (i = 0; i < 10000; i ++) {
+    ck_assert(btree_int_double_insert(a, (i * 7919) % 10007, (double)i) == 1);
+  }
+
+  ck_assert(btree_int_double_insert(b, 5, 1.0) == 1);
+  ck_assert(btree_int_double_clone(b, a) == 0);
+  ck_assert(btree_int_double_count(b) == 10000);
+
+  for (i = 0; i < 10000; i ++) {
+    ck_assert(btree_int_double_set(a, (i * 7919) % 10007, -1.0) == 0);
+  }
+
+  for (i = 0; i < 10000; i ++) {
+    ck_assert(btree_int_double_get(b, (i * 7919) % 10007, &value) == 0);
+    ck_assert(value == (double)i);
+  }
+
+  for (i = 1; i < 10000; i ++) {
+    ck_assert(btree_int_double_nth(b, i, &key, &value) == 0);
+    ck_assert(key > 0);
+  }
+
+  ck_assert(btree_int_double_clear(b) == 0);
+  ck_assert(btree_int_double_count(b) == 0);
+  ck_assert(btree_int_double_is_element(b, 5) == 0);
+
+  btree_int_double_destroy(a);
+  btree_int_double_destroy(b);
+}
+END_TEST
+
+Suite *
+btree_int_double_suite (void)
+{
+  Suite *s = suite_create ("BTree Int Double");
+
+  /* Core test case */
+  TCase *tc_core = tcase_create ("Core");
+  tcase_add_test (tc_core, test_btree_int_double_create);
+  tcase_add_test (tc_core, test_btree_int_double_random);
+  tcase_add_test (tc_core, test_btree_int_double_clone);
+  suite_add_tcase (s, tc_core);
+
+  return s;
+}
+
+int main (void)
+{
+  int number_failed;
+  Suite *s = btree_int_double_suite ();
+  SRunner *sr = srunner_create (s);
+  srunner_run_all (sr, CK_VERBOSE);
+  number_failed = srunner_ntests_failed (sr);
+  srunner_free (sr);
+  return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -1,6 +1,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <math.h>
 #include <check.h>
 
 #include "multiset_int_double.h"
@@ -319,6 +320,105 @@ START_TEST(test_multiset_int_double_binary_readwrite)
 }
 END_TEST
 
+/*
+ * Weighted choice against a direct evaluation of the depth weights, with
+ * the cached weights rebuilt on a change of exponent and updated through
+ * inserts and removes in between.
+ */
+static void weighted_reference(multiset_int_double_t *set,
+			       double u,
+			       int maxdepth,
+			       double depthweight,
+			       int *index,
+			       int *depth,
+			       double *prob)
+{
+  int i;
+  int n;
+  double sum;
+  double v;
+  double dv;
+  double value;
+  sum = 0.0;
+  for (i = 0; i <= maxdepth; i ++) {
+    sum += (double)multiset_int_double_depth_count(set, i) * pow((double)(i + 1), depthweight);
+  }
+
+  v = sum * u;
+  for (i = 0; i <= maxdepth; i ++) {
+    n = multiset_int_double_depth_count(set, i);
+    dv = (double)n * pow((double)(i + 1), depthweight);
+    if (v < dv) {
+      ck_assert(multiset_int_double_nth_element(set, i, (int)(v/dv * (double)n), index, &value) == 0);
+      *depth = i;
+      *prob = pow((double)(i + 1), depthweight)/sum;
+      return;
+    }
+    v -= dv;
+  }
+
+  ck_assert(0);
+}
+
+START_TEST (test_multiset_int_double_weighted)
+{
+  multiset_int_double_t *set;
+  double weights[] = {1.5, -0.5, 1.5};
+  int w;
+  int i;
+  int j;
+  int k;
+  int d;
+  int maxdepth;
+  int index;
+  int depth;
+  double prob;
+  int rindex;
+  int rdepth;
+  double rprob;
+  double u;
+
+  set = multiset_int_double_create();
+  ck_assert(set != NULL);
+
+  srand(42);
+
+  for (w = 0; w < sizeof(weights)/sizeof(double); w ++) {
+
+    for (j = 0; j < 20; j ++) {
+
+      for (i = 0; i < 500; i ++) {
+	d = rand() % 10;
+	k = rand() % 1000;
+	if (rand() % 4 == 0) {
+	  ck_assert(multiset_int_double_remove(set, k, d) >= 0);
+	} else {
+	  ck_assert(multiset_int_double_insert(set, k, d, (double)k) >= 0);
+	}
+      }
+
+      for (maxdepth = 3; maxdepth < 10; maxdepth += 6) {
+	for (i = 0; i < 100; i ++) {
+	  u = ((double)i + 0.37)/100.0;
+
+	  ck_assert(multiset_int_double_choose_index_weighted(set, u, maxdepth, weights[w], &index, &depth, &prob) == 0);
+	  weighted_reference(set, u, maxdepth, weights[w], &rindex, &rdepth, &rprob);
+
+	  ck_assert(index == rindex);
+	  ck_assert(depth == rdepth);
+	  ck_assert(fabs(prob - rprob) < 1.0e-12 * rprob);
+
+	  ck_assert(multiset_int_double_reverse_choose_index_weighted(set, maxdepth, weights[w], index, depth, &prob) == 0);
+	  ck_assert(fabs(prob - rprob) < 1.0e-12 * rprob);
+	}
+      }
+    }
+  }
+
+  multiset_int_double_destroy(set);
+}
+END_TEST
+
 Suite *
 multiset_int_double_suite (void)
 {
@@ -330,6 +430,7 @@ multiset_int_double_suite (void)
   tcase_add_test (tc_core, test_multiset_int_double_insert);
   tcase_add_test (tc_core, test_multiset_int_double_remove);
   tcase_add_test (tc_core, test_multiset_int_double_choice);
+  tcase_add_test (tc_core, test_multiset_int_double_weighted);
 
   tcase_add_test (tc_core, test_multiset_int_double_binary_readwrite);
   
@@ -38,6 +38,7 @@ icosahedron_create(int degree)
   double phi;
   double ax, ay, az, theta;
   double transform[16];
+  vertex3_t v;
   
   o = manifold_create(degree,
 		      icosahedron_nvertices,
@@ -378,29 +379,37 @@ icosahedron_create(int degree)
    * Rotate all vertices to align poles 
    */
   for (i = 0; i < 12; i ++) {
-    vertex3_transform(&(o->vertices[i]), transform);
+    v.x = o->vx[i];
+    v.y = o->vy[i];
+    v.z = o->vz[i];
+    
+    vertex3_transform(&v, transform);
+
+    o->vx[i] = v.x;
+    o->vy[i] = v.y;
+    o->vz[i] = v.z;
   }
 
   /*
    * Check north and south poles
    */
-  if (fabs(o->vertices[0].x) > 1.0e-9 ||
-      fabs(o->vertices[0].y) > 1.0e-9 ||
-      fabs(o->vertices[0].z - 1.0) > 1.0e-9) {
+  if (fabs(o->vx[0]) > 1.0e-9 ||
+      fabs(o->vy[0]) > 1.0e-9 ||
+      fabs(o->vz[0] - 1.0) > 1.0e-9) {
     ERROR("rotation failed to move vertex 0 to north pole (%g %g %g)",
-	  o->vertices[0].x,
-	  o->vertices[0].y,
-	  o->vertices[0].z);
+	  o->vx[0],
+	  o->vy[0],
+	  o->vz[0]);
     return NULL;
   }
     
-  if (fabs(o->vertices[1].x) > 1.0e-9 ||
-      fabs(o->vertices[1].y) > 1.0e-9 ||
-      fabs(o->vertices[1].z + 1.0) > 1.0e-9) {
+  if (fabs(o->vx[1]) > 1.0e-9 ||
+      fabs(o->vy[1]) > 1.0e-9 ||
+      fabs(o->vz[1] + 1.0) > 1.0e-9) {
     ERROR("rotation failed to move vertex 1 to south pole (%g %g %g)",
-	  o->vertices[1].x,
-	  o->vertices[1].y,
-	  o->vertices[1].z);
+	  o->vx[1],
+	  o->vy[1],
+	  o->vz[1]);
     return NULL;
   }
   
@@ -426,6 +435,17 @@ icosahedron_create(int degree)
   return o;
 }
 
+manifold_t *
+icosahedron_create_cached(int degree, const char *filename)
+{
+  return manifold_create_cached(filename,
+				degree,
+				icosahedron_create,
+				icosahedron_nvertices,
+				icosahedron_nedges,
+				icosahedron_ntriangles);
+}
+
 int 
 icosahedron_nvertices(int depth)
 {
@@ -475,10 +495,10 @@ icosahedron_angle(int depth)
   v2 = m->edges[depth][0].b;
 
   
-  vertex3_carttosph(m->vertices[v1].x, m->vertices[v1].y, m->vertices[v1].z,
+  vertex3_carttosph(m->vx[v1], m->vy[v1], m->vz[v1],
 		    &lon1, &lat1);
   
-  vertex3_carttosph(m->vertices[v2].x, m->vertices[v2].y, m->vertices[v2].z,
+  vertex3_carttosph(m->vx[v2], m->vy[v2], m->vz[v2],
 		    &lon2, &lat2);
 
   manifold_destroy(m);
@@ -21,13 +21,27 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 
 #include <math.h>
 
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
 #include "manifold.h"
 
 #include "slog.h"
 
+static void
+manifold_initialize_vertex(manifold_t *m, int vi);
+
+static int
+manifold_add_vertex_child(manifold_t *m, int pi, int ci);
+
+static int
+manifold_add_vertex_neighbor(manifold_t *m, int vi, int ni);
 
 manifold_t *
 manifold_create(int degree,
@@ -49,12 +63,43 @@ manifold_create(int degree,
   m->ntrianglesatdepth = ntrianglesatdepth;
 
   m->nvertices = m->nverticesatdepth(m->degree);
-  m->vertices = malloc(sizeof(vertex3_t) * m->nvertices);
-  if (m->vertices == NULL) {
-    ERROR("failed to allocate vertices");
+
+  m->vx = malloc(sizeof(double) * m->nvertices);
+  m->vy = malloc(sizeof(double) * m->nvertices);
+  m->vz = malloc(sizeof(double) * m->nvertices);
+  if (m->vx == NULL || m->vy == NULL || m->vz == NULL) {
+    ERROR("failed to allocate vertex coordinates");
+    return NULL;
+  }
+
+  m->vdepth = malloc(sizeof(int) * m->nvertices);
+  m->vparent = malloc(sizeof(int) * m->nvertices);
+  m->vchildren = malloc(sizeof(int[4]) * m->nvertices);
+  m->vv = malloc(sizeof(int[2]) * m->nvertices);
+  m->vf = malloc(sizeof(int[2]) * m->nvertices);
+  m->ve = malloc(sizeof(int[4]) * m->nvertices);
+  m->vn = malloc(sizeof(int[6]) * m->nvertices);
+  if (m->vdepth == NULL ||
+      m->vparent == NULL ||
+      m->vchildren == NULL ||
+      m->vv == NULL ||
+      m->vf == NULL ||
+      m->ve == NULL ||
+      m->vn == NULL) {
+    ERROR("failed to allocate vertex topology");
     return NULL;
   }
 
+  m->varea = malloc(sizeof(double) * m->nvertices);
+  if (m->varea == NULL) {
+    ERROR("failed to allocate vertex areas");
+    return NULL;
+  }
+
+  for (i = 0; i < m->nvertices; i ++) {
+    manifold_initialize_vertex(m, i);
+  }
+
   m->nedges = malloc(sizeof(int) * (degree + 1));
   if (m->nedges == NULL) {
     ERROR("failed to allocate nedges");
@@ -79,6 +124,9 @@ manifold_create(int degree,
     return NULL;
   }
 
+  m->mapping = NULL;
+  m->mapping_size = 0;
+
   m->ntotaltriangles = 0;
   for (i = 0; i <= degree; i ++) {
     m->nedges[i] = m->nedgesatdepth(i);
@@ -109,6 +157,15 @@ manifold_destroy(manifold_t *m)
   int i;
 
   if (m != NULL) {
+    if (m->mapping != NULL) {
+      /* Only the depth tables are private */
+      free(m->edges);
+      free(m->triangles);
+      munmap(m->mapping, m->mapping_size);
+      free(m);
+      return;
+    }
+    
     for (i = 0; i <= m->degree; i ++) {
       free(m->triangles[i]);
       free(m->edges[i]);
@@ -119,7 +176,19 @@ manifold_destroy(manifold_t *m)
     free(m->edges);
     free(m->nedges);
 
-    free(m->vertices);
+    free(m->vx);
+    free(m->vy);
+    free(m->vz);
+
+    free(m->vdepth);
+    free(m->vparent);
+    free(m->vchildren);
+    free(m->vv);
+    free(m->vf);
+    free(m->ve);
+    free(m->vn);
+
+    free(m->varea);
 
     free(m);
   }
@@ -130,10 +199,10 @@ int
 manifold_subdivide(manifold_t *m,
 		   int depth)
 {
-  vertex3_t *va, *vb;
-  vertex3_t *vm;
+  vertex3_t vm;
 
   int vi;
+  int va, vb;
   int ei;
   int ti;
   int i;
@@ -161,50 +230,55 @@ manifold_subdivide(manifold_t *m,
   for (i = 0; i < m->nedges[depth - 1]; i ++, vi ++) {
 
     /*
-     * Get references to the end points and midpoint vertex
+     * Get the end points of the edge
      */
-    va = &(m->vertices[m->edges[depth - 1][i].a]);
-    vb = &(m->vertices[m->edges[depth - 1][i].b]);
+    va = m->edges[depth - 1][i].a;
+    vb = m->edges[depth - 1][i].b;
 
-    vm = &(m->vertices[vi]);
-    vertex3_initialize(vm);
+    manifold_initialize_vertex(m, vi);
     
     /*
      * Find and normalize the midpoint
      */
-    vertex3_midpoint(va, vb, vm);
-    vertex3_normalize(vm);
-    vm->depth = depth;
+    vm.x = (m->vx[va] + m->vx[vb])/2.0;
+    vm.y = (m->vy[va] + m->vy[vb])/2.0;
+    vm.z = (m->vz[va] + m->vz[vb])/2.0;
+    vertex3_normalize(&vm);
+
+    m->vx[vi] = vm.x;
+    m->vy[vi] = vm.y;
+    m->vz[vi] = vm.z;
+    m->vdepth[vi] = depth;
 
     /*
      * Set the "v" vertices (easy)
      */
-    vm->v[0] = m->edges[depth - 1][i].a;
-    vm->v[1] = m->edges[depth - 1][i].b;
+    m->vv[vi][0] = va;
+    m->vv[vi][1] = vb;
 
     /*
      * Set the parent child relation ships
      */
-    if (va->depth == (depth - 1)) {
+    if (m->vdepth[va] == (depth - 1)) {
       /* vm is child of va */
-      if (vertex3_add_child(va, vi) < 0) {
+      if (manifold_add_vertex_child(m, va, vi) < 0) {
 	ERROR("failed to add child to parent vertex");
 	return -1;
       }
-      vm->parent = vm->v[0];
+      m->vparent[vi] = va;
     } else {
       /* vm is child of vb */
-      if (vertex3_add_child(vb, vi) < 0) {
+      if (manifold_add_vertex_child(m, vb, vi) < 0) {
 	ERROR("failed to add child to parent vertex");
 	return -1;
       }
-      vm->parent = vm->v[1];
+      m->vparent[vi] = vb;
     }
 
     /*
      * Set the f vertices
      */
-    if (manifold_get_edge_f_vertices(m, depth - 1, i, vm->f) < 0) {
+    if (manifold_get_edge_f_vertices(m, depth - 1, i, m->vf[vi]) < 0) {
       ERROR("failed to generate f vertices");
       return -1;
     }
@@ -212,7 +286,7 @@ manifold_subdivide(manifold_t *m,
     /*
      * Set the e vertices
      */
-    if (manifold_get_edge_e_vertices(m, depth - 1, i, vm->e) < 0) {
+    if (manifold_get_edge_e_vertices(m, depth - 1, i, m->ve[vi]) < 0) {
       ERROR("failed to generate e vertices");
       return -1;
     }
@@ -403,11 +477,11 @@ manifold_build_neighbors(manifold_t *m)
     v0 = m->edges[m->degree][j].a;
     v1 = m->edges[m->degree][j].b;
       
-    if (vertex3_add_neighbor(&(m->vertices[v0]), v1) < 0) {
+    if (manifold_add_vertex_neighbor(m, v0, v1) < 0) {
       return -1;
     }
       
-    if (vertex3_add_neighbor(&(m->vertices[v1]), v0) < 0) {
+    if (manifold_add_vertex_neighbor(m, v1, v0) < 0) {
       return -1;
     }
 
@@ -435,14 +509,14 @@ manifold_compute_areas(manifold_t *m,
     for (i = 0; i < m->ntriangles[depth]; i ++) {
 
       a = triangle_area(&(m->triangles[depth][i]),
-			m->vertices);
+			m->vx, m->vy, m->vz);
       m->triangles[depth][i].area = a;
       
       total_area += a;
 
-      m->vertices[m->triangles[depth][i].a].area += a/3.0;
-      m->vertices[m->triangles[depth][i].b].area += a/3.0;
-      m->vertices[m->triangles[depth][i].c].area += a/3.0;
+      m->varea[m->triangles[depth][i].a] += a/3.0;
+      m->varea[m->triangles[depth][i].b] += a/3.0;
+      m->varea[m->triangles[depth][i].c] += a/3.0;
       
     }
 
@@ -454,41 +528,41 @@ manifold_compute_areas(manifold_t *m,
     vend = m->nverticesatdepth(depth + 1);
 
     for (i = vstart; i < vend; i ++) {
-      a = m->vertices[i].area;
+      a = m->varea[i];
 
-      if (m->vertices[i].v[0] < 0 ||
-	  m->vertices[i].v[1] < 0) {
+      if (m->vv[i][0] < 0 ||
+	  m->vv[i][1] < 0) {
 	ERROR("v vertices unset");
 	return -1;
       }
-      m->vertices[m->vertices[i].v[0]].area += a/2.0;
-      m->vertices[m->vertices[i].v[1]].area += a/2.0;
+      m->varea[m->vv[i][0]] += a/2.0;
+      m->varea[m->vv[i][1]] += a/2.0;
       
-      if (m->vertices[i].f[0] < 0 ||
-	  m->vertices[i].f[1] < 0) {
+      if (m->vf[i][0] < 0 ||
+	  m->vf[i][1] < 0) {
 	ERROR("f vertices unset");
 	return -1;
       }
-      m->vertices[m->vertices[i].f[0]].area += a/4.0;
-      m->vertices[m->vertices[i].f[1]].area += a/4.0;
+      m->varea[m->vf[i][0]] += a/4.0;
+      m->varea[m->vf[i][1]] += a/4.0;
 
-      if (m->vertices[i].e[0] < 0 ||
-	  m->vertices[i].e[1] < 0 ||
-	  m->vertices[i].e[2] < 0 ||
-	  m->vertices[i].e[3] < 0) {
+      if (m->ve[i][0] < 0 ||
+	  m->ve[i][1] < 0 ||
+	  m->ve[i][2] < 0 ||
+	  m->ve[i][3] < 0) {
 	ERROR("e vertices unset");
 	return -1;
       }
-      m->vertices[m->vertices[i].e[0]].area -= a/16.0;
-      m->vertices[m->vertices[i].e[1]].area -= a/16.0;
-      m->vertices[m->vertices[i].e[2]].area -= a/16.0;
-      m->vertices[m->vertices[i].e[3]].area -= a/16.0;
+      m->varea[m->ve[i][0]] -= a/16.0;
+      m->varea[m->ve[i][1]] -= a/16.0;
+      m->varea[m->ve[i][2]] -= a/16.0;
+      m->varea[m->ve[i][3]] -= a/16.0;
     }
 
     for (i = vstart; i < vend; i ++) {
-      m->vertices[i].area =
-	m->vertices[i].area/
-	(m->vertices[m->vertices[i].v[0]].area + m->vertices[m->vertices[i].v[1]].area);
+      m->varea[i] =
+	m->varea[i]/
+	(m->varea[m->vv[i][0]] + m->varea[m->vv[i][1]]);
     }
 
     /*
@@ -533,7 +607,7 @@ manifold_save_geo(manifold_t *m,
   for (i = 0; i < m->nvertices; i ++) {
 
     fprintf(fp, "%f %f %f 1.0\n", 
-	    m->vertices[i].x, m->vertices[i].y, m->vertices[i].z);
+	    m->vx[i], m->vy[i], m->vz[i]);
     
   }
 
@@ -556,6 +630,321 @@ manifold_save_geo(manifold_t *m,
   return 0;
 }
 
+/*
+ * Manifold cache
+ */
+#define MANIFOLD_CACHE_MAGIC "MANIFOLD"
+#define MANIFOLD_CACHE_VERSION 1
+#define MANIFOLD_CACHE_ALIGN 64
+
+typedef struct {
+  char magic[8];
+  int version;
+  int degree;
+  int nvertices;
+  int ntotaltriangles;
+  int edge_size;
+  int triangle_size;
+  int64_t length;
+} manifold_cache_header_t;
+
+typedef struct {
+  const void *data;
+  size_t offset;
+  size_t size;
+} manifold_cache_section_t;
+
+static size_t
+manifold_cache_align(size_t offset)
+{
+  return (offset + MANIFOLD_CACHE_ALIGN - 1) & ~((size_t)MANIFOLD_CACHE_ALIGN - 1);
+}
+
+/*
+ * The one place the section order is defined. Records each section when
+ * sections is non-NULL and, when base is non-NULL, points the manifold
+ * arrays into base as it goes (the depth counts come first so the later
+ * sizes are read from the mapping, and are checked against the count
+ * functions before use). Every section must end within limit. Returns the
+ * number of sections or -1.
+ */
+#define MANIFOLD_CACHE_SECTION(field, bytes)		\
+  do {							\
+    length = manifold_cache_align(length);		\
+    if (length > limit || (bytes) > limit - length) {	\
+      return -1;					\
+    }							\
+    if (base != NULL) {					\
+      m->field = (void *)(base + length);		\
+    }							\
+    if (sections != NULL) {				\
+      sections[n].data = m->field;			\
+      sections[n].offset = length;			\
+      sections[n].size = (bytes);			\
+    }							\
+    length += (bytes);					\
+    n ++;						\
+  } while (0)
+
+static int
+manifold_cache_layout(manifold_t *m,
+		      char *base,
+		      manifold_cache_section_t *sections,
+		      size_t limit,
+		      size_t *total)
+{
+  size_t length;
+  size_t nv;
+  int n;
+  int d;
+
+  length = sizeof(manifold_cache_header_t);
+  n = 0;
+  nv = (size_t)m->nvertices;
+
+  MANIFOLD_CACHE_SECTION(nedges, sizeof(int) * (m->degree + 1));
+  MANIFOLD_CACHE_SECTION(ntriangles, sizeof(int) * (m->degree + 1));
+
+  MANIFOLD_CACHE_SECTION(vx, sizeof(double) * nv);
+  MANIFOLD_CACHE_SECTION(vy, sizeof(double) * nv);
+  MANIFOLD_CACHE_SECTION(vz, sizeof(double) * nv);
+
+  MANIFOLD_CACHE_SECTION(vdepth, sizeof(int) * nv);
+  MANIFOLD_CACHE_SECTION(vparent, sizeof(int) * nv);
+  MANIFOLD_CACHE_SECTION(vchildren, sizeof(int[4]) * nv);
+  MANIFOLD_CACHE_SECTION(vv, sizeof(int[2]) * nv);
+  MANIFOLD_CACHE_SECTION(vf, sizeof(int[2]) * nv);
+  MANIFOLD_CACHE_SECTION(ve, sizeof(int[4]) * nv);
+  MANIFOLD_CACHE_SECTION(vn, sizeof(int[6]) * nv);
+
+  MANIFOLD_CACHE_SECTION(varea, sizeof(double) * nv);
+
+  if (base != NULL) {
+    for (d = 0; d <= m->degree; d ++) {
+      if (m->nedges[d] != m->nedgesatdepth(d) ||
+	  m->ntriangles[d] != m->ntrianglesatdepth(d)) {
+	ERROR("wrong counts at depth %d", d);
+	return -1;
+      }
+    }
+  }
+
+  for (d = 0; d <= m->degree; d ++) {
+    MANIFOLD_CACHE_SECTION(edges[d], sizeof(edge_t) * (size_t)m->nedges[d]);
+  }
+
+  for (d = 0; d <= m->degree; d ++) {
+    MANIFOLD_CACHE_SECTION(triangles[d], sizeof(triangle_t) * (size_t)m->ntriangles[d]);
+  }
+
+  *total = length;
+  return n;
+}
+
+#undef MANIFOLD_CACHE_SECTION
+
+int
+manifold_save(const manifold_t *m,
+	      const char *filename)
+{
+  static const char zero[MANIFOLD_CACHE_ALIGN] = {0};
+  manifold_cache_header_t header;
+  manifold_cache_section_t *sections;
+  size_t length;
+  size_t offset;
+  int nsections;
+  int i;
+  FILE *fp;
+
+  sections = malloc(sizeof(manifold_cache_section_t) * (13 + 2 * (m->degree + 1)));
+  if (sections == NULL) {
+    ERROR("failed to allocate sections");
+    return -1;
+  }
+
+  nsections = manifold_cache_layout((manifold_t *)m, NULL, sections, SIZE_MAX, &length);
+  if (nsections < 0) {
+    ERROR("manifold too large to save");
+    free(sections);
+    return -1;
+  }
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, MANIFOLD_CACHE_MAGIC, sizeof(header.magic));
+  header.version = MANIFOLD_CACHE_VERSION;
+  header.degree = m->degree;
+  header.nvertices = m->nvertices;
+  header.ntotaltriangles = m->ntotaltriangles;
+  header.edge_size = sizeof(edge_t);
+  header.triangle_size = sizeof(triangle_t);
+  header.length = (int64_t)length;
+
+  fp = fopen(filename, "wb");
+  if (fp == NULL) {
+    ERROR("failed to create file %s", filename);
+    free(sections);
+    return -1;
+  }
+
+  if (fwrite(&header, sizeof(header), 1, fp) != 1) {
+    ERROR("failed to write header");
+    fclose(fp);
+    free(sections);
+    return -1;
+  }
+  offset = sizeof(header);
+  
+  for (i = 0; i < nsections; i ++) {
+    if (fwrite(zero, 1, sections[i].offset - offset, fp) != sections[i].offset - offset ||
+	fwrite(sections[i].data, 1, sections[i].size, fp) != sections[i].size) {
+      ERROR("failed to write section %d", i);
+      fclose(fp);
+      free(sections);
+      return -1;
+    }
+    offset = sections[i].offset + sections[i].size;
+  }
+
+  free(sections);
+  
+  if (fclose(fp) != 0) {
+    ERROR("failed to close file %s", filename);
+    return -1;
+  }
+
+  return 0;
+}
+
+manifold_t *
+manifold_map(const char *filename,
+	     vertex_count_t nverticesatdepth,
+	     edge_count_t nedgesatdepth,
+	     triangle_count_t ntrianglesatdepth)
+{
+  const manifold_cache_header_t *header;
+  struct stat st;
+  manifold_t *m;
+  size_t length;
+  void *base;
+  int fd;
+
+  fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    ERROR("failed to open %s", filename);
+    return NULL;
+  }
+
+  if (fstat(fd, &st) < 0 ||
+      st.st_size < (off_t)sizeof(manifold_cache_header_t)) {
+    ERROR("invalid manifold cache %s", filename);
+    close(fd);
+    return NULL;
+  }
+
+  base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    ERROR("failed to map %s", filename);
+    return NULL;
+  }
+
+  /*
+   * The degree is checked against the space its depth counts need before
+   * anything is sized from it.
+   */
+  header = (const manifold_cache_header_t *)base;
+  if (memcmp(header->magic, MANIFOLD_CACHE_MAGIC, sizeof(header->magic)) != 0 ||
+      header->version != MANIFOLD_CACHE_VERSION ||
+      header->edge_size != sizeof(edge_t) ||
+      header->triangle_size != sizeof(triangle_t) ||
+      header->length != (int64_t)st.st_size ||
+      header->degree < 0 ||
+      (size_t)header->degree + 1 > (size_t)st.st_size/(2 * sizeof(int)) ||
+      header->nvertices <= 0 ||
+      header->nvertices != nverticesatdepth(header->degree)) {
+    ERROR("manifold cache %s does not match", filename);
+    munmap(base, st.st_size);
+    return NULL;
+  }
+
+  m = malloc(sizeof(manifold_t));
+  if (m == NULL) {
+    ERROR("failed to allocate manifold");
+    munmap(base, st.st_size);
+    return NULL;
+  }
+
+  m->degree = header->degree;
+  m->nverticesatdepth = nverticesatdepth;
+  m->nedgesatdepth = nedgesatdepth;
+  m->ntrianglesatdepth = ntrianglesatdepth;
+  m->nvertices = header->nvertices;
+  m->ntotaltriangles = header->ntotaltriangles;
+
+  m->mapping = base;
+  m->mapping_size = st.st_size;
+
+  m->edges = malloc(sizeof(edge_t*) * (m->degree + 1));
+  m->triangles = malloc(sizeof(triangle_t*) * (m->degree + 1));
+  if (m->edges == NULL || m->triangles == NULL) {
+    ERROR("failed to allocate depth tables");
+    manifold_destroy(m);
+    return NULL;
+  }
+
+  if (manifold_cache_layout(m, (char *)base, NULL, m->mapping_size, &length) < 0 ||
+      length != m->mapping_size) {
+    ERROR("manifold cache %s has inconsistent layout", filename);
+    manifold_destroy(m);
+    return NULL;
+  }
+
+  return m;
+}
+
+manifold_t *
+manifold_create_cached(const char *filename,
+		       int degree,
+		       manifold_t *(*create)(int),
+		       vertex_count_t nverticesatdepth,
+		       edge_count_t nedgesatdepth,
+		       triangle_count_t ntrianglesatdepth)
+{
+  manifold_t *m;
+  char *tmp;
+  
+  if (access(filename, R_OK) == 0) {
+    m = manifold_map(filename, nverticesatdepth, nedgesatdepth, ntrianglesatdepth);
+    if (m != NULL && m->degree == degree) {
+      return m;
+    }
+
+    manifold_destroy(m);
+    WARNING("rebuilding manifold cache %s", filename);
+  }
+
+  m = create(degree);
+  if (m == NULL) {
+    return NULL;
+  }
+
+  tmp = malloc(strlen(filename) + 32);
+  if (tmp == NULL) {
+    ERROR("failed to allocate file name");
+    return m;
+  }
+  
+  sprintf(tmp, "%s.%d", filename, (int)getpid());
+  if (manifold_save(m, tmp) < 0 ||
+      rename(tmp, filename) < 0) {
+    ERROR("failed to write manifold cache %s", filename);
+    remove(tmp);
+  }
+  free(tmp);
+
+  return m;
+}
+
 int
 manifold_get_child_vertices(manifold_t *m, int pi, int *ci)
 {
@@ -568,10 +957,10 @@ manifold_get_child_vertices(manifold_t *m, int pi, int *ci)
   }
 
   for (i = 0; i < 4; i ++) {
-    if (m->vertices[pi].children[i] < 0) {
+    if (m->vchildren[pi][i] < 0) {
       break;
     }
-    ci[i] = m->vertices[pi].children[i];
+    ci[i] = m->vchildren[pi][i];
   }
 
   return i;
@@ -586,7 +975,62 @@ manifold_get_parent(manifold_t *m, int ci)
     return -1;
   }
 
-  return m->vertices[ci].parent;
+  return m->vparent[ci];
+}
+
+int
+manifold_get_vertex(const manifold_t *m, int vi, vertex3_t *v)
+{
+  int i;
+  
+  if (m == NULL || v == NULL ||
+      vi < 0 || vi >= m->nvertices) {
+    ERROR("invalid parameters");
+    return -1;
+  }
+
+  v->x = m->vx[vi];
+  v->y = m->vy[vi];
+  v->z = m->vz[vi];
+
+  v->depth = m->vdepth[vi];
+  v->parent = m->vparent[vi];
+  for (i = 0; i < 4; i ++) {
+    v->children[i] = m->vchildren[vi][i];
+  }
+
+  v->v[0] = m->vv[vi][0];
+  v->v[1] = m->vv[vi][1];
+  v->f[0] = m->vf[vi][0];
+  v->f[1] = m->vf[vi][1];
+  for (i = 0; i < 4; i ++) {
+    v->e[i] = m->ve[vi][i];
+  }
+
+  for (i = 0; i < 6; i ++) {
+    v->n[i] = m->vn[vi][i];
+  }
+
+  v->area = m->varea[vi];
+
+  return 0;
+}
+
+int
+manifold_get_vertex_position(const manifold_t *m, int vi,
+			     double *x, double *y, double *z)
+{
+  if (m == NULL ||
+      vi < 0 || vi >= m->nvertices) {
+    ERROR("invalid parameters");
+    return -1;
+  }
+
+  *x = m->vx[vi];
+  *y = m->vy[vi];
+  *z = m->vz[vi];
+
+  return 0;
 }
 
 /*
@@ -622,7 +1066,7 @@ manifold_find_enclosing_triangle(manifold_t *m,
   for (i = 0; i < m->ntriangles[0]; i ++) {
     if (triangle_point_in_triangle(workspace,
 				   &(m->triangles[0][i]),
-				   m->vertices,
+				   m->vx, m->vy, m->vz,
 				   px, py, pz,
 				   &ta, &tb, &tc,
 				   DEFAULT_TRIANGLE_EPSILON)) {
@@ -649,7 +1093,7 @@ manifold_find_enclosing_triangle(manifold_t *m,
       for (i = 0; i < 4; i ++) {
 	if (triangle_point_in_triangle(workspace,
 				       &(m->triangles[depth + 1][m->triangles[depth][t].child_triangles[i]]),
-				       m->vertices,
+				       m->vx, m->vy, m->vz,
 				       px, py, pz,
 				       &ta, &tb, &tc,
 				       epsilon)) {
@@ -668,7 +1112,7 @@ manifold_find_enclosing_triangle(manifold_t *m,
     /*   for (i = 0; i < 4; i ++) { */
     /* 	ct = triangle_point_in_triangle(workspace, */
     /* 					&(m->triangles[depth + 1][m->triangles[depth][t].child_triangles[i]]), */
-    /* 					m->vertices, */
+    /* 					m->vx, m->vy, m->vz, */
     /* 					px, py, pz, */
     /* 					&ta, &tb, &tc); */
     /* 	ERROR("    %20.17f %20.17f %20.17f %d\n", ta, tb, tc, ct); */
@@ -747,27 +1191,29 @@ manifold_set_vertex(manifold_t *m,
 		    int depth,
 		    int normalize)
 {
-  vertex3_t *v;
+  vertex3_t v;
 
   if (m == NULL ||
       vi < 0 || vi >= m->nvertices) {
     return -1;
   }
 
-  v = m->vertices + vi;
-
-  vertex3_initialize(v);
-
-  v->x = x;
-  v->y = y;
-  v->z = z;
+  manifold_initialize_vertex(m, vi);
 
-  v->depth = depth;
+  v.x = x;
+  v.y = y;
+  v.z = z;
 
   if (normalize) {
-    vertex3_normalize(v);
+    vertex3_normalize(&v);
   }
 
+  m->vx[vi] = v.x;
+  m->vy[vi] = v.y;
+  m->vz[vi] = v.z;
+
+  m->vdepth[vi] = depth;
+
   return 0;
 }
 
@@ -1092,8 +1538,84 @@ manifold_area_for_depth(manifold_t *m,
 
   a = 0.0;
   for (i = vstart; i < vend; i ++) {
-    a += m->vertices[i].area;
+    a += m->varea[i];
   }
 
   return a;
 }
+
+static void
+manifold_initialize_vertex(manifold_t *m, int vi)
+{
+  int i;
+  
+  m->vx[vi] = 0.0;
+  m->vy[vi] = 0.0;
+  m->vz[vi] = 0.0;
+
+  m->vdepth[vi] = -1;
+  m->vparent[vi] = -1;
+  for (i = 0; i < 4; i ++) {
+    m->vchildren[vi][i] = -1;
+  }
+
+  m->vv[vi][0] = -1;
+  m->vv[vi][1] = -1;
+  m->vf[vi][0] = -1;
+  m->vf[vi][1] = -1;
+  for (i = 0; i < 4; i ++) {
+    m->ve[vi][i] = -1;
+  }
+
+  for (i = 0; i < 6; i ++) {
+    m->vn[vi][i] = -1;
+  }
+
+  m->varea[vi] = 0.0;
+}
+
+static int
+manifold_add_vertex_child(manifold_t *m, int pi, int ci)
+{
+  int i;
+  
+  if (ci < 0) {
+    ERROR("invalid parameters (%d %d)", pi, ci);
+    return -1;
+  }
+
+  for (i = 0; i < 4; i ++) {
+    if (m->vchildren[pi][i] < 0) {
+      m->vchildren[pi][i] = ci;
+      return 0;
+    }
+  }
+
+  ERROR("no empty slots");
+  return -1;
+}
+
+static int
+manifold_add_vertex_neighbor(manifold_t *m, int vi, int ni)
+{
+  int i;
+
+  for (i = 0; i < 6; i ++) {
+
+    if (m->vn[vi][i] < 0) {
+      m->vn[vi][i] = ni;
+      return 0;
+    }
+
+    if (m->vn[vi][i] == ni) {
+      ERROR("neighbor already present");
+      return -1;
+    }
+  }
+
+  ERROR("neighbors full (adding %d)", ni);
+  for (i = 0; i < 6; i ++ ) {
+    ERROR("  %d", m->vn[vi][i]);
+  }
+  return -1;
+}
@@ -21,6 +21,8 @@
 #ifndef manifold_h
 #define manifold_h
 
+#include <stddef.h>
+
 #include "vertex3.h"
 #include "edge.h"
 #include "triangle.h"
@@ -44,9 +46,28 @@ struct _manifold {
   edge_count_t nedgesatdepth;
   triangle_count_t ntrianglesatdepth;
 
-  /* Vertices are index from 0 .. total number of vertices across all depths */
+  /* 
+   * Vertices are index from 0 .. total number of vertices across all depths
+   * and stored as separate arrays so that transforms and point lookups only
+   * touch the fields they use. The fields match those of vertex3_t.
+   */
   int nvertices;
-  vertex3_t *vertices;
+
+  double *vx;
+  double *vy;
+  double *vz;
+
+  int *vdepth;
+  int *vparent;
+  int (*vchildren)[4];
+
+  int (*vv)[2];
+  int (*vf)[2];
+  int (*ve)[4];
+
+  int (*vn)[6];
+
+  double *varea;
 
   /* Edges and triangles are index by (depth, 0..number of edges/triangles per depth - 1) */
   int *nedges;
@@ -55,6 +76,10 @@ struct _manifold {
   int ntotaltriangles;
   int *ntriangles;
   triangle_t **triangles;
+
+  /* Read only file mapping the arrays point into (see manifold_map) or NULL */
+  void *mapping;
+  size_t mapping_size;
 };
 
 manifold_t *
@@ -81,6 +106,37 @@ int
 manifold_save_geo(manifold_t *m,
 		  const char *filename);
 
+/*
+ * Binary cache of a complete manifold (all depths, neighbours and areas) in
+ * native byte order with every array 64 byte aligned, so that it can be
+ * mapped in place. A mapped manifold shares its pages with every other
+ * process mapping the same file and is read only: it must not be passed to
+ * manifold_subdivide, manifold_compute_areas or the other construction
+ * functions. manifold_destroy unmaps it.
+ */
+int
+manifold_save(const manifold_t *m,
+	      const char *filename);
+
+manifold_t *
+manifold_map(const char *filename,
+	     vertex_count_t nverticesatdepth,
+	     edge_count_t nedgesatdepth,
+	     triangle_count_t ntrianglesatdepth);
+
+/*
+ * Maps filename if it holds a manifold of this degree, otherwise builds it
+ * with create and writes the cache (via a temporary file and rename so
+ * concurrent readers never see a partial file).
+ */
+manifold_t *
+manifold_create_cached(const char *filename,
+		       int degree,
+		       manifold_t *(*create)(int),
+		       vertex_count_t nverticesatdepth,
+		       edge_count_t nedgesatdepth,
+		       triangle_count_t ntrianglesatdepth);
+
 int
 manifold_valid(manifold_t *m);
 
@@ -90,6 +146,16 @@ manifold_get_children_vertices(manifold_t *m, int pi, int *ci);
 int
 manifold_get_parent(manifold_t *m, int ci);
 
+/*
+ * Vertex accessors
+ */
+int
+manifold_get_vertex(const manifold_t *m, int vi, vertex3_t *v);
+
+int
+manifold_get_vertex_position(const manifold_t *m, int vi,
+			     double *x, double *y, double *z);
+
 /*
  * Lookup functions
  */
@@ -0,0 +1,473 @@
+//
+//    Spherical Subdivision/Wavelet library
+//    
+//    Copyright (C) 2014 - 2018 Rhys Hawkins
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "manifold_locator.h"
+
+#include "slog.h"
+
+struct _manifold_locator {
+  int resolution;
+  int ncells;
+  int ntriangles;
+
+  /* Per triangle : b x c, c x a and a x b each scaled by 1/det(a, b, c) */
+  double (*plane)[9];
+
+  /* Candidate triangles of each cell */
+  int *cell_start;
+  int *cell_triangle;
+};
+
+/* Cells are widened by this much (in gnomonic units) to keep edges conservative */
+static const double LOCATOR_MARGIN = 1.0e-9;
+
+static int
+locator_face_coordinates(int face,
+			 double x, double y, double z,
+			 double *u, double *v);
+
+static int
+locator_cell_coordinate(const manifold_locator_t *l, double u);
+
+static int
+locator_point_cell(const manifold_locator_t *l,
+		   double x, double y, double z);
+
+static void
+locator_visit_triangle(manifold_locator_t *l,
+		       const manifold_t *m,
+		       int ti,
+		       int *cursor);
+
+static int
+locator_locate(const manifold_locator_t *l,
+	       double lon, double lat,
+	       int *ti,
+	       double *ba, double *bb, double *bc);
+
+manifold_locator_t *
+manifold_locator_create(const manifold_t *m,
+			int resolution)
+{
+  manifold_locator_t *l;
+  const triangle_t *t;
+  int *cursor;
+  int i;
+  double n[3][3];
+  double den;
+  int j;
+
+  if (m == NULL) {
+    ERROR("null manifold");
+    return NULL;
+  }
+
+  l = malloc(sizeof(manifold_locator_t));
+  if (l == NULL) {
+    ERROR("failed to allocate locator");
+    return NULL;
+  }
+
+  l->ntriangles = m->ntriangles[m->degree];
+
+  if (resolution <= 0) {
+    resolution = (int)ceil(sqrt((double)l->ntriangles/6.0));
+  }
+  l->resolution = resolution;
+  l->ncells = 6 * resolution * resolution;
+
+  l->plane = malloc(sizeof(double[9]) * l->ntriangles);
+  l->cell_start = malloc(sizeof(int) * (l->ncells + 1));
+  l->cell_triangle = NULL;
+  if (l->plane == NULL || l->cell_start == NULL) {
+    ERROR("failed to allocate locator tables");
+    manifold_locator_destroy(l);
+    return NULL;
+  }
+
+  /*
+   * Scaled edge planes : the barycentre coordinates of a point are then
+   * three dot products.
+   */
+  for (i = 0; i < l->ntriangles; i ++) {
+    t = &(m->triangles[m->degree][i]);
+
+    vertex3_cross(m->vx[t->b], m->vy[t->b], m->vz[t->b],
+		  m->vx[t->c], m->vy[t->c], m->vz[t->c],
+		  &(n[0][0]), &(n[0][1]), &(n[0][2]));
+    vertex3_cross(m->vx[t->c], m->vy[t->c], m->vz[t->c],
+		  m->vx[t->a], m->vy[t->a], m->vz[t->a],
+		  &(n[1][0]), &(n[1][1]), &(n[1][2]));
+    vertex3_cross(m->vx[t->a], m->vy[t->a], m->vz[t->a],
+		  m->vx[t->b], m->vy[t->b], m->vz[t->b],
+		  &(n[2][0]), &(n[2][1]), &(n[2][2]));
+
+    den = m->vx[t->a]*n[0][0] + m->vy[t->a]*n[0][1] + m->vz[t->a]*n[0][2];
+    if (den == 0.0) {
+      ERROR("degenerate triangle %d", i);
+      manifold_locator_destroy(l);
+      return NULL;
+    }
+
+    for (j = 0; j < 9; j ++) {
+      l->plane[i][j] = n[j/3][j%3]/den;
+    }
+  }
+
+  /*
+   * Count, prefix sum and fill the candidate lists
+   */
+  memset(l->cell_start, 0, sizeof(int) * (l->ncells + 1));
+  for (i = 0; i < l->ntriangles; i ++) {
+    locator_visit_triangle(l, m, i, NULL);
+  }
+
+  for (i = 0; i < l->ncells; i ++) {
+    l->cell_start[i + 1] += l->cell_start[i];
+  }
+
+  l->cell_triangle = malloc(sizeof(int) * (l->cell_start[l->ncells] + 1));
+  cursor = malloc(sizeof(int) * l->ncells);
+  if (l->cell_triangle == NULL || cursor == NULL) {
+    ERROR("failed to allocate candidate lists");
+    free(cursor);
+    manifold_locator_destroy(l);
+    return NULL;
+  }
+
+  memcpy(cursor, l->cell_start, sizeof(int) * l->ncells);
+  for (i = 0; i < l->ntriangles; i ++) {
+    locator_visit_triangle(l, m, i, cursor);
+  }
+
+  free(cursor);
+  return l;
+}
+
+void
+manifold_locator_destroy(manifold_locator_t *l)
+{
+  if (l != NULL) {
+    free(l->plane);
+    free(l->cell_start);
+    free(l->cell_triangle);
+    free(l);
+  }
+}
+
+int
+manifold_locator_find_enclosing_triangle(const manifold_locator_t *l,
+					 double lon, double lat,
+					 int *ti,
+					 double *ba, double *bb, double *bc)
+{
+  return locator_locate(l, lon, lat, ti, ba, bb, bc);
+}
+
+int
+manifold_locator_find_enclosing_triangles(const manifold_locator_t *l,
+					  int npoints,
+					  const double *lon,
+					  const double *lat,
+					  int *ti,
+					  double *ba, double *bb, double *bc)
+{
+  int i;
+
+  for (i = 0; i < npoints; i ++) {
+    if (locator_locate(l, lon[i], lat[i], ti + i, ba + i, bb + i, bc + i) < 0) {
+      ERROR("failed to locate point %d (%f %f)", i, lon[i], lat[i]);
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+/*
+ * Faces are +x, -x, +y, -y, +z, -z. Returns 0 with the gnomonic coordinates
+ * if the point is in the open hemisphere of the face, -1 otherwise.
+ */
+static int
+locator_face_coordinates(int face,
+			 double x, double y, double z,
+			 double *u, double *v)
+{
+  double p[3];
+  double d;
+  int axis;
+
+  p[0] = x;
+  p[1] = y;
+  p[2] = z;
+
+  axis = face >> 1;
+  d = (face & 1) ? -p[axis] : p[axis];
+  if (d <= 0.0) {
+    return -1;
+  }
+
+  *u = p[(axis + 1) % 3]/d;
+  *v = p[(axis + 2) % 3]/d;
+
+  return 0;
+}
+
+static int
+locator_cell_coordinate(const manifold_locator_t *l, double u)
+{
+  double c;
+
+  c = floor((u + 1.0) * 0.5 * (double)l->resolution);
+
+  if (c < 0.0) {
+    return 0;
+  }
+
+  if (c >= (double)l->resolution) {
+    return l->resolution - 1;
+  }
+
+  return (int)c;
+}
+
+static int
+locator_point_cell(const manifold_locator_t *l,
+		   double x, double y, double z)
+{
+  int face;
+  double u;
+  double v;
+
+  if (fabs(x) >= fabs(y) && fabs(x) >= fabs(z)) {
+    face = (x < 0.0) ? 1 : 0;
+  } else if (fabs(y) >= fabs(z)) {
+    face = (y < 0.0) ? 3 : 2;
+  } else {
+    face = (z < 0.0) ? 5 : 4;
+  }
+
+  if (locator_face_coordinates(face, x, y, z, &u, &v) < 0) {
+    return -1;
+  }
+
+  return (face * l->resolution + locator_cell_coordinate(l, v)) * l->resolution +
+    locator_cell_coordinate(l, u);
+}
+
+/*
+ * Gnomonic projection maps great circle arcs to straight lines, so the part
+ * of a triangle in a face's hemisphere projects to the convex hull of its
+ * projected vertices and, for edges leaving the hemisphere, rays towards
+ * the boundary crossings. The bounding box of these is conservative.
+ */
+static void
+locator_visit_triangle(manifold_locator_t *l,
+		       const manifold_t *m,
+		       int ti,
+		       int *cursor)
+{
+  const triangle_t *t;
+  double p[3][3];
+  double d[3];
+  double r[3];
+  int vi[3];
+  double umin, umax;
+  double vmin, vmax;
+  double u, v;
+  int face;
+  int axis;
+  int npos;
+  int imin, imax;
+  int jmin, jmax;
+  int i;
+  int j;
+  int c;
+
+  t = &(m->triangles[m->degree][ti]);
+  vi[0] = t->a;
+  vi[1] = t->b;
+  vi[2] = t->c;
+
+  for (i = 0; i < 3; i ++) {
+    p[i][0] = m->vx[vi[i]];
+    p[i][1] = m->vy[vi[i]];
+    p[i][2] = m->vz[vi[i]];
+  }
+
+  for (face = 0; face < 6; face ++) {
+
+    axis = face >> 1;
+
+    npos = 0;
+    for (i = 0; i < 3; i ++) {
+      d[i] = (face & 1) ? -p[i][axis] : p[i][axis];
+      if (d[i] > 0.0) {
+	npos ++;
+      }
+    }
+
+    if (npos == 0) {
+      continue;
+    }
+
+    umin = vmin = 2.0;
+    umax = vmax = -2.0;
+    
+    for (i = 0; i < 3; i ++) {
+      if (d[i] > 0.0) {
+	locator_face_coordinates(face, p[i][0], p[i][1], p[i][2], &u, &v);
+	if (u < umin) umin = u;
+	if (u > umax) umax = u;
+	if (v < vmin) vmin = v;
+	if (v > vmax) vmax = v;
+      } else {
+	/* Rays towards where the edges to the positive vertices cross d = 0 */
+	for (j = 0; j < 3; j ++) {
+	  if (d[j] > 0.0) {
+	    r[0] = d[j]*p[i][0] - d[i]*p[j][0];
+	    r[1] = d[j]*p[i][1] - d[i]*p[j][1];
+	    r[2] = d[j]*p[i][2] - d[i]*p[j][2];
+
+	    u = r[(axis + 1) % 3];
+	    v = r[(axis + 2) % 3];
+	    if (u > 0.0) umax = 2.0;
+	    if (u < 0.0) umin = -2.0;
+	    if (v > 0.0) vmax = 2.0;
+	    if (v < 0.0) vmin = -2.0;
+	  }
+	}
+      }
+    }
+
+    umin -= LOCATOR_MARGIN;
+    vmin -= LOCATOR_MARGIN;
+    umax += LOCATOR_MARGIN;
+    vmax += LOCATOR_MARGIN;
+
+    if (umax < -1.0 || umin > 1.0 ||
+	vmax < -1.0 || vmin > 1.0) {
+      continue;
+    }
+
+    imin = locator_cell_coordinate(l, umin);
+    imax = locator_cell_coordinate(l, umax);
+    jmin = locator_cell_coordinate(l, vmin);
+    jmax = locator_cell_coordinate(l, vmax);
+
+    for (j = jmin; j <= jmax; j ++) {
+      for (i = imin; i <= imax; i ++) {
+	c = (face * l->resolution + j) * l->resolution + i;
+	if (cursor == NULL) {
+	  l->cell_start[c + 1] ++;
+	} else {
+	  l->cell_triangle[cursor[c]] = ti;
+	  cursor[c] ++;
+	}
+      }
+    }
+  }
+}
+
+static double
+locator_truncate(double b)
+{
+  if (fabs(b) < DEFAULT_TRIANGLE_EPSILON) {
+    return 0.0;
+  }
+
+  return b;
+}
+
+/*
+ * The triangles tile the sphere so the enclosing triangle is always a
+ * candidate. If rounding leaves every candidate marginally outside, the
+ * one with the largest minimum coordinate is taken, which stands in for
+ * the epsilon widening of manifold_find_enclosing_triangle.
+ */
+static int
+locator_locate(const manifold_locator_t *l,
+	       double lon, double lat,
+	       int *ti,
+	       double *ba, double *bb, double *bc)
+{
+  const double *p;
+  double px, py, pz;
+  double b[3];
+  double best[3];
+  double bmin;
+  double bestmin;
+  int besti;
+  int c;
+  int k;
+  int i;
+
+  vertex3_sphtocart(lon, lat, &px, &py, &pz);
+
+  c = locator_point_cell(l, px, py, pz);
+  if (c < 0) {
+    ERROR("invalid point (%f %f)", lon, lat);
+    return -1;
+  }
+
+  besti = -1;
+  bestmin = 0.0;
+  for (k = l->cell_start[c]; k < l->cell_start[c + 1]; k ++) {
+
+    i = l->cell_triangle[k];
+    p = l->plane[i];
+
+    b[0] = locator_truncate(px*p[0] + py*p[1] + pz*p[2]);
+    b[1] = locator_truncate(px*p[3] + py*p[4] + pz*p[5]);
+    b[2] = locator_truncate(px*p[6] + py*p[7] + pz*p[8]);
+
+    bmin = b[0] < b[1] ? b[0] : b[1];
+    bmin = bmin < b[2] ? bmin : b[2];
+
+    if (besti < 0 || bmin > bestmin) {
+      besti = i;
+      bestmin = bmin;
+      best[0] = b[0];
+      best[1] = b[1];
+      best[2] = b[2];
+
+      if (bmin >= 0.0) {
+	break;
+      }
+    }
+  }
+
+  if (besti < 0) {
+    ERROR("empty cell %d", c);
+    return -1;
+  }
+
+  *ti = besti;
+  *ba = best[0];
+  *bb = best[1];
+  *bc = best[2];
+
+  return 0;
+}
@@ -0,0 +1,66 @@
+//
+//    Spherical Subdivision/Wavelet library
+//    
+//    Copyright (C) 2014 - 2018 Rhys Hawkins
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+
+#ifndef manifold_locator_h
+#define manifold_locator_h
+
+#include "manifold.h"
+
+/*
+ * Point location index for the finest level triangles of a manifold. Each
+ * cube face is split into resolution x resolution gnomonic cells and every
+ * cell lists the triangles that may overlap it, so a lookup only tests a
+ * handful of triangles instead of descending from the top level. The
+ * barycentre coordinates agree with triangle_point_in_triangle to rounding.
+ * Points on a shared edge may resolve to either neighbour.
+ *
+ * The locator only reads the manifold during creation and lookups do not
+ * modify it, so batches may be split across threads.
+ */
+typedef struct _manifold_locator manifold_locator_t;
+
+/*
+ * A resolution <= 0 selects roughly one cell per triangle.
+ */
+manifold_locator_t *
+manifold_locator_create(const manifold_t *m,
+			int resolution);
+
+void
+manifold_locator_destroy(manifold_locator_t *l);
+
+int
+manifold_locator_find_enclosing_triangle(const manifold_locator_t *l,
+					 double lon, double lat,
+					 int *ti,
+					 double *ba, double *bb, double *bc);
+
+/*
+ * Batch lookup of npoints lon/lat pairs, ti/ba/bb/bc are npoints long.
+ */
+int
+manifold_locator_find_enclosing_triangles(const manifold_locator_t *l,
+					  int npoints,
+					  const double *lon,
+					  const double *lat,
+					  int *ti,
+					  double *ba, double *bb, double *bc);
+
+#endif /* manifold_locator_h */
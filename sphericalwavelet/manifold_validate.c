@@ -61,52 +61,52 @@ manifold_all_vertices_set(manifold_t *m)
   for (i = 0; i < m->nvertices; i ++) {
 
     
-    if (m->vertices[i].depth < 0) {
+    if (m->vdepth[i] < 0) {
       ERROR("vertex %d depth not set", i);
       ec ++;
 
     } else {
 
-      if (m->vertices[i].depth > 0) {
-	if (m->vertices[i].depth == m->degree) {
+      if (m->vdepth[i] > 0) {
+	if (m->vdepth[i] == m->degree) {
 	  expected_children = 0;
 	} else {
 	  expected_children = 4;
 	}
 	
-	if (m->vertices[i].parent < 0) {
+	if (m->vparent[i] < 0) {
 	  ERROR("vertex %d parent not set", i);
 	  ec ++;
 	}
 
-	if (m->vertices[i].v[0] < 0 ||
-	    m->vertices[i].v[1] < 0) {
+	if (m->vv[i][0] < 0 ||
+	    m->vv[i][1] < 0) {
 	  ERROR("vertex %d v vertices not set (%d %d)",
 		i,
-		m->vertices[i].v[0],
-		m->vertices[i].v[1]);
+		m->vv[i][0],
+		m->vv[i][1]);
 	  ec ++;
 	}
 	  
-	if (m->vertices[i].f[0] < 0 ||
-	    m->vertices[i].f[1] < 0) {
+	if (m->vf[i][0] < 0 ||
+	    m->vf[i][1] < 0) {
 	  ERROR("vertex %d f vertices not set (%d %d)",
 		i,
-		m->vertices[i].f[0],
-		m->vertices[i].f[1]);
+		m->vf[i][0],
+		m->vf[i][1]);
 	  ec ++;
 	}
 
-	if (m->vertices[i].e[0] < 0 ||
-	    m->vertices[i].e[1] < 0 ||
-	    m->vertices[i].e[2] < 0 ||
-	    m->vertices[i].e[3] < 0) {
+	if (m->ve[i][0] < 0 ||
+	    m->ve[i][1] < 0 ||
+	    m->ve[i][2] < 0 ||
+	    m->ve[i][3] < 0) {
 	  ERROR("vertex %d e vertices not set (%d %d %d %d)",
 		i,
-		m->vertices[i].e[0],
-		m->vertices[i].e[1],
-		m->vertices[i].e[2],
-		m->vertices[i].e[3]);
+		m->ve[i][0],
+		m->ve[i][1],
+		m->ve[i][2],
+		m->ve[i][3]);
 	  ec ++;
 	}
 
@@ -123,14 +123,14 @@ manifold_all_vertices_set(manifold_t *m)
       }
 
       for (j = 0; j < expected_children; j ++) {
-	if (m->vertices[i].children[j] < 0) {
+	if (m->vchildren[i][j] < 0) {
 	  ERROR("vertex %d missing child %d", i, j);
 	  ec ++;
 	}
       }
 
       for (j = expected_children; j < 4; j ++) {
-	if (m->vertices[i].children[j] >= 0) {
+	if (m->vchildren[i][j] >= 0) {
 	  ERROR("vertex %d has extra child %d", i, j);
 	  ec ++;
 	}
@@ -204,11 +204,11 @@ manifold_all_parent_child_valid(manifold_t *m)
 
     for (j = 0; j < 4; j ++) {
 
-      if (m->vertices[i].children[j] >= 0) {
+      if (m->vchildren[i][j] >= 0) {
 
-	if (m->vertices[m->vertices[i].children[j]].parent != i) {
+	if (m->vparent[m->vchildren[i][j]] != i) {
 	  ERROR("parent %d isn't referenced by child %d",
-		i, m->vertices[i].children[j]);
+		i, m->vchildren[i][j]);
 	  ec ++;
 	}
       }
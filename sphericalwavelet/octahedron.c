@@ -233,6 +233,17 @@ octahedron_print_triangles(manifold_t *o, int depth)
   }
 }
 
+manifold_t *
+octahedron_create_cached(int degree, const char *filename)
+{
+  return manifold_create_cached(filename,
+				degree,
+				octahedron_create,
+				octahedron_nvertices,
+				octahedron_nedges,
+				octahedron_ntriangles);
+}
+
 int 
 octahedron_nvertices(int depth)
 {
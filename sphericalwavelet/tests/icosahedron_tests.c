@@ -1,11 +1,15 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
 #include <check.h>
 
 #include <math.h>
 
 #include "icosahedron.h"
+#include "octahedron.h"
+#include "vertex_wavelet.h"
 
 START_TEST(test_icosahedron_counting)
 {
@@ -94,7 +98,7 @@ START_TEST(test_icosahedron_neighbors)
 
     nc = 0;
     for (i = 0; i < 6; i ++) {
-      if (o->vertices[vi].n[i] >= 0) {
+      if (o->vn[vi][i] >= 0) {
 	nc ++;
       } else {
 	break;
@@ -114,6 +118,183 @@ START_TEST(test_icosahedron_neighbors)
 }
 END_TEST
 
+START_TEST(test_icosahedron_vertex_access)
+{
+  manifold_t *o;
+  vertex3_t v;
+  double x, y, z;
+  int vi;
+  int i;
+  
+  o = icosahedron_create(3);
+
+  ck_assert(o != NULL);
+  
+  ck_assert(manifold_valid(o));
+
+  for (vi = 0; vi < o->nvertices; vi ++) {
+
+    ck_assert(manifold_get_vertex(o, vi, &v) == 0);
+    ck_assert(v.x == o->vx[vi] && v.y == o->vy[vi] && v.z == o->vz[vi]);
+    ck_assert(fabs(v.x*v.x + v.y*v.y + v.z*v.z - 1.0) < 1.0e-12);
+    ck_assert(v.area == o->varea[vi]);
+    ck_assert(v.parent == manifold_get_parent(o, vi));
+
+    if (v.depth > 0) {
+      ck_assert(v.v[0] == o->vv[vi][0] && v.v[1] == o->vv[vi][1]);
+      for (i = 0; i < 4; i ++) {
+	ck_assert(v.e[i] == o->ve[vi][i]);
+      }
+    }
+
+    ck_assert(manifold_get_vertex_position(o, vi, &x, &y, &z) == 0);
+    ck_assert(x == v.x && y == v.y && z == v.z);
+  }
+
+  ck_assert(manifold_get_vertex(o, o->nvertices, &v) < 0);
+  ck_assert(manifold_get_vertex_position(o, -1, &x, &y, &z) < 0);
+
+  manifold_destroy(o);
+}
+END_TEST
+
+/*
+ * Rewrites the degree, vertex count and length of a cache header, keeping
+ * only the first size bytes of the file.
+ */
+static int
+corrupt_cache(const char *filename, int degree, int nvertices, long size)
+{
+  FILE *fp;
+  char *data;
+  long length;
+  int64_t l;
+
+  fp = fopen(filename, "rb");
+  if (fp == NULL) {
+    return -1;
+  }
+  fseek(fp, 0, SEEK_END);
+  length = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  data = malloc(length);
+  if (data == NULL || fread(data, 1, length, fp) != length || size > length) {
+    fclose(fp);
+    free(data);
+    return -1;
+  }
+  fclose(fp);
+
+  l = size;
+  memcpy(data + 12, &degree, sizeof(int));
+  memcpy(data + 16, &nvertices, sizeof(int));
+  memcpy(data + 32, &l, sizeof(int64_t));
+
+  fp = fopen(filename, "wb");
+  if (fp == NULL || fwrite(data, 1, size, fp) != size) {
+    free(data);
+    return -1;
+  }
+  fclose(fp);
+  free(data);
+
+  return 0;
+}
+
+START_TEST(test_icosahedron_cache)
+{
+  const char *filename = "icosahedron_cache_test.dat";
+  manifold_t *o;
+  manifold_t *c;
+  double *a;
+  double *b;
+  size_t nv;
+  int i;
+
+  o = icosahedron_create(4);
+  ck_assert(o != NULL);
+
+  ck_assert(manifold_save(o, filename) == 0);
+
+  c = manifold_map(filename, icosahedron_nvertices, icosahedron_nedges, icosahedron_ntriangles);
+  ck_assert(c != NULL);
+  ck_assert(c->mapping != NULL);
+  ck_assert(c->degree == o->degree);
+  ck_assert(c->nvertices == o->nvertices);
+  ck_assert(c->ntotaltriangles == o->ntotaltriangles);
+
+  nv = o->nvertices;
+  ck_assert(memcmp(c->vx, o->vx, sizeof(double) * nv) == 0);
+  ck_assert(memcmp(c->vy, o->vy, sizeof(double) * nv) == 0);
+  ck_assert(memcmp(c->vz, o->vz, sizeof(double) * nv) == 0);
+  ck_assert(memcmp(c->varea, o->varea, sizeof(double) * nv) == 0);
+  ck_assert(memcmp(c->vdepth, o->vdepth, sizeof(int) * nv) == 0);
+  ck_assert(memcmp(c->vparent, o->vparent, sizeof(int) * nv) == 0);
+  ck_assert(memcmp(c->vchildren, o->vchildren, sizeof(int[4]) * nv) == 0);
+  ck_assert(memcmp(c->vv, o->vv, sizeof(int[2]) * nv) == 0);
+  ck_assert(memcmp(c->vf, o->vf, sizeof(int[2]) * nv) == 0);
+  ck_assert(memcmp(c->ve, o->ve, sizeof(int[4]) * nv) == 0);
+  ck_assert(memcmp(c->vn, o->vn, sizeof(int[6]) * nv) == 0);
+
+  for (i = 0; i <= o->degree; i ++) {
+    ck_assert(c->nedges[i] == o->nedges[i]);
+    ck_assert(c->ntriangles[i] == o->ntriangles[i]);
+    ck_assert(memcmp(c->edges[i], o->edges[i], sizeof(edge_t) * o->nedges[i]) == 0);
+    ck_assert(memcmp(c->triangles[i], o->triangles[i], sizeof(triangle_t) * o->ntriangles[i]) == 0);
+  }
+
+  ck_assert(manifold_valid(c));
+
+  /* Transforms on the mapped manifold must match exactly */
+  a = malloc(sizeof(double) * nv);
+  b = malloc(sizeof(double) * nv);
+  for (i = 0; i < (int)nv; i ++) {
+    a[i] = o->vx[i] * o->vz[i] + 0.5 * o->vy[i];
+    b[i] = a[i];
+  }
+  ck_assert(vertex_wavelet_butterfly_forward(o, a) >= 0);
+  ck_assert(vertex_wavelet_butterfly_forward(c, b) >= 0);
+  ck_assert(memcmp(a, b, sizeof(double) * nv) == 0);
+  free(a);
+  free(b);
+
+  manifold_destroy(c);
+
+  /* Counts of a different base shape must be rejected */
+  ck_assert(manifold_map(filename, octahedron_nvertices, octahedron_nedges, octahedron_ntriangles) == NULL);
+
+  /* A cache of the wrong degree is rebuilt, then mapped on the next call */
+  c = icosahedron_create_cached(3, filename);
+  ck_assert(c != NULL);
+  ck_assert(c->mapping == NULL);
+  ck_assert(c->degree == 3);
+  manifold_destroy(c);
+
+  c = icosahedron_create_cached(3, filename);
+  ck_assert(c != NULL);
+  ck_assert(c->mapping != NULL);
+  ck_assert(c->degree == 3);
+  ck_assert(manifold_valid(c));
+  manifold_destroy(c);
+
+  /* Headers whose sections do not fit in the file are rejected */
+  ck_assert(manifold_save(o, filename) == 0);
+  ck_assert(corrupt_cache(filename, 12, icosahedron_nvertices(12), 4096) == 0);
+  ck_assert(manifold_map(filename, icosahedron_nvertices, icosahedron_nedges, icosahedron_ntriangles) == NULL);
+
+  ck_assert(manifold_save(o, filename) == 0);
+  ck_assert(corrupt_cache(filename, 3, icosahedron_nvertices(3), 128) == 0);
+  ck_assert(manifold_map(filename, icosahedron_nvertices, icosahedron_nedges, icosahedron_ntriangles) == NULL);
+
+  ck_assert(manifold_save(o, filename) == 0);
+  ck_assert(corrupt_cache(filename, 100000, icosahedron_nvertices(4), 4096) == 0);
+  ck_assert(manifold_map(filename, icosahedron_nvertices, icosahedron_nedges, icosahedron_ntriangles) == NULL);
+
+  manifold_destroy(o);
+  remove(filename);
+}
+END_TEST
+
 Suite *
 icosahedron_suite (void)
 {
@@ -127,6 +308,8 @@ icosahedron_suite (void)
 
   tcase_add_test (tc_core, test_icosahedron_edges);
   tcase_add_test (tc_core, test_icosahedron_neighbors);
+  tcase_add_test (tc_core, test_icosahedron_vertex_access);
+  tcase_add_test (tc_core, test_icosahedron_cache);
   
   suite_add_tcase (s, tc_core);
 
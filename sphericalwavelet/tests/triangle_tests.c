@@ -4,14 +4,20 @@
 #include <stdlib.h>
 #include <check.h>
 
+#include <math.h>
+
 #include "octahedron.h"
+#include "icosahedron.h"
+#include "manifold_locator.h"
 #include "triangle.h"
 
 START_TEST(test_triangle_point_in_triangle)
 {
   triangle_workspace_t *workspace;
   triangle_t triangle;
-  vertex3_t vertices[3];
+  double vx[3];
+  double vy[3];
+  double vz[3];
 
   double px, py, pz;
   double ba, bc, bb;
@@ -19,15 +25,12 @@ START_TEST(test_triangle_point_in_triangle)
   workspace = triangle_point_in_triangle_create_workspace();
   ck_assert(workspace != NULL);
 
-  vertex3_initialize(&(vertices[0]));
   vertex3_sphtocart(0.0, 0.0,
-		    &(vertices[0].x), &(vertices[0].y), &(vertices[0].z));
-  vertex3_initialize(&(vertices[1]));
+		    &(vx[0]), &(vy[0]), &(vz[0]));
   vertex3_sphtocart(0.0, 90.0,
-		    &(vertices[1].x), &(vertices[1].y), &(vertices[1].z));
-  vertex3_initialize(&(vertices[2]));
+		    &(vx[1]), &(vy[1]), &(vz[1]));
   vertex3_sphtocart(90.0, 0.0,
-		    &(vertices[2].x), &(vertices[2].y), &(vertices[2].z));
+		    &(vx[2]), &(vy[2]), &(vz[2]));
 
   triangle_init(&triangle);
   triangle.a = 0;
@@ -41,9 +44,10 @@ START_TEST(test_triangle_point_in_triangle)
 		    &px, &py, &pz);
   ck_assert(triangle_point_in_triangle(workspace,
 				       &triangle,
-				       vertices,
+				       vx, vy, vz,
 				       px, py, pz,
-				       &ba, &bb, &bc) == 0);
+				       &ba, &bb, &bc,
+				       DEFAULT_TRIANGLE_EPSILON) == 0);
 
   /*
    * Central test
@@ -52,9 +56,10 @@ START_TEST(test_triangle_point_in_triangle)
 		    &px, &py, &pz);
   ck_assert(triangle_point_in_triangle(workspace,
 				       &triangle,
-				       vertices,
+				       vx, vy, vz,
 				       px, py, pz,
-				       &ba, &bb, &bc));
+				       &ba, &bb, &bc,
+				       DEFAULT_TRIANGLE_EPSILON));
 
   /*
    * Vertex test
@@ -63,9 +68,10 @@ START_TEST(test_triangle_point_in_triangle)
 		    &px, &py, &pz);
   ck_assert(triangle_point_in_triangle(workspace,
 				       &triangle,
-				       vertices,
+				       vx, vy, vz,
 				       px, py, pz,
-				       &ba, &bb, &bc));
+				       &ba, &bb, &bc,
+				       DEFAULT_TRIANGLE_EPSILON));
   ck_assert(ba == 1.0);
   
   /*
@@ -75,9 +81,10 @@ START_TEST(test_triangle_point_in_triangle)
 		    &px, &py, &pz);
   ck_assert(triangle_point_in_triangle(workspace,
 				       &triangle,
-				       vertices,
+				       vx, vy, vz,
 				       px, py, pz,
-				       &ba, &bb, &bc));
+				       &ba, &bb, &bc,
+				       DEFAULT_TRIANGLE_EPSILON));
   ck_assert(bb == 1.0);
 
   /*
@@ -87,9 +94,10 @@ START_TEST(test_triangle_point_in_triangle)
 		    &px, &py, &pz);
   ck_assert(triangle_point_in_triangle(workspace,
 				       &triangle,
-				       vertices,
+				       vx, vy, vz,
 				       px, py, pz,
-				       &ba, &bb, &bc));
+				       &ba, &bb, &bc,
+				       DEFAULT_TRIANGLE_EPSILON));
   ck_assert(bc == 1.0);
 
   /*
@@ -99,9 +107,10 @@ START_TEST(test_triangle_point_in_triangle)
 		    &px, &py, &pz);
   ck_assert(triangle_point_in_triangle(workspace,
 				       &triangle,
-				       vertices,
+				       vx, vy, vz,
 				       px, py, pz,
-				       &ba, &bb, &bc));
+				       &ba, &bb, &bc,
+				       DEFAULT_TRIANGLE_EPSILON));
   ck_assert(bc == 0.0);
   
   /*
@@ -111,9 +120,10 @@ START_TEST(test_triangle_point_in_triangle)
 		    &px, &py, &pz);
   triangle_point_in_triangle(workspace,
 					    &triangle,
-					    vertices,
+					    vx, vy, vz,
 					    px, py, pz,
-					    &ba, &bb, &bc);
+					    &ba, &bb, &bc,
+					    DEFAULT_TRIANGLE_EPSILON);
   ck_assert(ba == 0.0);
   
   /*
@@ -123,9 +133,10 @@ START_TEST(test_triangle_point_in_triangle)
 		    &px, &py, &pz);
   ck_assert(triangle_point_in_triangle(workspace,
 				       &triangle,
-				       vertices,
+				       vx, vy, vz,
 				       px, py, pz,
-				       &ba, &bb, &bc));
+				       &ba, &bb, &bc,
+				       DEFAULT_TRIANGLE_EPSILON));
   ck_assert(bb == 0.0);
 
   triangle_point_in_triangle_free_workspace(workspace);
@@ -282,6 +293,115 @@ START_TEST(test_triangle_in_icosahedron)
 }
 END_TEST
 
+START_TEST(test_triangle_locator)
+{
+  static const int NPOINTS = 20000;
+  manifold_t *o;
+  manifold_locator_t *l;
+  triangle_workspace_t *workspace;
+  double *lon;
+  double *lat;
+  int *ti;
+  double *ba, *bb, *bc;
+  int rti;
+  double rba, rbb, rbc;
+  int nmismatch;
+  int i;
+  int k;
+
+  workspace = triangle_point_in_triangle_create_workspace();
+  ck_assert(workspace != NULL);
+
+  lon = malloc(sizeof(double) * NPOINTS);
+  lat = malloc(sizeof(double) * NPOINTS);
+  ti = malloc(sizeof(int) * NPOINTS);
+  ba = malloc(sizeof(double) * NPOINTS);
+  bb = malloc(sizeof(double) * NPOINTS);
+  bc = malloc(sizeof(double) * NPOINTS);
+  ck_assert(lon != NULL && lat != NULL && ti != NULL);
+  ck_assert(ba != NULL && bb != NULL && bc != NULL);
+
+  /* Poles, the date line and vertices first then random points */
+  srand(42);
+  for (i = 0; i < NPOINTS; i ++) {
+    switch (i) {
+    case 0:
+      lon[i] = 0.0;
+      lat[i] = 90.0;
+      break;
+    case 1:
+      lon[i] = 45.0;
+      lat[i] = -90.0;
+      break;
+    case 2:
+      lon[i] = 180.0;
+      lat[i] = 0.0;
+      break;
+    case 3:
+      lon[i] = -180.0;
+      lat[i] = 10.0;
+      break;
+    case 4:
+      lon[i] = 45.0;
+      lat[i] = 0.0;
+      break;
+    default:
+      lon[i] = 360.0 * (double)rand()/(double)RAND_MAX - 180.0;
+      lat[i] = 180.0 * (double)rand()/(double)RAND_MAX - 90.0;
+      break;
+    }
+  }
+
+  for (k = 0; k < 2; k ++) {
+
+    if (k == 0) {
+      o = octahedron_create(4);
+    } else {
+      o = icosahedron_create(5);
+    }
+    ck_assert(o != NULL);
+
+    l = manifold_locator_create(o, 0);
+    ck_assert(l != NULL);
+
+    ck_assert(manifold_locator_find_enclosing_triangles(l, NPOINTS, lon, lat, ti, ba, bb, bc) == 0);
+
+    nmismatch = 0;
+    for (i = 0; i < NPOINTS; i ++) {
+      ck_assert(manifold_find_enclosing_triangle(o, workspace, lon[i], lat[i], &rti, &rba, &rbb, &rbc) == 0);
+
+      ck_assert(ti[i] >= 0 && ti[i] < o->ntriangles[o->degree]);
+
+      if (ti[i] == rti) {
+	ck_assert(fabs(ba[i] - rba) < 1.0e-12);
+	ck_assert(fabs(bb[i] - rbb) < 1.0e-12);
+	ck_assert(fabs(bc[i] - rbc) < 1.0e-12);
+      } else {
+	/* Only points on a shared edge or vertex may differ */
+	ck_assert(ba[i] >= 0.0 && bb[i] >= 0.0 && bc[i] >= 0.0);
+	ck_assert(rba == 0.0 || rbb == 0.0 || rbc == 0.0);
+	nmismatch ++;
+      }
+    }
+    ck_assert(nmismatch < 10);
+
+    ck_assert(manifold_locator_find_enclosing_triangle(l, lon[4], lat[4], &rti, &rba, &rbb, &rbc) == 0);
+    ck_assert(rti == ti[4] && rba == ba[4] && rbb == bb[4] && rbc == bc[4]);
+    
+    manifold_locator_destroy(l);
+    manifold_destroy(o);
+  }
+
+  free(lon);
+  free(lat);
+  free(ti);
+  free(ba);
+  free(bb);
+  free(bc);
+  triangle_point_in_triangle_free_workspace(workspace);
+}
+END_TEST
+
 Suite *
 triangle_suite (void)
 {
@@ -294,6 +414,7 @@ triangle_suite (void)
   
   tcase_add_test (tc_core, test_triangle_in_octahedron);
   tcase_add_test (tc_core, test_triangle_in_icosahedron);
+  tcase_add_test (tc_core, test_triangle_locator);
 
   suite_add_tcase (s, tc_core);
 
@@ -135,6 +135,17 @@ tetrahedron_create(int degree)
   return o;
 }
 
+manifold_t *
+tetrahedron_create_cached(int degree, const char *filename)
+{
+  return manifold_create_cached(filename,
+				degree,
+				tetrahedron_create,
+				tetrahedron_nvertices,
+				tetrahedron_nedges,
+				tetrahedron_ntriangles);
+}
+
 int 
 tetrahedron_nvertices(int depth)
 {
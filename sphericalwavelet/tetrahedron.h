@@ -26,6 +26,13 @@
 manifold_t *
 tetrahedron_create(int degree);
 
+/*
+ * Maps a cache written by manifold_save, building and writing it first if
+ * needed (see manifold_create_cached).
+ */
+manifold_t *
+tetrahedron_create_cached(int degree, const char *filename);
+
 /*
  * Counting functions
  */
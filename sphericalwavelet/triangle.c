@@ -48,16 +48,18 @@ triangle_init(triangle_t *t)
 
 double
 triangle_area(triangle_t *t,
-	      const vertex3_t *vertices)
+	      const double *vx,
+	      const double *vy,
+	      const double *vz)
 {
   double nx, ny, nz;
 
-  vertex3_cross(vertices[t->b].x - vertices[t->a].x,
-		vertices[t->b].y - vertices[t->a].y,
-		vertices[t->b].z - vertices[t->a].z,
-		vertices[t->a].x - vertices[t->c].x,
-		vertices[t->a].y - vertices[t->c].y,
-		vertices[t->a].z - vertices[t->c].z,
+  vertex3_cross(vx[t->b] - vx[t->a],
+		vy[t->b] - vy[t->a],
+		vz[t->b] - vz[t->a],
+		vx[t->a] - vx[t->c],
+		vy[t->a] - vy[t->c],
+		vz[t->a] - vz[t->c],
 		&nx, &ny, &nz);
 
   return 0.5 * sqrt(nx*nx + ny*ny + nz*nz);
@@ -65,15 +67,17 @@ triangle_area(triangle_t *t,
 
 int
 triangle_centroid(triangle_t *t,
-		  const vertex3_t *vertices,
+		  const double *vx,
+		  const double *vy,
+		  const double *vz,
 		  double *x, double *y, double *z)
 {
   double cx, cy, cz;
   double l;
   
-  cx = (vertices[t->a].x + vertices[t->b].x + vertices[t->c].x)/3.0;
-  cy = (vertices[t->a].y + vertices[t->b].y + vertices[t->c].y)/3.0;
-  cz = (vertices[t->a].z + vertices[t->b].z + vertices[t->c].z)/3.0;
+  cx = (vx[t->a] + vx[t->b] + vx[t->c])/3.0;
+  cy = (vy[t->a] + vy[t->b] + vy[t->c])/3.0;
+  cz = (vz[t->a] + vz[t->b] + vz[t->c])/3.0;
 
   l = sqrt(cx*cx + cy*cy + cz*cz);
   if (l < 1.0e-12) {
@@ -161,35 +165,44 @@ const double DEFAULT_TRIANGLE_EPSILON = 1.0e-14;
 int
 triangle_point_in_triangle(triangle_workspace_t *workspace,
 			   triangle_t *t,
-			   const vertex3_t *vertices,
+			   const double *vx,
+			   const double *vy,
+			   const double *vz,
 			   double x, double y, double z,
 			   double *ba, double *bb, double *bc,
 			   double epsilon)
 {
   double den;
   vertex3_t p;
+  vertex3_t a;
+  vertex3_t b;
+  vertex3_t c;
 
   p.x = x;
   p.y = y;
   p.z = z;
 
-  den = vertex3_determinant(&(vertices[t->a]),
-			    &(vertices[t->b]),
-			    &(vertices[t->c]));
+  a.x = vx[t->a];
+  a.y = vy[t->a];
+  a.z = vz[t->a];
 
-  *ba = truncate_barycentre_coordinate(vertex3_determinant(&p, 
-							   &(vertices[t->b]),
-							   &(vertices[t->c]))/den,
+  b.x = vx[t->b];
+  b.y = vy[t->b];
+  b.z = vz[t->b];
+
+  c.x = vx[t->c];
+  c.y = vy[t->c];
+  c.z = vz[t->c];
+
+  den = vertex3_determinant(&a, &b, &c);
+
+  *ba = truncate_barycentre_coordinate(vertex3_determinant(&p, &b, &c)/den,
 				       epsilon);
   
-  *bb = truncate_barycentre_coordinate(vertex3_determinant(&(vertices[t->a]), 
-							   &p,
-							   &(vertices[t->c]))/den,
+  *bb = truncate_barycentre_coordinate(vertex3_determinant(&a, &p, &c)/den,
 				       epsilon);
 
-  *bc = truncate_barycentre_coordinate(vertex3_determinant(&(vertices[t->a]),
-							   &(vertices[t->b]),
-							   &p)/den,
+  *bc = truncate_barycentre_coordinate(vertex3_determinant(&a, &b, &p)/den,
 				       epsilon);
 
   return ((*ba) >= 0.0 && ((*bb) >= 0.0) && ((*bc) >= 0.0));
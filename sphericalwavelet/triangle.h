@@ -42,11 +42,15 @@ triangle_init(triangle_t *t);
 
 double
 triangle_area(triangle_t *t,
-	      const vertex3_t *vertices);
+	      const double *vx,
+	      const double *vy,
+	      const double *vz);
 
 int
 triangle_centroid(triangle_t *t,
-		  const vertex3_t *vertices,
+		  const double *vx,
+		  const double *vy,
+		  const double *vz,
 		  double *x, double *y, double *z);
 
 
@@ -63,7 +67,9 @@ extern const double DEFAULT_TRIANGLE_EPSILON;
 int
 triangle_point_in_triangle(triangle_workspace_t *workspace,
 			   triangle_t *t,
-			   const vertex3_t *vertices,
+			   const double *vx,
+			   const double *vy,
+			   const double *vz,
 			   double x, double y, double z,
 			   double *ba, double *bb, double *bc,
 			   double epsilon);
@@ -105,16 +105,16 @@ vertex_wavelet_butterfly_forward_step(manifold_t *m,
 
   for (i = vstart; i < vend; i ++) {
 
-    coeff[i] -= (0.5 * (coeff[m->vertices[i].v[0]] +
-			coeff[m->vertices[i].v[1]])
+    coeff[i] -= (0.5 * (coeff[m->vv[i][0]] +
+			coeff[m->vv[i][1]])
 		 +
-		 0.125 * (coeff[m->vertices[i].f[0]] +
-			  coeff[m->vertices[i].f[1]])
+		 0.125 * (coeff[m->vf[i][0]] +
+			  coeff[m->vf[i][1]])
 		 -
-		 0.0625 * (coeff[m->vertices[i].e[0]] +
-			   coeff[m->vertices[i].e[1]] +
-			   coeff[m->vertices[i].e[2]] +
-			   coeff[m->vertices[i].e[3]]));
+		 0.0625 * (coeff[m->ve[i][0]] +
+			   coeff[m->ve[i][1]] +
+			   coeff[m->ve[i][2]] +
+			   coeff[m->ve[i][3]]));
     
   }
 		      
@@ -140,10 +140,10 @@ vertex_wavelet_butterfly_forward_lifted_step(manifold_t *m,
 
   for (i = vstart; i < vend; i ++) {
 
-    lift = coeff[i] * m->vertices[i].area;
+    lift = coeff[i] * m->varea[i];
 
-    coeff[m->vertices[i].v[0]] += lift;
-    coeff[m->vertices[i].v[1]] += lift;
+    coeff[m->vv[i][0]] += lift;
+    coeff[m->vv[i][1]] += lift;
 
   }
 
@@ -167,16 +167,16 @@ vertex_wavelet_butterfly_inverse_step(manifold_t *m,
   vend = m->nverticesatdepth(depth);
 
   for (i = vstart; i < vend; i ++) {
-    coeff[i] += (0.5 * (coeff[m->vertices[i].v[0]] +
-			coeff[m->vertices[i].v[1]])
+    coeff[i] += (0.5 * (coeff[m->vv[i][0]] +
+			coeff[m->vv[i][1]])
 		 +
-		 0.125 * (coeff[m->vertices[i].f[0]] +
-			  coeff[m->vertices[i].f[1]])
+		 0.125 * (coeff[m->vf[i][0]] +
+			  coeff[m->vf[i][1]])
 		 -
-		 0.0625 * (coeff[m->vertices[i].e[0]] +
-			   coeff[m->vertices[i].e[1]] +
-			   coeff[m->vertices[i].e[2]] +
-			   coeff[m->vertices[i].e[3]]));
+		 0.0625 * (coeff[m->ve[i][0]] +
+			   coeff[m->ve[i][1]] +
+			   coeff[m->ve[i][2]] +
+			   coeff[m->ve[i][3]]));
   }
 		      
   return 0;  
@@ -202,10 +202,10 @@ vertex_wavelet_butterfly_inverse_lifted_step(manifold_t *m,
 
   for (i = vstart; i < vend; i ++) {
 
-    lift = coeff[i] * m->vertices[i].area;
+    lift = coeff[i] * m->varea[i];
 
-    coeff[m->vertices[i].v[0]] -= lift;
-    coeff[m->vertices[i].v[1]] -= lift;
+    coeff[m->vv[i][0]] -= lift;
+    coeff[m->vv[i][1]] -= lift;
 
   }
 
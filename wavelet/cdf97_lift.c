@@ -19,6 +19,7 @@
 //
 
 #include <stdio.h>
+#include <string.h>
 
 #include "cdf97_lift.h"
 
@@ -98,6 +99,53 @@ cdf97_lift_forward1d_cdf97_step(double *s,
   return 0;
 }
 
+GENERIC_LIFT_SIMD
+int
+cdf97_lift_forward1d_cdf97_panel_step(double *s,
+				      int width,
+				      double *work)
+{
+  int i;
+
+  /*
+   * Copy to workspace
+   */
+  memcpy(work, s, sizeof(double) * width * GENERIC_LIFT_PANEL);
+
+  /*
+   * Lifting steps
+   */
+  for (i = 1; i < (width - 1); i += 2) {
+    generic_lift_panel_lift(work, i, i - 1, i + 1, a1);
+  }
+  generic_lift_panel_add(work, width - 1, width - 2, 2.0 * a1);
+
+  for (i = 2; i < width; i += 2) {
+    generic_lift_panel_lift(work, i, i - 1, i + 1, a2);
+  }
+  generic_lift_panel_add(work, 0, 1, 2.0 * a2);
+
+  for (i = 1; i < (width - 1); i += 2) {
+    generic_lift_panel_lift(work, i, i - 1, i + 1, a3);
+  }
+  generic_lift_panel_add(work, width - 1, width - 2, 2.0 * a3);
+
+  for (i = 2; i < width; i += 2) {
+    generic_lift_panel_lift(work, i, i - 1, i + 1, a4);
+  }
+  generic_lift_panel_add(work, 0, 1, 2.0 * a4);
+
+  /*
+   * Copy back and de-interleave
+   */
+  for (i = 0; i < width/2; i ++) {
+    generic_lift_panel_scale(s, i, work, 2*i, k1);
+    generic_lift_panel_scale(s, width/2 + i, work, 2*i + 1, k2);
+  }
+
+  return 0;
+}
+
 int
 cdf97_lift_inverse1d_cdf97(double *s,
 			   int width,
@@ -157,6 +205,53 @@ cdf97_lift_inverse1d_cdf97_step(double *s,
   return 0;
 }
 
+GENERIC_LIFT_SIMD
+int
+cdf97_lift_inverse1d_cdf97_panel_step(double *s,
+				      int width,
+				      double *work)
+{
+  int i;
+
+  /*
+   * Copy to workspace and interleave
+   */
+  for (i = 0; i < width/2; i ++) {
+    generic_lift_panel_scale(work, 2*i, s, i, ik1);
+    generic_lift_panel_scale(work, 2*i + 1, s, width/2 + i, ik2);
+  }
+
+  /*
+   * Inverse lifting steps
+   */
+  for (i = 2; i < width; i += 2) {
+    generic_lift_panel_lift(work, i, i - 1, i + 1, -a4);
+  }
+  generic_lift_panel_add(work, 0, 1, -2.0 * a4);
+
+  for (i = 1; i < (width - 1); i += 2) {
+    generic_lift_panel_lift(work, i, i - 1, i + 1, -a3);
+  }
+  generic_lift_panel_add(work, width - 1, width - 2, -2.0 * a3);
+
+  for (i = 2; i < width; i += 2) {
+    generic_lift_panel_lift(work, i, i - 1, i + 1, -a2);
+  }
+  generic_lift_panel_add(work, 0, 1, -2.0 * a2);
+
+  for (i = 1; i < (width - 1); i += 2) {
+    generic_lift_panel_lift(work, i, i - 1, i + 1, -a1);
+  }
+  generic_lift_panel_add(work, width - 1, width - 2, -2.0 * a1);
+
+  /*
+   * Copy back
+   */
+  memcpy(s, work, sizeof(double) * width * GENERIC_LIFT_PANEL);
+
+  return 0;
+}
+
 /*
  * 2D
  */
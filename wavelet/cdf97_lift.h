@@ -36,6 +36,11 @@ cdf97_lift_forward1d_cdf97_step(double *s,
 				int stride,
 				double *work);
 
+int
+cdf97_lift_forward1d_cdf97_panel_step(double *s,
+				      int width,
+				      double *work);
+
 /*
  * 1D Inverse
  */
@@ -51,6 +56,11 @@ cdf97_lift_inverse1d_cdf97_step(double *s,
 				int stride,
 				double *work);
 
+int
+cdf97_lift_inverse1d_cdf97_panel_step(double *s,
+				      int width,
+				      double *work);
+
 /*
  * 2D Forward
  */
@@ -24,6 +24,10 @@
 
 #include "cdf97_lift_impulse.h"
 
+#include "cdf97_lift.h"
+#include "haar_lift.h"
+#include "generic_lift.h"
+
 static const double a1 = -1.58613434200;
 static const double a2 = -0.05298011854;
 static const double a3 =  0.88291107620;
@@ -39,6 +43,15 @@ static int cdf97_lift_inverse1d_interlaced(double *v,
 					   int width,
 					   int stride);
 
+static int impulse_response_1d(int width,
+			       int levels,
+			       int index,
+			       double *v,
+			       double *work,
+			       int *lo,
+			       int *hi,
+			       generic_lift_inverse1d_step_t transform);
+
 int cdf97_lift_impulse_1dsize(int degree, int impulse_depth)
 {
   if (impulse_depth < 0 || impulse_depth > degree) {
@@ -65,6 +78,79 @@ int cdf97_lift_impulse_1d(int degree,
   return cdf97_lift_inverse1d_interlaced(v, size, 1);
 }
 
+int cdf97_lift_impulse_response_1d(int width,
+				   int levels,
+				   int index,
+				   double *v,
+				   double *work,
+				   int *lo,
+				   int *hi)
+{
+  return impulse_response_1d(width, levels, index, v, work, lo, hi,
+			     cdf97_lift_inverse1d_cdf97_step);
+}
+
+int haar_lift_impulse_response_1d(int width,
+				  int levels,
+				  int index,
+				  double *v,
+				  double *work,
+				  int *lo,
+				  int *hi)
+{
+  return impulse_response_1d(width, levels, index, v, work, lo, hi,
+			     haar_lift_inverse1d_haar_step);
+}
+
+static int impulse_response_1d(int width,
+			       int levels,
+			       int index,
+			       double *v,
+			       double *work,
+			       int *lo,
+			       int *hi,
+			       generic_lift_inverse1d_step_t transform)
+{
+  int w;
+  int i;
+
+  if (index < 0 || index >= width || levels < 0 || (width >> levels) < 1) {
+    return -1;
+  }
+
+  memset(v, 0, sizeof(double) * width);
+  v[index] = 1.0;
+
+  /*
+   * Apply the same sequence of inverse steps as generic_lift_inverse1d,
+   * finishing at the full width (fewer levels corresponds to a subtile)
+   */
+  if (levels > 0) {
+    w = width >> (levels - 1);
+    for (i = 0; i < levels; i ++) {
+      if (transform(v, w, 1, work) < 0) {
+	return -1;
+      }
+      w <<= 1;
+    }
+  }
+
+  /*
+   * Lifting a single impulse leaves exact zeros outside the support
+   */
+  *lo = 0;
+  while (*lo < width && v[*lo] == 0.0) {
+    (*lo) ++;
+  }
+
+  *hi = width - 1;
+  while (*hi > *lo && v[*hi] == 0.0) {
+    (*hi) --;
+  }
+
+  return 0;
+}
+
 static int cdf97_lift_inverse1d_interlaced(double *v,
 					   int width,
 					   int stride)
@@ -36,5 +36,26 @@ int cdf97_lift_impulse_1d(int degree,
 			  int size,
 			  int offset);
 
+/*
+ * 1D Impulse Responses of the full inverse transform. The response of
+ * coefficient index in a signal of the given width is computed by
+ * applying levels inverse steps and the non-zero support of the result
+ * is returned in [lo, hi]. Both v and work must be of size width.
+ */
+int cdf97_lift_impulse_response_1d(int width,
+				   int levels,
+				   int index,
+				   double *v,
+				   double *work,
+				   int *lo,
+				   int *hi);
+
+int haar_lift_impulse_response_1d(int width,
+				  int levels,
+				  int index,
+				  double *v,
+				  double *work,
+				  int *lo,
+				  int *hi);
 
 #endif /* cdf97_lift_impulse_h */
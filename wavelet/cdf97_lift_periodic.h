@@ -36,6 +36,11 @@ cdf97_lift_periodic_forward1d_cdf97_step(double *s,
 				int stride,
 				double *work);
 
+int
+cdf97_lift_periodic_forward1d_cdf97_panel_step(double *s,
+					       int width,
+					       double *work);
+
 /*
  * 1D Inverse
  */
@@ -51,6 +56,11 @@ cdf97_lift_periodic_inverse1d_cdf97_step(double *s,
 				int stride,
 				double *work);
 
+int
+cdf97_lift_periodic_inverse1d_cdf97_panel_step(double *s,
+					       int width,
+					       double *work);
+
 /*
  * 2D Forward
  */
@@ -20,9 +20,12 @@
 
 #include <stdio.h>
 #include <math.h>
+#include <string.h>
 
 #include "daub4_lift.h"
 
+#include "generic_lift.h"
+
 
 static const double a1 = 1.7320508075688772; /* Sqrt(3) */
 static const double b1 = 0.4330127018922193; /* sqrt(3)/4 */
@@ -112,6 +115,49 @@ daub4_lift_forward1d_daub4_step(double *s,
   return 0;
 }
 
+GENERIC_LIFT_SIMD
+int
+daub4_lift_forward1d_daub4_panel_step(double *s,
+				      int width,
+				      double *work)
+{
+  int i;
+
+  /*
+   * Copy to workspace
+   */
+  memcpy(work, s, sizeof(double) * width * GENERIC_LIFT_PANEL);
+
+  /*
+   * Lifting steps
+   */
+
+  /* Odd */
+  for (i = 1; i < width; i += 2) {
+    generic_lift_panel_add(work, i, i - 1, -a1);
+  }
+
+  /* Even */
+  for (i = 0; i < width; i += 2) {
+    generic_lift_panel_add2(work, i, i + 1, b1, (i + 3) % width, b2);
+  }
+
+  /* Odd */
+  for (i = 1; i < width; i += 2) {
+    generic_lift_panel_add(work, i, (width + i - 3) % width, 1.0);
+  }
+
+  /*
+   * Copy back and de-interleave
+   */
+  for (i = 0; i < width/2; i ++) {
+    generic_lift_panel_scale(s, i, work, 2*i, k1);
+    generic_lift_panel_scale(s, width/2 + i, work, 2*i + 1, k2);
+  }
+
+  return 0;
+}
+
 int
 daub4_lift_inverse1d_daub4(double *s,
 			   int width,
@@ -187,6 +233,49 @@ daub4_lift_inverse1d_daub4_step(double *s,
   return 0;
 }
 
+GENERIC_LIFT_SIMD
+int
+daub4_lift_inverse1d_daub4_panel_step(double *s,
+				      int width,
+				      double *work)
+{
+  int i;
+
+  /*
+   * Copy to workspace and interleave
+   */
+  for (i = 0; i < width/2; i ++) {
+    generic_lift_panel_scale(work, 2*i, s, i, ik1);
+    generic_lift_panel_scale(work, 2*i + 1, s, width/2 + i, ik2);
+  }
+
+  /*
+   * Inverse lifting steps
+   */
+
+  /* Odd */
+  for (i = 1; i < width; i += 2) {
+    generic_lift_panel_add(work, i, (width + i - 3) % width, -1.0);
+  }
+
+  /* Even */
+  for (i = 0; i < width; i += 2) {
+    generic_lift_panel_add2(work, i, i + 1, -b1, (i + 3) % width, -b2);
+  }
+
+  /* Odd */
+  for (i = 1; i < width; i += 2) {
+    generic_lift_panel_add(work, i, i - 1, a1);
+  }
+
+  /*
+   * Copy back
+   */
+  memcpy(s, work, sizeof(double) * width * GENERIC_LIFT_PANEL);
+
+  return 0;
+}
+
 /*
  * 2D
  */
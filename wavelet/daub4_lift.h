@@ -36,6 +36,11 @@ daub4_lift_forward1d_daub4_step(double *s,
 				int stride,
 				double *work);
 
+int
+daub4_lift_forward1d_daub4_panel_step(double *s,
+				      int width,
+				      double *work);
+
 /*
  * 1D Inverse
  */
@@ -51,6 +56,11 @@ daub4_lift_inverse1d_daub4_step(double *s,
 				int stride,
 				double *work);
 
+int
+daub4_lift_inverse1d_daub4_panel_step(double *s,
+				      int width,
+				      double *work);
+
 /*
  * 2D Forward
  */
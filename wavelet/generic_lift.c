@@ -22,6 +22,120 @@
 
 #include "generic_lift.h"
 
+#include "cdf97_lift.h"
+#include "cdf97_lift_periodic.h"
+#include "daub4_lift.h"
+#include "haar_lift.h"
+
+#include "slog.h"
+
+/*
+ * Passes with fewer samples than this are not split across threads
+ */
+#define THREAD_MIN_SAMPLES 4096
+
+static const struct {
+  generic_lift_forward1d_step_t step;
+  generic_lift_panel_step_t panel_step;
+} panel_steps[] = {
+  {cdf97_lift_forward1d_cdf97_step, cdf97_lift_forward1d_cdf97_panel_step},
+  {cdf97_lift_inverse1d_cdf97_step, cdf97_lift_inverse1d_cdf97_panel_step},
+  {cdf97_lift_periodic_forward1d_cdf97_step, cdf97_lift_periodic_forward1d_cdf97_panel_step},
+  {cdf97_lift_periodic_inverse1d_cdf97_step, cdf97_lift_periodic_inverse1d_cdf97_panel_step},
+  {daub4_lift_forward1d_daub4_step, daub4_lift_forward1d_daub4_panel_step},
+  {daub4_lift_inverse1d_daub4_step, daub4_lift_inverse1d_daub4_panel_step},
+  {haar_lift_forward1d_haar_step, haar_lift_forward1d_haar_panel_step},
+  {haar_lift_inverse1d_haar_step, haar_lift_inverse1d_haar_panel_step}
+};
+
+typedef struct {
+  double *s;
+  int n;
+  int nstride;
+  int m;
+  int mstride;
+  int len;
+  int stride;
+  generic_lift_forward1d_step_t transform;
+} plane_job_t;
+
+static int panel_pass(double *s,
+		      int n,
+		      int len,
+		      int stride,
+		      double *panel,
+		      generic_lift_panel_step_t panel_step);
+
+static int column_pass(double *s,
+		       int n,
+		       int len,
+		       int stride,
+		       double *work,
+		       double *panel,
+		       generic_lift_forward1d_step_t transform);
+
+static int plane_pass(double *s,
+		      int n,
+		      int nstride,
+		      int m,
+		      int mstride,
+		      int len,
+		      int stride,
+		      double *work,
+		      double *panel,
+		      generic_lift_pool_t *pool,
+		      generic_lift_forward1d_step_t transform);
+
+static int forward2d(double *s,
+		     int width,
+		     int height,
+		     int stride,
+		     double *work,
+		     double *panel,
+		     generic_lift_pool_t *pool,
+		     generic_lift_forward1d_step_t row_transform,
+		     generic_lift_forward1d_step_t col_transform,
+		     int subtile);
+
+static int inverse2d(double *s,
+		     int width,
+		     int height,
+		     int stride,
+		     double *work,
+		     double *panel,
+		     generic_lift_pool_t *pool,
+		     generic_lift_inverse1d_step_t row_transform,
+		     generic_lift_inverse1d_step_t col_transform,
+		     int subtile);
+
+static int forward3d(double *s,
+		     int width,
+		     int height,
+		     int depth,
+		     int rowstride,
+		     int slicestride,
+		     double *work,
+		     double *panel,
+		     generic_lift_pool_t *pool,
+		     generic_lift_forward1d_step_t row_transform,
+		     generic_lift_forward1d_step_t col_transform,
+		     generic_lift_forward1d_step_t dep_transform,
+		     int subtile);
+
+static int inverse3d(double *s,
+		     int width,
+		     int height,
+		     int depth,
+		     int rowstride,
+		     int slicestride,
+		     double *work,
+		     double *panel,
+		     generic_lift_pool_t *pool,
+		     generic_lift_inverse1d_step_t row_transform,
+		     generic_lift_inverse1d_step_t col_transform,
+		     generic_lift_inverse1d_step_t dep_transform,
+		     int subtile);
+
 /*
  * 1D Full Transform
  */
@@ -134,10 +248,62 @@ generic_lift_forward2d(double *s,
 		       generic_lift_forward1d_step_t row_transform,
 		       generic_lift_forward1d_step_t col_transform,
 		       int subtile)
+{
+  return forward2d(s, width, height, stride, work, NULL, NULL,
+		   row_transform, col_transform, subtile);
+}
+
+int
+generic_lift_forward2d_blocked(double *s,
+			       int width,
+			       int height,
+			       int stride,
+			       double *work,
+			       double *panel,
+			       generic_lift_forward1d_step_t row_transform,
+			       generic_lift_forward1d_step_t col_transform,
+			       int subtile)
+{
+  return forward2d(s, width, height, stride, work, panel, NULL,
+		   row_transform, col_transform, subtile);
+}
+
+int
+generic_lift_forward2d_threaded(double *s,
+				int width,
+				int height,
+				int stride,
+				generic_lift_pool_t *pool,
+				generic_lift_forward1d_step_t row_transform,
+				generic_lift_forward1d_step_t col_transform,
+				int subtile)
+{
+  if (generic_lift_pool_size(pool) < width ||
+      generic_lift_pool_size(pool) < height) {
+    ERROR("pool size too small for %d x %d", width, height);
+    return -1;
+  }
+
+  return forward2d(s, width, height, stride,
+		   generic_lift_pool_work(pool, 0),
+		   generic_lift_pool_panel(pool, 0),
+		   pool,
+		   row_transform, col_transform, subtile);
+}
+
+static int forward2d(double *s,
+		     int width,
+		     int height,
+		     int stride,
+		     double *work,
+		     double *panel,
+		     generic_lift_pool_t *pool,
+		     generic_lift_forward1d_step_t row_transform,
+		     generic_lift_forward1d_step_t col_transform,
+		     int subtile)
 {
   int w;
   int h;
-  int i;
 
   w = width;
   h = height;
@@ -147,25 +313,15 @@ generic_lift_forward2d(double *s,
     /*
      * 1D Transform on Columns
      */
-    for (i = 0; i < w; i ++) {
-      if (col_transform(s + i,
-			h,
-			stride,
-			work) < 0) {
-	return -1;
-      }
+    if (plane_pass(s, w, 1, 1, 0, h, stride, work, panel, pool, col_transform) < 0) {
+      return -1;
     }
 
     /*
      * 1D Transform on Rows
      */
-    for (i = 0; i < h; i ++) {
-      if (row_transform(s + i*stride,
-			w,
-			1,
-			work) < 0) {
-	return -1;
-      }
+    if (plane_pass(s, h, stride, 1, 0, w, 1, work, panel, pool, row_transform) < 0) {
+      return -1;
     }
 
     w >>= 1;
@@ -208,6 +364,59 @@ generic_lift_inverse2d(double *s,
 		       generic_lift_inverse1d_step_t row_transform,
 		       generic_lift_inverse1d_step_t col_transform,
 		       int subtile)
+{
+  return inverse2d(s, width, height, stride, work, NULL, NULL,
+		   row_transform, col_transform, subtile);
+}
+
+int
+generic_lift_inverse2d_blocked(double *s,
+			       int width,
+			       int height,
+			       int stride,
+			       double *work,
+			       double *panel,
+			       generic_lift_inverse1d_step_t row_transform,
+			       generic_lift_inverse1d_step_t col_transform,
+			       int subtile)
+{
+  return inverse2d(s, width, height, stride, work, panel, NULL,
+		   row_transform, col_transform, subtile);
+}
+
+int
+generic_lift_inverse2d_threaded(double *s,
+				int width,
+				int height,
+				int stride,
+				generic_lift_pool_t *pool,
+				generic_lift_inverse1d_step_t row_transform,
+				generic_lift_inverse1d_step_t col_transform,
+				int subtile)
+{
+  if (generic_lift_pool_size(pool) < width ||
+      generic_lift_pool_size(pool) < height) {
+    ERROR("pool size too small for %d x %d", width, height);
+    return -1;
+  }
+
+  return inverse2d(s, width, height, stride,
+		   generic_lift_pool_work(pool, 0),
+		   generic_lift_pool_panel(pool, 0),
+		   pool,
+		   row_transform, col_transform, subtile);
+}
+
+static int inverse2d(double *s,
+		     int width,
+		     int height,
+		     int stride,
+		     double *work,
+		     double *panel,
+		     generic_lift_pool_t *pool,
+		     generic_lift_inverse1d_step_t row_transform,
+		     generic_lift_inverse1d_step_t col_transform,
+		     int subtile)
 {
   int w;
   int h;
@@ -216,7 +425,6 @@ generic_lift_inverse2d(double *s,
   int wlevels;
   int hlevels;
   int i;
-  int j;
 
   w = width;
   h = height;
@@ -265,27 +473,123 @@ generic_lift_inverse2d(double *s,
     /*
      * 1D Transform on Rows
      */
-    for (j = 0; j < h; j ++) {
-      if (row_transform(s + j*stride,
-			w,
-			1,
-			work) < 0) {
-	return -1;
-      }
+    if (plane_pass(s, h, stride, 1, 0, w, 1, work, panel, pool, row_transform) < 0) {
+      return -1;
     }
 
     /*
      * 1D Transform on Columns
      */
-    for (j = 0; j < w; j ++) {
-      if (col_transform(s + j,
-			h,
-			stride,
-			work) < 0) {
+    if (plane_pass(s, w, 1, 1, 0, h, stride, work, panel, pool, col_transform) < 0) {
+      return -1;
+    }
+
+    w <<= 1;
+    h <<= 1;
+  }
+
+  return 0;
+}
+
+int
+generic_lift_inverse2d_sparse(double *s,
+			      int width,
+			      int height,
+			      int stride,
+			      double *work,
+			      double *panel,
+			      const int *row_first,
+			      generic_lift_inverse1d_step_t row_transform,
+			      generic_lift_inverse1d_step_t col_transform,
+			      int subtile)
+{
+  int w;
+  int h;
+  int levels;
+  int wlevels;
+  int hlevels;
+  int i;
+  int j;
+  int k;
+  int dense;
+  int active;
+
+  w = width;
+  h = height;
+  levels = 0;
+  wlevels = 0;
+  hlevels = 0;
+
+  while (w > 2 && h > 2) {
+    levels ++;
+    w >>= 1;
+    h >>= 1;
+  }
+
+  if (!subtile) {
+    while (w > 2) {
+      wlevels ++;
+      w >>= 1;
+    }
+    
+    while (h > 2) {
+      hlevels ++;
+      h >>= 1;
+    }
+
+    /* Single row and column steps are cheap, do them regardless */
+    for (i = 0; i < wlevels; i ++) {
+      if (row_transform(s, w, 1, work) < 0) {
 	return -1;
       }
+      w <<= 1;
+    }
+    
+    for (i = 0; i < hlevels; i ++) {
+      if (col_transform(s, h, stride, work) < 0) {
+	return -1;
+      }
+      h <<= 1;
+    }
+  }
+
+  /*
+   * Rows below dense may be non-zero from the synthesis of the previous
+   * level, the first level also holds the single row and column steps so
+   * is taken as dense if anything is in it.
+   */
+  dense = 0;
+  for (j = 0; j < h; j ++) {
+    if (row_first[j] < w) {
+      dense = h;
+      break;
+    }
+  }
+  
+  for (i = 0; i <= levels; i ++) {
+
+    active = 0;
+    for (j = 0; j < h; j = k) {
+
+      /* Transform each run of rows that can be non-zero */
+      for (k = j; k < h && (k < dense || row_first[k] < w); k ++);
+
+      if (k > j) {
+	if (plane_pass(s + j*stride, k - j, stride, 1, 0, w, 1, work, panel, NULL, row_transform) < 0) {
+	  return -1;
+	}
+	active = 1;
+      } else {
+	k ++;
+      }
     }
 
+    if (active) {
+      if (plane_pass(s, w, 1, 1, 0, h, stride, work, panel, NULL, col_transform) < 0) {
+	return -1;
+      }
+      dense = h;
+    }
 
     w <<= 1;
     h <<= 1;
@@ -309,14 +613,73 @@ generic_lift_forward3d(double *s,
 		       generic_lift_forward1d_step_t col_transform,
 		       generic_lift_forward1d_step_t dep_transform,
 		       int subtile)
+{
+  return forward3d(s, width, height, depth, rowstride, slicestride, work, NULL, NULL,
+		   row_transform, col_transform, dep_transform, subtile);
+}
+
+int
+generic_lift_forward3d_blocked(double *s,
+			       int width,
+			       int height,
+			       int depth,
+			       int rowstride,
+			       int slicestride,
+			       double *work,
+			       double *panel,
+			       generic_lift_forward1d_step_t row_transform,
+			       generic_lift_forward1d_step_t col_transform,
+			       generic_lift_forward1d_step_t dep_transform,
+			       int subtile)
+{
+  return forward3d(s, width, height, depth, rowstride, slicestride, work, panel, NULL,
+		   row_transform, col_transform, dep_transform, subtile);
+}
+
+int
+generic_lift_forward3d_threaded(double *s,
+				int width,
+				int height,
+				int depth,
+				int rowstride,
+				int slicestride,
+				generic_lift_pool_t *pool,
+				generic_lift_forward1d_step_t row_transform,
+				generic_lift_forward1d_step_t col_transform,
+				generic_lift_forward1d_step_t dep_transform,
+				int subtile)
+{
+  if (generic_lift_pool_size(pool) < width ||
+      generic_lift_pool_size(pool) < height ||
+      generic_lift_pool_size(pool) < depth) {
+    ERROR("pool size too small for %d x %d x %d", width, height, depth);
+    return -1;
+  }
+
+  return forward3d(s, width, height, depth, rowstride, slicestride,
+		   generic_lift_pool_work(pool, 0),
+		   generic_lift_pool_panel(pool, 0),
+		   pool,
+		   row_transform, col_transform, dep_transform, subtile);
+}
+
+static int forward3d(double *s,
+		     int width,
+		     int height,
+		     int depth,
+		     int rowstride,
+		     int slicestride,
+		     double *work,
+		     double *panel,
+		     generic_lift_pool_t *pool,
+		     generic_lift_forward1d_step_t row_transform,
+		     generic_lift_forward1d_step_t col_transform,
+		     generic_lift_forward1d_step_t dep_transform,
+		     int subtile)
 {
   int w;
   int h;
   int d;
-
-  int i;
-  int j;
-  int o;
   
   w = width;
   h = height;
@@ -330,51 +693,22 @@ generic_lift_forward3d(double *s,
     /*
      * 1D Transform on Rows
      */
-    for (i = 0; i < h; i ++) {
-      for (j = 0; j < d; j ++) {
-
-	o = j*slicestride + i*rowstride;
-	if (row_transform(s + o,
-			  w,
-			  1,
-			  work) < 0) {
-	  return -1;
-	}
-      }
+    if (plane_pass(s, h, rowstride, d, slicestride, w, 1, work, panel, pool, row_transform) < 0) {
+      return -1;
     }
 
     /*
      * 1D Transform on Columns
      */
-    for (i = 0; i < w; i ++) {
-      for (j = 0; j < d; j ++) {
-
-	o = j*slicestride + i;
-
-	if (col_transform(s + o,
-			  h,
-			  rowstride,
-			  work) < 0) {
-	  return -1;
-	}
-      }
+    if (plane_pass(s, w, 1, d, slicestride, h, rowstride, work, panel, pool, col_transform) < 0) {
+      return -1;
     }
 			
     /*
      * 1D Transform on Slices
      */
-    for (i = 0; i < w; i ++) {
-      for (j = 0; j < h; j ++) {
-
-	o = j*rowstride + i;
-
-	if (dep_transform(s + o,
-			  d,
-			  slicestride,
-			  work) < 0) {
-	  return -1;
-	}
-      }
+    if (plane_pass(s, w, 1, h, rowstride, d, slicestride, work, panel, pool, dep_transform) < 0) {
+      return -1;
     }
 	
     w >>= 1;
@@ -392,28 +726,15 @@ generic_lift_forward3d(double *s,
 	/*
 	 * 1D Transform on Rows
 	 */
-	for (i = 0; i < h; i ++) {
-	  o = i*rowstride;
-	  if (row_transform(s + o,
-			    w,
-			    1,
-			    work) < 0) {
-	    return -1;
-	  }
+	if (plane_pass(s, h, rowstride, 1, 0, w, 1, work, panel, pool, row_transform) < 0) {
+	  return -1;
 	}
 	
 	/*
 	 * 1D Transform on Columns
 	 */
-	for (i = 0; i < w; i ++) {
-	  o = i;
-	  
-	  if (col_transform(s + o,
-			    h,
-			    rowstride,
-			    work) < 0) {
-	    return -1;
-	  }
+	if (plane_pass(s, w, 1, 1, 0, h, rowstride, work, panel, pool, col_transform) < 0) {
+	  return -1;
 	}
 	
 	w >>= 1;
@@ -427,31 +748,16 @@ generic_lift_forward3d(double *s,
 	/*
 	 * 1D Transform on Rows
 	 */
-	for (j = 0; j < d; j ++) {
-	  
-	  o = j*slicestride;
-	  if (row_transform(s + o,
-			    w,
-			    1,
-			    work) < 0) {
-	    return -1;
-	  }
+	if (plane_pass(s, d, slicestride, 1, 0, w, 1, work, panel, pool, row_transform) < 0) {
+	  return -1;
 	}
 	
 	
 	/*
 	 * 1D Transform on Slices
 	 */
-	for (i = 0; i < w; i ++) {
-	  
-	  o = i;
-	  
-	  if (dep_transform(s + o,
-			    d,
-			    slicestride,
-			    work) < 0) {
-	    return -1;
-	  }
+	if (plane_pass(s, w, 1, 1, 0, d, slicestride, work, panel, pool, dep_transform) < 0) {
+	  return -1;
 	}
 	
 	w >>= 1;
@@ -467,31 +773,15 @@ generic_lift_forward3d(double *s,
 	/*
 	 * 1D Transform on Columns
 	 */
-	for (j = 0; j < d; j ++) {
-	  
-	  o = j*slicestride;
-	  
-	  if (col_transform(s + o,
-			    h,
-			    rowstride,
-			    work) < 0) {
-	    return -1;
-	  }
+	if (plane_pass(s, d, slicestride, 1, 0, h, rowstride, work, panel, pool, col_transform) < 0) {
+	  return -1;
 	}
 	
 	/*
 	 * 1D Transform on Slices
 	 */
-	for (j = 0; j < h; j ++) {
-	  
-	  o = j*rowstride;
-	  
-	  if (dep_transform(s + o,
-			    d,
-			    slicestride,
-			    work) < 0) {
-	    return -1;
-	  }
+	if (plane_pass(s, h, rowstride, 1, 0, d, slicestride, work, panel, pool, dep_transform) < 0) {
+	  return -1;
 	}
 	
 	h >>= 1;
@@ -548,6 +838,69 @@ generic_lift_inverse3d(double *s,
 		       generic_lift_inverse1d_step_t col_transform,
 		       generic_lift_inverse1d_step_t dep_transform,
 		       int subtile)
+{
+  return inverse3d(s, width, height, depth, rowstride, slicestride, work, NULL, NULL,
+		   row_transform, col_transform, dep_transform, subtile);
+}
+
+int
+generic_lift_inverse3d_blocked(double *s,
+			       int width,
+			       int height,
+			       int depth,
+			       int rowstride,
+			       int slicestride,
+			       double *work,
+			       double *panel,
+			       generic_lift_inverse1d_step_t row_transform,
+			       generic_lift_inverse1d_step_t col_transform,
+			       generic_lift_inverse1d_step_t dep_transform,
+			       int subtile)
+{
+  return inverse3d(s, width, height, depth, rowstride, slicestride, work, panel, NULL,
+		   row_transform, col_transform, dep_transform, subtile);
+}
+
+int
+generic_lift_inverse3d_threaded(double *s,
+				int width,
+				int height,
+				int depth,
+				int rowstride,
+				int slicestride,
+				generic_lift_pool_t *pool,
+				generic_lift_inverse1d_step_t row_transform,
+				generic_lift_inverse1d_step_t col_transform,
+				generic_lift_inverse1d_step_t dep_transform,
+				int subtile)
+{
+  if (generic_lift_pool_size(pool) < width ||
+      generic_lift_pool_size(pool) < height ||
+      generic_lift_pool_size(pool) < depth) {
+    ERROR("pool size too small for %d x %d x %d", width, height, depth);
+    return -1;
+  }
+
+  return inverse3d(s, width, height, depth, rowstride, slicestride,
+		   generic_lift_pool_work(pool, 0),
+		   generic_lift_pool_panel(pool, 0),
+		   pool,
+		   row_transform, col_transform, dep_transform, subtile);
+}
+
+static int inverse3d(double *s,
+		     int width,
+		     int height,
+		     int depth,
+		     int rowstride,
+		     int slicestride,
+		     double *work,
+		     double *panel,
+		     generic_lift_pool_t *pool,
+		     generic_lift_inverse1d_step_t row_transform,
+		     generic_lift_inverse1d_step_t col_transform,
+		     generic_lift_inverse1d_step_t dep_transform,
+		     int subtile)
 {
   int w;
   int h;
@@ -563,10 +916,6 @@ generic_lift_inverse3d(double *s,
   int dlevels;
 
   int i;
-  int j;
-  int k;
-
-  int o;
 
   w = width;
   h = height;
@@ -654,16 +1003,12 @@ generic_lift_inverse3d(double *s,
      */
     for (i = 0; i < whlevels; i ++) {
 
-      for (j = 0; j < w; j ++) {
-	if (col_transform(s + j, h, rowstride, work) < 0) {
-	  return -1;
-	}
+      if (plane_pass(s, w, 1, 1, 0, h, rowstride, work, panel, pool, col_transform) < 0) {
+	return -1;
       }
 
-      for (j = 0; j < h; j ++) {
-	if (row_transform(s + j*rowstride, w, 1, work) < 0) {
-	  return -1;
-	}
+      if (plane_pass(s, h, rowstride, 1, 0, w, 1, work, panel, pool, row_transform) < 0) {
+	return -1;
       }
 
       w <<= 1;
@@ -672,16 +1017,12 @@ generic_lift_inverse3d(double *s,
     
     for (i = 0; i < wdlevels; i ++) {
 
-      for (j = 0; j < w; j ++) {
-	if (dep_transform(s + j, d, slicestride, work) < 0) {
-	  return -1;
-	}
+      if (plane_pass(s, w, 1, 1, 0, d, slicestride, work, panel, pool, dep_transform) < 0) {
+	return -1;
       }
 
-      for (j = 0; j < d; j ++) {
-	if (row_transform(s + j*slicestride, w, 1, work) < 0) {
-	  return -1;
-	}
+      if (plane_pass(s, d, slicestride, 1, 0, w, 1, work, panel, pool, row_transform) < 0) {
+	return -1;
       }
 
       w <<= 1;
@@ -690,16 +1031,12 @@ generic_lift_inverse3d(double *s,
     
     for (i = 0; i < hdlevels; i ++) {
 
-      for (j = 0; j < h; j ++) {
-	if (dep_transform(s + j * rowstride, d, slicestride, work) < 0) {
-	  return -1;
-	}
+      if (plane_pass(s, h, rowstride, 1, 0, d, slicestride, work, panel, pool, dep_transform) < 0) {
+	return -1;
       }
 
-      for (j = 0; j < d; j ++) {
-	if (col_transform(s + j*slicestride, h, rowstride, work) < 0) {
-	  return -1;
-	}
+      if (plane_pass(s, d, slicestride, 1, 0, h, rowstride, work, panel, pool, col_transform) < 0) {
+	return -1;
       }
 
       h <<= 1;
@@ -715,40 +1052,22 @@ generic_lift_inverse3d(double *s,
     /*
      * 1D Transform on Slices
      */
-    for (j = 0; j < w; j ++) {
-      for (k = 0; k < h; k ++) {
-	o = k * rowstride + j;
-
-	if (dep_transform(s + o, d, slicestride, work) < 0) {
-	  return -1;
-	}
-      }
+    if (plane_pass(s, w, 1, h, rowstride, d, slicestride, work, panel, pool, dep_transform) < 0) {
+      return -1;
     }
 	
     /*
      * 1D Transform on Columns
      */
-    for (j = 0; j < w; j ++) {
-      for (k = 0; k < d; k ++) {
-	o = k * slicestride + j;
-
-	if (col_transform(s + o, h, rowstride, work) < 0) {
-	  return -1;
-	}
-      }
+    if (plane_pass(s, w, 1, d, slicestride, h, rowstride, work, panel, pool, col_transform) < 0) {
+      return -1;
     }
 
     /*
      * 1D Transform on Rows
      */
-    for (j = 0; j < h; j ++) {
-      for (k = 0; k < d; k ++) {
-	o = k * slicestride + j * rowstride;
-
-	if (col_transform(s + o, w, 1, work) < 0) {
-	  return -1;
-	}
-      }
+    if (plane_pass(s, h, rowstride, d, slicestride, w, 1, work, panel, pool, col_transform) < 0) {
+      return -1;
     }
 
     w <<= 1;
@@ -759,3 +1078,265 @@ generic_lift_inverse3d(double *s,
   return 0;
 }
 
+/*
+ * Applies transform to the n x m strided lines with line (a, b) starting at
+ * s + a*nstride + b*mstride. When nstride is 1 the lines are adjacent and
+ * transformed as columns in panels. With a pool, blocks of up to
+ * GENERIC_LIFT_PANEL lines are shared out between the threads.
+ */
+static int plane_block(double *s,
+		       int n,
+		       int nstride,
+		       int len,
+		       int stride,
+		       double *work,
+		       double *panel,
+		       generic_lift_forward1d_step_t transform)
+{
+  int a;
+
+  if (nstride == 1) {
+    return column_pass(s, n, len, stride, work, panel, transform);
+  }
+
+  for (a = 0; a < n; a ++) {
+    if (transform(s + a*nstride, len, stride, work) < 0) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+static int plane_job(void *arg,
+		     int thread,
+		     int nthreads,
+		     double *work,
+		     double *panel)
+{
+  plane_job_t *job = (plane_job_t*)arg;
+  int nblocks;
+  int u;
+  int lo;
+  int hi;
+  int a;
+  int b;
+  int na;
+
+  nblocks = (job->n + GENERIC_LIFT_PANEL - 1)/GENERIC_LIFT_PANEL;
+  lo = (int)((long)job->m * nblocks * thread / nthreads);
+  hi = (int)((long)job->m * nblocks * (thread + 1) / nthreads);
+
+  for (u = lo; u < hi; u ++) {
+    b = u / nblocks;
+    a = (u % nblocks) * GENERIC_LIFT_PANEL;
+    na = job->n - a;
+    if (na > GENERIC_LIFT_PANEL) {
+      na = GENERIC_LIFT_PANEL;
+    }
+
+    if (plane_block(job->s + a*job->nstride + b*job->mstride,
+		    na,
+		    job->nstride,
+		    job->len,
+		    job->stride,
+		    work,
+		    panel,
+		    job->transform) < 0) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+static int plane_pass(double *s,
+		      int n,
+		      int nstride,
+		      int m,
+		      int mstride,
+		      int len,
+		      int stride,
+		      double *work,
+		      double *panel,
+		      generic_lift_pool_t *pool,
+		      generic_lift_forward1d_step_t transform)
+{
+  plane_job_t job;
+  int b;
+
+  if (pool == NULL ||
+      generic_lift_pool_nthreads(pool) == 1 ||
+      n * m < 2 ||
+      n * m * len < THREAD_MIN_SAMPLES) {
+
+    for (b = 0; b < m; b ++) {
+      if (plane_block(s + b*mstride, n, nstride, len, stride, work, panel, transform) < 0) {
+	return -1;
+      }
+    }
+
+    return 0;
+  }
+
+  job.s = s;
+  job.n = n;
+  job.nstride = nstride;
+  job.m = m;
+  job.mstride = mstride;
+  job.len = len;
+  job.stride = stride;
+  job.transform = transform;
+
+  return generic_lift_pool_run(pool, plane_job, &job);
+}
+
+/*
+ * Returns the panel step for a known step
+ */
+generic_lift_panel_step_t
+generic_lift_panel_step(generic_lift_forward1d_step_t transform)
+{
+  int i;
+
+  for (i = 0; i < (int)(sizeof(panel_steps)/sizeof(panel_steps[0])); i ++) {
+    if (panel_steps[i].step == transform) {
+      return panel_steps[i].panel_step;
+    }
+  }
+
+  return NULL;
+}
+
+/*
+ * Applies transform to the n adjacent strided lines starting at s. Without
+ * a panel each line is transformed in place. Steps with a panel step are
+ * vectorised across blocks of GENERIC_LIFT_PANEL lines, otherwise blocks
+ * of lines are gathered into contiguous rows of the panel so that each
+ * cache line of s is read and written once per block.
+ */
+static int column_pass(double *s,
+		       int n,
+		       int len,
+		       int stride,
+		       double *work,
+		       double *panel,
+		       generic_lift_forward1d_step_t transform)
+{
+  int i;
+  int j;
+  int k;
+  int nb;
+  double *p;
+  generic_lift_panel_step_t panel_step;
+
+  if (panel == NULL) {
+    for (i = 0; i < n; i ++) {
+      if (transform(s + i, len, stride, work) < 0) {
+	return -1;
+      }
+    }
+
+    return 0;
+  }
+
+  panel_step = generic_lift_panel_step(transform);
+  if (panel_step != NULL) {
+    return panel_pass(s, n, len, stride, panel, panel_step);
+  }
+
+  for (i = 0; i < n; i += GENERIC_LIFT_PANEL) {
+
+    nb = n - i;
+    if (nb > GENERIC_LIFT_PANEL) {
+      nb = GENERIC_LIFT_PANEL;
+    }
+
+    /*
+     * Gather
+     */
+    for (j = 0; j < len; j ++) {
+      p = s + j*stride + i;
+      for (k = 0; k < nb; k ++) {
+	panel[k*len + j] = p[k];
+      }
+    }
+
+    for (k = 0; k < nb; k ++) {
+      if (transform(panel + k*len, len, 1, work) < 0) {
+	return -1;
+      }
+    }
+
+    /*
+     * Scatter
+     */
+    for (j = 0; j < len; j ++) {
+      p = s + j*stride + i;
+      for (k = 0; k < nb; k ++) {
+	p[k] = panel[k*len + j];
+      }
+    }
+  }
+
+  return 0;
+}
+
+/*
+ * Gathers blocks of GENERIC_LIFT_PANEL lines interleaved into the panel,
+ * zero padding a partial last block, and applies the panel step with the
+ * second half of the panel as its workspace.
+ */
+static int panel_pass(double *s,
+		      int n,
+		      int len,
+		      int stride,
+		      double *panel,
+		      generic_lift_panel_step_t panel_step)
+{
+  int i;
+  int j;
+  int k;
+  int nb;
+  double *p;
+  double *q;
+
+  for (i = 0; i < n; i += GENERIC_LIFT_PANEL) {
+
+    nb = n - i;
+    if (nb > GENERIC_LIFT_PANEL) {
+      nb = GENERIC_LIFT_PANEL;
+    }
+
+    /*
+     * Gather
+     */
+    for (j = 0; j < len; j ++) {
+      p = s + j*stride + i;
+      q = panel + j*GENERIC_LIFT_PANEL;
+      for (k = 0; k < nb; k ++) {
+	q[k] = p[k];
+      }
+      for (; k < GENERIC_LIFT_PANEL; k ++) {
+	q[k] = 0.0;
+      }
+    }
+
+    if (panel_step(panel, len, panel + GENERIC_LIFT_PANEL*len) < 0) {
+      return -1;
+    }
+
+    /*
+     * Scatter
+     */
+    for (j = 0; j < len; j ++) {
+      p = s + j*stride + i;
+      q = panel + j*GENERIC_LIFT_PANEL;
+      for (k = 0; k < nb; k ++) {
+	p[k] = q[k];
+      }
+    }
+  }
+
+  return 0;
+}
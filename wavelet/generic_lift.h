@@ -21,6 +21,29 @@
 #ifndef generic_lift_h
 #define generic_lift_h
 
+#include "generic_lift_pool.h"
+
+/*
+ * No. of adjacent columns processed together by the blocked transforms
+ */
+#define GENERIC_LIFT_PANEL 16
+
+/*
+ * Size of the panel workspace required by the blocked transforms for lines
+ * of length n: the gathered lines plus the lifting workspace of the panel
+ * steps.
+ */
+#define GENERIC_LIFT_PANEL_SIZE(n) (2 * GENERIC_LIFT_PANEL * (n))
+
+/*
+ * When built with WAVELET_SIMD on x86-64 gcc, the panel steps are compiled
+ * for AVX-512, AVX2 and the SSE2 baseline with the best chosen at load time.
+ */
+#if defined(WAVELET_SIMD) && defined(__x86_64__) && defined(__GNUC__) && !defined(__clang__)
+#define GENERIC_LIFT_SIMD __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define GENERIC_LIFT_SIMD
+#endif
 
 typedef int (*generic_lift_forward1d_step_t)(double *s,
 					     int width,
@@ -32,6 +55,76 @@ typedef int (*generic_lift_inverse1d_step_t)(double *s,
 					     int stride,
 					     double *work);
 
+/*
+ * Panel steps transform GENERIC_LIFT_PANEL lines at once stored interleaved,
+ * ie line l sample i is s[i*GENERIC_LIFT_PANEL + l], so that each lifting
+ * update is a contiguous vector operation. The work array must be the same
+ * size as s.
+ */
+typedef int (*generic_lift_panel_step_t)(double *s,
+					 int width,
+					 double *work);
+
+/*
+ * Panel lifting updates on interleaved sample indices c, m, p etc shared by
+ * the panel steps.
+ */
+static inline void
+generic_lift_panel_lift(double *w, int c, int m, int p, double a)
+{
+  int l;
+  double *wc = w + c*GENERIC_LIFT_PANEL;
+  const double *wm = w + m*GENERIC_LIFT_PANEL;
+  const double *wp = w + p*GENERIC_LIFT_PANEL;
+
+  for (l = 0; l < GENERIC_LIFT_PANEL; l ++) {
+    wc[l] += a * (wm[l] + wp[l]);
+  }
+}
+
+static inline void
+generic_lift_panel_add(double *w, int c, int m, double a)
+{
+  int l;
+  double *wc = w + c*GENERIC_LIFT_PANEL;
+  const double *wm = w + m*GENERIC_LIFT_PANEL;
+
+  for (l = 0; l < GENERIC_LIFT_PANEL; l ++) {
+    wc[l] += a * wm[l];
+  }
+}
+
+static inline void
+generic_lift_panel_add2(double *w, int c, int x, double a, int y, double b)
+{
+  int l;
+  double *wc = w + c*GENERIC_LIFT_PANEL;
+  const double *wx = w + x*GENERIC_LIFT_PANEL;
+  const double *wy = w + y*GENERIC_LIFT_PANEL;
+
+  for (l = 0; l < GENERIC_LIFT_PANEL; l ++) {
+    wc[l] += a * wx[l] + b * wy[l];
+  }
+}
+
+static inline void
+generic_lift_panel_scale(double *restrict d, int i, const double *restrict s, int j, double k)
+{
+  int l;
+  double *restrict di = d + i*GENERIC_LIFT_PANEL;
+  const double *restrict sj = s + j*GENERIC_LIFT_PANEL;
+
+  for (l = 0; l < GENERIC_LIFT_PANEL; l ++) {
+    di[l] = k * sj[l];
+  }
+}
+
+/*
+ * Returns the panel step equivalent of a known 1D step or NULL
+ */
+generic_lift_panel_step_t
+generic_lift_panel_step(generic_lift_forward1d_step_t transform);
+
 /*
  * 1D Full Transform
  */
@@ -84,6 +177,79 @@ generic_lift_inverse2d(double *s,
 		       generic_lift_inverse1d_step_t col_transform,
 		       int subtile);
 
+/*
+ * 2D Blocked Full Transform: columns are transformed in panels of
+ * GENERIC_LIFT_PANEL gathered into the contiguous workspace panel, which
+ * must be of size GENERIC_LIFT_PANEL_SIZE(height). Steps with a panel step
+ * (see generic_lift_panel_step) are vectorised across the panel columns.
+ */
+int
+generic_lift_forward2d_blocked(double *s,
+			       int width,
+			       int height,
+			       int stride,
+			       double *work,
+			       double *panel,
+			       generic_lift_forward1d_step_t row_transform,
+			       generic_lift_forward1d_step_t col_transform,
+			       int subtile);
+
+int
+generic_lift_inverse2d_blocked(double *s,
+			       int width,
+			       int height,
+			       int stride,
+			       double *work,
+			       double *panel,
+			       generic_lift_inverse1d_step_t row_transform,
+			       generic_lift_inverse1d_step_t col_transform,
+			       int subtile);
+
+/*
+ * 2D Sparse Inverse Transform: as generic_lift_inverse2d (or the blocked
+ * version when panel is not NULL) but rows of each level that are known
+ * to be zero are not transformed, and levels with no non-zero rows are
+ * skipped entirely. row_first[j] is the smallest column of a non-zero
+ * coefficient in row j, width for an empty row. The result is identical
+ * to the dense transform.
+ */
+int
+generic_lift_inverse2d_sparse(double *s,
+			      int width,
+			      int height,
+			      int stride,
+			      double *work,
+			      double *panel,
+			      const int *row_first,
+			      generic_lift_inverse1d_step_t row_transform,
+			      generic_lift_inverse1d_step_t col_transform,
+			      int subtile);
+
+/*
+ * 2D Threaded Full Transform: the rows and columns of each level are split
+ * across the threads of pool, each with its own work and panel buffers. The
+ * pool size must be at least max(width, height).
+ */
+int
+generic_lift_forward2d_threaded(double *s,
+				int width,
+				int height,
+				int stride,
+				generic_lift_pool_t *pool,
+				generic_lift_forward1d_step_t row_transform,
+				generic_lift_forward1d_step_t col_transform,
+				int subtile);
+
+int
+generic_lift_inverse2d_threaded(double *s,
+				int width,
+				int height,
+				int stride,
+				generic_lift_pool_t *pool,
+				generic_lift_inverse1d_step_t row_transform,
+				generic_lift_inverse1d_step_t col_transform,
+				int subtile);
+
 /*
  * 3D Full Transform
  */
@@ -114,5 +280,66 @@ generic_lift_inverse3d(double *s,
 		       generic_lift_inverse1d_step_t dep_transform,
 		       int subtile);
 
+/*
+ * 3D Blocked Full Transform: column and slice transforms are done in
+ * panels, panel must be of size GENERIC_LIFT_PANEL_SIZE(max(height, depth)).
+ */
+int
+generic_lift_forward3d_blocked(double *s,
+			       int width,
+			       int height,
+			       int depth,
+			       int stride,
+			       int slicestride,
+			       double *work,
+			       double *panel,
+			       generic_lift_forward1d_step_t row_transform,
+			       generic_lift_forward1d_step_t col_transform,
+			       generic_lift_forward1d_step_t dep_transform,
+			       int subtile);
+
+int
+generic_lift_inverse3d_blocked(double *s,
+			       int width,
+			       int height,
+			       int depth,
+			       int stride,
+			       int slicestride,
+			       double *work,
+			       double *panel,
+			       generic_lift_inverse1d_step_t row_transform,
+			       generic_lift_inverse1d_step_t col_transform,
+			       generic_lift_inverse1d_step_t dep_transform,
+			       int subtile);
+
+/*
+ * 3D Threaded Full Transform: as for 2D, the pool size must be at least
+ * max(width, height, depth).
+ */
+int
+generic_lift_forward3d_threaded(double *s,
+				int width,
+				int height,
+				int depth,
+				int stride,
+				int slicestride,
+				generic_lift_pool_t *pool,
+				generic_lift_forward1d_step_t row_transform,
+				generic_lift_forward1d_step_t col_transform,
+				generic_lift_forward1d_step_t dep_transform,
+				int subtile);
+
+int
+generic_lift_inverse3d_threaded(double *s,
+				int width,
+				int height,
+				int depth,
+				int stride,
+				int slicestride,
+				generic_lift_pool_t *pool,
+				generic_lift_inverse1d_step_t row_transform,
+				generic_lift_inverse1d_step_t col_transform,
+				generic_lift_inverse1d_step_t dep_transform,
+				int subtile);
 
 #endif /* generic_lift_h */
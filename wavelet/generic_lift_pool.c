@@ -0,0 +1,263 @@
+//
+//    Wavelet transform library
+//    
+//    Copyright (C) 2014 - 2018 Rhys Hawkins
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <pthread.h>
+
+#include "generic_lift_pool.h"
+#include "generic_lift.h"
+
+#include "slog.h"
+
+typedef struct {
+  generic_lift_pool_t *pool;
+  int thread;
+} worker_t;
+
+struct _generic_lift_pool {
+
+  int nthreads;
+  int size;
+
+  double *work;    /* [nthreads * size] */
+  double *panel;   /* [nthreads * GENERIC_LIFT_PANEL_SIZE(size)] */
+
+  pthread_t *threads;  /* [nthreads - 1] */
+  worker_t *workers;   /* [nthreads - 1] */
+  int nstarted;
+
+  pthread_mutex_t mutex;
+  pthread_cond_t start;
+  pthread_cond_t done;
+
+  unsigned long generation;
+  int pending;
+  int quit;
+  int result;
+
+  generic_lift_pool_job_t job;
+  void *arg;
+};
+
+static void *worker_main(void *arg);
+
+generic_lift_pool_t *
+generic_lift_pool_create(int nthreads,
+			 int size)
+{
+  generic_lift_pool_t *pool;
+  int i;
+
+  if (nthreads < 1 || size < 1) {
+    ERROR("invalid parameters %d %d", nthreads, size);
+    return NULL;
+  }
+
+  pool = malloc(sizeof(generic_lift_pool_t));
+  if (pool == NULL) {
+    ERROR("failed to allocate struct");
+    return NULL;
+  }
+
+  pool->nthreads = nthreads;
+  pool->size = size;
+  pool->nstarted = 0;
+  pool->generation = 0;
+  pool->pending = 0;
+  pool->quit = 0;
+  pool->result = 0;
+  pool->job = NULL;
+  pool->arg = NULL;
+
+  /*
+   * Initialised first so that generic_lift_pool_destroy can release a
+   * partially created pool.
+   */
+  pthread_mutex_init(&(pool->mutex), NULL);
+  pthread_cond_init(&(pool->start), NULL);
+  pthread_cond_init(&(pool->done), NULL);
+
+  pool->work = malloc(sizeof(double) * nthreads * size);
+  pool->panel = malloc(sizeof(double) * nthreads * GENERIC_LIFT_PANEL_SIZE(size));
+  pool->threads = malloc(sizeof(pthread_t) * nthreads);
+  pool->workers = malloc(sizeof(worker_t) * nthreads);
+  if (pool->work == NULL ||
+      pool->panel == NULL ||
+      pool->threads == NULL ||
+      pool->workers == NULL) {
+    ERROR("failed to allocate thread buffers");
+    generic_lift_pool_destroy(pool);
+    return NULL;
+  }
+
+  for (i = 0; i < nthreads - 1; i ++) {
+    pool->workers[i].pool = pool;
+    pool->workers[i].thread = i + 1;
+
+    if (pthread_create(&(pool->threads[i]), NULL, worker_main, &(pool->workers[i])) != 0) {
+      ERROR("failed to start worker thread %d", i + 1);
+      generic_lift_pool_destroy(pool);
+      return NULL;
+    }
+
+    pool->nstarted ++;
+  }
+
+  return pool;
+}
+
+void
+generic_lift_pool_destroy(generic_lift_pool_t *pool)
+{
+  int i;
+
+  if (pool != NULL) {
+
+    pthread_mutex_lock(&(pool->mutex));
+    pool->quit = 1;
+    pthread_cond_broadcast(&(pool->start));
+    pthread_mutex_unlock(&(pool->mutex));
+
+    for (i = 0; i < pool->nstarted; i ++) {
+      pthread_join(pool->threads[i], NULL);
+    }
+
+    pthread_cond_destroy(&(pool->done));
+    pthread_cond_destroy(&(pool->start));
+    pthread_mutex_destroy(&(pool->mutex));
+
+    free(pool->workers);
+    free(pool->threads);
+    free(pool->panel);
+    free(pool->work);
+    free(pool);
+  }
+}
+
+int
+generic_lift_pool_nthreads(const generic_lift_pool_t *pool)
+{
+  return pool->nthreads;
+}
+
+int
+generic_lift_pool_size(const generic_lift_pool_t *pool)
+{
+  return pool->size;
+}
+
+double *
+generic_lift_pool_work(generic_lift_pool_t *pool,
+		       int thread)
+{
+  return pool->work + thread * pool->size;
+}
+
+double *
+generic_lift_pool_panel(generic_lift_pool_t *pool,
+			int thread)
+{
+  return pool->panel + thread * GENERIC_LIFT_PANEL_SIZE(pool->size);
+}
+
+int
+generic_lift_pool_run(generic_lift_pool_t *pool,
+		      generic_lift_pool_job_t job,
+		      void *arg)
+{
+  int r;
+
+  if (pool->nthreads == 1) {
+    return job(arg, 0, 1, generic_lift_pool_work(pool, 0), generic_lift_pool_panel(pool, 0));
+  }
+
+  pthread_mutex_lock(&(pool->mutex));
+  pool->job = job;
+  pool->arg = arg;
+  pool->result = 0;
+  pool->pending = pool->nthreads - 1;
+  pool->generation ++;
+  pthread_cond_broadcast(&(pool->start));
+  pthread_mutex_unlock(&(pool->mutex));
+
+  r = job(arg, 0, pool->nthreads, generic_lift_pool_work(pool, 0), generic_lift_pool_panel(pool, 0));
+
+  pthread_mutex_lock(&(pool->mutex));
+  while (pool->pending > 0) {
+    pthread_cond_wait(&(pool->done), &(pool->mutex));
+  }
+  if (r < 0) {
+    pool->result = -1;
+  }
+  r = pool->result;
+  pthread_mutex_unlock(&(pool->mutex));
+
+  return r;
+}
+
+static void *worker_main(void *arg)
+{
+  worker_t *w = (worker_t*)arg;
+  generic_lift_pool_t *pool = w->pool;
+  unsigned long seen;
+  generic_lift_pool_job_t job;
+  void *jobarg;
+  int r;
+
+  /*
+   * Jobs are counted from creation so a job started before this thread
+   * first takes the lock is not missed
+   */
+  seen = 0;
+
+  pthread_mutex_lock(&(pool->mutex));
+  for (;;) {
+    while (!pool->quit && pool->generation == seen) {
+      pthread_cond_wait(&(pool->start), &(pool->mutex));
+    }
+
+    if (pool->quit) {
+      break;
+    }
+
+    seen = pool->generation;
+    job = pool->job;
+    jobarg = pool->arg;
+    pthread_mutex_unlock(&(pool->mutex));
+
+    r = job(jobarg, w->thread, pool->nthreads,
+	    generic_lift_pool_work(pool, w->thread),
+	    generic_lift_pool_panel(pool, w->thread));
+
+    pthread_mutex_lock(&(pool->mutex));
+    if (r < 0) {
+      pool->result = -1;
+    }
+    pool->pending --;
+    if (pool->pending == 0) {
+      pthread_cond_signal(&(pool->done));
+    }
+  }
+
+  pthread_mutex_unlock(&(pool->mutex));
+  return NULL;
+}
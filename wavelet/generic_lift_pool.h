@@ -0,0 +1,80 @@
+//
+//    Wavelet transform library
+//    
+//    Copyright (C) 2014 - 2018 Rhys Hawkins
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+
+#ifndef generic_lift_pool_h
+#define generic_lift_pool_h
+
+/*
+ * A pool of worker threads with per-thread work and panel buffers used by
+ * the threaded generic lifting transforms. The calling thread takes part as
+ * thread 0, so a pool of n threads starts n - 1 workers. A pool runs one
+ * job at a time and must not be shared between concurrent transforms.
+ */
+typedef struct _generic_lift_pool generic_lift_pool_t;
+
+/*
+ * Job run on each thread with that thread's buffers, the buffers are of
+ * size and GENERIC_LIFT_PANEL_SIZE(size) respectively.
+ */
+typedef int (*generic_lift_pool_job_t)(void *arg,
+				       int thread,
+				       int nthreads,
+				       double *work,
+				       double *panel);
+
+/*
+ * Creates a pool of nthreads threads for transforms with lines of length up
+ * to size.
+ */
+generic_lift_pool_t *
+generic_lift_pool_create(int nthreads,
+			 int size);
+
+void
+generic_lift_pool_destroy(generic_lift_pool_t *pool);
+
+int
+generic_lift_pool_nthreads(const generic_lift_pool_t *pool);
+
+int
+generic_lift_pool_size(const generic_lift_pool_t *pool);
+
+/*
+ * The buffers of a thread, those of thread 0 may be used by the caller
+ * outside of generic_lift_pool_run.
+ */
+double *
+generic_lift_pool_work(generic_lift_pool_t *pool,
+		       int thread);
+
+double *
+generic_lift_pool_panel(generic_lift_pool_t *pool,
+			int thread);
+
+/*
+ * Runs job on all threads and waits for completion, returns -1 if any
+ * thread's job failed.
+ */
+int
+generic_lift_pool_run(generic_lift_pool_t *pool,
+		      generic_lift_pool_job_t job,
+		      void *arg);
+
+#endif /* generic_lift_pool_h */
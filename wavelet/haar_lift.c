@@ -18,8 +18,12 @@
 //
 //
 
+#include <string.h>
+
 #include "haar_lift.h"
 
+#include "generic_lift.h"
+
 /*
  * 1D Forward
  */
@@ -82,6 +86,41 @@ haar_lift_forward1d_haar_step(double *s,
   return 0;
 }
 
+GENERIC_LIFT_SIMD
+int
+haar_lift_forward1d_haar_panel_step(double *s,
+				    int width,
+				    double *work)
+{
+  int i;
+
+  /*
+   * Copy to workspace
+   */
+  memcpy(work, s, sizeof(double) * width * GENERIC_LIFT_PANEL);
+
+  /*
+   * Lifting steps
+   */
+  for (i = 1; i < width; i += 2) {
+    generic_lift_panel_add(work, i, i - 1, -1.0);
+  }
+
+  for (i = 0; i < width; i += 2) {
+    generic_lift_panel_add(work, i, i + 1, 0.5);
+  }
+
+  /*
+   * Copy back and de-interleave
+   */
+  for (i = 0; i < width/2; i ++) {
+    generic_lift_panel_scale(s, i, work, 2*i, 1.0);
+    generic_lift_panel_scale(s, width/2 + i, work, 2*i + 1, -0.5);
+  }
+
+  return 0;
+}
+
 /*
  * 1D Inverse
  */
@@ -154,6 +193,41 @@ haar_lift_inverse1d_haar_step(double *s,
   return 0;
 }
 
+GENERIC_LIFT_SIMD
+int
+haar_lift_inverse1d_haar_panel_step(double *s,
+				    int width,
+				    double *work)
+{
+  int i;
+
+  /*
+   * Copy to workspace and interleave
+   */
+  for (i = 0; i < width/2; i ++) {
+    generic_lift_panel_scale(work, 2*i, s, i, 1.0);
+    generic_lift_panel_scale(work, 2*i + 1, s, width/2 + i, -2.0);
+  }
+
+  /*
+   * Lifting steps
+   */
+  for (i = 0; i < width; i += 2) {
+    generic_lift_panel_add(work, i, i + 1, -0.5);
+  }
+
+  for (i = 1; i < width; i += 2) {
+    generic_lift_panel_add(work, i, i - 1, 1.0);
+  }
+
+  /*
+   * Copy back
+   */
+  memcpy(s, work, sizeof(double) * width * GENERIC_LIFT_PANEL);
+
+  return 0;
+}
+
 /*
  * 2D Forward
  */
@@ -36,6 +36,11 @@ haar_lift_forward1d_haar_step(double *s,
 			      int stride,
 			      double *work);
 
+int
+haar_lift_forward1d_haar_panel_step(double *s,
+				    int width,
+				    double *work);
+
 /*
  * 1D Inverse
  */
@@ -51,6 +56,11 @@ haar_lift_inverse1d_haar_step(double *s,
 			      int stride,
 			      double *work);
 
+int
+haar_lift_inverse1d_haar_panel_step(double *s,
+				    int width,
+				    double *work);
+
 /*
  * 2D Forward
  */
@@ -3,9 +3,11 @@
 #include <stdlib.h>
 #include <check.h>
 #include <math.h>
+#include <string.h>
 
 #include "cdf97_lift.h"
 #include "cdf97_lift_impulse.h"
+#include "haar_lift.h"
 
 START_TEST (test_cdf97_impulse_size)
 {
@@ -68,6 +70,47 @@ START_TEST (test_cdf97_impulse_1d_top)
 }
 END_TEST
 
+START_TEST (test_cdf97_impulse_response_1d)
+{
+  #define SIZE_1D_RESPONSE 64
+
+  double v[SIZE_1D_RESPONSE];
+  double wave[SIZE_1D_RESPONSE];
+  double workspace[SIZE_1D_RESPONSE];
+
+  int i;
+  int j;
+  int lo;
+  int hi;
+
+  for (i = 0; i < SIZE_1D_RESPONSE; i ++) {
+
+    memset(wave, 0, sizeof(double) * SIZE_1D_RESPONSE);
+    wave[i] = 1.0;
+    ck_assert(cdf97_lift_inverse1d_cdf97(wave, SIZE_1D_RESPONSE, 1, workspace) >= 0);
+
+    ck_assert(cdf97_lift_impulse_response_1d(SIZE_1D_RESPONSE, 6, i, v, workspace, &lo, &hi) >= 0);
+    ck_assert(lo <= hi);
+
+    for (j = 0; j < SIZE_1D_RESPONSE; j ++) {
+      ck_assert(v[j] == wave[j]);
+      if (j < lo || j > hi) {
+	ck_assert(v[j] == 0.0);
+      }
+    }
+
+    memset(wave, 0, sizeof(double) * SIZE_1D_RESPONSE);
+    wave[i] = 1.0;
+    ck_assert(haar_lift_inverse1d_haar(wave, SIZE_1D_RESPONSE, 1, workspace) >= 0);
+
+    ck_assert(haar_lift_impulse_response_1d(SIZE_1D_RESPONSE, 6, i, v, workspace, &lo, &hi) >= 0);
+
+    for (j = 0; j < SIZE_1D_RESPONSE; j ++) {
+      ck_assert(v[j] == wave[j]);
+    }
+  }
+}
+END_TEST
 
 Suite *
 cdf97_suite (void)
@@ -79,6 +122,7 @@ cdf97_suite (void)
 
   tcase_add_test (tc_core, test_cdf97_impulse_size);
   tcase_add_test (tc_core, test_cdf97_impulse_1d_top);
+  tcase_add_test (tc_core, test_cdf97_impulse_response_1d);
 
   suite_add_tcase (s, tc_core);
 
@@ -5,6 +5,9 @@
 #include <math.h>
 
 #include "cdf97_lift.h"
+#include "cdf97_lift_periodic.h"
+#include "daub4_lift.h"
+#include "haar_lift.h"
 #include "generic_lift.h"
 #include "boundary.h"
 
@@ -161,7 +164,7 @@ START_TEST (test_cdf97_superresolution)
     for (i = 0; i < NS1_WIDTH/2; i ++) {
       dx = (double)i - (double)NS1_WIDTH/4;
 
-      
+
       data[j * NS1_WIDTH + i] = exp(-(dx*dx + dy*dy));
 
       printf("%3.1f ", data[j * NS1_WIDTH + i]);
@@ -725,6 +728,396 @@ START_TEST (test_generic_cdf97_3d_sinusoid_nonsquare2_subtile)
 END_TEST
 #endif
 
+#define BLOCKED_NSTEPS 4
+
+static const generic_lift_forward1d_step_t blocked_forward[BLOCKED_NSTEPS] = {
+  haar_lift_forward1d_haar_step,
+  daub4_lift_forward1d_daub4_step,
+  cdf97_lift_forward1d_cdf97_step,
+  cdf97_lift_periodic_forward1d_cdf97_step
+};
+
+static const generic_lift_inverse1d_step_t blocked_inverse[BLOCKED_NSTEPS] = {
+  haar_lift_inverse1d_haar_step,
+  daub4_lift_inverse1d_daub4_step,
+  cdf97_lift_inverse1d_cdf97_step,
+  cdf97_lift_periodic_inverse1d_cdf97_step
+};
+
+START_TEST (test_generic_panel_step)
+{
+  double lines[GENERIC_LIFT_PANEL][64];
+  double panel[GENERIC_LIFT_PANEL * 64];
+  double work[GENERIC_LIFT_PANEL * 64];
+  generic_lift_panel_step_t panel_step;
+  int t;
+  int width;
+  int i;
+  int l;
+  int inverse;
+
+  for (t = 0; t < BLOCKED_NSTEPS; t ++) {
+    for (inverse = 0; inverse < 2; inverse ++) {
+
+      if (inverse) {
+	panel_step = generic_lift_panel_step(blocked_inverse[t]);
+      } else {
+	panel_step = generic_lift_panel_step(blocked_forward[t]);
+      }
+      ck_assert(panel_step != NULL);
+
+      for (width = 2; width <= 64; width <<= 1) {
+
+	for (l = 0; l < GENERIC_LIFT_PANEL; l ++) {
+	  for (i = 0; i < width; i ++) {
+	    lines[l][i] = sin((double)(i + 1) * 0.37 * (double)(l + 1));
+	    panel[i*GENERIC_LIFT_PANEL + l] = lines[l][i];
+	  }
+
+	  if (inverse) {
+	    ck_assert(blocked_inverse[t](lines[l], width, 1, work) >= 0);
+	  } else {
+	    ck_assert(blocked_forward[t](lines[l], width, 1, work) >= 0);
+	  }
+	}
+
+	ck_assert(panel_step(panel, width, work) >= 0);
+
+	for (l = 0; l < GENERIC_LIFT_PANEL; l ++) {
+	  for (i = 0; i < width; i ++) {
+	    ck_assert(fabs(panel[i*GENERIC_LIFT_PANEL + l] - lines[l][i]) < 1.0e-12);
+	  }
+	}
+      }
+    }
+  }
+}
+END_TEST
+
+START_TEST (test_generic_2d_blocked)
+{
+  static const int widths[3] = {64, 64, 8};
+  static const int heights[3] = {64, 16, 32};
+  
+  double data[64 * 64];
+  double blocked[64 * 64];
+  double work[64];
+  double panel[GENERIC_LIFT_PANEL_SIZE(64)];
+  int size;
+  int t;
+  int n;
+  int i;
+  int subtile;
+
+  for (t = 0; t < BLOCKED_NSTEPS; t ++) {
+    for (n = 0; n < 3; n ++) {
+      for (subtile = 0; subtile < 2; subtile ++) {
+
+	size = widths[n] * heights[n];
+	for (i = 0; i < size; i ++) {
+	  data[i] = sin((double)i * 0.37) + cos((double)(i % widths[n]) * 0.11);
+	  blocked[i] = data[i];
+	}
+
+	ck_assert(generic_lift_forward2d(data, widths[n], heights[n], widths[n], work,
+					 blocked_forward[t], blocked_forward[t], subtile) >= 0);
+	ck_assert(generic_lift_forward2d_blocked(blocked, widths[n], heights[n], widths[n], work, panel,
+						 blocked_forward[t], blocked_forward[t], subtile) >= 0);
+	for (i = 0; i < size; i ++) {
+	  ck_assert(fabs(data[i] - blocked[i]) < 1.0e-9);
+	}
+
+	ck_assert(generic_lift_inverse2d(data, widths[n], heights[n], widths[n], work,
+					 blocked_inverse[t], blocked_inverse[t], subtile) >= 0);
+	ck_assert(generic_lift_inverse2d_blocked(blocked, widths[n], heights[n], widths[n], work, panel,
+						 blocked_inverse[t], blocked_inverse[t], subtile) >= 0);
+	for (i = 0; i < size; i ++) {
+	  ck_assert(fabs(data[i] - blocked[i]) < 1.0e-9);
+	}
+      }
+    }
+  }
+}
+END_TEST
+
+/*
+ * Sparse coefficient images, mostly coarse with a few fine details, must
+ * give exactly the dense result.
+ */
+START_TEST (test_generic_2d_sparse)
+{
+  static const int widths[3] = {64, 64, 8};
+  static const int heights[3] = {64, 16, 32};
+  static const int ncoeffs[4] = {0, 1, 5, 20};
+
+  double dense[64 * 64];
+  double sparse[64 * 64];
+  double work[64];
+  double panel[GENERIC_LIFT_PANEL_SIZE(64)];
+  int row_first[64];
+  int size;
+  int t;
+  int n;
+  int c;
+  int i;
+  int j;
+  int k;
+  int subtile;
+  int blocked;
+
+  srand(2468);
+  
+  for (t = 0; t < BLOCKED_NSTEPS; t ++) {
+    for (n = 0; n < 3; n ++) {
+      for (c = 0; c < 4; c ++) {
+	for (subtile = 0; subtile < 2; subtile ++) {
+	  for (blocked = 0; blocked < 2; blocked ++) {
+
+	    size = widths[n] * heights[n];
+	    for (i = 0; i < size; i ++) {
+	      dense[i] = 0.0;
+	    }
+	    for (j = 0; j < heights[n]; j ++) {
+	      row_first[j] = widths[n];
+	    }
+
+	    for (k = 0; k < ncoeffs[c]; k ++) {
+	      /* The first at the origin then mostly in the top left */
+	      if (k == 0) {
+		i = 0;
+		j = 0;
+	      } else if (k % 5 == 0) {
+		i = rand() % widths[n];
+		j = rand() % heights[n];
+	      } else {
+		i = rand() % (widths[n]/4);
+		j = rand() % (heights[n]/4);
+	      }
+	      
+	      dense[j*widths[n] + i] = (double)rand()/(double)RAND_MAX - 0.5;
+	      if (i < row_first[j]) {
+		row_first[j] = i;
+	      }
+	    }
+
+	    for (i = 0; i < size; i ++) {
+	      sparse[i] = dense[i];
+	    }
+
+	    if (blocked) {
+	      ck_assert(generic_lift_inverse2d_blocked(dense, widths[n], heights[n], widths[n], work, panel,
+						       blocked_inverse[t], blocked_inverse[t], subtile) >= 0);
+	    } else {
+	      ck_assert(generic_lift_inverse2d(dense, widths[n], heights[n], widths[n], work,
+					       blocked_inverse[t], blocked_inverse[t], subtile) >= 0);
+	    }
+	    ck_assert(generic_lift_inverse2d_sparse(sparse, widths[n], heights[n], widths[n], work,
+						    blocked ? panel : NULL, row_first,
+						    blocked_inverse[t], blocked_inverse[t], subtile) >= 0);
+	    
+	    for (i = 0; i < size; i ++) {
+	      ck_assert(dense[i] == sparse[i]);
+	    }
+	  }
+	}
+      }
+    }
+  }
+}
+END_TEST
+
+START_TEST (test_generic_3d_blocked)
+{
+  static const int widths[3] = {32, 16, 32};
+  static const int heights[3] = {32, 32, 8};
+  static const int depths[3] = {32, 8, 16};
+  
+  double *data;
+  double *blocked;
+  double work[32];
+  double panel[GENERIC_LIFT_PANEL_SIZE(32)];
+  int size;
+  int t;
+  int n;
+  int i;
+  int subtile;
+
+  data = malloc(sizeof(double) * 32 * 32 * 32);
+  blocked = malloc(sizeof(double) * 32 * 32 * 32);
+  ck_assert(data != NULL && blocked != NULL);
+
+  for (t = 0; t < BLOCKED_NSTEPS; t ++) {
+    for (n = 0; n < 3; n ++) {
+      for (subtile = 0; subtile < 2; subtile ++) {
+
+	size = widths[n] * heights[n] * depths[n];
+	for (i = 0; i < size; i ++) {
+	  data[i] = sin((double)i * 0.37) + cos((double)(i % widths[n]) * 0.11);
+	  blocked[i] = data[i];
+	}
+
+	ck_assert(generic_lift_forward3d(data, widths[n], heights[n], depths[n],
+					 widths[n], widths[n] * heights[n], work,
+					 blocked_forward[t], blocked_forward[t], blocked_forward[t],
+					 subtile) >= 0);
+	ck_assert(generic_lift_forward3d_blocked(blocked, widths[n], heights[n], depths[n],
+						 widths[n], widths[n] * heights[n], work, panel,
+						 blocked_forward[t], blocked_forward[t], blocked_forward[t],
+						 subtile) >= 0);
+	for (i = 0; i < size; i ++) {
+	  ck_assert(fabs(data[i] - blocked[i]) < 1.0e-9);
+	}
+
+	ck_assert(generic_lift_inverse3d(data, widths[n], heights[n], depths[n],
+					 widths[n], widths[n] * heights[n], work,
+					 blocked_inverse[t], blocked_inverse[t], blocked_inverse[t],
+					 subtile) >= 0);
+	ck_assert(generic_lift_inverse3d_blocked(blocked, widths[n], heights[n], depths[n],
+						 widths[n], widths[n] * heights[n], work, panel,
+						 blocked_inverse[t], blocked_inverse[t], blocked_inverse[t],
+						 subtile) >= 0);
+	for (i = 0; i < size; i ++) {
+	  ck_assert(fabs(data[i] - blocked[i]) < 1.0e-9);
+	}
+      }
+    }
+  }
+
+  free(data);
+  free(blocked);
+}
+END_TEST
+
+START_TEST (test_generic_2d_threaded)
+{
+  static const int widths[3] = {128, 128, 16};
+  static const int heights[3] = {128, 32, 64};
+
+  generic_lift_pool_t *pool;
+  double *data;
+  double *threaded;
+  double work[128];
+  int size;
+  int t;
+  int n;
+  int i;
+  int subtile;
+
+  pool = generic_lift_pool_create(4, 128);
+  ck_assert(pool != NULL);
+  ck_assert(generic_lift_pool_nthreads(pool) == 4);
+
+  data = malloc(sizeof(double) * 128 * 128);
+  threaded = malloc(sizeof(double) * 128 * 128);
+  ck_assert(data != NULL && threaded != NULL);
+
+  for (t = 0; t < BLOCKED_NSTEPS; t ++) {
+    for (n = 0; n < 3; n ++) {
+      for (subtile = 0; subtile < 2; subtile ++) {
+
+	size = widths[n] * heights[n];
+	for (i = 0; i < size; i ++) {
+	  data[i] = sin((double)i * 0.37) + cos((double)(i % widths[n]) * 0.11);
+	  threaded[i] = data[i];
+	}
+
+	ck_assert(generic_lift_forward2d(data, widths[n], heights[n], widths[n], work,
+					 blocked_forward[t], blocked_forward[t], subtile) >= 0);
+	ck_assert(generic_lift_forward2d_threaded(threaded, widths[n], heights[n], widths[n], pool,
+						  blocked_forward[t], blocked_forward[t], subtile) >= 0);
+	for (i = 0; i < size; i ++) {
+	  ck_assert(fabs(data[i] - threaded[i]) < 1.0e-9);
+	}
+
+	ck_assert(generic_lift_inverse2d(data, widths[n], heights[n], widths[n], work,
+					 blocked_inverse[t], blocked_inverse[t], subtile) >= 0);
+	ck_assert(generic_lift_inverse2d_threaded(threaded, widths[n], heights[n], widths[n], pool,
+						  blocked_inverse[t], blocked_inverse[t], subtile) >= 0);
+	for (i = 0; i < size; i ++) {
+	  ck_assert(fabs(data[i] - threaded[i]) < 1.0e-9);
+	}
+      }
+    }
+  }
+
+  /*
+   * Pool too small
+   */
+  ck_assert(generic_lift_forward2d_threaded(threaded, 256, 256, 256, pool,
+					    blocked_forward[0], blocked_forward[0], 0) < 0);
+
+  free(data);
+  free(threaded);
+  generic_lift_pool_destroy(pool);
+}
+END_TEST
+
+START_TEST (test_generic_3d_threaded)
+{
+  static const int widths[3] = {32, 16, 32};
+  static const int heights[3] = {32, 32, 8};
+  static const int depths[3] = {32, 8, 16};
+
+  generic_lift_pool_t *pool;
+  double *data;
+  double *threaded;
+  double work[32];
+  int size;
+  int t;
+  int n;
+  int i;
+  int subtile;
+
+  pool = generic_lift_pool_create(3, 32);
+  ck_assert(pool != NULL);
+
+  data = malloc(sizeof(double) * 32 * 32 * 32);
+  threaded = malloc(sizeof(double) * 32 * 32 * 32);
+  ck_assert(data != NULL && threaded != NULL);
+
+  for (t = 0; t < BLOCKED_NSTEPS; t ++) {
+    for (n = 0; n < 3; n ++) {
+      for (subtile = 0; subtile < 2; subtile ++) {
+
+	size = widths[n] * heights[n] * depths[n];
+	for (i = 0; i < size; i ++) {
+	  data[i] = sin((double)i * 0.37) + cos((double)(i % widths[n]) * 0.11);
+	  threaded[i] = data[i];
+	}
+
+	ck_assert(generic_lift_forward3d(data, widths[n], heights[n], depths[n],
+					 widths[n], widths[n] * heights[n], work,
+					 blocked_forward[t], blocked_forward[t], blocked_forward[t],
+					 subtile) >= 0);
+	ck_assert(generic_lift_forward3d_threaded(threaded, widths[n], heights[n], depths[n],
+						  widths[n], widths[n] * heights[n], pool,
+						  blocked_forward[t], blocked_forward[t], blocked_forward[t],
+						  subtile) >= 0);
+	for (i = 0; i < size; i ++) {
+	  ck_assert(fabs(data[i] - threaded[i]) < 1.0e-9);
+	}
+
+	ck_assert(generic_lift_inverse3d(data, widths[n], heights[n], depths[n],
+					 widths[n], widths[n] * heights[n], work,
+					 blocked_inverse[t], blocked_inverse[t], blocked_inverse[t],
+					 subtile) >= 0);
+	ck_assert(generic_lift_inverse3d_threaded(threaded, widths[n], heights[n], depths[n],
+						  widths[n], widths[n] * heights[n], pool,
+						  blocked_inverse[t], blocked_inverse[t], blocked_inverse[t],
+						  subtile) >= 0);
+	for (i = 0; i < size; i ++) {
+	  ck_assert(fabs(data[i] - threaded[i]) < 1.0e-9);
+	}
+      }
+    }
+  }
+
+  free(data);
+  free(threaded);
+  generic_lift_pool_destroy(pool);
+}
+END_TEST
+
 Suite *
 cdf97_suite (void)
 {
@@ -737,6 +1130,13 @@ cdf97_suite (void)
 
   tcase_add_test (tc_core, test_cdf97_superresolution);
 
+  tcase_add_test (tc_core, test_generic_panel_step);
+  tcase_add_test (tc_core, test_generic_2d_blocked);
+  tcase_add_test (tc_core, test_generic_2d_sparse);
+  tcase_add_test (tc_core, test_generic_3d_blocked);
+  tcase_add_test (tc_core, test_generic_2d_threaded);
+  tcase_add_test (tc_core, test_generic_3d_threaded);
+
   /* tcase_add_test (tc_core, test_cdf97_2d_sinusoid_nonsquare2); */
   /* tcase_add_test (tc_core, test_cdf97_3d_sinusoid); */
   /* tcase_add_test (tc_core, test_cdf97_3d_sinusoid_nonsquare1); */
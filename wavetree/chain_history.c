@@ -27,6 +27,12 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
 #include "chain_history.h"
 
 #include "slog.h"
@@ -39,10 +45,75 @@ struct _chain_history {
   int maxsteps;
   int nsteps;
   chain_history_change_t *steps;
+
+  int block_steps;
 };
 
+/*
+ * Compact chunk header, followed by nblocks 64 bit block offsets relative to
+ * the end of the index and nbytes of block data.
+ */
+#define COMPACT_MAGIC "WTCH"
+#define COMPACT_VERSION 1
+
+typedef struct {
+  char magic[4];
+  int version;
+  int nsteps;
+  int nblocks;
+  int block_steps;
+  int reserved;
+  long long nbytes;
+} compact_header_t;
+
+/*
+ * Record tag: low 4 bits step type, then accepted and flags for likelihood,
+ * temperature and hierarchical being unchanged from the previous record.
+ */
+#define TAG_TYPE_MASK    0x0f
+#define TAG_ACCEPTED     0x10
+#define TAG_SAME_LIKE    0x20
+#define TAG_SAME_TEMP    0x40
+#define TAG_SAME_HIER    0x80
+
+typedef struct {
+  unsigned char *data;
+  size_t len;
+  size_t size;
+} buffer_t;
+
+typedef struct {
+  const unsigned char *p;
+  const unsigned char *end;
+} cursor_t;
+
+/*
+ * State carried between records in a block
+ */
+typedef struct {
+  int node_id;
+  double likelihood;
+  double temperature;
+  double hierarchical;
+} record_state_t;
+
 static int do_step(multiset_int_double_t *S_v,
 		   chain_history_change_t *step);
+static int check_chunk(const compact_header_t *header,
+		       const long long *offsets);
+
+static int encode_block(buffer_t *b,
+			buffer_t *keyframe,
+			const multiset_int_double_t *S_v,
+			const chain_history_change_t *previous,
+			const chain_history_change_t *steps,
+			int nsteps);
+static int decode_block_start(cursor_t *c,
+			      multiset_int_double_t *S_v,
+			      record_state_t *state);
+static int decode_record(cursor_t *c,
+			 record_state_t *state,
+			 chain_history_change_t *step);
 
 chain_history_t *
 chain_history_create(int maxsteps)
@@ -65,6 +136,7 @@ chain_history_create(int maxsteps)
 
   ch->maxsteps = maxsteps;
   ch->nsteps = 0;
+  ch->block_steps = CHAIN_HISTORY_BLOCK_STEPS;
   ch->steps = malloc(sizeof(chain_history_change_t) * maxsteps);
   if (ch->steps == NULL) {
     ERROR("failed to allocate steps");
@@ -302,6 +374,213 @@ chain_history_read(chain_history_t *ch,
     
 }
 
+int
+chain_history_set_block_steps(chain_history_t *ch,
+			      int block_steps)
+{
+  if (block_steps < 1) {
+    ERROR("invalid block size %d", block_steps);
+    return -1;
+  }
+
+  ch->block_steps = block_steps;
+  return 0;
+}
+
+int
+chain_history_write_compact(chain_history_t *ch,
+			    ch_write_t write_function,
+			    void *fp)
+{
+  compact_header_t header;
+  multiset_int_double_t *S_v;
+  buffer_t data;
+  buffer_t keyframe;
+  long long *offsets;
+  int first;
+  int n;
+  int b;
+  int i;
+  
+  if (ch->nsteps <= 0) {
+    ERROR("no steps");
+    return -1;
+  }
+
+  if (ch->steps[0].header.type != CH_INITIALISE) {
+    ERROR("first step is not initialisation");
+    return -1;
+  }
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, COMPACT_MAGIC, sizeof(header.magic));
+  header.version = COMPACT_VERSION;
+  header.nsteps = ch->nsteps;
+  header.block_steps = ch->block_steps;
+  header.nblocks = (ch->nsteps - 1 + ch->block_steps - 1)/ch->block_steps;
+  if (header.nblocks == 0) {
+    /* Block 0 still carries the initial model */
+    header.nblocks = 1;
+  }
+
+  memset(&data, 0, sizeof(buffer_t));
+  memset(&keyframe, 0, sizeof(buffer_t));
+
+  offsets = malloc(sizeof(long long) * header.nblocks);
+  S_v = multiset_int_double_create();
+  if (offsets == NULL || S_v == NULL) {
+    ERROR("failed to allocate memory");
+    goto fail;
+  }
+
+  if (multiset_int_double_clone(S_v, ch->S_v_initial) < 0) {
+    ERROR("failed to clone initial model");
+    goto fail;
+  }
+
+  for (b = 0; b < header.nblocks; b ++) {
+
+    first = 1 + b * ch->block_steps;
+    n = ch->nsteps - first;
+    if (n > ch->block_steps) {
+      n = ch->block_steps;
+    }
+
+    offsets[b] = data.len;
+    if (encode_block(&data, &keyframe, S_v, &(ch->steps[first - 1]), &(ch->steps[first]), n) < 0) {
+      ERROR("failed to encode block %d", b);
+      goto fail;
+    }
+
+    /* Advance the model to the start of the next block */
+    for (i = 0; i < n; i ++) {
+      if (do_step(S_v, &(ch->steps[first + i])) < 0) {
+	ERROR("failed to do step %d", first + i);
+	goto fail;
+      }
+    }
+  }
+
+  header.nbytes = data.len;
+
+  if (write_function(&header, sizeof(compact_header_t), 1, fp) != 1 ||
+      write_function(offsets, sizeof(long long), header.nblocks, fp) != header.nblocks ||
+      write_function(data.data, 1, data.len, fp) != data.len) {
+    ERROR("failed to write compact history");
+    goto fail;
+  }
+
+  multiset_int_double_destroy(S_v);
+  free(offsets);
+  free(data.data);
+  free(keyframe.data);
+  
+  return 0;
+
+ fail:
+  multiset_int_double_destroy(S_v);
+  free(offsets);
+  free(data.data);
+  free(keyframe.data);
+  return -1;
+}
+
+int
+chain_history_read_compact(chain_history_t *ch,
+			   ch_read_t read_function,
+			   void *fp)
+{
+  compact_header_t header;
+  long long *offsets;
+  unsigned char *data;
+  cursor_t c;
+  record_state_t state;
+  int b;
+  int i;
+
+  if (read_function(&header, sizeof(compact_header_t), 1, fp) != 1) {
+    /* End of file */
+    return -1;
+  }
+
+  if (memcmp(header.magic, COMPACT_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != COMPACT_VERSION) {
+    ERROR("not a compact chain history");
+    return -1;
+  }
+
+  if (header.nsteps > ch->maxsteps) {
+    ERROR("invalid number of steps (%d > %d)", header.nsteps, ch->maxsteps);
+    return -1;
+  }
+
+  if (header.nsteps < 1 ||
+      header.nblocks < 1 ||
+      header.nbytes < 0) {
+    ERROR("invalid compact history header");
+    return -1;
+  }
+
+  offsets = malloc(sizeof(long long) * header.nblocks);
+  data = malloc(header.nbytes > 0 ? header.nbytes : 1);
+  if (offsets == NULL || data == NULL) {
+    ERROR("failed to allocate memory");
+    goto fail;
+  }
+
+  if (read_function(offsets, sizeof(long long), header.nblocks, fp) != header.nblocks ||
+      read_function(data, 1, header.nbytes, fp) != header.nbytes) {
+    ERROR("failed to read compact history");
+    goto fail;
+  }
+
+  if (check_chunk(&header, offsets) < 0) {
+    goto fail;
+  }
+
+  memset(&(ch->steps[0]), 0, sizeof(chain_history_change_t));
+  ch->steps[0].header.type = CH_INITIALISE;
+
+  /*
+   * The records run on through the blocks, only the first keyframe is needed
+   */
+  i = 1;
+  for (b = 0; b < header.nblocks; b ++) {
+    c.p = data + offsets[b];
+    c.end = data + header.nbytes;
+
+    if (decode_block_start(&c, (b == 0 ? ch->S_v_initial : NULL), &state) < 0) {
+      ERROR("failed to decode block %d", b);
+      goto fail;
+    }
+
+    if (b == 0) {
+      ch->steps[0].header.likelihood = state.likelihood;
+      ch->steps[0].header.temperature = state.temperature;
+      ch->steps[0].header.hierarchical = state.hierarchical;
+    }
+
+    for (; i < header.nsteps && i <= (b + 1) * header.block_steps; i ++) {
+      if (decode_record(&c, &state, &(ch->steps[i])) < 0) {
+	ERROR("failed to decode step %d", i);
+	goto fail;
+      }
+    }
+  }
+
+  ch->nsteps = header.nsteps;
+
+  free(offsets);
+  free(data);
+  
+  return 0;
+
+ fail:
+  free(offsets);
+  free(data);
+  return -1;
+}
+
 int
 chain_history_replay(chain_history_t *ch,
 		     multiset_int_double_t *S_v,
@@ -346,125 +625,1237 @@ chain_history_replay(chain_history_t *ch,
   return 0;
 }
 
-int
-chain_history_nsteps(chain_history_t *ch)
-{
-  return ch->nsteps;
-}
+struct _chain_history_file {
+  void *map;
+  size_t length;
 
-int
-chain_history_full(chain_history_t *ch)
-{
-  return ch->nsteps == ch->maxsteps;
-}
+  int nchunks;
+  const unsigned char **chunks;
+  int *chunk_first;
+  
+  int nsteps;
+};
 
-static int do_step(multiset_int_double_t *S_v,
-		   chain_history_change_t *step)
+chain_history_file_t *
+chain_history_file_open(const char *filename)
 {
-  switch (step->header.type) {
-    
-  case CH_NOCHANGE:
-    /* printf("ch: none\n"); */
-    break;
-    
-  case CH_BIRTH:
-    /* printf("ch: birth %d %d %f\n", */
-    /* 	   step->perturbation.birth.node_id, */
-    /* 	   step->perturbation.birth.node_depth, */
-    /* 	   step->perturbation.birth.new_value); */
+  chain_history_file_t *f;
+  const compact_header_t *header;
+  struct stat st;
+  const unsigned char **chunks;
+  int *chunk_first;
+  size_t offset;
+  size_t size;
+  int maxchunks;
+  int fd;
 
-    if (step->header.accepted) {
-      if (multiset_int_double_insert(S_v,
-				     step->perturbation.birth.node_id,
-				     step->perturbation.birth.node_depth,
-				     step->perturbation.birth.new_value) < 0) {
-	ERROR("failed to recreate birth");
-	return -1;
-      }
+  fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    ERROR("failed to open %s", filename);
+    return NULL;
+  }
+
+  if (fstat(fd, &st) < 0) {
+    ERROR("failed to stat %s", filename);
+    close(fd);
+    return NULL;
+  }
+
+  f = malloc(sizeof(chain_history_file_t));
+  if (f == NULL) {
+    ERROR("failed to allocate memory");
+    close(fd);
+    return NULL;
+  }
+
+  f->length = st.st_size;
+  f->map = NULL;
+  if (f->length > 0) {
+    f->map = mmap(NULL, f->length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (f->map == MAP_FAILED) {
+      ERROR("failed to map %s", filename);
+      close(fd);
+      free(f);
+      return NULL;
     }
-    break;
-    
-  case CH_DEATH:
-    /* printf("ch: death %d %d\n", */
-    /* 	   step->perturbation.death.node_id, */
-    /* 	   step->perturbation.death.node_depth); */
-    if (step->header.accepted) {
-      if (multiset_int_double_remove(S_v,
-				     step->perturbation.death.node_id,
-				     step->perturbation.death.node_depth) < 0) {
-	ERROR("failed to recreate death");
-	return -1;
-      }
+  }
+  close(fd);
+
+  f->nchunks = 0;
+  f->nsteps = 0;
+  maxchunks = 16;
+  f->chunks = malloc(sizeof(unsigned char *) * maxchunks);
+  f->chunk_first = malloc(sizeof(int) * (maxchunks + 1));
+  if (f->chunks == NULL || f->chunk_first == NULL) {
+    ERROR("failed to allocate chunk index");
+    chain_history_file_close(f);
+    return NULL;
+  }
+
+  /*
+   * Index the chunks, a truncated final chunk is ignored
+   */
+  offset = 0;
+  while (offset + sizeof(compact_header_t) <= f->length) {
+
+    header = (const compact_header_t *)((const unsigned char *)f->map + offset);
+    if (memcmp(header->magic, COMPACT_MAGIC, sizeof(header->magic)) != 0 ||
+	header->version != COMPACT_VERSION) {
+      ERROR("invalid chunk at offset %lu", (unsigned long)offset);
+      chain_history_file_close(f);
+      return NULL;
     }
-    break;
-    
-  case CH_VALUE:
-    /* printf("ch: value %d %d %f (%d)\n", */
-    /* 	   step->perturbation.value.node_id, */
-    /* 	   step->perturbation.value.node_depth, */
-    /* 	   step->perturbation.value.new_value, */
-    /* 	   multiset_int_double_total_count(S_v)); */
-    if (step->header.accepted) {
-      if (multiset_int_double_set(S_v,
-				  step->perturbation.value.node_id,
-				  step->perturbation.value.node_depth,
-				  step->perturbation.value.new_value) < 0) {
-	ERROR("failed to recreate change value (%d %d)",
-		step->perturbation.value.node_id, step->perturbation.value.node_depth);
-	multiset_int_double_dump(S_v);
-	return -1;
-      }
+
+    if (header->nblocks < 1 ||
+	header->nbytes < 0 ||
+	header->nbytes > (long long)f->length) {
+      ERROR("invalid chunk header at offset %lu", (unsigned long)offset);
+      chain_history_file_close(f);
+      return NULL;
     }
-    break;
-    
-  case CH_MOVE:
 
-    if (step->header.accepted) {
-      if (multiset_int_double_remove(S_v,
-    				     step->perturbation.move.node_id,
-    				     step->perturbation.move.node_depth) < 0) {
-    	ERROR("failed to recreate move (delete)");
-    	return -1;
+    size = sizeof(compact_header_t) + sizeof(long long) * header->nblocks + header->nbytes;
+    if (offset + size > f->length) {
+      break;
+    }
+
+    if (check_chunk(header, (const long long *)(header + 1)) < 0) {
+      ERROR("invalid chunk at offset %lu", (unsigned long)offset);
+      chain_history_file_close(f);
+      return NULL;
+    }
+
+    if (f->nchunks == maxchunks) {
+      maxchunks *= 2;
+      
+      chunks = realloc(f->chunks, sizeof(unsigned char *) * maxchunks);
+      if (chunks == NULL) {
+	ERROR("failed to grow chunk index");
+	chain_history_file_close(f);
+	return NULL;
       }
+      f->chunks = chunks;
       
-      if (multiset_int_double_insert(S_v,
-    				     step->perturbation.move.new_node_id,
-    				     step->perturbation.move.node_depth,
-    				     step->perturbation.move.new_value) < 0) {
-    	ERROR("failed to recreate move (insert)");
-    	return -1;
+      chunk_first = realloc(f->chunk_first, sizeof(int) * (maxchunks + 1));
+      if (chunk_first == NULL) {
+	ERROR("failed to grow chunk index");
+	chain_history_file_close(f);
+	return NULL;
       }
+      f->chunk_first = chunk_first;
     }
-    break;
 
-  case CH_HIERARCHICAL:
-    /*
-     * Does nothing to model S_v!
-     */
-    break;
-    
+    f->chunks[f->nchunks] = (const unsigned char *)f->map + offset;
+    f->chunk_first[f->nchunks] = f->nsteps;
+    f->nchunks ++;
+    f->nsteps += header->nsteps - 1;
 
-  case CH_HYPER:
-    /*
-     * Do nothing - user controlled
-     */
-    break;
-    
-  case CH_INITIALISE:
-    ERROR("initialisation unimplemented");
-    return -1;
-    
-  case CH_PTEXCHANGE:
-    ERROR("exchange unimplemented");
-    return -1;
+    offset += size;
+  }
+  f->chunk_first[f->nchunks] = f->nsteps;
 
-    
-  default:
-    ERROR("invalid step type %d", step->header.type);
-    return -1;
+  return f;
+}
 
+void
+chain_history_file_close(chain_history_file_t *f)
+{
+  if (f != NULL) {
+    if (f->map != NULL) {
+      munmap(f->map, f->length);
+    }
+    free(f->chunks);
+    free(f->chunk_first);
+    free(f);
   }
+}
 
-  return 0;
+int
+chain_history_file_nsteps(const chain_history_file_t *f)
+{
+  return f->nsteps;
 }
 
+int
+chain_history_file_replay(chain_history_file_t *f,
+			  int first,
+			  int nsteps,
+			  multiset_int_double_t *S_v,
+			  chain_history_replay_function_t cb,
+			  void *user)
+{
+  const compact_header_t *header;
+  const long long *offsets;
+  const unsigned char *data;
+  chain_history_change_t step;
+  record_state_t state;
+  cursor_t c;
+  int chunk;
+  int lo;
+  int hi;
+  int i;
+  int k;
+  int last;
+  int b;
+
+  if (first < 0 || nsteps < 0 || first + nsteps > f->nsteps) {
+    ERROR("invalid range %d + %d (%d)", first, nsteps, f->nsteps);
+    return -1;
+  }
+
+  if (nsteps == 0) {
+    return 0;
+  }
+
+  /* Last chunk starting at or before first */
+  lo = 0;
+  hi = f->nchunks - 1;
+  while (lo < hi) {
+    chunk = (lo + hi + 1)/2;
+    if (f->chunk_first[chunk] <= first) {
+      lo = chunk;
+    } else {
+      hi = chunk - 1;
+    }
+  }
+
+  last = first + nsteps;
+  i = first;
+  for (chunk = lo; i < last; chunk ++) {
+
+    header = (const compact_header_t *)f->chunks[chunk];
+    offsets = (const long long *)(f->chunks[chunk] + sizeof(compact_header_t));
+    data = (const unsigned char *)(offsets + header->nblocks);
+
+    /* Step k within the chunk's records, starting at the keyframe of its block */
+    k = i - f->chunk_first[chunk];
+    b = k/header->block_steps;
+
+    c.p = data + offsets[b];
+    c.end = data + header->nbytes;
+    if (decode_block_start(&c, S_v, &state) < 0) {
+      ERROR("failed to decode block %d of chunk %d", b, chunk);
+      return -1;
+    }
+    
+    for (k = b * header->block_steps; k < header->nsteps - 1 && i < last; k ++) {
+
+      if (k > b * header->block_steps && k % header->block_steps == 0) {
+	/* Next block, skip its keyframe */
+	if (decode_block_start(&c, NULL, &state) < 0) {
+	  ERROR("failed to decode block start");
+	  return -1;
+	}
+      }
+
+      if (decode_record(&c, &state, &step) < 0) {
+	ERROR("failed to decode step");
+	return -1;
+      }
+
+      if (do_step(S_v, &step) < 0) {
+	ERROR("failed to do step");
+	return -1;
+      }
+
+      if (f->chunk_first[chunk] + k >= first) {
+	if (cb(i, user, &step, S_v) < 0) {
+	  return -1;
+	}
+	i ++;
+      }
+    }
+  }
+
+  return 0;
+}
+
+/*
+ * Segments per thread for in memory replay and maximum steps per segment
+ * for file replay, enough to even out the load between threads.
+ */
+#define REPLAY_SEGMENTS_PER_THREAD 4
+#define FILE_REPLAY_SEGMENT_STEPS 65536
+
+typedef struct _replay_queue replay_queue_t;
+
+typedef int (*replay_unit_t)(replay_queue_t *q,
+			     int u,
+			     multiset_int_double_t *S_v,
+			     void *acc);
+
+struct _replay_queue {
+  pthread_mutex_t mutex;
+  int next;
+  int nunits;
+  int failed;
+
+  replay_unit_t unit;
+  const chain_history_accumulator_t *acc;
+
+  /* In memory: keyframe and first step of each unit */
+  chain_history_t *ch;
+  multiset_int_double_t **keyframes;
+  int *first;
+
+  /* Files: file, first step and no. steps of each unit */
+  chain_history_file_t **files;
+  int *unit_file;
+  int *unit_first;
+  int *unit_nsteps;
+};
+
+typedef struct {
+  replay_queue_t *q;
+  multiset_int_double_t *S_v;
+  void *acc;
+} replay_worker_t;
+
+static void *replay_worker(void *arg)
+{
+  replay_worker_t *w = (replay_worker_t *)arg;
+  replay_queue_t *q = w->q;
+  int u;
+
+  for (;;) {
+    pthread_mutex_lock(&(q->mutex));
+    u = q->next ++;
+    if (q->failed) {
+      u = q->nunits;
+    }
+    pthread_mutex_unlock(&(q->mutex));
+
+    if (u >= q->nunits) {
+      break;
+    }
+
+    if (q->unit(q, u, w->S_v, w->acc) < 0) {
+      pthread_mutex_lock(&(q->mutex));
+      q->failed = 1;
+      pthread_mutex_unlock(&(q->mutex));
+    }
+  }
+
+  return NULL;
+}
+
+/*
+ * Runs all units of the queue on nthreads threads, including the calling
+ * one, then merges the per thread accumulators in thread order.
+ */
+static int replay_run(replay_queue_t *q, int nthreads)
+{
+  replay_worker_t *workers;
+  pthread_t *threads;
+  int started;
+  int i;
+
+  if (nthreads < 1) {
+    ERROR("invalid no. threads %d", nthreads);
+    return -1;
+  }
+
+  if (nthreads > q->nunits && q->nunits > 0) {
+    nthreads = q->nunits;
+  }
+
+  workers = malloc(sizeof(replay_worker_t) * nthreads);
+  threads = malloc(sizeof(pthread_t) * nthreads);
+  if (workers == NULL || threads == NULL) {
+    ERROR("failed to allocate workers");
+    free(workers);
+    free(threads);
+    return -1;
+  }
+
+  pthread_mutex_init(&(q->mutex), NULL);
+  q->next = 0;
+  q->failed = 0;
+
+  for (i = 0; i < nthreads; i ++) {
+    workers[i].q = q;
+    workers[i].S_v = NULL;
+    workers[i].acc = NULL;
+  }
+
+  for (i = 0; i < nthreads; i ++) {
+    workers[i].S_v = multiset_int_double_create();
+    workers[i].acc = q->acc->create(q->acc->user);
+    if (workers[i].S_v == NULL || workers[i].acc == NULL) {
+      ERROR("failed to create worker %d", i);
+      q->failed = 1;
+      break;
+    }
+  }
+
+  if (!q->failed) {
+
+    /*
+     * A thread that fails to start leaves its units to the others
+     */
+    started = 1;
+    for (i = 1; i < nthreads; i ++, started ++) {
+      if (pthread_create(&(threads[i]), NULL, replay_worker, &(workers[i])) != 0) {
+	ERROR("failed to start thread %d, continuing with %d", i, started);
+	break;
+      }
+    }
+
+    replay_worker(&(workers[0]));
+
+    for (i = 1; i < started; i ++) {
+      pthread_join(threads[i], NULL);
+    }
+  }
+
+  for (i = 0; i < nthreads; i ++) {
+    if (!q->failed && q->acc->merge(q->acc->user, workers[i].acc) < 0) {
+      ERROR("failed to merge accumulator %d", i);
+      q->failed = 1;
+    }
+    if (workers[i].acc != NULL) {
+      q->acc->destroy(workers[i].acc);
+    }
+    multiset_int_double_destroy(workers[i].S_v);
+  }
+
+  pthread_mutex_destroy(&(q->mutex));
+  free(workers);
+  free(threads);
+
+  return q->failed ? -1 : 0;
+}
+
+static int replay_memory_unit(replay_queue_t *q,
+			      int u,
+			      multiset_int_double_t *S_v,
+			      void *acc)
+{
+  int i;
+
+  if (multiset_int_double_clone(S_v, q->keyframes[u]) < 0) {
+    ERROR("failed to clone keyframe");
+    return -1;
+  }
+
+  for (i = q->first[u]; i < q->first[u + 1]; i ++) {
+
+    if (do_step(S_v, &(q->ch->steps[i])) < 0) {
+      ERROR("failed to do step %d", i);
+      return -1;
+    }
+
+    if (q->acc->step(i - 1, acc, &(q->ch->steps[i]), S_v) < 0) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+int
+chain_history_replay_parallel(chain_history_t *ch,
+			      int nthreads,
+			      const chain_history_accumulator_t *acc)
+{
+  replay_queue_t q;
+  multiset_int_double_t *S_v;
+  int nsegments;
+  int u;
+  int i;
+  int r;
+
+  if (ch->nsteps <= 1) {
+    return ch->nsteps < 0 ? -1 : 0;
+  }
+
+  nsegments = nthreads * REPLAY_SEGMENTS_PER_THREAD;
+  if (nsegments > ch->nsteps - 1) {
+    nsegments = ch->nsteps - 1;
+  }
+  if (nsegments < 1) {
+    ERROR("invalid no. threads %d", nthreads);
+    return -1;
+  }
+
+  r = -1;
+  memset(&q, 0, sizeof(replay_queue_t));
+  q.nunits = nsegments;
+  q.unit = replay_memory_unit;
+  q.acc = acc;
+  q.ch = ch;
+  q.keyframes = calloc(nsegments, sizeof(multiset_int_double_t *));
+  q.first = malloc(sizeof(int) * (nsegments + 1));
+  S_v = multiset_int_double_create();
+  if (q.keyframes == NULL || q.first == NULL || S_v == NULL) {
+    ERROR("failed to allocate segments");
+    goto cleanup;
+  }
+
+  for (u = 0; u <= nsegments; u ++) {
+    q.first[u] = 1 + (int)(((long long)(ch->nsteps - 1) * u)/nsegments);
+  }
+
+  /*
+   * Sequential pass applying the steps without callbacks to snapshot the
+   * model at the start of each segment.
+   */
+  if (multiset_int_double_clone(S_v, ch->S_v_initial) < 0) {
+    ERROR("failed to clone initial model");
+    goto cleanup;
+  }
+
+  i = 1;
+  for (u = 0; u < nsegments; u ++) {
+    for (; i < q.first[u]; i ++) {
+      if (do_step(S_v, &(ch->steps[i])) < 0) {
+	ERROR("failed to do step %d", i);
+	goto cleanup;
+      }
+    }
+
+    q.keyframes[u] = multiset_int_double_create();
+    if (q.keyframes[u] == NULL ||
+	multiset_int_double_clone(q.keyframes[u], S_v) < 0) {
+      ERROR("failed to create keyframe");
+      goto cleanup;
+    }
+  }
+
+  r = replay_run(&q, nthreads);
+
+ cleanup:
+  if (q.keyframes != NULL) {
+    for (u = 0; u < nsegments; u ++) {
+      multiset_int_double_destroy(q.keyframes[u]);
+    }
+  }
+  free(q.keyframes);
+  free(q.first);
+  multiset_int_double_destroy(S_v);
+
+  return r;
+}
+
+static int replay_file_unit(replay_queue_t *q,
+			    int u,
+			    multiset_int_double_t *S_v,
+			    void *acc)
+{
+  return chain_history_file_replay(q->files[q->unit_file[u]],
+				   q->unit_first[u],
+				   q->unit_nsteps[u],
+				   S_v,
+				   q->acc->step,
+				   acc);
+}
+
+int
+chain_history_file_replay_parallel(const char **filenames,
+				   int nfiles,
+				   int nthreads,
+				   const chain_history_accumulator_t *acc)
+{
+  replay_queue_t q;
+  int maxunits;
+  int first;
+  int n;
+  int i;
+  int r;
+
+  r = -1;
+  memset(&q, 0, sizeof(replay_queue_t));
+  q.unit = replay_file_unit;
+  q.acc = acc;
+
+  q.files = calloc(nfiles + 1, sizeof(chain_history_file_t *));
+  if (q.files == NULL) {
+    ERROR("failed to allocate files");
+    return -1;
+  }
+
+  maxunits = 0;
+  for (i = 0; i < nfiles; i ++) {
+    q.files[i] = chain_history_file_open(filenames[i]);
+    if (q.files[i] == NULL) {
+      ERROR("failed to open %s", filenames[i]);
+      goto cleanup;
+    }
+
+    n = chain_history_file_nsteps(q.files[i]);
+    maxunits += (n + FILE_REPLAY_SEGMENT_STEPS - 1)/FILE_REPLAY_SEGMENT_STEPS;
+  }
+
+  q.unit_file = malloc(sizeof(int) * (maxunits + 1));
+  q.unit_first = malloc(sizeof(int) * (maxunits + 1));
+  q.unit_nsteps = malloc(sizeof(int) * (maxunits + 1));
+  if (q.unit_file == NULL || q.unit_first == NULL || q.unit_nsteps == NULL) {
+    ERROR("failed to allocate units");
+    goto cleanup;
+  }
+
+  for (i = 0; i < nfiles; i ++) {
+    n = chain_history_file_nsteps(q.files[i]);
+    for (first = 0; first < n; first += FILE_REPLAY_SEGMENT_STEPS) {
+      q.unit_file[q.nunits] = i;
+      q.unit_first[q.nunits] = first;
+      q.unit_nsteps[q.nunits] = n - first;
+      if (q.unit_nsteps[q.nunits] > FILE_REPLAY_SEGMENT_STEPS) {
+	q.unit_nsteps[q.nunits] = FILE_REPLAY_SEGMENT_STEPS;
+      }
+      q.nunits ++;
+    }
+  }
+
+  r = replay_run(&q, nthreads);
+
+ cleanup:
+  for (i = 0; i < nfiles; i ++) {
+    chain_history_file_close(q.files[i]);
+  }
+  free(q.files);
+  free(q.unit_file);
+  free(q.unit_first);
+  free(q.unit_nsteps);
+
+  return r;
+}
+
+int
+chain_history_nsteps(chain_history_t *ch)
+{
+  return ch->nsteps;
+}
+
+int
+chain_history_full(chain_history_t *ch)
+{
+  return ch->nsteps == ch->maxsteps;
+}
+
+/*
+ * Checks the header fields and that every block offset lies within the
+ * block data before anything is decoded.
+ */
+static int check_chunk(const compact_header_t *header,
+		       const long long *offsets)
+{
+  long long nblocks;
+  int b;
+  
+  if (header->nsteps < 1 ||
+      header->block_steps < 1 ||
+      header->nbytes < 0) {
+    ERROR("invalid chunk header");
+    return -1;
+  }
+
+  /* The steps after the initial model fill whole blocks, with at least one */
+  nblocks = ((long long)header->nsteps - 1 + header->block_steps - 1)/header->block_steps;
+  if (nblocks == 0) {
+    nblocks = 1;
+  }
+  if (header->nblocks != nblocks) {
+    ERROR("invalid block count %d (%lld)", header->nblocks, nblocks);
+    return -1;
+  }
+
+  for (b = 0; b < header->nblocks; b ++) {
+    if (offsets[b] < 0 || offsets[b] >= header->nbytes ||
+	(b > 0 && offsets[b] < offsets[b - 1])) {
+      ERROR("invalid offset for block %d", b);
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+static int do_step(multiset_int_double_t *S_v,
+		   chain_history_change_t *step)
+{
+  switch (step->header.type) {
+    
+  case CH_NOCHANGE:
+    /* printf("ch: none\n"); */
+    break;
+    
+  case CH_BIRTH:
+    /* printf("ch: birth %d %d %f\n", */
+    /* 	   step->perturbation.birth.node_id, */
+    /* 	   step->perturbation.birth.node_depth, */
+    /* 	   step->perturbation.birth.new_value); */
+
+    if (step->header.accepted) {
+      if (multiset_int_double_insert(S_v,
+				     step->perturbation.birth.node_id,
+				     step->perturbation.birth.node_depth,
+				     step->perturbation.birth.new_value) < 0) {
+	ERROR("failed to recreate birth");
+	return -1;
+      }
+    }
+    break;
+    
+  case CH_DEATH:
+    /* printf("ch: death %d %d\n", */
+    /* 	   step->perturbation.death.node_id, */
+    /* 	   step->perturbation.death.node_depth); */
+    if (step->header.accepted) {
+      if (multiset_int_double_remove(S_v,
+				     step->perturbation.death.node_id,
+				     step->perturbation.death.node_depth) < 0) {
+	ERROR("failed to recreate death");
+	return -1;
+      }
+    }
+    break;
+    
+  case CH_VALUE:
+    /* printf("ch: value %d %d %f (%d)\n", */
+    /* 	   step->perturbation.value.node_id, */
+    /* 	   step->perturbation.value.node_depth, */
+    /* 	   step->perturbation.value.new_value, */
+    /* 	   multiset_int_double_total_count(S_v)); */
+    if (step->header.accepted) {
+      if (multiset_int_double_set(S_v,
+				  step->perturbation.value.node_id,
+				  step->perturbation.value.node_depth,
+				  step->perturbation.value.new_value) < 0) {
+	ERROR("failed to recreate change value (%d %d)",
+		step->perturbation.value.node_id, step->perturbation.value.node_depth);
+	multiset_int_double_dump(S_v);
+	return -1;
+      }
+    }
+    break;
+    
+  case CH_MOVE:
+
+    if (step->header.accepted) {
+      if (multiset_int_double_remove(S_v,
+    				     step->perturbation.move.node_id,
+    				     step->perturbation.move.node_depth) < 0) {
+    	ERROR("failed to recreate move (delete)");
+    	return -1;
+      }
+      
+      if (multiset_int_double_insert(S_v,
+    				     step->perturbation.move.new_node_id,
+    				     step->perturbation.move.node_depth,
+    				     step->perturbation.move.new_value) < 0) {
+    	ERROR("failed to recreate move (insert)");
+    	return -1;
+      }
+    }
+    break;
+
+  case CH_HIERARCHICAL:
+    /*
+     * Does nothing to model S_v!
+     */
+    break;
+    
+
+  case CH_HYPER:
+    /*
+     * Do nothing - user controlled
+     */
+    break;
+    
+  case CH_INITIALISE:
+    ERROR("initialisation unimplemented");
+    return -1;
+    
+  case CH_PTEXCHANGE:
+    ERROR("exchange unimplemented");
+    return -1;
+
+    
+  default:
+    ERROR("invalid step type %d", step->header.type);
+    return -1;
+
+  }
+
+  return 0;
+}
+
+
+static int buffer_reserve(buffer_t *b, size_t n)
+{
+  size_t newsize;
+  unsigned char *p;
+
+  if (b->len + n <= b->size) {
+    return 0;
+  }
+
+  newsize = b->size > 0 ? b->size : 65536;
+  while (newsize < b->len + n) {
+    newsize *= 2;
+  }
+
+  p = realloc(b->data, newsize);
+  if (p == NULL) {
+    ERROR("failed to grow buffer");
+    return -1;
+  }
+
+  b->data = p;
+  b->size = newsize;
+  return 0;
+}
+
+static int put_bytes(buffer_t *b, const void *p, size_t n)
+{
+  if (buffer_reserve(b, n) < 0) {
+    return -1;
+  }
+
+  memcpy(b->data + b->len, p, n);
+  b->len += n;
+  return 0;
+}
+
+static int put_varint(buffer_t *b, unsigned long long v)
+{
+  if (buffer_reserve(b, 10) < 0) {
+    return -1;
+  }
+
+  while (v >= 0x80) {
+    b->data[b->len ++] = (unsigned char)(v | 0x80);
+    v >>= 7;
+  }
+  b->data[b->len ++] = (unsigned char)v;
+  
+  return 0;
+}
+
+static int put_svarint(buffer_t *b, long long v)
+{
+  /* Zigzag so small negative deltas stay short */
+  return put_varint(b, ((unsigned long long)v << 1) ^ (unsigned long long)(v >> 63));
+}
+
+static int put_double(buffer_t *b, double v)
+{
+  return put_bytes(b, &v, sizeof(double));
+}
+
+static int get_bytes(cursor_t *c, void *p, size_t n)
+{
+  if (c->p + n > c->end) {
+    return -1;
+  }
+
+  memcpy(p, c->p, n);
+  c->p += n;
+  return 0;
+}
+
+static int get_varint(cursor_t *c, unsigned long long *v)
+{
+  int shift;
+
+  *v = 0;
+  for (shift = 0; shift < 64; shift += 7) {
+    if (c->p >= c->end) {
+      return -1;
+    }
+    
+    *v |= (unsigned long long)(*c->p & 0x7f) << shift;
+    if ((*(c->p ++) & 0x80) == 0) {
+      return 0;
+    }
+  }
+
+  return -1;
+}
+
+static int get_int(cursor_t *c, int *v)
+{
+  unsigned long long u;
+
+  if (get_varint(c, &u) < 0) {
+    return -1;
+  }
+
+  *v = (int)u;
+  return 0;
+}
+
+static int get_delta(cursor_t *c, int base, int *v)
+{
+  unsigned long long u;
+
+  if (get_varint(c, &u) < 0) {
+    return -1;
+  }
+
+  *v = (int)((long long)base + (long long)((u >> 1) ^ (~(u & 1) + 1)));
+  return 0;
+}
+
+static int get_double(cursor_t *c, double *v)
+{
+  return get_bytes(c, v, sizeof(double));
+}
+
+/*
+ * Model as depth counts then, per depth, ascending index deltas and values
+ */
+static int encode_model(buffer_t *b,
+			const multiset_int_double_t *S_v)
+{
+  int ndepths;
+  int d;
+  int i;
+  int n;
+  int index;
+  int prev;
+  double value;
+
+  ndepths = 0;
+  for (d = 0; (n = multiset_int_double_depth_count(S_v, d)) >= 0; d ++) {
+    if (n > 0) {
+      ndepths = d + 1;
+    }
+  }
+
+  if (put_varint(b, ndepths) < 0) {
+    return -1;
+  }
+
+  for (d = 0; d < ndepths; d ++) {
+    n = multiset_int_double_depth_count(S_v, d);
+    if (put_varint(b, n) < 0) {
+      return -1;
+    }
+
+    prev = 0;
+    for (i = 0; i < n; i ++) {
+      if (multiset_int_double_nth_element(S_v, d, i, &index, &value) < 0 ||
+	  put_varint(b, index - prev) < 0 ||
+	  put_double(b, value) < 0) {
+	return -1;
+      }
+      prev = index;
+    }
+  }
+
+  return 0;
+}
+
+static int decode_model(cursor_t *c,
+			multiset_int_double_t *S_v)
+{
+  int ndepths;
+  int d;
+  int i;
+  int n;
+  int index;
+  int delta;
+  double value;
+
+  if (multiset_int_double_clear(S_v) < 0 ||
+      get_int(c, &ndepths) < 0) {
+    return -1;
+  }
+
+  for (d = 0; d < ndepths; d ++) {
+    if (get_int(c, &n) < 0) {
+      return -1;
+    }
+
+    index = 0;
+    for (i = 0; i < n; i ++) {
+      if (get_int(c, &delta) < 0 ||
+	  get_double(c, &value) < 0) {
+	return -1;
+      }
+      index += delta;
+
+      if (multiset_int_double_insert(S_v, index, d, value) < 0) {
+	ERROR("failed to insert %d %d", index, d);
+	return -1;
+      }
+    }
+  }
+
+  return 0;
+}
+
+static int encode_record(buffer_t *b,
+			 record_state_t *state,
+			 const chain_history_change_t *step)
+{
+  unsigned char tag;
+  int node_id;
+  int r;
+
+  tag = step->header.type & TAG_TYPE_MASK;
+  if (step->header.accepted) {
+    tag |= TAG_ACCEPTED;
+  }
+  if (step->header.likelihood == state->likelihood) {
+    tag |= TAG_SAME_LIKE;
+  }
+  if (step->header.temperature == state->temperature) {
+    tag |= TAG_SAME_TEMP;
+  }
+  if (step->header.hierarchical == state->hierarchical) {
+    tag |= TAG_SAME_HIER;
+  }
+
+  r = put_bytes(b, &tag, 1);
+  if ((tag & TAG_SAME_LIKE) == 0) {
+    r += put_double(b, step->header.likelihood);
+  }
+  if ((tag & TAG_SAME_TEMP) == 0) {
+    r += put_double(b, step->header.temperature);
+  }
+  if ((tag & TAG_SAME_HIER) == 0) {
+    r += put_double(b, step->header.hierarchical);
+  }
+
+  state->likelihood = step->header.likelihood;
+  state->temperature = step->header.temperature;
+  state->hierarchical = step->header.hierarchical;
+
+  switch (step->header.type) {
+  case CH_NOCHANGE:
+  case CH_INITIALISE:
+    break;
+
+  case CH_BIRTH:
+    node_id = step->perturbation.birth.node_id;
+    r += put_varint(b, step->perturbation.birth.node_depth);
+    r += put_svarint(b, (long long)node_id - state->node_id);
+    r += put_double(b, step->perturbation.birth.new_value);
+    state->node_id = node_id;
+    break;
+
+  case CH_DEATH:
+    node_id = step->perturbation.death.node_id;
+    r += put_varint(b, step->perturbation.death.node_depth);
+    r += put_svarint(b, (long long)node_id - state->node_id);
+    r += put_double(b, step->perturbation.death.old_value);
+    state->node_id = node_id;
+    break;
+
+  case CH_VALUE:
+    node_id = step->perturbation.value.node_id;
+    r += put_varint(b, step->perturbation.value.node_depth);
+    r += put_svarint(b, (long long)node_id - state->node_id);
+    r += put_double(b, step->perturbation.value.new_value);
+    r += put_double(b, step->perturbation.value.old_value);
+    state->node_id = node_id;
+    break;
+
+  case CH_MOVE:
+    node_id = step->perturbation.move.node_id;
+    r += put_varint(b, step->perturbation.move.node_depth);
+    r += put_svarint(b, (long long)node_id - state->node_id);
+    r += put_svarint(b, (long long)step->perturbation.move.new_node_id - node_id);
+    r += put_double(b, step->perturbation.move.new_value);
+    r += put_double(b, step->perturbation.move.old_value);
+    state->node_id = node_id;
+    break;
+
+  case CH_HIERARCHICAL:
+    r += put_double(b, step->perturbation.hierarchical.old_value);
+    r += put_double(b, step->perturbation.hierarchical.new_value);
+    break;
+
+  case CH_PTEXCHANGE:
+    r += put_double(b, step->perturbation.ptexchange.old_temperature);
+    break;
+
+  case CH_HYPER:
+    r += put_svarint(b, step->perturbation.hyper.index);
+    r += put_double(b, step->perturbation.hyper.old_value);
+    r += put_double(b, step->perturbation.hyper.new_value);
+    break;
+
+  default:
+    /* Unknown to this encoding, keep the whole perturbation */
+    r += put_bytes(b, &(step->perturbation), sizeof(step->perturbation));
+    break;
+  }
+
+  return r < 0 ? -1 : 0;
+}
+
+static int decode_record(cursor_t *c,
+			 record_state_t *state,
+			 chain_history_change_t *step)
+{
+  unsigned char tag;
+  int r;
+
+  memset(step, 0, sizeof(chain_history_change_t));
+  
+  if (get_bytes(c, &tag, 1) < 0) {
+    return -1;
+  }
+
+  step->header.type = (chain_history_step_t)(tag & TAG_TYPE_MASK);
+  step->header.accepted = (tag & TAG_ACCEPTED) ? 1 : 0;
+
+  r = 0;
+  if (tag & TAG_SAME_LIKE) {
+    step->header.likelihood = state->likelihood;
+  } else {
+    r += get_double(c, &(step->header.likelihood));
+  }
+  if (tag & TAG_SAME_TEMP) {
+    step->header.temperature = state->temperature;
+  } else {
+    r += get_double(c, &(step->header.temperature));
+  }
+  if (tag & TAG_SAME_HIER) {
+    step->header.hierarchical = state->hierarchical;
+  } else {
+    r += get_double(c, &(step->header.hierarchical));
+  }
+
+  state->likelihood = step->header.likelihood;
+  state->temperature = step->header.temperature;
+  state->hierarchical = step->header.hierarchical;
+
+  switch (step->header.type) {
+  case CH_NOCHANGE:
+  case CH_INITIALISE:
+    break;
+
+  case CH_BIRTH:
+    r += get_int(c, &(step->perturbation.birth.node_depth));
+    r += get_delta(c, state->node_id, &(step->perturbation.birth.node_id));
+    r += get_double(c, &(step->perturbation.birth.new_value));
+    state->node_id = step->perturbation.birth.node_id;
+    break;
+
+  case CH_DEATH:
+    r += get_int(c, &(step->perturbation.death.node_depth));
+    r += get_delta(c, state->node_id, &(step->perturbation.death.node_id));
+    r += get_double(c, &(step->perturbation.death.old_value));
+    state->node_id = step->perturbation.death.node_id;
+    break;
+
+  case CH_VALUE:
+    r += get_int(c, &(step->perturbation.value.node_depth));
+    r += get_delta(c, state->node_id, &(step->perturbation.value.node_id));
+    r += get_double(c, &(step->perturbation.value.new_value));
+    r += get_double(c, &(step->perturbation.value.old_value));
+    state->node_id = step->perturbation.value.node_id;
+    break;
+
+  case CH_MOVE:
+    r += get_int(c, &(step->perturbation.move.node_depth));
+    r += get_delta(c, state->node_id, &(step->perturbation.move.node_id));
+    r += get_delta(c, step->perturbation.move.node_id, &(step->perturbation.move.new_node_id));
+    r += get_double(c, &(step->perturbation.move.new_value));
+    r += get_double(c, &(step->perturbation.move.old_value));
+    state->node_id = step->perturbation.move.node_id;
+    break;
+
+  case CH_HIERARCHICAL:
+    r += get_double(c, &(step->perturbation.hierarchical.old_value));
+    r += get_double(c, &(step->perturbation.hierarchical.new_value));
+    break;
+
+  case CH_PTEXCHANGE:
+    r += get_double(c, &(step->perturbation.ptexchange.old_temperature));
+    break;
+
+  case CH_HYPER:
+    r += get_delta(c, 0, &(step->perturbation.hyper.index));
+    r += get_double(c, &(step->perturbation.hyper.old_value));
+    r += get_double(c, &(step->perturbation.hyper.new_value));
+    break;
+
+  default:
+    r += get_bytes(c, &(step->perturbation), sizeof(step->perturbation));
+    break;
+  }
+
+  return r < 0 ? -1 : 0;
+}
+
+/*
+ * A block is the keyframe length and model, the header values of the step
+ * before the block and then its records.
+ */
+static int encode_block(buffer_t *b,
+			buffer_t *keyframe,
+			const multiset_int_double_t *S_v,
+			const chain_history_change_t *previous,
+			const chain_history_change_t *steps,
+			int nsteps)
+{
+  record_state_t state;
+  int i;
+
+  keyframe->len = 0;
+  if (encode_model(keyframe, S_v) < 0 ||
+      put_varint(b, keyframe->len) < 0 ||
+      put_bytes(b, keyframe->data, keyframe->len) < 0) {
+    return -1;
+  }
+
+  state.node_id = 0;
+  state.likelihood = previous->header.likelihood;
+  state.temperature = previous->header.temperature;
+  state.hierarchical = previous->header.hierarchical;
+
+  if (put_double(b, state.likelihood) < 0 ||
+      put_double(b, state.temperature) < 0 ||
+      put_double(b, state.hierarchical) < 0) {
+    return -1;
+  }
+  
+  for (i = 0; i < nsteps; i ++) {
+    if (encode_record(b, &state, &(steps[i])) < 0) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+/*
+ * Reads the keyframe into S_v, or skips it if S_v is NULL, and resets the
+ * record state.
+ */
+static int decode_block_start(cursor_t *c,
+			      multiset_int_double_t *S_v,
+			      record_state_t *state)
+{
+  unsigned long long len;
+  cursor_t keyframe;
+
+  if (get_varint(c, &len) < 0 ||
+      c->p + len > c->end) {
+    return -1;
+  }
+
+  if (S_v != NULL) {
+    keyframe.p = c->p;
+    keyframe.end = c->p + len;
+    if (decode_model(&keyframe, S_v) < 0) {
+      return -1;
+    }
+  }
+  c->p += len;
+
+  state->node_id = 0;
+  if (get_double(c, &(state->likelihood)) < 0 ||
+      get_double(c, &(state->temperature)) < 0 ||
+      get_double(c, &(state->hierarchical)) < 0) {
+    return -1;
+  }
+
+  return 0;
+}
@@ -140,6 +140,30 @@ chain_history_read(chain_history_t *ch,
 		   ch_read_t read_function,
 		   void *fp);
 
+/*
+ * Compact chunk format. Records are type tagged and variable length with
+ * node ids delta coded and repeated header values elided, grouped in blocks
+ * of block_steps steps. Each block starts with a keyframe of the model so it
+ * can be decoded without the blocks before it, and a block offset index
+ * follows the chunk header. Chunks may be appended to the same file as the
+ * history is reset.
+ */
+#define CHAIN_HISTORY_BLOCK_STEPS 4096
+
+int
+chain_history_set_block_steps(chain_history_t *ch,
+			      int block_steps);
+
+int
+chain_history_write_compact(chain_history_t *ch,
+			    ch_write_t write_function,
+			    void *fp);
+
+int
+chain_history_read_compact(chain_history_t *ch,
+			   ch_read_t read_function,
+			   void *fp);
+
 typedef int (*chain_history_replay_function_t)(int i,
 					       void *user,
 					       const chain_history_change_t *step,
@@ -151,6 +175,72 @@ chain_history_replay(chain_history_t *ch,
 		     chain_history_replay_function_t cb,
 		     void *user);
 
+/*
+ * Random access replay of a file of compact chunks. The file is mapped and
+ * steps numbered from 0 over all chunks (excluding each chunk's
+ * initialisation), replay of a range starts from the nearest keyframe.
+ */
+typedef struct _chain_history_file chain_history_file_t;
+
+chain_history_file_t *
+chain_history_file_open(const char *filename);
+
+void
+chain_history_file_close(chain_history_file_t *f);
+
+int
+chain_history_file_nsteps(const chain_history_file_t *f);
+
+int
+chain_history_file_replay(chain_history_file_t *f,
+			  int first,
+			  int nsteps,
+			  multiset_int_double_t *S_v,
+			  chain_history_replay_function_t cb,
+			  void *user);
+
+/*
+ * Parallel replay. Each worker thread creates its own accumulator, which is
+ * passed as the user pointer to the replay callback, and after all threads
+ * finish the accumulators are merged in thread order and destroyed.
+ *
+ * On both paths the step index passed to the callback is numbered from 0
+ * over the steps of one history or file, excluding the initialisation, ie.
+ * the numbering of chain_history_file_replay (chain_history_replay instead
+ * numbers from 1).
+ */
+typedef void *(*chain_history_accumulator_create_t)(void *user);
+typedef int (*chain_history_accumulator_merge_t)(void *user, void *acc);
+typedef void (*chain_history_accumulator_destroy_t)(void *acc);
+
+typedef struct {
+  chain_history_accumulator_create_t create;
+  chain_history_replay_function_t step;
+  chain_history_accumulator_merge_t merge;
+  chain_history_accumulator_destroy_t destroy;
+  void *user;
+} chain_history_accumulator_t;
+
+/*
+ * Splits an in memory history into segments, snapshotting S_v at the
+ * start of each in a sequential pass, and replays the segments in parallel.
+ */
+int
+chain_history_replay_parallel(chain_history_t *ch,
+			      int nthreads,
+			      const chain_history_accumulator_t *acc);
+
+/*
+ * Replays a set of compact history files, each split into segments at its
+ * keyframes, with the segments of all files shared out through a work
+ * queue. Step indices restart from 0 in each file.
+ */
+int
+chain_history_file_replay_parallel(const char **filenames,
+				   int nfiles,
+				   int nthreads,
+				   const chain_history_accumulator_t *acc);
+
 int
 chain_history_nsteps(chain_history_t *ch);
 
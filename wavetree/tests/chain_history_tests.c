@@ -0,0 +1,472 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <check.h>
+
+#include "chain_history.h"
+
+#define NSTEPS 2000
+#define MAXNODES 64
+
+/*
+ * Generate a random but consistent history: births of absent nodes, deaths,
+ * value changes and moves of present ones, with some rejected steps and
+ * hierarchical/no change steps mixed in.
+ */
+static void random_history(chain_history_t *ch,
+			   multiset_int_double_t *S_v,
+			   int nsteps)
+{
+  chain_history_change_t step;
+  double likelihood;
+  double hierarchical;
+  double value;
+  int node;
+  int depth;
+  int i;
+
+  likelihood = 100.0;
+  hierarchical = 1.0;
+
+  for (i = 1; i < nsteps; i ++) {
+
+    memset(&step, 0, sizeof(chain_history_change_t));
+    step.header.accepted = (rand() % 3) != 0;
+    step.header.temperature = 1.0;
+
+    node = 1 + rand() % MAXNODES;
+    depth = 1 + node % 5;
+
+    switch (rand() % 6) {
+    case 0:
+    case 1:
+      if (multiset_int_double_is_element(S_v, node, depth)) {
+	step.header.type = CH_DEATH;
+	step.perturbation.death.node_id = node;
+	step.perturbation.death.node_depth = depth;
+	multiset_int_double_get(S_v, node, depth, &(step.perturbation.death.old_value));
+      } else {
+	step.header.type = CH_BIRTH;
+	step.perturbation.birth.node_id = node;
+	step.perturbation.birth.node_depth = depth;
+	step.perturbation.birth.new_value = (double)rand()/(double)RAND_MAX;
+      }
+      break;
+
+    case 2:
+    case 3:
+      if (multiset_int_double_get(S_v, node, depth, &value) == 0) {
+	step.header.type = CH_VALUE;
+	step.perturbation.value.node_id = node;
+	step.perturbation.value.node_depth = depth;
+	step.perturbation.value.old_value = value;
+	step.perturbation.value.new_value = (double)rand()/(double)RAND_MAX;
+      } else {
+	step.header.type = CH_NOCHANGE;
+      }
+      break;
+
+    case 4:
+      if (multiset_int_double_get(S_v, node, depth, &value) == 0 &&
+	  !multiset_int_double_is_element(S_v, node + MAXNODES, depth)) {
+	step.header.type = CH_MOVE;
+	step.perturbation.move.node_id = node;
+	step.perturbation.move.node_depth = depth;
+	step.perturbation.move.new_node_id = node + MAXNODES;
+	step.perturbation.move.old_value = value;
+	step.perturbation.move.new_value = value;
+      } else {
+	step.header.type = CH_NOCHANGE;
+      }
+      break;
+
+    default:
+      step.header.type = CH_HIERARCHICAL;
+      step.perturbation.hierarchical.old_value = hierarchical;
+      step.perturbation.hierarchical.new_value = hierarchical * 1.01;
+      if (step.header.accepted) {
+	hierarchical *= 1.01;
+      }
+      break;
+    }
+
+    if (step.header.accepted && step.header.type != CH_NOCHANGE) {
+      likelihood = (double)rand()/(double)RAND_MAX;
+    }
+
+    step.header.likelihood = likelihood;
+    step.header.hierarchical = hierarchical;
+
+    ck_assert(chain_history_add_step(ch, &step) >= 0);
+
+    if (step.header.accepted) {
+      switch (step.header.type) {
+      case CH_BIRTH:
+	multiset_int_double_insert(S_v, node, depth, step.perturbation.birth.new_value);
+	break;
+      case CH_DEATH:
+	multiset_int_double_remove(S_v, node, depth);
+	break;
+      case CH_VALUE:
+	multiset_int_double_set(S_v, node, depth, step.perturbation.value.new_value);
+	break;
+      case CH_MOVE:
+	multiset_int_double_remove(S_v, node, depth);
+	multiset_int_double_insert(S_v, node + MAXNODES, depth, step.perturbation.move.new_value);
+	break;
+      default:
+	break;
+      }
+    }
+  }
+}
+
+struct replay_record {
+  int n;
+  chain_history_change_t steps[2 * NSTEPS];
+  double sums[2 * NSTEPS];
+  int counts[2 * NSTEPS];
+};
+
+static double model_sum(const multiset_int_double_t *S_v)
+{
+  int d;
+  int i;
+  int n;
+  int index;
+  double value;
+  double sum;
+
+  sum = 0.0;
+  for (d = 0; (n = multiset_int_double_depth_count(S_v, d)) >= 0; d ++) {
+    for (i = 0; i < n; i ++) {
+      multiset_int_double_nth_element(S_v, d, i, &index, &value);
+      sum += (double)index * value;
+    }
+  }
+
+  return sum;
+}
+
+static int record_cb(int i,
+		     void *user,
+		     const chain_history_change_t *step,
+		     const multiset_int_double_t *S_v)
+{
+  struct replay_record *r = (struct replay_record *)user;
+
+  memcpy(&(r->steps[r->n]), step, sizeof(chain_history_change_t));
+  r->sums[r->n] = model_sum(S_v);
+  r->counts[r->n] = multiset_int_double_total_count(S_v);
+  r->n ++;
+
+  return 0;
+}
+
+START_TEST (test_chain_history_compact)
+{
+  chain_history_t *ch;
+  chain_history_t *rch;
+  multiset_int_double_t *S_v;
+  multiset_int_double_t *R_v;
+  struct replay_record *expected;
+  struct replay_record *actual;
+  chain_history_file_t *f;
+  FILE *fp;
+  unsigned char *buffer;
+  long long offset;
+  long length;
+  int i;
+  int first;
+
+  expected = malloc(sizeof(struct replay_record));
+  actual = malloc(sizeof(struct replay_record));
+  S_v = multiset_int_double_create();
+  R_v = multiset_int_double_create();
+  ch = chain_history_create(NSTEPS);
+  rch = chain_history_create(NSTEPS);
+  ck_assert(expected != NULL && actual != NULL);
+  ck_assert(S_v != NULL && R_v != NULL);
+  ck_assert(ch != NULL && rch != NULL);
+
+  ck_assert(chain_history_set_block_steps(ch, 128) >= 0);
+
+  srand(11);
+  multiset_int_double_insert(S_v, 0, 0, 1.0);
+  ck_assert(chain_history_initialise(ch, S_v, 100.0, 1.0, 1.0) >= 0);
+
+  /*
+   * Two chunks, the second following a reset
+   */
+  fp = fopen("chain_history_tests.dat", "w");
+  ck_assert(fp != NULL);
+
+  expected->n = 0;
+  random_history(ch, S_v, NSTEPS);
+  ck_assert(chain_history_replay(ch, R_v, record_cb, expected) >= 0);
+  ck_assert(chain_history_write_compact(ch, (ch_write_t)fwrite, fp) >= 0);
+
+  ck_assert(chain_history_reset(ch) >= 0);
+  random_history(ch, S_v, NSTEPS - 7);
+  ck_assert(chain_history_replay(ch, R_v, record_cb, expected) >= 0);
+  ck_assert(chain_history_write_compact(ch, (ch_write_t)fwrite, fp) >= 0);
+  fclose(fp);
+
+  ck_assert(expected->n == 2 * NSTEPS - 9);
+
+  /*
+   * Sequential read back
+   */
+  fp = fopen("chain_history_tests.dat", "r");
+  ck_assert(fp != NULL);
+
+  actual->n = 0;
+  ck_assert(chain_history_read_compact(rch, (ch_read_t)fread, fp) >= 0);
+  ck_assert(chain_history_nsteps(rch) == NSTEPS);
+  ck_assert(chain_history_replay(rch, R_v, record_cb, actual) >= 0);
+  ck_assert(chain_history_read_compact(rch, (ch_read_t)fread, fp) >= 0);
+  ck_assert(chain_history_nsteps(rch) == NSTEPS - 7);
+  ck_assert(chain_history_replay(rch, R_v, record_cb, actual) >= 0);
+  ck_assert(chain_history_read_compact(rch, (ch_read_t)fread, fp) < 0);
+  fclose(fp);
+
+  ck_assert(actual->n == expected->n);
+  for (i = 0; i < expected->n; i ++) {
+    ck_assert(memcmp(&(actual->steps[i]), &(expected->steps[i]), sizeof(chain_history_change_t)) == 0);
+    ck_assert(actual->sums[i] == expected->sums[i]);
+    ck_assert(actual->counts[i] == expected->counts[i]);
+  }
+
+  /*
+   * A block offset past the end of the data (the index follows the 32 byte
+   * chunk header) must be rejected before decoding
+   */
+  fp = fopen("chain_history_tests.dat", "r");
+  ck_assert(fp != NULL);
+  fseek(fp, 0, SEEK_END);
+  length = ftell(fp);
+  rewind(fp);
+  buffer = malloc(length);
+  ck_assert(buffer != NULL);
+  ck_assert(fread(buffer, 1, length, fp) == length);
+  fclose(fp);
+
+  offset = 1LL << 40;
+  memcpy(buffer + 32 + sizeof(long long), &offset, sizeof(long long));
+  
+  fp = fopen("chain_history_tests_corrupt.dat", "w");
+  ck_assert(fp != NULL);
+  ck_assert(fwrite(buffer, 1, length, fp) == length);
+  fclose(fp);
+  free(buffer);
+
+  fp = fopen("chain_history_tests_corrupt.dat", "r");
+  ck_assert(fp != NULL);
+  ck_assert(chain_history_read_compact(rch, (ch_read_t)fread, fp) < 0);
+  fclose(fp);
+  ck_assert(chain_history_file_open("chain_history_tests_corrupt.dat") == NULL);
+  remove("chain_history_tests_corrupt.dat");
+
+  /*
+   * Random access from various starting steps
+   */
+  f = chain_history_file_open("chain_history_tests.dat");
+  ck_assert(f != NULL);
+  ck_assert(chain_history_file_nsteps(f) == expected->n);
+
+  for (first = 0; first < expected->n; first += 397) {
+    actual->n = 0;
+    ck_assert(chain_history_file_replay(f, first, expected->n - first, R_v, record_cb, actual) >= 0);
+    ck_assert(actual->n == expected->n - first);
+
+    for (i = 0; i < actual->n; i ++) {
+      ck_assert(memcmp(&(actual->steps[i]), &(expected->steps[first + i]), sizeof(chain_history_change_t)) == 0);
+      ck_assert(actual->sums[i] == expected->sums[first + i]);
+      ck_assert(actual->counts[i] == expected->counts[first + i]);
+    }
+  }
+
+  ck_assert(chain_history_file_replay(f, expected->n - 1, 2, R_v, record_cb, actual) < 0);
+
+  chain_history_file_close(f);
+
+  chain_history_destroy(ch);
+  chain_history_destroy(rch);
+  multiset_int_double_destroy(S_v);
+  multiset_int_double_destroy(R_v);
+  free(expected);
+  free(actual);
+}
+END_TEST
+
+struct parallel_total {
+  double sum;
+  long long isum;
+  int n;
+  int merges;
+};
+
+static void *total_create(void *user)
+{
+  return calloc(1, sizeof(struct parallel_total));
+}
+
+static int total_step(int i,
+		      void *user,
+		      const chain_history_change_t *step,
+		      const multiset_int_double_t *S_v)
+{
+  struct parallel_total *t = (struct parallel_total *)user;
+
+  t->sum += model_sum(S_v) + step->header.likelihood;
+  t->isum += i;
+  t->n ++;
+
+  return 0;
+}
+
+static int total_merge(void *user, void *acc)
+{
+  struct parallel_total *t = (struct parallel_total *)user;
+  struct parallel_total *a = (struct parallel_total *)acc;
+
+  t->sum += a->sum;
+  t->isum += a->isum;
+  t->n += a->n;
+  t->merges ++;
+
+  return 0;
+}
+
+static void total_destroy(void *acc)
+{
+  free(acc);
+}
+
+START_TEST (test_chain_history_parallel)
+{
+  chain_history_t *ch;
+  multiset_int_double_t *S_v;
+  chain_history_accumulator_t acc;
+  struct parallel_total expected;
+  struct parallel_total actual;
+  struct parallel_total *t;
+  const char *filenames[3] = {"chain_history_tests_a.dat",
+			      "chain_history_tests_b.dat",
+			      "chain_history_tests_c.dat"};
+  FILE *fp;
+  long long n;
+  int nthreads;
+  int i;
+
+  S_v = multiset_int_double_create();
+  ch = chain_history_create(NSTEPS);
+  ck_assert(S_v != NULL && ch != NULL);
+  ck_assert(chain_history_set_block_steps(ch, 100) >= 0);
+
+  acc.create = total_create;
+  acc.step = total_step;
+  acc.merge = total_merge;
+  acc.destroy = total_destroy;
+  acc.user = &actual;
+
+  srand(5);
+  multiset_int_double_insert(S_v, 0, 0, 1.0);
+  ck_assert(chain_history_initialise(ch, S_v, 100.0, 1.0, 1.0) >= 0);
+  random_history(ch, S_v, NSTEPS);
+
+  /*
+   * In memory against sequential replay
+   */
+  t = total_create(NULL);
+  ck_assert(chain_history_replay(ch, S_v, total_step, t) >= 0);
+  expected = *t;
+  free(t);
+
+  for (nthreads = 1; nthreads <= 4; nthreads ++) {
+    memset(&actual, 0, sizeof(actual));
+    ck_assert(chain_history_replay_parallel(ch, nthreads, &acc) >= 0);
+    ck_assert(actual.merges == nthreads);
+    ck_assert(actual.n == expected.n);
+    ck_assert(actual.isum == (long long)expected.n * (expected.n - 1)/2);
+    ck_assert(fabs(actual.sum - expected.sum) < 1.0e-9 * fabs(expected.sum));
+  }
+
+  /*
+   * Files, the second twice the first
+   */
+  for (i = 0; i < 2; i ++) {
+    fp = fopen(filenames[i], "w");
+    ck_assert(fp != NULL);
+    ck_assert(chain_history_write_compact(ch, (ch_write_t)fwrite, fp) >= 0);
+    if (i == 1) {
+      ck_assert(chain_history_write_compact(ch, (ch_write_t)fwrite, fp) >= 0);
+    }
+    fclose(fp);
+  }
+
+  for (nthreads = 1; nthreads <= 4; nthreads += 3) {
+    memset(&actual, 0, sizeof(actual));
+    ck_assert(chain_history_file_replay_parallel(filenames, 2, nthreads, &acc) >= 0);
+    ck_assert(actual.n == 3 * expected.n);
+    n = expected.n;
+    ck_assert(actual.isum == n * (n - 1)/2 + 2 * n * (2 * n - 1)/2);
+    ck_assert(fabs(actual.sum - 3.0 * expected.sum) < 1.0e-9 * fabs(expected.sum));
+  }
+
+  /*
+   * A file long enough to be split into more than one segment
+   */
+  fp = fopen(filenames[2], "w");
+  ck_assert(fp != NULL);
+  for (i = 0; i < 34; i ++) {
+    ck_assert(chain_history_write_compact(ch, (ch_write_t)fwrite, fp) >= 0);
+  }
+  fclose(fp);
+
+  n = 34 * (long long)expected.n;
+  ck_assert(n > 65536);
+  for (nthreads = 1; nthreads <= 3; nthreads += 2) {
+    memset(&actual, 0, sizeof(actual));
+    ck_assert(chain_history_file_replay_parallel(filenames + 2, 1, nthreads, &acc) >= 0);
+    ck_assert(actual.n == n);
+    ck_assert(actual.isum == n * (n - 1)/2);
+    ck_assert(fabs(actual.sum - 34.0 * expected.sum) < 1.0e-9 * fabs(expected.sum));
+  }
+
+  chain_history_destroy(ch);
+  multiset_int_double_destroy(S_v);
+}
+END_TEST
+
+Suite *
+chain_history_suite (void)
+{
+  Suite *s = suite_create ("Chain History");
+
+  /* Core test case */
+  TCase *tc_core = tcase_create ("Core");
+  tcase_add_test (tc_core, test_chain_history_compact);
+  tcase_add_test (tc_core, test_chain_history_parallel);
+
+  suite_add_tcase (s, tc_core);
+
+  return s;
+}
+
+int main (void)
+{
+  int number_failed;
+  Suite *s = chain_history_suite ();
+  SRunner *sr = srunner_create (s);
+
+  srunner_set_fork_status (sr, CK_NOFORK);
+
+  srunner_run_all (sr, CK_VERBOSE);
+  number_failed = srunner_ntests_failed (sr);
+  srunner_free (sr);
+  return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
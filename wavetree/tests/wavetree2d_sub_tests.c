@@ -1,9 +1,17 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
 #include <check.h>
 
 #include "wavetree2d_sub.h"
+#include "wavetree_snapshot.h"
+
+#include "cdf97_lift.h"
+#include "cdf97_lift_impulse.h"
+#include "haar_lift.h"
+#include "generic_lift.h"
 
 START_TEST (test_wavetree2d_sub_ncoefficients)
 {
@@ -181,6 +189,41 @@ START_TEST (test_wavetree2d_sub_depth)
 }
 END_TEST
 
+START_TEST (test_wavetree2d_sub_depth_nonsquare)
+{
+  wavetree2d_sub_t *s;
+  int i;
+  int j;
+  int d;
+  int size;
+  int n;
+  int indices[16];
+
+  /*
+   * Depth must agree with walking the parent chain and children must be
+   * one level deeper.
+   */
+  s = wavetree2d_sub_create(6, 3, 0.0);
+  ck_assert(s != NULL);
+
+  size = wavetree2d_sub_get_width(s) * wavetree2d_sub_get_height(s);
+
+  ck_assert(wavetree2d_sub_depthofindex(s, 0) == 0);
+  for (i = 1; i <= size; i ++) {
+    d = wavetree2d_sub_depthofindex(s, i);
+    ck_assert(d == 1 + wavetree2d_sub_depthofindex(s, wavetree2d_sub_parent_index(s, i)));
+
+    ck_assert(wavetree2d_sub_child_indices(s, i, d, indices, &n, 16) == 0);
+    for (j = 0; j < n; j ++) {
+      ck_assert(wavetree2d_sub_parent_index(s, indices[j]) == i);
+      ck_assert(wavetree2d_sub_depthofindex(s, indices[j]) == d + 1);
+    }
+  }
+
+  wavetree2d_sub_destroy(s);
+}
+END_TEST
+
 START_TEST(test_wavetree2d_sub_birth)
 {
   wavetree2d_sub_t *s;
@@ -246,6 +289,68 @@ START_TEST(test_wavetree2d_sub_birth)
 }
 END_TEST
 
+START_TEST(test_wavetree2d_sub_hash)
+{
+  wavetree2d_sub_t *s;
+  wavetree2d_sub_t *r;
+  uint64_t h0;
+  uint64_t h1;
+  double old_value;
+  char buffer[1024];
+  int len;
+  int indices[3] = {0, 1, 3};
+  double values[3] = {0.5, 1.0, 3.0};
+
+  s = wavetree2d_sub_create(7, 7, 0.0);
+  ck_assert(s != NULL);
+
+  ck_assert(wavetree2d_sub_initialize(s, 0.5) >= 0);
+  h0 = wavetree2d_sub_hash(s);
+
+  ck_assert(wavetree2d_sub_propose_birth(s, 1, 1, 1.0) >= 0);
+  ck_assert(wavetree2d_sub_commit(s) >= 0);
+  h1 = wavetree2d_sub_hash(s);
+  ck_assert(h1 != h0);
+
+  /* Birth then undo, value then undo and birth then death all return */
+  ck_assert(wavetree2d_sub_propose_birth(s, 2, 2, 2.0) >= 0);
+  ck_assert(wavetree2d_sub_hash(s) != h1);
+  ck_assert(wavetree2d_sub_undo(s) >= 0);
+  ck_assert(wavetree2d_sub_hash(s) == h1);
+
+  ck_assert(wavetree2d_sub_propose_value(s, 1, 1, 1.5) >= 0);
+  ck_assert(wavetree2d_sub_hash(s) != h1);
+  ck_assert(wavetree2d_sub_undo(s) >= 0);
+  ck_assert(wavetree2d_sub_hash(s) == h1);
+
+  ck_assert(wavetree2d_sub_propose_birth(s, 3, 2, 3.0) >= 0);
+  ck_assert(wavetree2d_sub_commit(s) >= 0);
+  ck_assert(wavetree2d_sub_propose_death(s, 3, 2, &old_value) >= 0);
+  ck_assert(wavetree2d_sub_commit(s) >= 0);
+  ck_assert(wavetree2d_sub_hash(s) == h1);
+
+  /* The same model built another way hashes the same */
+  ck_assert(wavetree2d_sub_propose_birth(s, 3, 2, 3.0) >= 0);
+  ck_assert(wavetree2d_sub_commit(s) >= 0);
+
+  r = wavetree2d_sub_create(7, 7, 0.0);
+  ck_assert(r != NULL);
+  ck_assert(wavetree2d_sub_set_model(r, indices, values, 3) >= 0);
+  ck_assert(wavetree2d_sub_hash(r) == wavetree2d_sub_hash(s));
+
+  ck_assert(wavetree2d_sub_initialize(r, 0.5) >= 0);
+  ck_assert(wavetree2d_sub_hash(r) == h0);
+
+  len = wavetree2d_sub_encode(s, buffer, sizeof(buffer));
+  ck_assert(len > 0);
+  ck_assert(wavetree2d_sub_decode(r, buffer, len) >= 0);
+  ck_assert(wavetree2d_sub_hash(r) == wavetree2d_sub_hash(s));
+
+  wavetree2d_sub_destroy(s);
+  wavetree2d_sub_destroy(r);
+}
+END_TEST
+
 START_TEST(test_wavetree2d_sub_move)
 {
   wavetree2d_sub_t *s;
@@ -621,6 +726,73 @@ START_TEST(test_wavetree2d_sub_saveload)
 }
 END_TEST
 
+START_TEST(test_wavetree2d_sub_saveload_binary)
+{
+  wavetree2d_sub_t *s;
+  wavetree2d_sub_t *r;
+  char *a;
+  char *b;
+  int alen;
+  int blen;
+  int i;
+  int depth;
+  int coeff;
+  double prob;
+
+  s = wavetree2d_sub_create(7, 6, 0.0);
+  ck_assert(s != NULL);
+  ck_assert(wavetree2d_sub_initialize(s, 1.0) >= 0);
+
+  /*
+   * Grow a random tree
+   */
+  srand(7);
+  for (i = 0; i < 500; i ++) {
+    ck_assert(wavetree2d_sub_choose_birth_global(s, (double)rand()/((double)RAND_MAX + 1.0), -1, &depth, &coeff, &prob) >= 0);
+    ck_assert(wavetree2d_sub_propose_birth(s, coeff, depth, (double)i) >= 0);
+    ck_assert(wavetree2d_sub_commit(s) >= 0);
+  }
+  ck_assert(wavetree2d_sub_valid(s));
+
+  ck_assert(wavetree2d_sub_save_binary(s, "wavetree2d_sub_tests_saveload.dat") >= 0);
+
+  r = wavetree2d_sub_create(7, 6, 0.0);
+  ck_assert(r != NULL);
+  ck_assert(wavetree2d_sub_load_binary(r, "wavetree2d_sub_tests_saveload.dat") >= 0);
+
+  /*
+   * S_b and S_d are rebuilt, so check them through validity and counts
+   */
+  ck_assert(wavetree2d_sub_valid(r));
+  ck_assert(wavetree2d_sub_coeff_count(r) == wavetree2d_sub_coeff_count(s));
+  ck_assert(wavetree2d_sub_hash(r) == wavetree2d_sub_hash(s));
+  ck_assert(wavetree2d_sub_prunable_leaves(r) == wavetree2d_sub_prunable_leaves(s));
+  ck_assert(wavetree2d_sub_attachable_branches(r) == wavetree2d_sub_attachable_branches(s));
+
+  a = malloc(1 << 20);
+  b = malloc(1 << 20);
+  alen = wavetree2d_sub_encode(s, a, 1 << 20);
+  blen = wavetree2d_sub_encode(r, b, 1 << 20);
+  ck_assert(alen > 0);
+  ck_assert(alen == blen);
+  ck_assert(memcmp(a, b, alen) == 0);
+  free(a);
+  free(b);
+
+  wavetree2d_sub_destroy(r);
+
+  /*
+   * Mismatched dimensions are rejected
+   */
+  r = wavetree2d_sub_create(6, 6, 0.0);
+  ck_assert(r != NULL);
+  ck_assert(wavetree2d_sub_load_binary(r, "wavetree2d_sub_tests_saveload.dat") < 0);
+  wavetree2d_sub_destroy(r);
+
+  wavetree2d_sub_destroy(s);
+}
+END_TEST
+
 START_TEST(test_wavetree2d_sub_dyck_duplicate)
 {
   wavetree2d_sub_t *s1;
@@ -1007,6 +1179,476 @@ START_TEST(test_wavetree2d_sub_map_impulse)
 }
 END_TEST
 
+static void
+propose_to_array_image(wavetree2d_sub_t *s,
+		       double *img,
+		       double *work,
+		       int haar)
+{
+  int width;
+  int height;
+  int size;
+  int subtile;
+
+  width = wavetree2d_sub_get_width(s);
+  height = wavetree2d_sub_get_height(s);
+  size = wavetree2d_sub_get_size(s);
+  subtile = (wavetree2d_sub_base_size(s) > 1);
+
+  memset(img, 0, sizeof(double) * size);
+  ck_assert(wavetree2d_sub_map_to_array(s, img, size) >= 0);
+
+  if (haar) {
+    ck_assert(haar_lift_inverse2d_haar(img, width, height, width, work, subtile) >= 0);
+  } else {
+    ck_assert(cdf97_lift_inverse2d_cdf97(img, width, height, width, work, subtile) >= 0);
+  }
+}
+
+static void
+propose_to_array_check(int degree_width, int degree_height, int haar, int moves)
+{
+  wavetree2d_sub_t *s;
+  double *img;
+  double *expected;
+  double *work;
+  int size;
+  int maxdepth;
+  int step;
+  int i;
+
+  int depth;
+  int coeff;
+  int sibling;
+  double prob;
+  double value;
+  int accept;
+
+  s = wavetree2d_sub_create(degree_width, degree_height, 0.0);
+  ck_assert(s != NULL);
+
+  if (haar) {
+    ck_assert(wavetree2d_sub_set_impulse_response(s, haar_lift_impulse_response_1d) >= 0);
+  } else {
+    ck_assert(wavetree2d_sub_set_impulse_response(s, cdf97_lift_impulse_response_1d) >= 0);
+  }
+
+  size = wavetree2d_sub_get_size(s);
+  maxdepth = wavetree2d_sub_maxdepth(s);
+  img = malloc(sizeof(double) * size);
+  expected = malloc(sizeof(double) * size);
+  work = malloc(sizeof(double) * size);
+  ck_assert(img != NULL && expected != NULL && work != NULL);
+
+  ck_assert(wavetree2d_sub_initialize(s, 1.0) >= 0);
+  propose_to_array_image(s, img, work, haar);
+
+  srand(1234);
+  for (step = 0; step < 500; step ++) {
+
+    value = (double)rand()/(double)RAND_MAX - 0.5;
+
+    switch (rand() % 4) {
+    case 0:
+      if (wavetree2d_sub_choose_birth_global(s, (double)rand()/((double)RAND_MAX + 1.0), maxdepth, &depth, &coeff, &prob) < 0) {
+	continue;
+      }
+      ck_assert(wavetree2d_sub_propose_birth(s, coeff, depth, value) >= 0);
+      break;
+
+    case 1:
+      if (wavetree2d_sub_prunable_leaves(s) == 0) {
+	continue;
+      }
+      ck_assert(wavetree2d_sub_choose_death_global(s, (double)rand()/((double)RAND_MAX + 1.0), maxdepth, &depth, &coeff, &prob) >= 0);
+      ck_assert(wavetree2d_sub_propose_death(s, coeff, depth, &value) >= 0);
+      break;
+
+    case 2:
+      ck_assert(wavetree2d_sub_choose_value_global(s, (double)rand()/((double)RAND_MAX + 1.0), maxdepth, &depth, &coeff, &prob) >= 0);
+      ck_assert(wavetree2d_sub_propose_value(s, coeff, depth, value) >= 0);
+      break;
+
+    default:
+      if (!moves ||
+	  wavetree2d_sub_choose_move_global(s, (double)rand()/((double)RAND_MAX + 1.0), maxdepth, &depth, &coeff, &prob) < 0 ||
+	  depth == 0 ||
+	  wavetree2d_sub_choose_move_sibling(s, (double)rand()/((double)RAND_MAX + 1.0), depth, coeff, &sibling, &prob) < 0) {
+	continue;
+      }
+      ck_assert(wavetree2d_sub_propose_move(s, coeff, depth, sibling, value) >= 0);
+      break;
+    }
+
+    ck_assert(wavetree2d_sub_propose_to_array(s, img, size) >= 0);
+    propose_to_array_image(s, expected, work, haar);
+    for (i = 0; i < size; i ++) {
+      ck_assert(fabs(img[i] - expected[i]) < 1.0e-9);
+    }
+
+    accept = rand() % 2;
+    if (accept) {
+      ck_assert(wavetree2d_sub_commit(s) >= 0);
+    } else {
+      ck_assert(wavetree2d_sub_revert_to_array(s, img, size) >= 0);
+      ck_assert(wavetree2d_sub_undo(s) >= 0);
+    }
+
+    propose_to_array_image(s, expected, work, haar);
+    for (i = 0; i < size; i ++) {
+      ck_assert(fabs(img[i] - expected[i]) < 1.0e-9);
+    }
+  }
+
+  free(img);
+  free(expected);
+  free(work);
+  wavetree2d_sub_destroy(s);
+}
+
+START_TEST(test_wavetree2d_sub_propose_to_array)
+{
+  propose_to_array_check(5, 5, 0, 1);
+  propose_to_array_check(5, 5, 1, 1);
+}
+END_TEST
+
+START_TEST(test_wavetree2d_sub_propose_to_array_nonsquare)
+{
+  propose_to_array_check(5, 3, 0, 0);
+  propose_to_array_check(4, 5, 1, 0);
+}
+END_TEST
+
+/*
+ * Sparse inverse from the row activity of the tree must match the dense
+ * inverse exactly as the model grows.
+ */
+static void
+inverse_sparse_check(int degree_width, int degree_height)
+{
+  wavetree2d_sub_t *s;
+  double *img;
+  double *expected;
+  double *work;
+  int *row_first;
+  int width;
+  int height;
+  int size;
+  int maxdepth;
+  int subtile;
+  int step;
+  int i;
+
+  int depth;
+  int coeff;
+  double prob;
+
+  s = wavetree2d_sub_create(degree_width, degree_height, 0.0);
+  ck_assert(s != NULL);
+
+  width = wavetree2d_sub_get_width(s);
+  height = wavetree2d_sub_get_height(s);
+  size = wavetree2d_sub_get_size(s);
+  maxdepth = wavetree2d_sub_maxdepth(s);
+  subtile = (wavetree2d_sub_base_size(s) > 1);
+
+  img = malloc(sizeof(double) * size);
+  expected = malloc(sizeof(double) * size);
+  work = malloc(sizeof(double) * size);
+  row_first = malloc(sizeof(int) * height);
+  ck_assert(img != NULL && expected != NULL && work != NULL && row_first != NULL);
+
+  ck_assert(wavetree2d_sub_initialize(s, 1.0) >= 0);
+
+  srand(1357);
+  for (step = 0; step < 60; step ++) {
+
+    if (step > 0) {
+      ck_assert(wavetree2d_sub_choose_birth_global(s, (double)rand()/((double)RAND_MAX + 1.0), maxdepth, &depth, &coeff, &prob) >= 0);
+      ck_assert(wavetree2d_sub_propose_birth(s, coeff, depth, (double)rand()/(double)RAND_MAX - 0.5) >= 0);
+      ck_assert(wavetree2d_sub_commit(s) >= 0);
+    }
+
+    propose_to_array_image(s, expected, work, 0);
+
+    memset(img, 0, sizeof(double) * size);
+    ck_assert(wavetree2d_sub_map_to_array(s, img, size) >= 0);
+    ck_assert(wavetree2d_sub_map_row_first(s, row_first, height) >= 0);
+    ck_assert(generic_lift_inverse2d_sparse(img, width, height, width, work, NULL, row_first,
+					    cdf97_lift_inverse1d_cdf97_step,
+					    cdf97_lift_inverse1d_cdf97_step,
+					    subtile) >= 0);
+
+    for (i = 0; i < size; i ++) {
+      ck_assert(img[i] == expected[i]);
+    }
+  }
+
+  free(img);
+  free(expected);
+  free(work);
+  free(row_first);
+  wavetree2d_sub_destroy(s);
+}
+
+START_TEST(test_wavetree2d_sub_inverse_sparse)
+{
+  inverse_sparse_check(6, 6);
+  inverse_sparse_check(6, 4);
+  inverse_sparse_check(3, 5);
+}
+END_TEST
+
+/*
+ * Point evaluation must agree with the full inverse at every pixel as the
+ * model grows.
+ */
+static void
+evaluate_points_check(int degree_width, int degree_height, int haar)
+{
+  wavetree2d_sub_t *s;
+  double *expected;
+  double *values;
+  double *work;
+  int *x;
+  int *y;
+  int width;
+  int size;
+  int maxdepth;
+  int step;
+  int i;
+
+  int depth;
+  int coeff;
+  double prob;
+
+  s = wavetree2d_sub_create(degree_width, degree_height, 0.0);
+  ck_assert(s != NULL);
+
+  if (haar) {
+    ck_assert(wavetree2d_sub_set_impulse_response(s, haar_lift_impulse_response_1d) >= 0);
+  } else {
+    ck_assert(wavetree2d_sub_set_impulse_response(s, cdf97_lift_impulse_response_1d) >= 0);
+  }
+
+  width = wavetree2d_sub_get_width(s);
+  size = wavetree2d_sub_get_size(s);
+  maxdepth = wavetree2d_sub_maxdepth(s);
+
+  expected = malloc(sizeof(double) * size);
+  values = malloc(sizeof(double) * size);
+  work = malloc(sizeof(double) * size);
+  x = malloc(sizeof(int) * size);
+  y = malloc(sizeof(int) * size);
+  ck_assert(expected != NULL && values != NULL && work != NULL && x != NULL && y != NULL);
+
+  for (i = 0; i < size; i ++) {
+    x[i] = i % width;
+    y[i] = i / width;
+  }
+
+  ck_assert(wavetree2d_sub_initialize(s, 1.0) >= 0);
+
+  srand(2468);
+  for (step = 0; step < 80; step ++) {
+
+    if (step > 0) {
+      ck_assert(wavetree2d_sub_choose_birth_global(s, (double)rand()/((double)RAND_MAX + 1.0), maxdepth, &depth, &coeff, &prob) >= 0);
+      ck_assert(wavetree2d_sub_propose_birth(s, coeff, depth, (double)rand()/(double)RAND_MAX - 0.5) >= 0);
+      ck_assert(wavetree2d_sub_commit(s) >= 0);
+    }
+
+    propose_to_array_image(s, expected, work, haar);
+    ck_assert(wavetree2d_sub_evaluate_points(s, x, y, values, size) >= 0);
+
+    for (i = 0; i < size; i ++) {
+      ck_assert(fabs(values[i] - expected[i]) < 1.0e-9);
+    }
+  }
+
+  x[0] = width;
+  ck_assert(wavetree2d_sub_evaluate_points(s, x, y, values, 1) < 0);
+
+  free(expected);
+  free(values);
+  free(work);
+  free(x);
+  free(y);
+  wavetree2d_sub_destroy(s);
+}
+
+START_TEST(test_wavetree2d_sub_evaluate_points)
+{
+  evaluate_points_check(5, 5, 0);
+  evaluate_points_check(5, 5, 1);
+  evaluate_points_check(6, 4, 0);
+  evaluate_points_check(3, 5, 1);
+}
+END_TEST
+
+/*
+ * Random births and deaths from the current model
+ */
+static void
+snapshot_walk(wavetree2d_sub_t *s, int nsteps)
+{
+  int maxdepth;
+  int step;
+  int depth;
+  int coeff;
+  double prob;
+  double value;
+
+  maxdepth = wavetree2d_sub_maxdepth(s);
+  for (step = 0; step < nsteps; step ++) {
+    if ((rand() % 3) == 0 && wavetree2d_sub_prunable_leaves(s) > 0) {
+      ck_assert(wavetree2d_sub_choose_death_global(s, (double)rand()/((double)RAND_MAX + 1.0), maxdepth, &depth, &coeff, &prob) >= 0);
+      ck_assert(wavetree2d_sub_propose_death(s, coeff, depth, &value) >= 0);
+    } else {
+      if (wavetree2d_sub_choose_birth_global(s, (double)rand()/((double)RAND_MAX + 1.0), maxdepth, &depth, &coeff, &prob) < 0) {
+	continue;
+      }
+      ck_assert(wavetree2d_sub_propose_birth(s, coeff, depth, (double)rand()/(double)RAND_MAX - 0.5) >= 0);
+    }
+    ck_assert(wavetree2d_sub_commit(s) >= 0);
+  }
+}
+
+/*
+ * Returns the death indices of the first depth in a snapshot holding at
+ * least two, these are in the last section adopted.
+ */
+static int *
+snapshot_deaths(void *snapshot, int len, int *n)
+{
+  const wavetree_snapshot_header_t *h;
+  const int *counts;
+  char *p;
+  int nd;
+  int d;
+
+  h = wavetree_snapshot_header(snapshot, len);
+  if (h == NULL) {
+    return NULL;
+  }
+
+  nd = h->ndepths;
+  counts = (const int *)((char *)snapshot + sizeof(wavetree_snapshot_header_t));
+  p = (char *)snapshot + sizeof(wavetree_snapshot_header_t) + ((sizeof(int) * 3 * nd + 7) & ~7);
+  for (d = 0; d < nd; d ++) {
+    p += ((sizeof(int) * counts[d] + 7) & ~7) + sizeof(double) * counts[d];
+  }
+  for (d = 0; d < nd; d ++) {
+    p += (sizeof(int) * counts[nd + d] + 7) & ~7;
+  }
+  for (d = 0; d < nd; d ++) {
+    if (counts[2 * nd + d] >= 2) {
+      *n = counts[2 * nd + d];
+      return (int *)p;
+    }
+    p += (sizeof(int) * counts[2 * nd + d] + 7) & ~7;
+  }
+
+  return NULL;
+}
+
+START_TEST(test_wavetree2d_sub_snapshot)
+{
+  wavetree2d_sub_t *s;
+  wavetree2d_sub_t *r;
+  wavetree2d_sub_t *o;
+  double *snapshot;
+  int *deaths;
+  char *a;
+  char *b;
+  int size;
+  int len;
+  int alen;
+  int blen;
+  int n;
+  int i;
+
+  s = wavetree2d_sub_create(6, 5, 0.0);
+  ck_assert(s != NULL);
+  r = wavetree2d_sub_create(6, 5, 0.0);
+  ck_assert(r != NULL);
+  o = wavetree2d_sub_create(5, 6, 0.0);
+  ck_assert(o != NULL);
+
+  a = malloc(65536);
+  b = malloc(65536);
+  ck_assert(a != NULL && b != NULL);
+
+  ck_assert(wavetree2d_sub_initialize(s, 1.0) >= 0);
+  ck_assert(wavetree2d_sub_initialize(r, -1.0) >= 0);
+  srand(97531);
+  snapshot_walk(s, 300);
+  snapshot_walk(r, 500);
+
+  size = wavetree2d_sub_snapshot_size(s);
+  snapshot = malloc(size);
+  ck_assert(snapshot != NULL);
+  len = wavetree2d_sub_write_snapshot(s, snapshot, size);
+  ck_assert(len == size);
+  ck_assert(wavetree2d_sub_write_snapshot(s, snapshot, size - 8) < 0);
+
+  /* Adopting replaces a larger model entirely */
+  ck_assert(wavetree2d_sub_adopt_snapshot(r, snapshot, len) >= 0);
+  ck_assert(wavetree2d_sub_valid(r));
+  ck_assert(wavetree2d_sub_hash(r) == wavetree2d_sub_hash(s));
+  ck_assert(wavetree2d_sub_prunable_leaves(r) == wavetree2d_sub_prunable_leaves(s));
+  ck_assert(wavetree2d_sub_attachable_branches(r) == wavetree2d_sub_attachable_branches(s));
+
+  alen = wavetree2d_sub_encode(s, a, 65536);
+  blen = wavetree2d_sub_encode(r, b, 65536);
+  ck_assert(alen > 0 && alen == blen);
+  ck_assert(memcmp(a, b, alen) == 0);
+
+  /* And both continue identically */
+  srand(8642);
+  snapshot_walk(s, 200);
+  srand(8642);
+  snapshot_walk(r, 200);
+  ck_assert(wavetree2d_sub_valid(r));
+
+  alen = wavetree2d_sub_encode(s, a, 65536);
+  blen = wavetree2d_sub_encode(r, b, 65536);
+  ck_assert(alen > 0 && alen == blen);
+  ck_assert(memcmp(a, b, alen) == 0);
+
+  /* A snapshot rejected part way through leaves the model untouched */
+  deaths = snapshot_deaths(snapshot, len, &n);
+  ck_assert(deaths != NULL && n >= 2);
+  i = deaths[0];
+  deaths[0] = deaths[1];
+  deaths[1] = i;
+  ck_assert(wavetree2d_sub_initialize(r, -1.0) >= 0);
+  snapshot_walk(r, 100);
+  alen = wavetree2d_sub_encode(r, a, 65536);
+  ck_assert(wavetree2d_sub_adopt_snapshot(r, snapshot, len) < 0);
+  blen = wavetree2d_sub_encode(r, b, 65536);
+  ck_assert(wavetree2d_sub_valid(r));
+  ck_assert(alen > 0 && alen == blen);
+  ck_assert(memcmp(a, b, alen) == 0);
+  deaths[1] = deaths[0];
+  deaths[0] = i;
+
+  /* Mismatched dimensions, truncation and a bad magic are rejected */
+  ck_assert(wavetree2d_sub_adopt_snapshot(o, snapshot, len) < 0);
+  ck_assert(wavetree2d_sub_adopt_snapshot(r, snapshot, len - 8) < 0);
+  ((char *)snapshot)[0] = 'X';
+  ck_assert(wavetree2d_sub_adopt_snapshot(r, snapshot, len) < 0);
+
+  free(snapshot);
+  free(a);
+  free(b);
+  wavetree2d_sub_destroy(s);
+  wavetree2d_sub_destroy(r);
+  wavetree2d_sub_destroy(o);
+}
+END_TEST
+
 Suite *
 wavetree2d_sub_suite (void)
 {
@@ -1019,14 +1661,18 @@ wavetree2d_sub_suite (void)
   tcase_add_test (tc_core, test_wavetree2d_sub_2dindices_rectangle);
   tcase_add_test (tc_core, test_wavetree2d_sub_childindices);
   tcase_add_test (tc_core, test_wavetree2d_sub_depth);
+  tcase_add_test (tc_core, test_wavetree2d_sub_depth_nonsquare);
   tcase_add_test (tc_core, test_wavetree2d_sub_birth);
   tcase_add_test (tc_core, test_wavetree2d_sub_image_mapping);
   tcase_add_test (tc_core, test_wavetree2d_sub_image_mapping_rectangular);
   tcase_add_test (tc_core, test_wavetree2d_sub_saveload);
+  tcase_add_test (tc_core, test_wavetree2d_sub_saveload_binary);
 
   tcase_add_test (tc_core, test_wavetree2d_sub_dyck_duplicate);
 
   tcase_add_test (tc_core, test_wavetree2d_sub_move);
+  tcase_add_test (tc_core, test_wavetree2d_sub_hash);
+  tcase_add_test (tc_core, test_wavetree2d_sub_snapshot);
 
   tcase_add_test (tc_core, test_wavetree2d_sub_nonsquare_coverage);
 
@@ -1034,6 +1680,11 @@ wavetree2d_sub_suite (void)
   tcase_add_test (tc_core, test_wavetree2d_sub_map_from_array_nonsquare);
 
   tcase_add_test (tc_core, test_wavetree2d_sub_map_impulse);
+
+  tcase_add_test (tc_core, test_wavetree2d_sub_propose_to_array);
+  tcase_add_test (tc_core, test_wavetree2d_sub_propose_to_array_nonsquare);
+  tcase_add_test (tc_core, test_wavetree2d_sub_inverse_sparse);
+  tcase_add_test (tc_core, test_wavetree2d_sub_evaluate_points);
   
   suite_add_tcase (s, tc_core);
 
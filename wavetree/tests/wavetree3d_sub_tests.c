@@ -2,11 +2,16 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 
 #include <check.h>
 
 #include "wavetree3d_sub.h"
 
+#include "cdf97_lift.h"
+#include "cdf97_lift_impulse.h"
+#include "haar_lift.h"
+
 START_TEST (test_wavetree3d_sub_ncoefficients)
 {
   wavetree3d_sub_t *s;
@@ -178,6 +183,41 @@ START_TEST (test_wavetree3d_sub_depth)
 }
 END_TEST
 
+START_TEST (test_wavetree3d_sub_depth_nonsquare)
+{
+  wavetree3d_sub_t *s;
+  int i;
+  int j;
+  int d;
+  int size;
+  int n;
+  int indices[16];
+
+  /*
+   * Depth must agree with walking the parent chain and children must be
+   * one level deeper.
+   */
+  s = wavetree3d_sub_create(5, 2, 3, 0.0);
+  ck_assert(s != NULL);
+
+  size = wavetree3d_sub_get_width(s) * wavetree3d_sub_get_height(s) * wavetree3d_sub_get_depth(s);
+
+  ck_assert(wavetree3d_sub_depthofindex(s, 0) == 0);
+  for (i = 1; i <= size; i ++) {
+    d = wavetree3d_sub_depthofindex(s, i);
+    ck_assert(d == 1 + wavetree3d_sub_depthofindex(s, wavetree3d_sub_parent_index(s, i)));
+
+    ck_assert(wavetree3d_sub_child_indices(s, i, d, indices, &n, 16) == 0);
+    for (j = 0; j < n; j ++) {
+      ck_assert(wavetree3d_sub_parent_index(s, indices[j]) == i);
+      ck_assert(wavetree3d_sub_depthofindex(s, indices[j]) == d + 1);
+    }
+  }
+
+  wavetree3d_sub_destroy(s);
+}
+END_TEST
+
 START_TEST(test_wavetree3d_sub_birth)
 {
   wavetree3d_sub_t *s;
@@ -351,6 +391,52 @@ START_TEST(test_wavetree3d_sub_death)
 }
 END_TEST
 
+START_TEST(test_wavetree3d_sub_hash)
+{
+  wavetree3d_sub_t *s;
+  wavetree3d_sub_t *r;
+  uint64_t h1;
+  double old_value;
+  char buffer[1024];
+  int len;
+
+  s = wavetree3d_sub_create(5, 5, 5, 0.0);
+  ck_assert(s != NULL);
+
+  ck_assert(wavetree3d_sub_initialize(s, 0.0) >= 0);
+  ck_assert(wavetree3d_sub_propose_birth(s, 1, 1, 1.0) >= 0);
+  ck_assert(wavetree3d_sub_commit(s) >= 0);
+  h1 = wavetree3d_sub_hash(s);
+
+  ck_assert(wavetree3d_sub_propose_birth(s, 2, 2, 2.0) >= 0);
+  ck_assert(wavetree3d_sub_hash(s) != h1);
+  ck_assert(wavetree3d_sub_undo(s) >= 0);
+  ck_assert(wavetree3d_sub_hash(s) == h1);
+
+  ck_assert(wavetree3d_sub_propose_value(s, 1, 1, -1.0) >= 0);
+  ck_assert(wavetree3d_sub_hash(s) != h1);
+  ck_assert(wavetree3d_sub_undo(s) >= 0);
+  ck_assert(wavetree3d_sub_hash(s) == h1);
+
+  ck_assert(wavetree3d_sub_propose_birth(s, 3, 2, 3.0) >= 0);
+  ck_assert(wavetree3d_sub_commit(s) >= 0);
+  ck_assert(wavetree3d_sub_propose_death(s, 3, 2, &old_value) >= 0);
+  ck_assert(wavetree3d_sub_commit(s) >= 0);
+  ck_assert(wavetree3d_sub_hash(s) == h1);
+
+  r = wavetree3d_sub_create(5, 5, 5, 0.0);
+  ck_assert(r != NULL);
+
+  len = wavetree3d_sub_encode(s, buffer, sizeof(buffer));
+  ck_assert(len > 0);
+  ck_assert(wavetree3d_sub_decode(r, buffer, len) >= 0);
+  ck_assert(wavetree3d_sub_hash(r) == h1);
+
+  wavetree3d_sub_destroy(s);
+  wavetree3d_sub_destroy(r);
+}
+END_TEST
+
 START_TEST(test_wavetree3d_sub_value)
 {
   wavetree3d_sub_t *s;
@@ -741,6 +827,73 @@ START_TEST(test_wavetree3d_sub_saveload)
 }
 END_TEST
 
+START_TEST(test_wavetree3d_sub_saveload_binary)
+{
+  wavetree3d_sub_t *s;
+  wavetree3d_sub_t *r;
+  char *a;
+  char *b;
+  int alen;
+  int blen;
+  int i;
+  int depth;
+  int coeff;
+  double prob;
+
+  s = wavetree3d_sub_create(5, 4, 5, 0.0);
+  ck_assert(s != NULL);
+  ck_assert(wavetree3d_sub_initialize(s, 1.0) >= 0);
+
+  /*
+   * Grow a random tree
+   */
+  srand(7);
+  for (i = 0; i < 500; i ++) {
+    ck_assert(wavetree3d_sub_choose_birth_global(s, (double)rand()/((double)RAND_MAX + 1.0), -1, &depth, &coeff, &prob) >= 0);
+    ck_assert(wavetree3d_sub_propose_birth(s, coeff, depth, (double)i) >= 0);
+    ck_assert(wavetree3d_sub_commit(s) >= 0);
+  }
+  ck_assert(wavetree3d_sub_valid(s));
+
+  ck_assert(wavetree3d_sub_save_binary(s, "wavetree3d_sub_tests_saveload.dat") >= 0);
+
+  r = wavetree3d_sub_create(5, 4, 5, 0.0);
+  ck_assert(r != NULL);
+  ck_assert(wavetree3d_sub_load_binary(r, "wavetree3d_sub_tests_saveload.dat") >= 0);
+
+  /*
+   * S_b and S_d are rebuilt, so check them through validity and counts
+   */
+  ck_assert(wavetree3d_sub_valid(r));
+  ck_assert(wavetree3d_sub_coeff_count(r) == wavetree3d_sub_coeff_count(s));
+  ck_assert(wavetree3d_sub_hash(r) == wavetree3d_sub_hash(s));
+  ck_assert(wavetree3d_sub_prunable_leaves(r) == wavetree3d_sub_prunable_leaves(s));
+  ck_assert(wavetree3d_sub_attachable_branches(r) == wavetree3d_sub_attachable_branches(s));
+
+  a = malloc(1 << 20);
+  b = malloc(1 << 20);
+  alen = wavetree3d_sub_encode(s, a, 1 << 20);
+  blen = wavetree3d_sub_encode(r, b, 1 << 20);
+  ck_assert(alen > 0);
+  ck_assert(alen == blen);
+  ck_assert(memcmp(a, b, alen) == 0);
+  free(a);
+  free(b);
+
+  wavetree3d_sub_destroy(r);
+
+  /*
+   * Mismatched dimensions are rejected
+   */
+  r = wavetree3d_sub_create(5, 5, 5, 0.0);
+  ck_assert(r != NULL);
+  ck_assert(wavetree3d_sub_load_binary(r, "wavetree3d_sub_tests_saveload.dat") < 0);
+  wavetree3d_sub_destroy(r);
+
+  wavetree3d_sub_destroy(s);
+}
+END_TEST
+
 #if 0
 // Old test pre subtile
 START_TEST(test_wavetree3d_sub_nonsquare)
@@ -923,6 +1076,215 @@ END_TEST
      
 
 
+/*
+ * Point evaluation must agree with the full subtile inverse at every voxel
+ * as the model grows.
+ */
+static void
+evaluate_points_check(int degree_width, int degree_height, int degree_depth, int haar)
+{
+  wavetree3d_sub_t *s;
+  double *expected;
+  double *values;
+  double *work;
+  int *x;
+  int *y;
+  int *z;
+  int width;
+  int height;
+  int depth;
+  int size;
+  int maxdepth;
+  int subtile;
+  int step;
+  int i;
+
+  int d;
+  int coeff;
+  double prob;
+
+  s = wavetree3d_sub_create(degree_width, degree_height, degree_depth, 0.0);
+  ck_assert(s != NULL);
+
+  if (haar) {
+    ck_assert(wavetree3d_sub_set_impulse_response(s, haar_lift_impulse_response_1d) >= 0);
+  } else {
+    ck_assert(wavetree3d_sub_set_impulse_response(s, cdf97_lift_impulse_response_1d) >= 0);
+  }
+
+  width = wavetree3d_sub_get_width(s);
+  height = wavetree3d_sub_get_height(s);
+  depth = wavetree3d_sub_get_depth(s);
+  size = wavetree3d_sub_get_size(s);
+  maxdepth = wavetree3d_sub_maxdepth(s);
+  subtile = (degree_width != degree_height || degree_width != degree_depth);
+
+  expected = malloc(sizeof(double) * size);
+  values = malloc(sizeof(double) * size);
+  work = malloc(sizeof(double) * size);
+  x = malloc(sizeof(int) * size);
+  y = malloc(sizeof(int) * size);
+  z = malloc(sizeof(int) * size);
+  ck_assert(expected != NULL && values != NULL && work != NULL);
+  ck_assert(x != NULL && y != NULL && z != NULL);
+
+  for (i = 0; i < size; i ++) {
+    x[i] = i % width;
+    y[i] = (i / width) % height;
+    z[i] = i / (width * height);
+  }
+
+  ck_assert(wavetree3d_sub_initialize(s, 1.0) >= 0);
+
+  srand(3579);
+  for (step = 0; step < 40; step ++) {
+
+    if (step > 0) {
+      ck_assert(wavetree3d_sub_choose_birth_global(s, (double)rand()/((double)RAND_MAX + 1.0), maxdepth, &d, &coeff, &prob) >= 0);
+      ck_assert(wavetree3d_sub_propose_birth(s, coeff, d, (double)rand()/(double)RAND_MAX - 0.5) >= 0);
+      ck_assert(wavetree3d_sub_commit(s) >= 0);
+    }
+
+    memset(expected, 0, sizeof(double) * size);
+    ck_assert(wavetree3d_sub_map_to_array(s, expected, size) >= 0);
+    if (haar) {
+      ck_assert(haar_lift_inverse3d_haar(expected, width, height, depth, width, width * height, work, subtile) >= 0);
+    } else {
+      ck_assert(cdf97_lift_inverse3d_cdf97(expected, width, height, depth, width, width * height, work, subtile) >= 0);
+    }
+
+    ck_assert(wavetree3d_sub_evaluate_points(s, x, y, z, values, size) >= 0);
+
+    for (i = 0; i < size; i ++) {
+      ck_assert(fabs(values[i] - expected[i]) < 1.0e-9);
+    }
+  }
+
+  z[0] = depth;
+  ck_assert(wavetree3d_sub_evaluate_points(s, x, y, z, values, 1) < 0);
+
+  free(expected);
+  free(values);
+  free(work);
+  free(x);
+  free(y);
+  free(z);
+  wavetree3d_sub_destroy(s);
+}
+
+START_TEST(test_wavetree3d_sub_evaluate_points)
+{
+  evaluate_points_check(3, 3, 3, 0);
+  evaluate_points_check(3, 3, 3, 1);
+  evaluate_points_check(4, 3, 2, 0);
+  evaluate_points_check(2, 3, 4, 1);
+}
+END_TEST
+
+/*
+ * Random births and deaths from the current model
+ */
+static void
+snapshot_walk(wavetree3d_sub_t *s, int nsteps)
+{
+  int maxdepth;
+  int step;
+  int depth;
+  int coeff;
+  double prob;
+  double value;
+
+  maxdepth = wavetree3d_sub_maxdepth(s);
+  for (step = 0; step < nsteps; step ++) {
+    if ((rand() % 3) == 0 && wavetree3d_sub_prunable_leaves(s) > 0) {
+      ck_assert(wavetree3d_sub_choose_death_global(s, (double)rand()/((double)RAND_MAX + 1.0), maxdepth, &depth, &coeff, &prob) >= 0);
+      ck_assert(wavetree3d_sub_propose_death(s, coeff, depth, &value) >= 0);
+    } else {
+      if (wavetree3d_sub_choose_birth_global(s, (double)rand()/((double)RAND_MAX + 1.0), maxdepth, &depth, &coeff, &prob) < 0) {
+	continue;
+      }
+      ck_assert(wavetree3d_sub_propose_birth(s, coeff, depth, (double)rand()/(double)RAND_MAX - 0.5) >= 0);
+    }
+    ck_assert(wavetree3d_sub_commit(s) >= 0);
+  }
+}
+
+START_TEST(test_wavetree3d_sub_snapshot)
+{
+  wavetree3d_sub_t *s;
+  wavetree3d_sub_t *r;
+  wavetree3d_sub_t *o;
+  double *snapshot;
+  char *a;
+  char *b;
+  int size;
+  int len;
+  int alen;
+  int blen;
+
+  s = wavetree3d_sub_create(4, 3, 4, 0.0);
+  ck_assert(s != NULL);
+  r = wavetree3d_sub_create(4, 3, 4, 0.0);
+  ck_assert(r != NULL);
+  o = wavetree3d_sub_create(4, 4, 3, 0.0);
+  ck_assert(o != NULL);
+
+  a = malloc(65536);
+  b = malloc(65536);
+  ck_assert(a != NULL && b != NULL);
+
+  ck_assert(wavetree3d_sub_initialize(s, 1.0) >= 0);
+  ck_assert(wavetree3d_sub_initialize(r, -1.0) >= 0);
+  srand(97531);
+  snapshot_walk(s, 300);
+  snapshot_walk(r, 500);
+
+  size = wavetree3d_sub_snapshot_size(s);
+  snapshot = malloc(size);
+  ck_assert(snapshot != NULL);
+  len = wavetree3d_sub_write_snapshot(s, snapshot, size);
+  ck_assert(len == size);
+  ck_assert(wavetree3d_sub_write_snapshot(s, snapshot, size - 8) < 0);
+
+  /* Adopting replaces a larger model entirely */
+  ck_assert(wavetree3d_sub_adopt_snapshot(r, snapshot, len) >= 0);
+  ck_assert(wavetree3d_sub_valid(r));
+  ck_assert(wavetree3d_sub_hash(r) == wavetree3d_sub_hash(s));
+  ck_assert(wavetree3d_sub_prunable_leaves(r) == wavetree3d_sub_prunable_leaves(s));
+  ck_assert(wavetree3d_sub_attachable_branches(r) == wavetree3d_sub_attachable_branches(s));
+
+  alen = wavetree3d_sub_encode(s, a, 65536);
+  blen = wavetree3d_sub_encode(r, b, 65536);
+  ck_assert(alen > 0 && alen == blen);
+  ck_assert(memcmp(a, b, alen) == 0);
+
+  /* And both continue identically */
+  srand(8642);
+  snapshot_walk(s, 200);
+  srand(8642);
+  snapshot_walk(r, 200);
+  ck_assert(wavetree3d_sub_valid(r));
+
+  alen = wavetree3d_sub_encode(s, a, 65536);
+  blen = wavetree3d_sub_encode(r, b, 65536);
+  ck_assert(alen > 0 && alen == blen);
+  ck_assert(memcmp(a, b, alen) == 0);
+
+  /* Mismatched dimensions, truncation and a bad magic are rejected */
+  ck_assert(wavetree3d_sub_adopt_snapshot(o, snapshot, len) < 0);
+  ck_assert(wavetree3d_sub_adopt_snapshot(r, snapshot, len - 8) < 0);
+  ((char *)snapshot)[0] = 'X';
+  ck_assert(wavetree3d_sub_adopt_snapshot(r, snapshot, len) < 0);
+
+  free(snapshot);
+  free(a);
+  free(b);
+  wavetree3d_sub_destroy(s);
+  wavetree3d_sub_destroy(r);
+  wavetree3d_sub_destroy(o);
+}
+END_TEST
+
 Suite *
 wavetree3d_sub_suite (void)
 {
@@ -934,15 +1296,20 @@ wavetree3d_sub_suite (void)
   tcase_add_test (tc_core, test_wavetree3d_sub_3dindices);
   tcase_add_test (tc_core, test_wavetree3d_sub_childindices);
   tcase_add_test (tc_core, test_wavetree3d_sub_depth);
+  tcase_add_test (tc_core, test_wavetree3d_sub_depth_nonsquare);
   tcase_add_test (tc_core, test_wavetree3d_sub_birth);
   tcase_add_test (tc_core, test_wavetree3d_sub_birth_nonsquare);
   tcase_add_test (tc_core, test_wavetree3d_sub_value);
   tcase_add_test (tc_core, test_wavetree3d_sub_death);
+  tcase_add_test (tc_core, test_wavetree3d_sub_hash);
+  tcase_add_test (tc_core, test_wavetree3d_sub_snapshot);
   tcase_add_test (tc_core, test_wavetree3d_sub_image_mapping);
   tcase_add_test (tc_core, test_wavetree3d_sub_image_mapping_nonsquare);
   tcase_add_test (tc_core, test_wavetree3d_sub_saveload);
+  tcase_add_test (tc_core, test_wavetree3d_sub_saveload_binary);
 
   tcase_add_test (tc_core, test_wavetree3d_sub_nonsquare_coverage);
+  tcase_add_test (tc_core, test_wavetree3d_sub_evaluate_points);
 
   suite_add_tcase (s, tc_core);
 
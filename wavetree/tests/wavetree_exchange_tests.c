@@ -0,0 +1,237 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <check.h>
+
+#include "wavetree_exchange.h"
+#include "wavetree2d_sub.h"
+
+#define NMODELS 100
+
+START_TEST (test_wavetree_exchange_ring)
+{
+  wavetree_exchange_t *x;
+  void *p;
+  const void *q;
+  int slots[4];
+  int slot;
+  int len;
+  int lap;
+  int i;
+
+  x = wavetree_exchange_create_local(4, 100);
+  ck_assert_ptr_ne(x, NULL);
+  ck_assert(wavetree_exchange_slot_size(x) == 128);
+
+  ck_assert(wavetree_exchange_acquire(x, &slot, &len) == NULL);
+
+  for (lap = 0; lap < 10; lap ++) {
+
+    /* Fill, the fifth reserve fails until a slot is released */
+    for (i = 0; i < 4; i ++) {
+      p = wavetree_exchange_reserve(x, &(slots[i]));
+      ck_assert_ptr_ne(p, NULL);
+      ck_assert(((uintptr_t)p & 63) == 0);
+      memset(p, lap * 4 + i, 128);
+    }
+    ck_assert(wavetree_exchange_reserve(x, &slot) == NULL);
+
+    /* Unpublished slots are not visible */
+    ck_assert(wavetree_exchange_acquire(x, &slot, &len) == NULL);
+
+    for (i = 0; i < 4; i ++) {
+      ck_assert(wavetree_exchange_publish(x, slots[i], 10 + i) >= 0);
+    }
+    ck_assert(wavetree_exchange_publish(x, 0, 129) < 0);
+
+    /* Consumed in order */
+    for (i = 0; i < 4; i ++) {
+      q = wavetree_exchange_acquire(x, &slot, &len);
+      ck_assert_ptr_ne(q, NULL);
+      ck_assert(len == 10 + i);
+      ck_assert(((const unsigned char *)q)[len - 1] == lap * 4 + i);
+      ck_assert(wavetree_exchange_release(x, slot) >= 0);
+    }
+    ck_assert(wavetree_exchange_acquire(x, &slot, &len) == NULL);
+  }
+
+  wavetree_exchange_destroy(x);
+}
+END_TEST
+
+START_TEST (test_wavetree_exchange_named)
+{
+  wavetree_exchange_t *x;
+  wavetree_exchange_t *y;
+  char name[64];
+  void *p;
+  const void *q;
+  int slot;
+  int len;
+
+  sprintf(name, "/wavetree_exchange_tests_%d", (int)getpid());
+
+  x = wavetree_exchange_create(name, 2, 64);
+  ck_assert_ptr_ne(x, NULL);
+  ck_assert(wavetree_exchange_create(name, 2, 64) == NULL);
+
+  y = wavetree_exchange_open(name);
+  ck_assert_ptr_ne(y, NULL);
+  ck_assert(wavetree_exchange_slot_size(y) == 64);
+
+  p = wavetree_exchange_reserve(y, &slot);
+  ck_assert_ptr_ne(p, NULL);
+  strcpy(p, "model");
+  ck_assert(wavetree_exchange_publish(y, slot, 6) >= 0);
+
+  q = wavetree_exchange_acquire(x, &slot, &len);
+  ck_assert_ptr_ne(q, NULL);
+  ck_assert(len == 6);
+  ck_assert(strcmp(q, "model") == 0);
+  ck_assert(wavetree_exchange_release(x, slot) >= 0);
+
+  wavetree_exchange_destroy(y);
+  wavetree_exchange_destroy(x);
+
+  /* The creator removes the name */
+  ck_assert(wavetree_exchange_open(name) == NULL);
+}
+END_TEST
+
+/*
+ * The same random sequence of tree models on both sides
+ */
+static void
+exchange_step(wavetree2d_sub_t *s)
+{
+  int depth;
+  int coeff;
+  double prob;
+  double value;
+
+  if ((rand() % 4) == 0 && wavetree2d_sub_prunable_leaves(s) > 0) {
+    ck_assert(wavetree2d_sub_choose_death_global(s, (double)rand()/((double)RAND_MAX + 1.0), wavetree2d_sub_maxdepth(s), &depth, &coeff, &prob) >= 0);
+    ck_assert(wavetree2d_sub_propose_death(s, coeff, depth, &value) >= 0);
+  } else {
+    ck_assert(wavetree2d_sub_choose_birth_global(s, (double)rand()/((double)RAND_MAX + 1.0), wavetree2d_sub_maxdepth(s), &depth, &coeff, &prob) >= 0);
+    ck_assert(wavetree2d_sub_propose_birth(s, coeff, depth, (double)rand()/(double)RAND_MAX - 0.5) >= 0);
+  }
+  ck_assert(wavetree2d_sub_commit(s) >= 0);
+}
+
+START_TEST (test_wavetree_exchange_fork)
+{
+  wavetree_exchange_t *x;
+  wavetree2d_sub_t *s;
+  wavetree2d_sub_t *r;
+  pid_t pid;
+  void *p;
+  const void *q;
+  int status;
+  int slot;
+  int len;
+  int i;
+  int j;
+
+  x = wavetree_exchange_create_local(3, 65536);
+  ck_assert_ptr_ne(x, NULL);
+
+  s = wavetree2d_sub_create(7, 6, 0.0);
+  ck_assert(s != NULL);
+  ck_assert(wavetree2d_sub_initialize(s, 1.0) >= 0);
+
+  pid = fork();
+  ck_assert(pid >= 0);
+
+  if (pid == 0) {
+
+    /*
+     * Producer, publishes the model every few steps writing the snapshot
+     * straight into the slot
+     */
+    srand(4321);
+    for (i = 0; i < NMODELS; i ++) {
+      for (j = 0; j < 10; j ++) {
+	exchange_step(s);
+      }
+
+      while ((p = wavetree_exchange_reserve(x, &slot)) == NULL) {
+	sched_yield();
+      }
+
+      len = wavetree2d_sub_write_snapshot(s, p, wavetree_exchange_slot_size(x));
+      if (len < 0 || wavetree_exchange_publish(x, slot, len) < 0) {
+	_exit(1);
+      }
+    }
+
+    _exit(0);
+  }
+
+  /*
+   * Consumer, adopts each model from its slot and checks it against a
+   * local replay of the producer
+   */
+  r = wavetree2d_sub_create(7, 6, 0.0);
+  ck_assert(r != NULL);
+  ck_assert(wavetree2d_sub_initialize(r, 0.0) >= 0);
+
+  srand(4321);
+  for (i = 0; i < NMODELS; i ++) {
+    for (j = 0; j < 10; j ++) {
+      exchange_step(s);
+    }
+    
+    while ((q = wavetree_exchange_acquire(x, &slot, &len)) == NULL) {
+      sched_yield();
+    }
+
+    ck_assert(wavetree2d_sub_adopt_snapshot(r, q, len) >= 0);
+    ck_assert(wavetree_exchange_release(x, slot) >= 0);
+
+    ck_assert(wavetree2d_sub_hash(r) == wavetree2d_sub_hash(s));
+    ck_assert(wavetree2d_sub_coeff_count(r) == wavetree2d_sub_coeff_count(s));
+    ck_assert(wavetree2d_sub_prunable_leaves(r) == wavetree2d_sub_prunable_leaves(s));
+    ck_assert(wavetree2d_sub_attachable_branches(r) == wavetree2d_sub_attachable_branches(s));
+  }
+  ck_assert(wavetree2d_sub_valid(r));
+
+  ck_assert(waitpid(pid, &status, 0) == pid);
+  ck_assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+  wavetree2d_sub_destroy(s);
+  wavetree2d_sub_destroy(r);
+  wavetree_exchange_destroy(x);
+}
+END_TEST
+
+Suite *
+wavetree_exchange_suite (void)
+{
+  Suite *s = suite_create ("Wavetree Exchange");
+
+  /* Core test case */
+  TCase *tc_core = tcase_create ("Core");
+  tcase_add_test (tc_core, test_wavetree_exchange_ring);
+  tcase_add_test (tc_core, test_wavetree_exchange_named);
+  tcase_add_test (tc_core, test_wavetree_exchange_fork);
+  suite_add_tcase (s, tc_core);
+
+  return s;
+}
+
+int main (void)
+{
+  int number_failed;
+  Suite *s = wavetree_exchange_suite ();
+  SRunner *sr = srunner_create (s);
+  srunner_run_all (sr, CK_VERBOSE);
+  number_failed = srunner_ntests_failed (sr);
+  srunner_free (sr);
+  return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
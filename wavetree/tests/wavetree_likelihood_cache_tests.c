@@ -0,0 +1,141 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <check.h>
+
+#include "wavetree_likelihood_cache.h"
+
+#define CACHE_SIZE 64
+#define KEY_RANGE 200
+
+START_TEST (test_wavetree_likelihood_cache_lru)
+{
+  wavetree_likelihood_cache_t *c;
+  double l;
+  int hits;
+  int misses;
+
+  c = wavetree_likelihood_cache_create(2);
+  ck_assert_ptr_ne(c, NULL);
+
+  ck_assert(wavetree_likelihood_cache_lookup(c, 1, &l) == 0);
+
+  ck_assert(wavetree_likelihood_cache_insert(c, 1, 10.0) == 0);
+  ck_assert(wavetree_likelihood_cache_insert(c, 2, 20.0) == 0);
+  ck_assert(wavetree_likelihood_cache_count(c) == 2);
+
+  /* Touch 1 so that 2 is the one evicted */
+  ck_assert(wavetree_likelihood_cache_lookup(c, 1, &l) == 1);
+  ck_assert(l == 10.0);
+
+  ck_assert(wavetree_likelihood_cache_insert(c, 3, 30.0) == 0);
+  ck_assert(wavetree_likelihood_cache_count(c) == 2);
+  ck_assert(wavetree_likelihood_cache_lookup(c, 2, &l) == 0);
+  ck_assert(wavetree_likelihood_cache_lookup(c, 1, &l) == 1);
+  ck_assert(wavetree_likelihood_cache_lookup(c, 3, &l) == 1);
+  ck_assert(l == 30.0);
+
+  /* Update in place */
+  ck_assert(wavetree_likelihood_cache_insert(c, 3, 31.0) == 0);
+  ck_assert(wavetree_likelihood_cache_lookup(c, 3, &l) == 1);
+  ck_assert(l == 31.0);
+
+  wavetree_likelihood_cache_stats(c, &hits, &misses);
+  ck_assert(hits == 4);
+  ck_assert(misses == 2);
+
+  wavetree_likelihood_cache_clear(c);
+  ck_assert(wavetree_likelihood_cache_count(c) == 0);
+  ck_assert(wavetree_likelihood_cache_lookup(c, 3, &l) == 0);
+
+  wavetree_likelihood_cache_destroy(c);
+}
+END_TEST
+
+/*
+ * Random lookups and inserts checked against a timestamped reference,
+ * keys share their low bits to exercise probing and backward shifts.
+ */
+START_TEST (test_wavetree_likelihood_cache_random)
+{
+  wavetree_likelihood_cache_t *c;
+  double value[KEY_RANGE];
+  int stamp[KEY_RANGE];
+  int i;
+  int j;
+  int k;
+  int n;
+  int oldest;
+  double l;
+  uint64_t key;
+
+  c = wavetree_likelihood_cache_create(CACHE_SIZE);
+  ck_assert_ptr_ne(c, NULL);
+
+  for (i = 0; i < KEY_RANGE; i ++) {
+    stamp[i] = -1;
+  }
+
+  srand(4321);
+  n = 0;
+  for (i = 0; i < 100000; i ++) {
+
+    k = rand() % KEY_RANGE;
+    key = ((uint64_t)k) << 40;
+
+    if (rand() % 2) {
+      ck_assert(wavetree_likelihood_cache_lookup(c, key, &l) == (stamp[k] >= 0));
+      if (stamp[k] >= 0) {
+	ck_assert(l == value[k]);
+	stamp[k] = i;
+      }
+    } else {
+      if (stamp[k] < 0) {
+	if (n == CACHE_SIZE) {
+	  oldest = -1;
+	  for (j = 0; j < KEY_RANGE; j ++) {
+	    if (stamp[j] >= 0 && (oldest < 0 || stamp[j] < stamp[oldest])) {
+	      oldest = j;
+	    }
+	  }
+	  stamp[oldest] = -1;
+	} else {
+	  n ++;
+	}
+      }
+
+      value[k] = (double)i;
+      stamp[k] = i;
+      ck_assert(wavetree_likelihood_cache_insert(c, key, value[k]) == 0);
+    }
+
+    ck_assert(wavetree_likelihood_cache_count(c) == n);
+  }
+
+  wavetree_likelihood_cache_destroy(c);
+}
+END_TEST
+
+Suite *
+wavetree_likelihood_cache_suite (void)
+{
+  Suite *s = suite_create ("Wavetree Likelihood Cache");
+
+  /* Core test case */
+  TCase *tc_core = tcase_create ("Core");
+  tcase_add_test (tc_core, test_wavetree_likelihood_cache_lru);
+  tcase_add_test (tc_core, test_wavetree_likelihood_cache_random);
+  suite_add_tcase (s, tc_core);
+
+  return s;
+}
+
+int main (void)
+{
+  int number_failed;
+  Suite *s = wavetree_likelihood_cache_suite ();
+  SRunner *sr = srunner_create (s);
+  srunner_run_all (sr, CK_VERBOSE);
+  number_failed = srunner_ntests_failed (sr);
+  srunner_free (sr);
+  return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
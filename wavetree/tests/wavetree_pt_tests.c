@@ -0,0 +1,201 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <stdint.h>
+#include <check.h>
+
+#include "wavetree_pt.h"
+
+#define NCHAINS 8
+
+/*
+ * Toy chains sampling a unit Gaussian, likelihood x^2/2, so that a chain
+ * at temperature T has variance T.
+ */
+typedef struct {
+  double x;
+  uint64_t state;
+
+  double sumsq;
+  int n;
+} toy_chain_t;
+
+static double toy_uniform(toy_chain_t *c)
+{
+  c->state ^= c->state >> 12;
+  c->state ^= c->state << 25;
+  c->state ^= c->state >> 27;
+  return (double)((c->state * 2685821657736338717ULL) >> 11)/9007199254740992.0;
+}
+
+static int toy_step(void *user,
+		    int chain,
+		    void *model,
+		    double temperature,
+		    int nsteps,
+		    double *likelihood)
+{
+  toy_chain_t *c = (toy_chain_t *)model;
+  int *fail_chain = (int *)user;
+  double x;
+  double l;
+  int i;
+
+  if (chain == *fail_chain) {
+    return -1;
+  }
+
+  for (i = 0; i < nsteps; i ++) {
+    x = c->x + 2.0*sqrt(temperature)*(toy_uniform(c) - 0.5);
+    l = 0.5*x*x;
+
+    if (log(toy_uniform(c)) < ((*likelihood) - l)/temperature) {
+      c->x = x;
+      *likelihood = l;
+    }
+
+    if (temperature == 1.0) {
+      c->sumsq += c->x * c->x;
+      c->n ++;
+    }
+  }
+
+  return 0;
+}
+
+static wavetree_pt_t *toy_create(toy_chain_t *chains, int *fail_chain)
+{
+  double temperatures[NCHAINS];
+  double likelihoods[NCHAINS];
+  void *models[NCHAINS];
+  int i;
+
+  for (i = 0; i < NCHAINS; i ++) {
+    temperatures[i] = pow(1.5, (double)i);
+
+    chains[i].x = 3.0;
+    chains[i].state = 0x9e3779b97f4a7c15ULL * (uint64_t)(i + 1);
+    chains[i].sumsq = 0.0;
+    chains[i].n = 0;
+
+    models[i] = &(chains[i]);
+    likelihoods[i] = 0.5*chains[i].x*chains[i].x;
+  }
+
+  return wavetree_pt_create(NCHAINS,
+			    temperatures,
+			    models,
+			    likelihoods,
+			    toy_step,
+			    fail_chain,
+			    1234);
+}
+
+START_TEST (test_wavetree_pt_threads)
+{
+  toy_chain_t a[NCHAINS];
+  toy_chain_t b[NCHAINS];
+  wavetree_pt_t *pa;
+  wavetree_pt_t *pb;
+  int fail_chain = -1;
+  int i;
+
+  /* The result must not depend on the no. threads */
+  pa = toy_create(a, &fail_chain);
+  ck_assert_ptr_ne(pa, NULL);
+  pb = toy_create(b, &fail_chain);
+  ck_assert_ptr_ne(pb, NULL);
+
+  ck_assert(wavetree_pt_run(pa, 1, 500, 10) == 0);
+  ck_assert(wavetree_pt_run(pb, 4, 500, 10) == 0);
+
+  for (i = 0; i < NCHAINS; i ++) {
+    ck_assert(a[i].x == b[i].x);
+    ck_assert(wavetree_pt_chain_at(pa, i) == wavetree_pt_chain_at(pb, i));
+    ck_assert(wavetree_pt_chain_likelihood(pa, i) == wavetree_pt_chain_likelihood(pb, i));
+    ck_assert(wavetree_pt_chain_temperature(pa, wavetree_pt_chain_at(pa, i)) == pow(1.5, (double)i));
+  }
+
+  wavetree_pt_destroy(pa);
+  wavetree_pt_destroy(pb);
+}
+END_TEST
+
+START_TEST (test_wavetree_pt_sample)
+{
+  toy_chain_t c[NCHAINS];
+  wavetree_pt_t *pt;
+  int fail_chain = -1;
+  int i;
+  int n;
+  int proposed;
+  int accepted;
+  double sumsq;
+
+  pt = toy_create(c, &fail_chain);
+  ck_assert_ptr_ne(pt, NULL);
+
+  ck_assert(wavetree_pt_run(pt, 3, 5000, 10) == 0);
+
+  /* Cold samples are spread over many chains and have unit variance */
+  sumsq = 0.0;
+  n = 0;
+  for (i = 0; i < NCHAINS; i ++) {
+    ck_assert(c[i].n > 0);
+    sumsq += c[i].sumsq;
+    n += c[i].n;
+  }
+  ck_assert(n == 50000);
+  ck_assert(fabs(sumsq/(double)n - 1.0) < 0.1);
+
+  for (i = 0; i < (NCHAINS - 1); i ++) {
+    ck_assert(wavetree_pt_exchange_stats(pt, i, &proposed, &accepted) == 0);
+    ck_assert(proposed == 2500);
+    ck_assert(accepted > 0 && accepted < proposed);
+  }
+  ck_assert(wavetree_pt_exchange_stats(pt, NCHAINS - 1, &proposed, &accepted) < 0);
+
+  wavetree_pt_destroy(pt);
+}
+END_TEST
+
+START_TEST (test_wavetree_pt_failure)
+{
+  toy_chain_t c[NCHAINS];
+  wavetree_pt_t *pt;
+  int fail_chain = 5;
+
+  pt = toy_create(c, &fail_chain);
+  ck_assert_ptr_ne(pt, NULL);
+
+  ck_assert(wavetree_pt_run(pt, 4, 10, 10) < 0);
+
+  wavetree_pt_destroy(pt);
+}
+END_TEST
+
+Suite *
+wavetree_pt_suite (void)
+{
+  Suite *s = suite_create ("Wavetree Parallel Tempering");
+
+  /* Core test case */
+  TCase *tc_core = tcase_create ("Core");
+  tcase_add_test (tc_core, test_wavetree_pt_threads);
+  tcase_add_test (tc_core, test_wavetree_pt_sample);
+  tcase_add_test (tc_core, test_wavetree_pt_failure);
+  suite_add_tcase (s, tc_core);
+
+  return s;
+}
+
+int main (void)
+{
+  int number_failed;
+  Suite *s = wavetree_pt_suite ();
+  SRunner *sr = srunner_create (s);
+  srunner_run_all (sr, CK_VERBOSE);
+  number_failed = srunner_ntests_failed (sr);
+  srunner_free (sr);
+  return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
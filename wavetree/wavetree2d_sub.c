@@ -29,6 +29,8 @@
 #include <math.h>
 
 #include "wavetree2d_sub.h"
+#include "wavetree_checkpoint.h"
+#include "wavetree_snapshot.h"
 
 #include "multiset_int.h"
 #include "multiset_int_double.h"
@@ -69,6 +71,17 @@ struct _wavetree2d_sub {
   multiset_int_t *S_b;
   multiset_int_t *S_d;
 
+  /*
+   * Snapshots are adopted into these and then swapped with the sets above,
+   * created on the first adopt.
+   */
+  multiset_int_double_t *adopt_S_v;
+  multiset_int_t *adopt_S_b;
+  multiset_int_t *adopt_S_d;
+
+  /* Order independent hash of the (index, value) pairs in S_v */
+  uint64_t hash;
+
   wavetree2d_sub_undo_t undo;
   int u_i;
   int u_j;
@@ -76,10 +89,17 @@ struct _wavetree2d_sub {
   double u_v;
 
   chain_history_change_t last_step;
+
+  wavetree_impulse_t *impulse_x;
+  wavetree_impulse_t *impulse_y;
 };
 
 static int add_node(wavetree2d_sub_t *t, int i, int d, double coeff);
 static int remove_node(wavetree2d_sub_t *t, int i, int d);
+static int rebuild_sets(wavetree2d_sub_t *t);
+static int bit_length(int x);
+static uint64_t coefficient_hash(int i, double v);
+static int rehash(wavetree2d_sub_t *t);
 
 wavetree2d_sub_t *wavetree2d_sub_create(int degree_width, int degree_height, double alpha)
 {
@@ -188,8 +208,17 @@ wavetree2d_sub_t *wavetree2d_sub_create(int degree_width, int degree_height, dou
   r->u_d = 0;
   r->u_v = 0.0;
 
+  r->hash = 0;
+
   memset(&(r->last_step), 0, sizeof(chain_history_change_t));
   r->last_step.header.type = CH_INITIALISE;
+
+  r->impulse_x = NULL;
+  r->impulse_y = NULL;
+
+  r->adopt_S_v = NULL;
+  r->adopt_S_b = NULL;
+  r->adopt_S_d = NULL;
   
   return r;
 }
@@ -201,6 +230,13 @@ void wavetree2d_sub_destroy(wavetree2d_sub_t *t)
     multiset_int_destroy(t->S_d);
     multiset_int_destroy(t->S_b);
 
+    multiset_int_double_destroy(t->adopt_S_v);
+    multiset_int_destroy(t->adopt_S_d);
+    multiset_int_destroy(t->adopt_S_b);
+
+    wavetree_impulse_destroy(t->impulse_x);
+    wavetree_impulse_destroy(t->impulse_y);
+
     free(t->child_indices);
     free(t->base_indices);
       
@@ -297,6 +333,7 @@ wavetree2d_sub_load(wavetree2d_sub_t *t,
   /* Clear everything first */
 
   multiset_int_double_clear(t->S_v);
+  t->hash = 0;
   multiset_int_clear(t->S_b);
   multiset_int_clear(t->S_d);
 
@@ -304,6 +341,11 @@ wavetree2d_sub_load(wavetree2d_sub_t *t,
     ERROR("failed to read S_v");
     return -1;
   }
+
+  if (rehash(t) < 0) {
+    ERROR("failed to hash S_v");
+    return -1;
+  }
   
   if (multiset_int_read(t->S_b, fp) < 0) {
     ERROR("failed to read S_b");
@@ -320,6 +362,69 @@ wavetree2d_sub_load(wavetree2d_sub_t *t,
   return 0;
 }
 
+int
+wavetree2d_sub_save_binary(const wavetree2d_sub_t *t,
+			   const char *filename)
+{
+  wavetree_checkpoint_header_t header;
+
+  memset(&header, 0, sizeof(header));
+  header.dimension = 2;
+  header.degree[0] = t->degree_width;
+  header.degree[1] = t->degree_height;
+  header.degree[2] = 0;
+  header.size[0] = t->width;
+  header.size[1] = t->height;
+  header.size[2] = 1;
+  header.alpha = t->alpha;
+
+  return wavetree_checkpoint_save(filename, &header, t->S_v);
+}
+
+int
+wavetree2d_sub_load_binary(wavetree2d_sub_t *t,
+			   const char *filename)
+{
+  wavetree_checkpoint_t *c;
+  const wavetree_checkpoint_header_t *header;
+
+  c = wavetree_checkpoint_open(filename);
+  if (c == NULL) {
+    return -1;
+  }
+
+  header = wavetree_checkpoint_header(c);
+  if (header->dimension != 2 ||
+      header->degree[0] != t->degree_width ||
+      header->degree[1] != t->degree_height ||
+      header->size[0] != t->width ||
+      header->size[1] != t->height) {
+    ERROR("checkpoint mismatch (%dd %d %d)",
+	  header->dimension, header->degree[0], header->degree[1]);
+    wavetree_checkpoint_close(c);
+    return -1;
+  }
+
+  t->alpha = header->alpha;
+
+  if (wavetree_checkpoint_restore(c, t->S_v) < 0) {
+    ERROR("failed to restore S_v");
+    wavetree_checkpoint_close(c);
+    return -1;
+  }
+
+  wavetree_checkpoint_close(c);
+
+  t->undo = UNDO_NONE;
+
+  if (rebuild_sets(t) < 0) {
+    ERROR("failed to rebuild sets");
+    return -1;
+  }
+
+  return rehash(t);
+}
+
 static int encode_int(int v,
 		      char *buffer,
 		      int *offset,
@@ -500,6 +605,7 @@ wavetree2d_sub_decode(wavetree2d_sub_t *t,
   
   /* Clear everything first before adding nodes from binary string */
   multiset_int_double_clear(t->S_v);
+  t->hash = 0;
   multiset_int_clear(t->S_b);
   multiset_int_clear(t->S_d);
 
@@ -536,6 +642,83 @@ wavetree2d_sub_decode(wavetree2d_sub_t *t,
   return 0;
 }
 
+int
+wavetree2d_sub_snapshot_size(const wavetree2d_sub_t *t)
+{
+  return wavetree_snapshot_size(t->S_v, t->S_b, t->S_d);
+}
+
+int
+wavetree2d_sub_write_snapshot(const wavetree2d_sub_t *t,
+			       void *buffer,
+			       int size)
+{
+  wavetree_snapshot_header_t header;
+
+  memset(&header, 0, sizeof(header));
+  header.dimension = 2;
+  header.degree[0] = t->degree_width;
+  header.degree[1] = t->degree_height;
+  header.degree[2] = 0;
+  header.alpha = t->alpha;
+
+  return wavetree_snapshot_write(buffer, size, &header, t->S_v, t->S_b, t->S_d);
+}
+
+int
+wavetree2d_sub_adopt_snapshot(wavetree2d_sub_t *t,
+			       const void *buffer,
+			       int len)
+{
+  const wavetree_snapshot_header_t *h;
+
+  h = wavetree_snapshot_header(buffer, len);
+  if (h == NULL) {
+    return -1;
+  }
+
+  if (h->dimension != 2 ||
+      h->degree[0] != t->degree_width ||
+      h->degree[1] != t->degree_height ||
+      h->alpha != t->alpha) {
+    ERROR("snapshot mismatch (%dd %d %d %f)",
+	  h->dimension, h->degree[0], h->degree[1], h->alpha);
+    return -1;
+  }
+
+  if (t->adopt_S_v == NULL) {
+    t->adopt_S_v = multiset_int_double_create();
+    t->adopt_S_b = multiset_int_create();
+    t->adopt_S_d = multiset_int_create();
+    if (t->adopt_S_v == NULL || t->adopt_S_b == NULL || t->adopt_S_d == NULL) {
+      ERROR("failed to create adopt sets");
+      multiset_int_double_destroy(t->adopt_S_v);
+      multiset_int_destroy(t->adopt_S_b);
+      multiset_int_destroy(t->adopt_S_d);
+      t->adopt_S_v = NULL;
+      t->adopt_S_b = NULL;
+      t->adopt_S_d = NULL;
+      return -1;
+    }
+  }
+
+  /*
+   * A failure part way through leaves the current model untouched
+   */
+  if (wavetree_snapshot_adopt(buffer, len, t->adopt_S_v, t->adopt_S_b, t->adopt_S_d) < 0) {
+    ERROR("failed to adopt snapshot");
+    return -1;
+  }
+
+  multiset_int_double_swap(t->S_v, t->adopt_S_v);
+  multiset_int_swap(t->S_b, t->adopt_S_b);
+  multiset_int_swap(t->S_d, t->adopt_S_d);
+
+  t->undo = UNDO_NONE;
+
+  return rehash(t);
+}
+
 int 
 wavetree2d_sub_load_promote(wavetree2d_sub_t *t,
 			    const char *filename)
@@ -590,6 +773,7 @@ wavetree2d_sub_load_promote(wavetree2d_sub_t *t,
 
   /* Clear everything first */
   multiset_int_double_clear(t->S_v);
+  t->hash = 0;
   multiset_int_clear(t->S_b);
   multiset_int_clear(t->S_d);
 
@@ -661,6 +845,7 @@ int wavetree2d_sub_initialize(wavetree2d_sub_t *t,
   int i;
 
   multiset_int_double_clear(t->S_v);
+  t->hash = 0;
   multiset_int_clear(t->S_b);
   multiset_int_clear(t->S_d);
 
@@ -669,6 +854,7 @@ int wavetree2d_sub_initialize(wavetree2d_sub_t *t,
 			     0,
 			     d,
 			     dc);
+  t->hash ^= coefficient_hash(0, dc);
   
   if (t->base_size == 1) {
     multiset_int_insert(t->S_b, 
@@ -872,6 +1058,59 @@ int wavetree2d_sub_map_to_array(const wavetree2d_sub_t *t, double *a, int n)
   return 0;
 }
 
+int wavetree2d_sub_map_row_first(const wavetree2d_sub_t *t,
+				 int *row_first,
+				 int height)
+{
+  int d;
+  int c;
+  int i;
+  int j;
+  int index;
+  double value;
+
+  if (height != t->height) {
+    ERROR("height mismatch %d != %d", height, t->height);
+    return -1;
+  }
+
+  for (j = 0; j < t->height; j ++) {
+    row_first[j] = t->width;
+  }
+
+  for (d = 0; d <= t->degree_max; d ++) {
+
+    c = multiset_int_double_depth_count(t->S_v, d);
+    for (i = 0; i < c; i ++) {
+
+      if (multiset_int_double_nth_element(t->S_v, d, i, &index, &value) < 0) {
+	ERROR("failed to get nth element");
+	return -1;
+      }
+
+      if (t->base_size > 1) {
+	if (index == 0) {
+	  /* The mean is spread over the base tile at the origin */
+	  for (j = 0; j < t->base_height; j ++) {
+	    row_first[j] = 0;
+	  }
+	  continue;
+	}
+
+	index --;
+      }
+
+      j = index >> t->degree_width;
+      index &= t->width - 1;
+      if (index < row_first[j]) {
+	row_first[j] = index;
+      }
+    }
+  }
+
+  return 0;
+}
+
 int wavetree2d_sub_map_impulse_to_array(const wavetree2d_sub_t *t,
 					int coeff_index,
 					double *a,
@@ -917,6 +1156,385 @@ int wavetree2d_sub_map_impulse_to_array(const wavetree2d_sub_t *t,
   return 0;
 }
 
+int wavetree2d_sub_set_impulse_response(wavetree2d_sub_t *t,
+					wavetree_impulse_response_t response)
+{
+  wavetree_impulse_t *x;
+  wavetree_impulse_t *y;
+
+  /*
+   * For non-square images the transform is a subtile one with degree_min
+   * levels along each axis so that the 2D basis functions are separable.
+   * Both are built before either is installed so that a failure leaves
+   * the previous responses in place.
+   */
+  x = wavetree_impulse_create(t->width, t->degree_min, response);
+  if (x == NULL) {
+    ERROR("failed to create x impulse responses");
+    return -1;
+  }
+
+  y = wavetree_impulse_create(t->height, t->degree_min, response);
+  if (y == NULL) {
+    ERROR("failed to create y impulse responses");
+    wavetree_impulse_destroy(x);
+    return -1;
+  }
+
+  wavetree_impulse_destroy(t->impulse_x);
+  wavetree_impulse_destroy(t->impulse_y);
+  
+  t->impulse_x = x;
+  t->impulse_y = y;
+
+  return 0;
+}
+
+static int paint_position(const wavetree2d_sub_t *t,
+			  double *a,
+			  int ii,
+			  int ij,
+			  double value)
+{
+  const double *vx;
+  const double *vy;
+  int xlo, xhi;
+  int ylo, yhi;
+  int x, y;
+  int levels;
+  int ylevels;
+  double *row;
+  double s;
+
+  /*
+   * The 2D basis function is the product of the 1D responses starting
+   * from the coarsest step that the coefficient takes part in.
+   */
+  levels = wavetree_impulse_levels(t->impulse_x, ii);
+  ylevels = wavetree_impulse_levels(t->impulse_y, ij);
+  if (ylevels < levels) {
+    levels = ylevels;
+  }
+
+  vx = wavetree_impulse_get(t->impulse_x, ii, levels, &xlo, &xhi);
+  vy = wavetree_impulse_get(t->impulse_y, ij, levels, &ylo, &yhi);
+  if (vx == NULL || vy == NULL) {
+    return -1;
+  }
+
+  for (y = ylo; y <= yhi; y ++) {
+    s = value * vy[y - ylo];
+    row = a + y*t->width;
+    for (x = xlo; x <= xhi; x ++) {
+      row[x] += s * vx[x - xlo];
+    }
+  }
+
+  return 0;
+}
+
+static int paint_coefficient(const wavetree2d_sub_t *t,
+			     double *a,
+			     int n,
+			     int index,
+			     double value)
+{
+  int i;
+  int p;
+
+  if (t->impulse_x == NULL || t->impulse_y == NULL) {
+    ERROR("impulse response not set");
+    return -1;
+  }
+
+  if (n < t->size) {
+    ERROR("size mismatch");
+    return -1;
+  }
+
+  if (t->base_size > 1) {
+
+    if (index == 0) {
+      /* The root is replicated over the base tile in map_to_array */
+      for (i = 0; i < t->base_size; i ++) {
+	p = t->base_indices[i] - 1;
+	if (paint_position(t, a, p % t->width, p / t->width, value) < 0) {
+	  return -1;
+	}
+      }
+      return 0;
+    }
+
+    p = index - 1;
+
+  } else {
+
+    p = index;
+
+  }
+
+  if (p < 0 || p >= t->size) {
+    ERROR("index out of range %d", index);
+    return -1;
+  }
+
+  return paint_position(t, a, p % t->width, p / t->width, value);
+}
+
+static int paint_proposal(const wavetree2d_sub_t *t,
+			  double *a,
+			  int n,
+			  double sign)
+{
+  double value;
+
+  switch (t->undo) {
+  case UNDO_BIRTH:
+    /* New index in undo information, new value in actual coefficient */
+    if (wavetree2d_sub_get_coeff(t, t->u_i, &value) < 0 ||
+	paint_coefficient(t, a, n, t->u_i, sign * value) < 0) {
+      ERROR("failed to paint birth value");
+      return -1;
+    }
+    break;
+
+  case UNDO_DEATH:
+    /* Removed index in undo information, previous value in undo information */
+    if (paint_coefficient(t, a, n, t->u_i, -sign * t->u_v) < 0) {
+      ERROR("failed to paint death value");
+      return -1;
+    }
+    break;
+
+  case UNDO_VALUE:
+    /* Index in undo information, old value in undo information, new value in actual coefficient */
+    if (wavetree2d_sub_get_coeff(t, t->u_i, &value) < 0 ||
+	paint_coefficient(t, a, n, t->u_i, sign * (value - t->u_v)) < 0) {
+      ERROR("failed to paint value change");
+      return -1;
+    }
+    break;
+
+  case UNDO_MOVE:
+    /* Old index and value in undo information, new index in u_j */
+    if (paint_coefficient(t, a, n, t->u_i, -sign * t->u_v) < 0) {
+      ERROR("failed to paint move source");
+      return -1;
+    }
+    if (wavetree2d_sub_get_coeff(t, t->u_j, &value) < 0 ||
+	paint_coefficient(t, a, n, t->u_j, sign * value) < 0) {
+      ERROR("failed to paint move destination");
+      return -1;
+    }
+    break;
+
+  default:
+    ERROR("invalid undo state");
+    return -1;
+  }
+
+  return 0;
+}
+
+int wavetree2d_sub_propose_to_array(const wavetree2d_sub_t *t,
+				    double *a,
+				    int n)
+{
+  return paint_proposal(t, a, n, 1.0);
+}
+
+int wavetree2d_sub_revert_to_array(const wavetree2d_sub_t *t,
+				   double *a,
+				   int n)
+{
+  return paint_proposal(t, a, n, -1.0);
+}
+
+static uint64_t *occupancy(const wavetree2d_sub_t *t)
+{
+  uint64_t *bits;
+  int nwords;
+  int d;
+  int c;
+  int i;
+  int index;
+  double value;
+
+  /*
+   * One bit per position of the map_to_array image that holds a value
+   */
+  nwords = (t->size + 63) >> 6;
+  bits = malloc(sizeof(uint64_t) * nwords);
+  if (bits == NULL) {
+    ERROR("failed to allocate occupancy");
+    return NULL;
+  }
+  memset(bits, 0, sizeof(uint64_t) * nwords);
+
+  for (d = 0; d <= t->degree_max; d ++) {
+    c = multiset_int_double_depth_count(t->S_v, d);
+    for (i = 0; i < c; i ++) {
+
+      if (multiset_int_double_nth_element(t->S_v, d, i, &index, &value) < 0) {
+	ERROR("failed to get nth element");
+	free(bits);
+	return NULL;
+      }
+
+      if (t->base_size > 1) {
+	if (index == 0) {
+	  continue;
+	}
+	index --;
+      }
+
+      bits[index >> 6] |= (uint64_t)1 << (index & 63);
+    }
+  }
+
+  if (t->base_size > 1) {
+    for (i = 0; i < t->base_size; i ++) {
+      index = t->base_indices[i] - 1;
+      bits[index >> 6] |= (uint64_t)1 << (index & 63);
+    }
+  }
+
+  return bits;
+}
+
+static double image_coefficient(const wavetree2d_sub_t *t,
+				int index,
+				double mean)
+{
+  double value;
+
+  /* The value map_to_array places at image position index */
+  if (t->base_size > 1) {
+    index ++;
+  }
+
+  if (multiset_int_double_get(t->S_v, index, wavetree2d_sub_depthofindex(t, index), &value) < 0) {
+    value = 0.0;
+  }
+
+  if (t->base_size > 1 && wavetree2d_sub_depthofindex(t, index) == 1) {
+    value += mean;
+  }
+
+  return value;
+}
+
+int wavetree2d_sub_evaluate_points(const wavetree2d_sub_t *t,
+				   const int *x,
+				   const int *y,
+				   double *values,
+				   int npoints)
+{
+  uint64_t *bits;
+  const int *cx;
+  const int *cy;
+  const double *vx;
+  const double *vy;
+  int nx, ny;
+  int ex, ey;
+  int xlo, xhi;
+  int ylo, yhi;
+  int levels;
+  int l;
+  int p;
+  int i;
+  int j;
+  int jn;
+  int index;
+  double mean;
+  double s;
+  double sum;
+
+  if (t->impulse_x == NULL || t->impulse_y == NULL) {
+    ERROR("impulse response not set");
+    return -1;
+  }
+
+  mean = 0.0;
+  if (t->base_size > 1 &&
+      multiset_int_double_nth_element(t->S_v, 0, 0, &index, &mean) < 0) {
+    ERROR("failed to get dc");
+    return -1;
+  }
+
+  bits = occupancy(t);
+  if (bits == NULL) {
+    return -1;
+  }
+
+  levels = t->degree_min;
+  
+  for (p = 0; p < npoints; p ++) {
+
+    if (x[p] < 0 || x[p] >= t->width ||
+	y[p] < 0 || y[p] >= t->height) {
+      ERROR("point out of range %d %d", x[p], y[p]);
+      free(bits);
+      return -1;
+    }
+
+    sum = 0.0;
+    for (l = (levels > 0); l <= levels; l ++) {
+
+      /*
+       * Below the coarsest step the coefficients taking part in exactly l
+       * steps form a single tree depth, skip it when it is empty.
+       */
+      if (l < levels &&
+	  multiset_int_double_depth_count(t->S_v,
+					  wavetree2d_sub_depthofindex(t, wavetree2d_sub_from_2dindices(t, t->width >> l, 0))) == 0) {
+	continue;
+      }
+
+      cx = wavetree_impulse_cover(t->impulse_x, l, x[p], &nx, &ex);
+      cy = wavetree_impulse_cover(t->impulse_y, l, y[p], &ny, &ey);
+      if (cx == NULL || cy == NULL) {
+	free(bits);
+	return -1;
+      }
+
+      /*
+       * A pair of indices belongs to l if at least one of them takes part
+       * in exactly l steps
+       */
+      for (j = 0; j < ny; j ++) {
+
+	jn = (j < ey) ? nx : ex;
+	if (jn == 0) {
+	  break;
+	}
+
+	vy = NULL;
+	s = 0.0;
+	for (i = 0; i < jn; i ++) {
+
+	  index = (cy[j] << t->degree_width) + cx[i];
+	  if (bits[index >> 6] & ((uint64_t)1 << (index & 63))) {
+
+	    if (vy == NULL) {
+	      vy = wavetree_impulse_get(t->impulse_y, cy[j], l, &ylo, &yhi);
+	      s = vy[y[p] - ylo];
+	    }
+	    
+	    vx = wavetree_impulse_get(t->impulse_x, cx[i], l, &xlo, &xhi);
+	    sum += image_coefficient(t, index, mean) * s * vx[x[p] - xlo];
+	  }
+	}
+      }
+    }
+
+    values[p] = sum;
+  }
+
+  free(bits);
+  return 0;
+}
+
 int wavetree2d_sub_map_from_array(wavetree2d_sub_t *t, const double *a, int n)
 {
   return wavetree2d_sub_create_from_array_with_threshold(t,
@@ -1120,6 +1738,7 @@ double value)
     ERROR("failed to set new value");
     return -1;
   }
+  t->hash ^= coefficient_hash(i, t->u_v) ^ coefficient_hash(i, value);
 
   /*
    * Record the proposal
@@ -1322,16 +1941,23 @@ wavetree2d_sub_propose_move(wavetree2d_sub_t *t,
 int 
 wavetree2d_sub_undo(wavetree2d_sub_t *t)
 {
+  double value;
+
   switch (t->undo) {
   case UNDO_NONE:
     ERROR("nothing to undo");
     return -1;
 
   case UNDO_VALUE:
+    if (multiset_int_double_get(t->S_v, t->u_i, t->u_d, &value) < 0) {
+      ERROR("failed to get value to undo");
+      return -1;
+    }
     if (multiset_int_double_set(t->S_v, t->u_i, t->u_d, t->u_v) < 0) {
       ERROR("failed to undo value");
       return -1;
     }
+    t->hash ^= coefficient_hash(t->u_i, value) ^ coefficient_hash(t->u_i, t->u_v);
     break;
 
   case UNDO_BIRTH:
@@ -1536,15 +2162,15 @@ int wavetree2d_sub_parent_index(const wavetree2d_sub_t *t, int c)
     /* Direct descendents of subtile */
     if (i < (2*t->base_width) &&
 	j < (2*t->base_height)) {
-      i = i % t->base_width;
-      j = j % t->base_height;
+      i = i & (t->base_width - 1);
+      j = j & (t->base_height - 1);
 
       return wavetree2d_sub_from_2dindices(t, i, j);
     }
 
     /* Rest follow the /2 pattern */
-    i /= 2;
-    j /= 2;
+    i >>= 1;
+    j >>= 1;
 
     return wavetree2d_sub_from_2dindices(t, i, j);
 
@@ -1555,8 +2181,8 @@ int wavetree2d_sub_parent_index(const wavetree2d_sub_t *t, int c)
       return -1;
     }
 
-    i /= 2;
-    j /= 2;
+    i >>= 1;
+    j >>= 1;
 
     return wavetree2d_sub_from_2dindices(t, i, j);
   }
@@ -1607,9 +2233,10 @@ int wavetree2d_sub_2dindices(const wavetree2d_sub_t *t,
 
     i --;
   }
-  
-  *ii = i % t->width;
-  *ij = (i - (*ii)) / t->width;
+
+  /* Width and height are powers of 2 so this is just a split of the bits */
+  *ii = i & (t->width - 1);
+  *ij = i >> t->degree_width;
   
   return 0;
 }
@@ -1631,7 +2258,7 @@ int wavetree2d_sub_from_2dindices(const wavetree2d_sub_t *t,
     }
     
 
-    return ij*t->width + ii;
+    return (ij << t->degree_width) + ii;
 
   } else {
 
@@ -1647,18 +2274,53 @@ int wavetree2d_sub_from_2dindices(const wavetree2d_sub_t *t,
       return -1;
     }
 
-    return ij*t->width + ii + 1;
+    return (ij << t->degree_width) + ii + 1;
   }    
 }
 
+/*
+ * Closed form of following parent_index back to the root: each halving of
+ * the 2d indices is one level, plus one level for the subtile when the base
+ * is not square.
+ */
 int wavetree2d_sub_depthofindex(const wavetree2d_sub_t *t,
 				int i)
 {
+  int ii;
+  int ij;
+  int di;
+  int dj;
+
   if (i == 0) {
     return 0;
   }
 
-  return 1 + wavetree2d_sub_depthofindex(t, wavetree2d_sub_parent_index(t, i));
+  if (wavetree2d_sub_2dindices(t, i, &ii, &ij) < 0) {
+    ERROR("failed to get 2d indices");
+    return -1;
+  }
+
+  if (t->base_size == 1) {
+
+    di = bit_length(ii);
+    dj = bit_length(ij);
+
+    return (di > dj) ? di : dj;
+
+  } else {
+
+    di = bit_length(ii) - (t->degree_width - t->degree_min);
+    dj = bit_length(ij) - (t->degree_height - t->degree_min);
+
+    if (dj > di) {
+      di = dj;
+    }
+    if (di < 0) {
+      di = 0;
+    }
+
+    return 1 + di;
+  }
 }
 
 int wavetree2d_sub_max_child_count(wavetree2d_sub_t *t)
@@ -1879,6 +2541,7 @@ static int add_node(wavetree2d_sub_t *t, int i, int d, double coeff)
     ERROR("error: failed to insert into S_v");
     return -1;
   }
+  t->hash ^= coefficient_hash(i, coeff);
 
   /*
    * Update parent CC
@@ -1921,6 +2584,7 @@ static int remove_node(wavetree2d_sub_t *t, int i, int d)
   int j;
   int pcc;
   int nchildren;
+  double coeff;
   
   if (d == 0) {
     ERROR("zero depth");
@@ -1929,10 +2593,16 @@ static int remove_node(wavetree2d_sub_t *t, int i, int d)
 
   //printf("removed node: %d\n", i);
 
+  if (multiset_int_double_get(t->S_v, i, d, &coeff) < 0) {
+    ERROR("failed to get value of node to remove (index %d, depth %d)", i, d);
+    return -1;
+  }
+
   if (multiset_int_double_remove(t->S_v, i, d) < 0) {
     ERROR("failed to remove from S_v");
     return -1;
   }
+  t->hash ^= coefficient_hash(i, coeff);
 
   /*
    * Update parent CC
@@ -1967,6 +2637,62 @@ static int remove_node(wavetree2d_sub_t *t, int i, int d)
   return 0;
 }
 
+/*
+ * Derive S_b and S_d from S_v in one pass: S_b holds the children of
+ * each node that are not themselves in S_v and S_d the non-root nodes
+ * without children.
+ */
+static int rebuild_sets(wavetree2d_sub_t *t)
+{
+  int d;
+  int i;
+  int j;
+  int n;
+  int index;
+  double value;
+  int nchildren;
+  int leaf;
+
+  multiset_int_clear(t->S_b);
+  multiset_int_clear(t->S_d);
+
+  for (d = 0; d <= t->degree_max; d ++) {
+    n = multiset_int_double_depth_count(t->S_v, d);
+
+    for (i = 0; i < n; i ++) {
+
+      if (multiset_int_double_nth_element(t->S_v, d, i, &index, &value) < 0) {
+	ERROR("failed to get nth element of S_v");
+	return -1;
+      }
+
+      if (wavetree2d_sub_child_indices(t, index, d, t->child_indices, &nchildren, t->max_children) < 0) {
+	ERROR("failed to get child indices of %d", index);
+	return -1;
+      }
+
+      leaf = -1;
+      for (j = 0; j < nchildren; j ++) {
+	if (multiset_int_double_is_element(t->S_v, t->child_indices[j], d + 1)) {
+	  leaf = 0;
+	} else if (multiset_int_insert(t->S_b, t->child_indices[j], d + 1) < 0) {
+	  ERROR("failed to insert into S_b");
+	  return -1;
+	}
+      }
+
+      if (leaf && d > 0) {
+	if (multiset_int_insert(t->S_d, index, d) < 0) {
+	  ERROR("failed to insert into S_d");
+	  return -1;
+	}
+      }
+    }
+  }
+
+  return 0;
+}
+
 void wavetree2d_sub_print_setinfo(wavetree2d_sub_t *t)
 {
   printf("Nb %d Nd %d CC %d\n", 
@@ -2158,6 +2884,11 @@ int wavetree2d_sub_generate_dyck_binary(wavetree2d_sub_t *t, uint64_t *binary)
   return 0;
 }
 
+uint64_t wavetree2d_sub_hash(const wavetree2d_sub_t *t)
+{
+  return t->hash;
+}
+
 int wavetree2d_sub_get_indices(wavetree2d_sub_t *t, int *set, int *n)
 {
   int d;
@@ -2263,6 +2994,7 @@ wavetree2d_sub_set_from_S_v(wavetree2d_sub_t *t,
   multiset_int_clear(t->S_b);
   multiset_int_clear(t->S_d);
   multiset_int_double_clear(t->S_v);
+  t->hash = 0;
 
   if (multiset_int_double_get(S_vp, 0, 0, &value) < 0) {
     ERROR("input set doesn't have 0,0 element");
@@ -2370,6 +3102,7 @@ wavetree2d_sub_set_model(wavetree2d_sub_t *t,
   }
   
   multiset_int_double_clear(t->S_v);
+  t->hash = 0;
   multiset_int_clear(t->S_b);
   multiset_int_clear(t->S_d);
 
@@ -2481,6 +3214,7 @@ int wavetree2d_sub_perturb(wavetree2d_sub_t *t,
           ERROR("failed to set value");
           return -1;
         }
+        t->hash ^= coefficient_hash(index, old_value) ^ coefficient_hash(index, value);
       }
 
     }
@@ -3058,3 +3792,57 @@ double wavetree2d_sub_mean_abs_deviation(const wavetree2d_sub_t *t)
 
   return mad;
 }
+
+static int bit_length(int x)
+{
+  if (x <= 0) {
+    return 0;
+  }
+
+  return (int)(8*sizeof(unsigned int)) - __builtin_clz((unsigned int)x);
+}
+
+/*
+ * Hash of a single coefficient. The model hash is the xor of these over
+ * S_v so it can be updated in O(1) as coefficients come and go.
+ */
+static uint64_t coefficient_hash(int i, double v)
+{
+  uint64_t x;
+
+  memcpy(&x, &v, sizeof(uint64_t));
+  x ^= ((uint64_t)(unsigned int)i) * 0x9e3779b97f4a7c15ULL;
+
+  /* splitmix64 finaliser */
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+
+  return x;
+}
+
+static int rehash(wavetree2d_sub_t *t)
+{
+  int d;
+  int i;
+  int n;
+  int index;
+  double value;
+
+  t->hash = 0;
+  for (d = 0; d <= t->degree_max; d ++) {
+    n = multiset_int_double_depth_count(t->S_v, d);
+    for (i = 0; i < n; i ++) {
+      if (multiset_int_double_nth_element(t->S_v, d, i, &index, &value) < 0) {
+	ERROR("failed to get nth element");
+	return -1;
+      }
+
+      t->hash ^= coefficient_hash(index, value);
+    }
+  }
+
+  return 0;
+}
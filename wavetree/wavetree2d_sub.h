@@ -34,6 +34,7 @@
 #include "chain_history.h"
 #include "wavetree.h"
 #include "wavetreepp.h"
+#include "wavetree_impulse.h"
 
 typedef struct _wavetree2d_sub wavetree2d_sub_t;
 
@@ -51,6 +52,37 @@ int
 wavetree2d_sub_load(wavetree2d_sub_t *t,
 		    const char *filename);
 
+/*
+ * Binary checkpoint of S_v only (see wavetree_checkpoint.h), the load maps
+ * the file and rebuilds S_b and S_d directly from S_v.
+ */
+int
+wavetree2d_sub_save_binary(const wavetree2d_sub_t *t,
+			   const char *filename);
+
+int
+wavetree2d_sub_load_binary(wavetree2d_sub_t *t,
+			   const char *filename);
+
+/*
+ * In memory snapshot of all three sets (see wavetree_snapshot.h). Adopting
+ * a snapshot copies the sorted arrays in place of rebuilding the sets, eg
+ * to take a model straight from a wavetree_exchange slot. The buffer must
+ * be 8 byte aligned.
+ */
+int
+wavetree2d_sub_snapshot_size(const wavetree2d_sub_t *t);
+
+int
+wavetree2d_sub_write_snapshot(const wavetree2d_sub_t *t,
+			       void *buffer,
+			       int size);
+
+int
+wavetree2d_sub_adopt_snapshot(wavetree2d_sub_t *t,
+			       const void *buffer,
+			       int len);
+
 int 
 wavetree2d_sub_load_promote(wavetree2d_sub_t *t,
 			    const char *filename);
@@ -105,11 +137,51 @@ int wavetree2d_sub_map_to_array(const wavetree2d_sub_t *t,
 				double *a, 
 				int n);
 
+/*
+ * For each row of the array produced by map_to_array, the smallest column
+ * holding a coefficient, or the width for an empty row. This is the row
+ * activity expected by generic_lift_inverse2d_sparse.
+ */
+int wavetree2d_sub_map_row_first(const wavetree2d_sub_t *t,
+				 int *row_first,
+				 int height);
+
 int wavetree2d_sub_map_impulse_to_array(const wavetree2d_sub_t *t,
 					int coeff_index,
 					double *a,
 					int n);
 
+/*
+ * Incremental image updates: after setting the 1D impulse response of the
+ * inverse transform (eg cdf97_lift_impulse_response_1d), propose_to_array
+ * adds the image space change of the pending proposal to an image
+ * previously obtained by map_to_array and an inverse transform, and
+ * revert_to_array removes it again. Both must be called before commit/undo.
+ */
+int wavetree2d_sub_set_impulse_response(wavetree2d_sub_t *t,
+					wavetree_impulse_response_t response);
+
+int wavetree2d_sub_propose_to_array(const wavetree2d_sub_t *t,
+				    double *a,
+				    int n);
+
+int wavetree2d_sub_revert_to_array(const wavetree2d_sub_t *t,
+				   double *a,
+				   int n);
+
+/*
+ * Evaluates the image that map_to_array and an inverse transform would
+ * give at the pixels (x[i], y[i]) without forming it. Only the stored
+ * coefficients whose basis function covers a pixel are summed, so the
+ * cost per point is proportional to the depth and the filter support.
+ * The impulse response must have been set.
+ */
+int wavetree2d_sub_evaluate_points(const wavetree2d_sub_t *t,
+				   const int *x,
+				   const int *y,
+				   double *values,
+				   int npoints);
+
 int wavetree2d_sub_map_from_array(wavetree2d_sub_t *t, 
 				  const double *a, 
 				  int n);
@@ -171,6 +243,13 @@ int wavetree2d_sub_generate_dyck_word(wavetree2d_sub_t *t, char *buffer, int max
 
 int wavetree2d_sub_generate_dyck_binary(wavetree2d_sub_t *t, uint64_t *binary);
 
+/*
+ * Order independent hash of the current coefficients, kept up to date
+ * by every proposal and undo so that it is O(1) to query. Identical
+ * models give identical hashes, use it as a likelihood_cache key.
+ */
+uint64_t wavetree2d_sub_hash(const wavetree2d_sub_t *t);
+
 int wavetree2d_sub_get_indices(wavetree2d_sub_t *t, int *set, int *n);
 
 int wavetree2d_sub_depth(wavetree2d_sub_t *t);
@@ -30,6 +30,8 @@
 #include <math.h>
 
 #include "wavetree3d_sub.h"
+#include "wavetree_checkpoint.h"
+#include "wavetree_snapshot.h"
 
 #include "multiset_int.h"
 #include "multiset_int_double.h"
@@ -74,16 +76,35 @@ struct _wavetree3d_sub {
   multiset_int_t *S_b;
   multiset_int_t *S_d;
 
+  /*
+   * Snapshots are adopted into these and then swapped with the sets above,
+   * created on the first adopt.
+   */
+  multiset_int_double_t *adopt_S_v;
+  multiset_int_t *adopt_S_b;
+  multiset_int_t *adopt_S_d;
+
+  /* Order independent hash of the (index, value) pairs in S_v */
+  uint64_t hash;
+
   wavetree3d_sub_undo_t undo;
   int u_i;
   int u_d;
   double u_v;
 
   chain_history_change_t last_step;
+
+  wavetree_impulse_t *impulse_x;
+  wavetree_impulse_t *impulse_y;
+  wavetree_impulse_t *impulse_z;
 };
 
 static int add_node(wavetree3d_sub_t *t, int i, int d, double coeff);
 static int remove_node(wavetree3d_sub_t *t, int i, int d);
+static int rebuild_sets(wavetree3d_sub_t *t);
+static int bit_length(int x);
+static uint64_t coefficient_hash(int i, double v);
+static int rehash(wavetree3d_sub_t *t);
 
 wavetree3d_sub_t *wavetree3d_sub_create(int degree_width,
 					int degree_height,
@@ -196,9 +217,19 @@ wavetree3d_sub_t *wavetree3d_sub_create(int degree_width,
   r->u_d = 0;
   r->u_v = 0.0;
 
+  r->hash = 0;
+
   memset(&(r->last_step), 0, sizeof(chain_history_change_t));
   r->last_step.header.type = CH_INITIALISE;
 
+  r->impulse_x = NULL;
+  r->impulse_y = NULL;
+  r->impulse_z = NULL;
+
+  r->adopt_S_v = NULL;
+  r->adopt_S_b = NULL;
+  r->adopt_S_d = NULL;
+
   return r;
 }
 
@@ -208,7 +239,14 @@ void wavetree3d_sub_destroy(wavetree3d_sub_t *t)
     multiset_int_double_destroy(t->S_v);
     multiset_int_destroy(t->S_d);
     multiset_int_destroy(t->S_b);
+
+    multiset_int_double_destroy(t->adopt_S_v);
+    multiset_int_destroy(t->adopt_S_d);
+    multiset_int_destroy(t->adopt_S_b);
     free(t->child_indices);
+    wavetree_impulse_destroy(t->impulse_x);
+    wavetree_impulse_destroy(t->impulse_y);
+    wavetree_impulse_destroy(t->impulse_z);
     free(t);
   }
 }
@@ -304,6 +342,7 @@ wavetree3d_sub_load(wavetree3d_sub_t *t,
   /* Clear everything first */
 
   multiset_int_double_clear(t->S_v);
+  t->hash = 0;
   multiset_int_clear(t->S_b);
   multiset_int_clear(t->S_d);
 
@@ -312,6 +351,11 @@ wavetree3d_sub_load(wavetree3d_sub_t *t,
     return -1;
   }
 
+  if (rehash(t) < 0) {
+    ERROR("failed to hash S_v");
+    return -1;
+  }
+
   if (multiset_int_read(t->S_b, fp) < 0) {
     ERROR("failed to read S_b");
     return -1;
@@ -325,6 +369,71 @@ wavetree3d_sub_load(wavetree3d_sub_t *t,
   return 0;
 }
 
+int
+wavetree3d_sub_save_binary(const wavetree3d_sub_t *t,
+			   const char *filename)
+{
+  wavetree_checkpoint_header_t header;
+
+  memset(&header, 0, sizeof(header));
+  header.dimension = 3;
+  header.degree[0] = t->degree_width;
+  header.degree[1] = t->degree_height;
+  header.degree[2] = t->degree_depth;
+  header.size[0] = t->width;
+  header.size[1] = t->height;
+  header.size[2] = t->depth;
+  header.alpha = t->alpha;
+
+  return wavetree_checkpoint_save(filename, &header, t->S_v);
+}
+
+int
+wavetree3d_sub_load_binary(wavetree3d_sub_t *t,
+			   const char *filename)
+{
+  wavetree_checkpoint_t *c;
+  const wavetree_checkpoint_header_t *header;
+
+  c = wavetree_checkpoint_open(filename);
+  if (c == NULL) {
+    return -1;
+  }
+
+  header = wavetree_checkpoint_header(c);
+  if (header->dimension != 3 ||
+      header->degree[0] != t->degree_width ||
+      header->degree[1] != t->degree_height ||
+      header->degree[2] != t->degree_depth ||
+      header->size[0] != t->width ||
+      header->size[1] != t->height ||
+      header->size[2] != t->depth) {
+    ERROR("checkpoint mismatch (%dd %d %d %d)",
+	  header->dimension, header->degree[0], header->degree[1], header->degree[2]);
+    wavetree_checkpoint_close(c);
+    return -1;
+  }
+
+  t->alpha = header->alpha;
+
+  if (wavetree_checkpoint_restore(c, t->S_v) < 0) {
+    ERROR("failed to restore S_v");
+    wavetree_checkpoint_close(c);
+    return -1;
+  }
+
+  wavetree_checkpoint_close(c);
+
+  t->undo = UNDO_NONE;
+
+  if (rebuild_sets(t) < 0) {
+    ERROR("failed to rebuild sets");
+    return -1;
+  }
+
+  return rehash(t);
+}
+
 static int encode_int(int v,
 		      char *buffer,
 		      int *offset,
@@ -517,6 +626,7 @@ wavetree3d_sub_decode(wavetree3d_sub_t *t,
   
   /* Clear everything first before adding nodes from binary string */
   multiset_int_double_clear(t->S_v);
+  t->hash = 0;
   multiset_int_clear(t->S_b);
   multiset_int_clear(t->S_d);
 
@@ -538,6 +648,84 @@ wavetree3d_sub_decode(wavetree3d_sub_t *t,
   return 0;
 }
 
+int
+wavetree3d_sub_snapshot_size(const wavetree3d_sub_t *t)
+{
+  return wavetree_snapshot_size(t->S_v, t->S_b, t->S_d);
+}
+
+int
+wavetree3d_sub_write_snapshot(const wavetree3d_sub_t *t,
+			       void *buffer,
+			       int size)
+{
+  wavetree_snapshot_header_t header;
+
+  memset(&header, 0, sizeof(header));
+  header.dimension = 3;
+  header.degree[0] = t->degree_width;
+  header.degree[1] = t->degree_height;
+  header.degree[2] = t->degree_depth;
+  header.alpha = t->alpha;
+
+  return wavetree_snapshot_write(buffer, size, &header, t->S_v, t->S_b, t->S_d);
+}
+
+int
+wavetree3d_sub_adopt_snapshot(wavetree3d_sub_t *t,
+			       const void *buffer,
+			       int len)
+{
+  const wavetree_snapshot_header_t *h;
+
+  h = wavetree_snapshot_header(buffer, len);
+  if (h == NULL) {
+    return -1;
+  }
+
+  if (h->dimension != 3 ||
+      h->degree[0] != t->degree_width ||
+      h->degree[1] != t->degree_height ||
+      h->degree[2] != t->degree_depth ||
+      h->alpha != t->alpha) {
+    ERROR("snapshot mismatch (%dd %d %d %d %f)",
+	  h->dimension, h->degree[0], h->degree[1], h->degree[2], h->alpha);
+    return -1;
+  }
+
+  if (t->adopt_S_v == NULL) {
+    t->adopt_S_v = multiset_int_double_create();
+    t->adopt_S_b = multiset_int_create();
+    t->adopt_S_d = multiset_int_create();
+    if (t->adopt_S_v == NULL || t->adopt_S_b == NULL || t->adopt_S_d == NULL) {
+      ERROR("failed to create adopt sets");
+      multiset_int_double_destroy(t->adopt_S_v);
+      multiset_int_destroy(t->adopt_S_b);
+      multiset_int_destroy(t->adopt_S_d);
+      t->adopt_S_v = NULL;
+      t->adopt_S_b = NULL;
+      t->adopt_S_d = NULL;
+      return -1;
+    }
+  }
+
+  /*
+   * A failure part way through leaves the current model untouched
+   */
+  if (wavetree_snapshot_adopt(buffer, len, t->adopt_S_v, t->adopt_S_b, t->adopt_S_d) < 0) {
+    ERROR("failed to adopt snapshot");
+    return -1;
+  }
+
+  multiset_int_double_swap(t->S_v, t->adopt_S_v);
+  multiset_int_swap(t->S_b, t->adopt_S_b);
+  multiset_int_swap(t->S_d, t->adopt_S_d);
+
+  t->undo = UNDO_NONE;
+
+  return rehash(t);
+}
+
 int
 wavetree3d_sub_get_width(wavetree3d_sub_t *t)
 {
@@ -603,6 +791,7 @@ int wavetree3d_sub_initialize(wavetree3d_sub_t *t,
    * Clear all sets
    */
   multiset_int_double_clear(t->S_v);
+  t->hash = 0;
   multiset_int_clear(t->S_b);
   multiset_int_clear(t->S_d);
 
@@ -614,6 +803,7 @@ int wavetree3d_sub_initialize(wavetree3d_sub_t *t,
 			     0,
 			     d,
 			     dc);
+  t->hash ^= coefficient_hash(0, dc);
 
   /*
    * Add the potential birthing nodes
@@ -793,6 +983,244 @@ int wavetree3d_sub_map_to_array(wavetree3d_sub_t *t,
   return 0;
 }
 
+int wavetree3d_sub_set_impulse_response(wavetree3d_sub_t *t,
+					wavetree_impulse_response_t response)
+{
+  wavetree_impulse_t *x;
+  wavetree_impulse_t *y;
+  wavetree_impulse_t *z;
+
+  /*
+   * The subtile transform uses degree_min levels along each axis so that
+   * the 3D basis functions are separable. All three are built before any
+   * is installed so that a failure leaves the previous responses in place.
+   */
+  x = wavetree_impulse_create(t->width, t->degree_min, response);
+  y = wavetree_impulse_create(t->height, t->degree_min, response);
+  z = wavetree_impulse_create(t->depth, t->degree_min, response);
+  if (x == NULL || y == NULL || z == NULL) {
+    ERROR("failed to create impulse responses");
+    wavetree_impulse_destroy(x);
+    wavetree_impulse_destroy(y);
+    wavetree_impulse_destroy(z);
+    return -1;
+  }
+
+  wavetree_impulse_destroy(t->impulse_x);
+  wavetree_impulse_destroy(t->impulse_y);
+  wavetree_impulse_destroy(t->impulse_z);
+
+  t->impulse_x = x;
+  t->impulse_y = y;
+  t->impulse_z = z;
+
+  return 0;
+}
+
+static uint64_t *occupancy(const wavetree3d_sub_t *t)
+{
+  uint64_t *bits;
+  int nwords;
+  int d;
+  int c;
+  int i;
+  int index;
+  double value;
+
+  /*
+   * One bit per position of the map_to_array image that holds a value
+   */
+  nwords = (t->size + 63) >> 6;
+  bits = malloc(sizeof(uint64_t) * nwords);
+  if (bits == NULL) {
+    ERROR("failed to allocate occupancy");
+    return NULL;
+  }
+  memset(bits, 0, sizeof(uint64_t) * nwords);
+
+  for (d = 0; d <= t->degree_max; d ++) {
+    c = multiset_int_double_depth_count(t->S_v, d);
+    for (i = 0; i < c; i ++) {
+
+      if (multiset_int_double_nth_element(t->S_v, d, i, &index, &value) < 0) {
+	ERROR("failed to get nth element");
+	free(bits);
+	return NULL;
+      }
+
+      if (t->base_size > 1) {
+	if (index == 0) {
+	  continue;
+	}
+	index --;
+      }
+
+      bits[index >> 6] |= (uint64_t)1 << (index & 63);
+    }
+  }
+
+  if (t->base_size > 1) {
+    for (i = 0; i < t->base_size; i ++) {
+      index = t->base_indices[i] - 1;
+      bits[index >> 6] |= (uint64_t)1 << (index & 63);
+    }
+  }
+
+  return bits;
+}
+
+static double image_coefficient(const wavetree3d_sub_t *t,
+				int index,
+				double mean)
+{
+  double value;
+
+  /* The value map_to_array places at image position index */
+  if (t->base_size > 1) {
+    index ++;
+  }
+
+  if (multiset_int_double_get(t->S_v, index, wavetree3d_sub_depthofindex(t, index), &value) < 0) {
+    value = 0.0;
+  }
+
+  if (t->base_size > 1 && wavetree3d_sub_depthofindex(t, index) == 1) {
+    value += mean;
+  }
+
+  return value;
+}
+
+int wavetree3d_sub_evaluate_points(const wavetree3d_sub_t *t,
+				   const int *x,
+				   const int *y,
+				   const int *z,
+				   double *values,
+				   int npoints)
+{
+  uint64_t *bits;
+  const int *cx;
+  const int *cy;
+  const int *cz;
+  const double *vx;
+  const double *vy;
+  const double *vz;
+  int nx, ny, nz;
+  int ex, ey, ez;
+  int lo, hi;
+  int levels;
+  int l;
+  int p;
+  int i;
+  int j;
+  int k;
+  int in;
+  int row;
+  int index;
+  double mean;
+  double sz;
+  double syz;
+  double sum;
+
+  if (t->impulse_x == NULL || t->impulse_y == NULL || t->impulse_z == NULL) {
+    ERROR("impulse response not set");
+    return -1;
+  }
+
+  mean = 0.0;
+  if (t->base_size > 1 &&
+      multiset_int_double_nth_element(t->S_v, 0, 0, &index, &mean) < 0) {
+    ERROR("failed to get dc");
+    return -1;
+  }
+
+  bits = occupancy(t);
+  if (bits == NULL) {
+    return -1;
+  }
+
+  levels = t->degree_min;
+  
+  for (p = 0; p < npoints; p ++) {
+
+    if (x[p] < 0 || x[p] >= t->width ||
+	y[p] < 0 || y[p] >= t->height ||
+	z[p] < 0 || z[p] >= t->depth) {
+      ERROR("point out of range %d %d %d", x[p], y[p], z[p]);
+      free(bits);
+      return -1;
+    }
+
+    sum = 0.0;
+    for (l = (levels > 0); l <= levels; l ++) {
+
+      /*
+       * Below the coarsest step the coefficients taking part in exactly l
+       * steps form a single tree depth, skip it when it is empty.
+       */
+      if (l < levels &&
+	  multiset_int_double_depth_count(t->S_v,
+					  wavetree3d_sub_depthofindex(t, wavetree3d_sub_from_3dindices(t, t->width >> l, 0, 0))) == 0) {
+	continue;
+      }
+
+      cx = wavetree_impulse_cover(t->impulse_x, l, x[p], &nx, &ex);
+      cy = wavetree_impulse_cover(t->impulse_y, l, y[p], &ny, &ey);
+      cz = wavetree_impulse_cover(t->impulse_z, l, z[p], &nz, &ez);
+      if (cx == NULL || cy == NULL || cz == NULL) {
+	free(bits);
+	return -1;
+      }
+
+      /*
+       * A triple of indices belongs to l if at least one of them takes
+       * part in exactly l steps
+       */
+      for (k = 0; k < nz; k ++) {
+
+	vz = NULL;
+	sz = 0.0;
+	
+	for (j = 0; j < ny; j ++) {
+
+	  in = (k < ez || j < ey) ? nx : ex;
+	  if (in == 0) {
+	    break;
+	  }
+
+	  row = ((cz[k] << t->degree_height) + cy[j]) << t->degree_width;
+	  vy = NULL;
+	  syz = 0.0;
+
+	  for (i = 0; i < in; i ++) {
+
+	    index = row + cx[i];
+	    if (bits[index >> 6] & ((uint64_t)1 << (index & 63))) {
+
+	      if (vy == NULL) {
+		if (vz == NULL) {
+		  vz = wavetree_impulse_get(t->impulse_z, cz[k], l, &lo, &hi);
+		  sz = vz[z[p] - lo];
+		}
+		vy = wavetree_impulse_get(t->impulse_y, cy[j], l, &lo, &hi);
+		syz = sz * vy[y[p] - lo];
+	      }
+	      
+	      vx = wavetree_impulse_get(t->impulse_x, cx[i], l, &lo, &hi);
+	      sum += image_coefficient(t, index, mean) * syz * vx[x[p] - lo];
+	    }
+	  }
+	}
+      }
+    }
+
+    values[p] = sum;
+  }
+
+  free(bits);
+  return 0;
+}
+
 int
 wavetree3d_sub_propose_value(wavetree3d_sub_t *t,
 			     int i,
@@ -836,6 +1264,7 @@ wavetree3d_sub_propose_value(wavetree3d_sub_t *t,
     ERROR("failed to set new value");
     return -1;
   }
+  t->hash ^= coefficient_hash(i, t->u_v) ^ coefficient_hash(i, value);
 
   /*
    * Record the proposal
@@ -960,16 +1389,23 @@ wavetree3d_sub_propose_death(wavetree3d_sub_t *t,
 int 
 wavetree3d_sub_undo(wavetree3d_sub_t *t)
 {
+  double value;
+
   switch (t->undo) {
   case UNDO_NONE:
     ERROR("nothing to undo");
     return -1;
 
   case UNDO_VALUE:
+    if (multiset_int_double_get(t->S_v, t->u_i, t->u_d, &value) < 0) {
+      ERROR("failed to get value to undo");
+      return -1;
+    }
     if (multiset_int_double_set(t->S_v, t->u_i, t->u_d, t->u_v) < 0) {
       ERROR("failed to undo value");
       return -1;
     }
+    t->hash ^= coefficient_hash(t->u_i, value) ^ coefficient_hash(t->u_i, t->u_v);
     break;
 
   case UNDO_BIRTH:
@@ -1462,6 +1898,7 @@ wavetree3d_sub_set_from_S_v(wavetree3d_sub_t *t,
   multiset_int_clear(t->S_b);
   multiset_int_clear(t->S_d);
   multiset_int_double_clear(t->S_v);
+  t->hash = 0;
 
   if (multiset_int_double_get(S_vp, 0, 0, &value) < 0) {
     ERROR("input set doesn't have 0,0 element");
@@ -1512,6 +1949,7 @@ wavetree3d_sub_set_from_S_v_filtered(wavetree3d_sub_t *t,
   multiset_int_clear(t->S_b);
   multiset_int_clear(t->S_d);
   multiset_int_double_clear(t->S_v);
+  t->hash = 0;
 
   if (multiset_int_double_get(S_vp, 0, 0, &value) < 0) {
     ERROR("input set doesn't have 0,0 element");
@@ -1622,6 +2060,7 @@ int wavetree3d_sub_perturb(wavetree3d_sub_t *t,
 	  ERROR("failed to set value");
 	  return -1;
 	}
+	t->hash ^= coefficient_hash(index, old_value) ^ coefficient_hash(index, value);
       }
 
     }
@@ -1659,17 +2098,17 @@ int wavetree3d_sub_parent_index(const wavetree3d_sub_t *t, int c)
 	j < (2*t->base_height) &&
 	k < (2*t->base_depth)) {
 
-      i = i % t->base_width;
-      j = j % t->base_height;
-      k = k % t->base_depth;
+      i = i & (t->base_width - 1);
+      j = j & (t->base_height - 1);
+      k = k & (t->base_depth - 1);
 
       return wavetree3d_sub_from_3dindices(t, i, j, k);
     }
 
     /* divide by 2 method for levels 2+*/
-    j /= 2;
-    i /= 2;
-    k /= 2;
+    j >>= 1;
+    i >>= 1;
+    k >>= 1;
     
     return wavetree3d_sub_from_3dindices(t, i, j, k);
 
@@ -1681,9 +2120,9 @@ int wavetree3d_sub_parent_index(const wavetree3d_sub_t *t, int c)
     }
     
     
-    j /= 2;
-    i /= 2;
-    k /= 2;
+    j >>= 1;
+    i >>= 1;
+    k >>= 1;
     
     return wavetree3d_sub_from_3dindices(t, i, j, k);
   }
@@ -1695,8 +2134,6 @@ int wavetree3d_sub_3dindices(const wavetree3d_sub_t *t,
 			     int *ij,
 			     int *ik)
 {
-  int j;
-
   if (t->base_size == 1) {
     if (i < 0 ||
 	i >= t->size) {
@@ -1717,11 +2154,10 @@ int wavetree3d_sub_3dindices(const wavetree3d_sub_t *t,
     i --;
   }
     
-  j = i % (t->width * t->height);
-  
-  *ii = j % t->width;
-  *ij = (j - (*ii)) / t->width;
-  *ik = (i - j)/(t->width * t->height);
+  /* Dimensions are powers of 2 so this is just a split of the bits */
+  *ii = i & (t->width - 1);
+  *ij = (i >> t->degree_width) & (t->height - 1);
+  *ik = i >> (t->degree_width + t->degree_height);
 
   return 0;
 }
@@ -1744,7 +2180,7 @@ int wavetree3d_sub_from_3dindices(const wavetree3d_sub_t *t,
       return -1;
     }
     
-    return (ik * t->height + ij)*t->width + ii;
+    return (((ik << t->degree_height) + ij) << t->degree_width) + ii;
 
   } else {
     if (ii == (-1) &&
@@ -1760,18 +2196,67 @@ int wavetree3d_sub_from_3dindices(const wavetree3d_sub_t *t,
       return -1;
     }
     
-    return (ik * t->height + ij)*t->width + ii + 1;
+    return (((ik << t->degree_height) + ij) << t->degree_width) + ii + 1;
   }
 }
 
+/*
+ * Closed form of following parent_index back to the root: each halving of
+ * the 3d indices is one level, plus one level for the subtile when the base
+ * is not a cube.
+ */
 int wavetree3d_sub_depthofindex(const wavetree3d_sub_t *t,
 				int i)
 {
+  int ii;
+  int ij;
+  int ik;
+  int di;
+  int dj;
+  int dk;
+
   if (i == 0) {
     return 0;
   }
 
-  return 1 + wavetree3d_sub_depthofindex(t, wavetree3d_sub_parent_index(t, i));
+  if (wavetree3d_sub_3dindices(t, i, &ii, &ij, &ik) < 0) {
+    ERROR("failed to get 3d indices");
+    return -1;
+  }
+
+  if (t->base_size == 1) {
+
+    di = bit_length(ii);
+    dj = bit_length(ij);
+    dk = bit_length(ik);
+
+    if (dj > di) {
+      di = dj;
+    }
+    if (dk > di) {
+      di = dk;
+    }
+
+    return di;
+
+  } else {
+
+    di = bit_length(ii) - (t->degree_width - t->degree_min);
+    dj = bit_length(ij) - (t->degree_height - t->degree_min);
+    dk = bit_length(ik) - (t->degree_depth - t->degree_min);
+
+    if (dj > di) {
+      di = dj;
+    }
+    if (dk > di) {
+      di = dk;
+    }
+    if (di < 0) {
+      di = 0;
+    }
+
+    return 1 + di;
+  }
 }
 
 int wavetree3d_sub_get_coeff(const wavetree3d_sub_t *t,
@@ -2019,6 +2504,11 @@ int wavetree3d_sub_generate_dyck_binary(wavetree3d_sub_t *t, uint64_t *binary)
   return 0;
 }
 
+uint64_t wavetree3d_sub_hash(const wavetree3d_sub_t *t)
+{
+  return t->hash;
+}
+
 static int add_node(wavetree3d_sub_t *t, int i, int d, double coeff)
 {
   int j;
@@ -2028,6 +2518,7 @@ static int add_node(wavetree3d_sub_t *t, int i, int d, double coeff)
   if (multiset_int_double_insert(t->S_v, i, d, coeff) < 0) {
     return -1;
   }
+  t->hash ^= coefficient_hash(i, coeff);
   
   j = wavetree3d_sub_parent_index(t, i);
 
@@ -2062,11 +2553,18 @@ static int remove_node(wavetree3d_sub_t *t, int i, int d)
   int j;
   int pcc;
   int nchildren;
+  double coeff;
   
+  if (multiset_int_double_get(t->S_v, i, d, &coeff) < 0) {
+    ERROR("failed to get value of node to remove (index %d, depth %d)", i, d);
+    return -1;
+  }
+
   if (multiset_int_double_remove(t->S_v, i, d) < 0) {
     ERROR("failed to remove index from S_v (index %d, depth %d)", i, d);
     return -1;
   }
+  t->hash ^= coefficient_hash(i, coeff);
 
   j = wavetree3d_sub_parent_index(t, i);
   if (j < 0) {
@@ -2097,6 +2595,62 @@ static int remove_node(wavetree3d_sub_t *t, int i, int d)
   return 0;
 }
 
+/*
+ * Derive S_b and S_d from S_v in one pass: S_b holds the children of
+ * each node that are not themselves in S_v and S_d the non-root nodes
+ * without children.
+ */
+static int rebuild_sets(wavetree3d_sub_t *t)
+{
+  int d;
+  int i;
+  int j;
+  int n;
+  int index;
+  double value;
+  int nchildren;
+  int leaf;
+
+  multiset_int_clear(t->S_b);
+  multiset_int_clear(t->S_d);
+
+  for (d = 0; d <= t->degree_max; d ++) {
+    n = multiset_int_double_depth_count(t->S_v, d);
+
+    for (i = 0; i < n; i ++) {
+
+      if (multiset_int_double_nth_element(t->S_v, d, i, &index, &value) < 0) {
+	ERROR("failed to get nth element of S_v");
+	return -1;
+      }
+
+      if (wavetree3d_sub_child_indices(t, index, d, t->child_indices, &nchildren, t->max_children) < 0) {
+	ERROR("failed to get child indices of %d", index);
+	return -1;
+      }
+
+      leaf = -1;
+      for (j = 0; j < nchildren; j ++) {
+	if (multiset_int_double_is_element(t->S_v, t->child_indices[j], d + 1)) {
+	  leaf = 0;
+	} else if (multiset_int_insert(t->S_b, t->child_indices[j], d + 1) < 0) {
+	  ERROR("failed to insert into S_b");
+	  return -1;
+	}
+      }
+
+      if (leaf && d > 0) {
+	if (multiset_int_insert(t->S_d, index, d) < 0) {
+	  ERROR("failed to insert into S_d");
+	  return -1;
+	}
+      }
+    }
+  }
+
+  return 0;
+}
+
 int wavetree3d_sub_child_count(wavetree3d_sub_t *t, int index, int depth)
 {
   int j;
@@ -2418,3 +2972,57 @@ double wavetree3d_sub_logpriorprobability(const wavetree3d_sub_t *t,
 
   return logprior;
 }
+
+static int bit_length(int x)
+{
+  if (x <= 0) {
+    return 0;
+  }
+
+  return (int)(8*sizeof(unsigned int)) - __builtin_clz((unsigned int)x);
+}
+
+/*
+ * Hash of a single coefficient. The model hash is the xor of these over
+ * S_v so it can be updated in O(1) as coefficients come and go.
+ */
+static uint64_t coefficient_hash(int i, double v)
+{
+  uint64_t x;
+
+  memcpy(&x, &v, sizeof(uint64_t));
+  x ^= ((uint64_t)(unsigned int)i) * 0x9e3779b97f4a7c15ULL;
+
+  /* splitmix64 finaliser */
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+
+  return x;
+}
+
+static int rehash(wavetree3d_sub_t *t)
+{
+  int d;
+  int i;
+  int n;
+  int index;
+  double value;
+
+  t->hash = 0;
+  for (d = 0; d <= t->degree_max; d ++) {
+    n = multiset_int_double_depth_count(t->S_v, d);
+    for (i = 0; i < n; i ++) {
+      if (multiset_int_double_nth_element(t->S_v, d, i, &index, &value) < 0) {
+	ERROR("failed to get nth element");
+	return -1;
+      }
+
+      t->hash ^= coefficient_hash(index, value);
+    }
+  }
+
+  return 0;
+}
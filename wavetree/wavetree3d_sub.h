@@ -33,6 +33,7 @@
 #include "chain_history.h"
 #include "wavetree.h"
 #include "wavetreepp.h"
+#include "wavetree_impulse.h"
 
 typedef struct _wavetree3d_sub wavetree3d_sub_t;
 
@@ -51,6 +52,18 @@ int
 wavetree3d_sub_load(wavetree3d_sub_t *t,
 		    const char *filename);
 
+/*
+ * Binary checkpoint of S_v only (see wavetree_checkpoint.h), the load maps
+ * the file and rebuilds S_b and S_d directly from S_v.
+ */
+int
+wavetree3d_sub_save_binary(const wavetree3d_sub_t *t,
+			   const char *filename);
+
+int
+wavetree3d_sub_load_binary(wavetree3d_sub_t *t,
+			   const char *filename);
+
 int
 wavetree3d_sub_encode(wavetree3d_sub_t *t,
 		      char *buffer,
@@ -61,6 +74,25 @@ wavetree3d_sub_decode(wavetree3d_sub_t *t,
 		  char *buffer,
 		  int len);
 
+/*
+ * In memory snapshot of all three sets (see wavetree_snapshot.h). Adopting
+ * a snapshot copies the sorted arrays in place of rebuilding the sets, eg
+ * to take a model straight from a wavetree_exchange slot. The buffer must
+ * be 8 byte aligned.
+ */
+int
+wavetree3d_sub_snapshot_size(const wavetree3d_sub_t *t);
+
+int
+wavetree3d_sub_write_snapshot(const wavetree3d_sub_t *t,
+			       void *buffer,
+			       int size);
+
+int
+wavetree3d_sub_adopt_snapshot(wavetree3d_sub_t *t,
+			       const void *buffer,
+			       int len);
+
 int 
 wavetree3d_sub_load_promote(wavetree3d_sub_t *t,
 			const char *filename);
@@ -95,6 +127,23 @@ int wavetree3d_sub_map_to_array(wavetree3d_sub_t *t,
 				double *a, 
 				int n);
 
+/*
+ * Point evaluation: after setting the 1D impulse response of the inverse
+ * transform (eg cdf97_lift_impulse_response_1d), evaluate_points gives
+ * the image that map_to_array and a subtile inverse transform would give
+ * at the voxels (x[i], y[i], z[i]) without forming it. The cost per point
+ * is proportional to the depth and the cube of the filter support.
+ */
+int wavetree3d_sub_set_impulse_response(wavetree3d_sub_t *t,
+					wavetree_impulse_response_t response);
+
+int wavetree3d_sub_evaluate_points(const wavetree3d_sub_t *t,
+				   const int *x,
+				   const int *y,
+				   const int *z,
+				   double *values,
+				   int npoints);
+
 int
 wavetree3d_sub_propose_value(wavetree3d_sub_t *t,
 			     int i,
@@ -236,6 +285,13 @@ int wavetree3d_sub_generate_dyck_word(wavetree3d_sub_t *t, char *buffer, int max
 
 int wavetree3d_sub_generate_dyck_binary(wavetree3d_sub_t *t, uint64_t *binary);
 
+/*
+ * Order independent hash of the current coefficients, kept up to date
+ * by every proposal and undo so that it is O(1) to query. Identical
+ * models give identical hashes, use it as a likelihood_cache key.
+ */
+uint64_t wavetree3d_sub_hash(const wavetree3d_sub_t *t);
+
 double wavetree3d_sub_logpriorprobability(const wavetree3d_sub_t *t,
 					  wavetree_pp_t *pp);
 
@@ -0,0 +1,327 @@
+//
+//    Wavetree Library : A library for performed trans-dimensional tree inversion,
+//    See
+//
+//      R Hawkins and M Sambridge, "Geophysical imaging using trans-dimensional trees",
+//      Geophysical Journal International, 2015, 203:2, 972 - 1000,
+//      https://doi.org/10.1093/gji/ggv326
+//    
+//    Copyright (C) 2014 - 2018 Rhys Hawkins
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "wavetree_checkpoint.h"
+
+#include "slog.h"
+
+struct _wavetree_checkpoint {
+  void *map;
+  size_t length;
+
+  const wavetree_checkpoint_header_t *header;
+  const int *counts;
+
+  /* Byte offset of each depth's indices */
+  size_t *offsets;
+};
+
+static size_t pad8(size_t n)
+{
+  return (n + 7) & ~((size_t)7);
+}
+
+static int write_padding(FILE *fp, size_t n)
+{
+  static const char zeros[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+
+  if (pad8(n) > n) {
+    if (fwrite(zeros, 1, pad8(n) - n, fp) != pad8(n) - n) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+int
+wavetree_checkpoint_save(const char *filename,
+			 const wavetree_checkpoint_header_t *header,
+			 const multiset_int_double_t *S_v)
+{
+  FILE *fp;
+  wavetree_checkpoint_header_t h;
+  int *counts;
+  int *indices;
+  double *values;
+  int maxcount;
+  int d;
+  int i;
+
+  h = *header;
+  memset(h.magic, 0, sizeof(h.magic));
+  memcpy(h.magic, WAVETREE_CHECKPOINT_MAGIC, strlen(WAVETREE_CHECKPOINT_MAGIC));
+  h.version = WAVETREE_CHECKPOINT_VERSION;
+
+  /* Depths up to the last non-empty one */
+  h.ndepths = 0;
+  for (d = 0; (i = multiset_int_double_depth_count(S_v, d)) >= 0; d ++) {
+    if (i > 0) {
+      h.ndepths = d + 1;
+    }
+  }
+  h.ncoeff = multiset_int_double_total_count(S_v);
+
+  counts = NULL;
+  indices = NULL;
+  values = NULL;
+  fp = NULL;
+
+  counts = malloc(sizeof(int) * (h.ndepths + 1));
+  if (counts == NULL) {
+    ERROR("failed to allocate counts");
+    goto fail;
+  }
+
+  maxcount = 0;
+  for (d = 0; d < h.ndepths; d ++) {
+    counts[d] = multiset_int_double_depth_count(S_v, d);
+    if (counts[d] > maxcount) {
+      maxcount = counts[d];
+    }
+  }
+
+  indices = malloc(sizeof(int) * (maxcount + 1));
+  values = malloc(sizeof(double) * (maxcount + 1));
+  if (indices == NULL || values == NULL) {
+    ERROR("failed to allocate buffers");
+    goto fail;
+  }
+  
+  fp = fopen(filename, "wb");
+  if (fp == NULL) {
+    ERROR("failed to create file %s", filename);
+    goto fail;
+  }
+
+  if (fwrite(&h, sizeof(h), 1, fp) != 1 ||
+      fwrite(counts, sizeof(int), h.ndepths, fp) != h.ndepths ||
+      write_padding(fp, sizeof(int) * h.ndepths) < 0) {
+    ERROR("failed to write header");
+    goto fail;
+  }
+
+  for (d = 0; d < h.ndepths; d ++) {
+
+    for (i = 0; i < counts[d]; i ++) {
+      if (multiset_int_double_nth_element(S_v, d, i, &(indices[i]), &(values[i])) < 0) {
+	ERROR("failed to get coefficient %d at depth %d", i, d);
+	goto fail;
+      }
+    }
+
+    if (fwrite(indices, sizeof(int), counts[d], fp) != counts[d] ||
+	write_padding(fp, sizeof(int) * counts[d]) < 0 ||
+	fwrite(values, sizeof(double), counts[d], fp) != counts[d]) {
+      ERROR("failed to write depth %d", d);
+      goto fail;
+    }
+  }
+
+  free(counts);
+  free(indices);
+  free(values);
+
+  if (fclose(fp) != 0) {
+    ERROR("failed to close file %s", filename);
+    return -1;
+  }
+
+  return 0;
+
+ fail:
+  if (fp != NULL) {
+    fclose(fp);
+  }
+  free(counts);
+  free(indices);
+  free(values);
+  return -1;
+}
+
+wavetree_checkpoint_t *
+wavetree_checkpoint_open(const char *filename)
+{
+  wavetree_checkpoint_t *c;
+  struct stat st;
+  int fd;
+  size_t offset;
+  int d;
+
+  fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    ERROR("failed to open file %s", filename);
+    return NULL;
+  }
+
+  if (fstat(fd, &st) < 0) {
+    ERROR("failed to stat file %s", filename);
+    close(fd);
+    return NULL;
+  }
+
+  if (st.st_size < sizeof(wavetree_checkpoint_header_t)) {
+    ERROR("file %s too short for header", filename);
+    close(fd);
+    return NULL;
+  }
+
+  c = malloc(sizeof(wavetree_checkpoint_t));
+  if (c == NULL) {
+    ERROR("failed to allocate memory");
+    close(fd);
+    return NULL;
+  }
+
+  c->length = st.st_size;
+  c->map = mmap(NULL, c->length, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (c->map == MAP_FAILED) {
+    ERROR("failed to map file %s", filename);
+    free(c);
+    return NULL;
+  }
+  c->offsets = NULL;
+
+  c->header = (const wavetree_checkpoint_header_t *)c->map;
+  if (strncmp(c->header->magic, WAVETREE_CHECKPOINT_MAGIC, sizeof(c->header->magic)) != 0) {
+    ERROR("%s is not a checkpoint", filename);
+    wavetree_checkpoint_close(c);
+    return NULL;
+  }
+
+  if (c->header->version != WAVETREE_CHECKPOINT_VERSION) {
+    ERROR("unsupported checkpoint version %d", c->header->version);
+    wavetree_checkpoint_close(c);
+    return NULL;
+  }
+
+  offset = sizeof(wavetree_checkpoint_header_t);
+  if (c->header->ndepths < 0 ||
+      offset + pad8(sizeof(int) * c->header->ndepths) > c->length) {
+    ERROR("invalid depth count %d", c->header->ndepths);
+    wavetree_checkpoint_close(c);
+    return NULL;
+  }
+  c->counts = (const int *)((const char *)c->map + offset);
+  offset += pad8(sizeof(int) * c->header->ndepths);
+
+  c->offsets = malloc(sizeof(size_t) * (c->header->ndepths + 1));
+  if (c->offsets == NULL) {
+    ERROR("failed to allocate offsets");
+    wavetree_checkpoint_close(c);
+    return NULL;
+  }
+
+  for (d = 0; d < c->header->ndepths; d ++) {
+    c->offsets[d] = offset;
+    if (c->counts[d] < 0) {
+      ERROR("invalid count at depth %d", d);
+      wavetree_checkpoint_close(c);
+      return NULL;
+    }
+    offset += pad8(sizeof(int) * c->counts[d]) + sizeof(double) * c->counts[d];
+    if (offset > c->length) {
+      ERROR("file %s truncated at depth %d", filename, d);
+      wavetree_checkpoint_close(c);
+      return NULL;
+    }
+  }
+
+  return c;
+}
+
+void
+wavetree_checkpoint_close(wavetree_checkpoint_t *c)
+{
+  if (c != NULL) {
+    munmap(c->map, c->length);
+    free(c->offsets);
+    free(c);
+  }
+}
+
+const wavetree_checkpoint_header_t *
+wavetree_checkpoint_header(const wavetree_checkpoint_t *c)
+{
+  return c->header;
+}
+
+int
+wavetree_checkpoint_depth(const wavetree_checkpoint_t *c,
+			  int d,
+			  const int **indices,
+			  const double **values)
+{
+  const char *p;
+
+  if (d < 0 || d >= c->header->ndepths) {
+    return -1;
+  }
+
+  p = (const char *)c->map + c->offsets[d];
+  *indices = (const int *)p;
+  *values = (const double *)(p + pad8(sizeof(int) * c->counts[d]));
+
+  return c->counts[d];
+}
+
+int
+wavetree_checkpoint_restore(const wavetree_checkpoint_t *c,
+			    multiset_int_double_t *S_v)
+{
+  const int *indices;
+  const double *values;
+  int n;
+  int d;
+  int i;
+
+  if (multiset_int_double_clear(S_v) < 0) {
+    return -1;
+  }
+
+  for (d = 0; d < c->header->ndepths; d ++) {
+    n = wavetree_checkpoint_depth(c, d, &indices, &values);
+
+    for (i = 0; i < n; i ++) {
+      if (multiset_int_double_insert(S_v, indices[i], d, values[i]) != 1) {
+	ERROR("failed to insert coefficient %d at depth %d", indices[i], d);
+	return -1;
+      }
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,102 @@
+//
+//    Wavetree Library : A library for performed trans-dimensional tree inversion,
+//    See
+//
+//      R Hawkins and M Sambridge, "Geophysical imaging using trans-dimensional trees",
+//      Geophysical Journal International, 2015, 203:2, 972 - 1000,
+//      https://doi.org/10.1093/gji/ggv326
+//    
+//    Copyright (C) 2014 - 2018 Rhys Hawkins
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+
+#ifndef wavetree_checkpoint_h
+#define wavetree_checkpoint_h
+
+#include "multiset_int_double.h"
+
+/*
+ * Binary checkpoint of a tree model. Only S_v is stored, S_b and S_d being
+ * derivable from it. The layout is
+ *
+ *   header
+ *   int counts[ndepths]            (padded to 8 bytes)
+ *   for each depth d:
+ *     int indices[counts[d]]       (padded to 8 bytes)
+ *     double values[counts[d]]
+ *
+ * in native byte order with every array 8 byte aligned, so a mapped file
+ * is used in place without any parsing.
+ */
+#define WAVETREE_CHECKPOINT_MAGIC "WTCHKPT"
+#define WAVETREE_CHECKPOINT_VERSION 1
+
+typedef struct {
+  char magic[8];
+  int version;
+  int dimension;
+
+  int degree[3];
+  int size[3];
+
+  int ncoeff;
+  int ndepths;
+  
+  double alpha;
+} wavetree_checkpoint_header_t;
+
+typedef struct _wavetree_checkpoint wavetree_checkpoint_t;
+
+/*
+ * Writes S_v with the header, the caller fills in dimension, degree, size
+ * and alpha.
+ */
+int
+wavetree_checkpoint_save(const char *filename,
+			 const wavetree_checkpoint_header_t *header,
+			 const multiset_int_double_t *S_v);
+
+/*
+ * Maps a checkpoint read only, checking the magic, version and that the
+ * arrays fit in the file.
+ */
+wavetree_checkpoint_t *
+wavetree_checkpoint_open(const char *filename);
+
+void
+wavetree_checkpoint_close(wavetree_checkpoint_t *c);
+
+const wavetree_checkpoint_header_t *
+wavetree_checkpoint_header(const wavetree_checkpoint_t *c);
+
+/*
+ * Returns the no. of coefficients at depth d with pointers into the mapping
+ * for their (sorted) indices and values, or -1 on error.
+ */
+int
+wavetree_checkpoint_depth(const wavetree_checkpoint_t *c,
+			  int d,
+			  const int **indices,
+			  const double **values);
+
+/*
+ * Fills S_v from the checkpoint in ascending index order
+ */
+int
+wavetree_checkpoint_restore(const wavetree_checkpoint_t *c,
+			    multiset_int_double_t *S_v);
+
+#endif /* wavetree_checkpoint_h */
@@ -0,0 +1,377 @@
+//
+//    Wavetree Library : A library for performed trans-dimensional tree inversion,
+//    See
+//
+//      R Hawkins and M Sambridge, "Geophysical imaging using trans-dimensional trees",
+//      Geophysical Journal International, 2015, 203:2, 972 - 1000,
+//      https://doi.org/10.1093/gji/ggv326
+//    
+//    Copyright (C) 2014 - 2018 Rhys Hawkins
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "wavetree_exchange.h"
+
+#include "slog.h"
+
+/* "WTXCHG" read as a little endian word */
+#define EXCHANGE_MAGIC 0x474843585457ULL
+
+/*
+ * Shared layout: the ring header followed by nslots of slot header and
+ * payload. The reserve and acquire counters sit on their own cache lines.
+ */
+typedef struct {
+  uint64_t magic;
+  int nslots;
+  int slot_size;
+  char pad0[48];
+
+  uint64_t head;
+  char pad1[56];
+
+  uint64_t tail;
+  char pad2[56];
+} ring_t;
+
+typedef struct {
+  uint64_t sequence;
+  uint64_t ticket;
+  int length;
+  char pad[44];
+} slot_t;
+
+struct _wavetree_exchange {
+  ring_t *ring;
+  size_t length;
+  int stride;
+
+  char *name;
+};
+
+static size_t ring_length(int nslots, int slot_size)
+{
+  return sizeof(ring_t) + (size_t)nslots * (sizeof(slot_t) + slot_size);
+}
+
+static slot_t *ring_slot(const wavetree_exchange_t *x, int i)
+{
+  return (slot_t *)((char *)x->ring + sizeof(ring_t) + (size_t)i * x->stride);
+}
+
+static wavetree_exchange_t *exchange_map(int fd,
+					 size_t length,
+					 int flags)
+{
+  wavetree_exchange_t *x;
+
+  x = malloc(sizeof(wavetree_exchange_t));
+  if (x == NULL) {
+    ERROR("failed to allocate memory");
+    return NULL;
+  }
+
+  x->length = length;
+  x->ring = mmap(NULL, length, PROT_READ | PROT_WRITE, flags, fd, 0);
+  if (x->ring == MAP_FAILED) {
+    ERROR("failed to map ring");
+    free(x);
+    return NULL;
+  }
+
+  x->stride = 0;
+  x->name = NULL;
+  return x;
+}
+
+static int exchange_initialise(wavetree_exchange_t *x,
+			       int nslots,
+			       int slot_size)
+{
+  int i;
+
+  x->ring->nslots = nslots;
+  x->ring->slot_size = slot_size;
+  x->ring->head = 0;
+  x->ring->tail = 0;
+  x->stride = sizeof(slot_t) + slot_size;
+
+  /*
+   * Slot i is free for ticket i, the magic is stored last with release
+   * semantics so that an opening process never sees a partly initialised
+   * ring.
+   */
+  for (i = 0; i < nslots; i ++) {
+    ring_slot(x, i)->sequence = i;
+    ring_slot(x, i)->ticket = 0;
+    ring_slot(x, i)->length = 0;
+  }
+
+  __atomic_store_n(&(x->ring->magic), EXCHANGE_MAGIC, __ATOMIC_RELEASE);
+
+  return 0;
+}
+
+wavetree_exchange_t *
+wavetree_exchange_create(const char *name,
+			 int nslots,
+			 int slot_size)
+{
+  wavetree_exchange_t *x;
+  size_t length;
+  int fd;
+
+  if (nslots < 1 || slot_size < 1) {
+    ERROR("invalid ring size %d %d", nslots, slot_size);
+    return NULL;
+  }
+
+  slot_size = (slot_size + 63) & ~63;
+  length = ring_length(nslots, slot_size);
+  
+  fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd < 0) {
+    ERROR("failed to create shared memory %s", name);
+    return NULL;
+  }
+
+  if (ftruncate(fd, length) < 0) {
+    ERROR("failed to size shared memory %s", name);
+    close(fd);
+    shm_unlink(name);
+    return NULL;
+  }
+
+  x = exchange_map(fd, length, MAP_SHARED);
+  close(fd);
+  if (x == NULL) {
+    shm_unlink(name);
+    return NULL;
+  }
+
+  x->name = strdup(name);
+  if (x->name == NULL) {
+    ERROR("failed to copy name");
+    wavetree_exchange_destroy(x);
+    shm_unlink(name);
+    return NULL;
+  }
+
+  exchange_initialise(x, nslots, slot_size);
+
+  return x;
+}
+
+wavetree_exchange_t *
+wavetree_exchange_open(const char *name)
+{
+  wavetree_exchange_t *x;
+  struct stat st;
+  int fd;
+
+  fd = shm_open(name, O_RDWR, 0600);
+  if (fd < 0) {
+    ERROR("failed to open shared memory %s", name);
+    return NULL;
+  }
+
+  if (fstat(fd, &st) < 0 || st.st_size < sizeof(ring_t)) {
+    ERROR("shared memory %s too short", name);
+    close(fd);
+    return NULL;
+  }
+
+  x = exchange_map(fd, st.st_size, MAP_SHARED);
+  close(fd);
+  if (x == NULL) {
+    return NULL;
+  }
+
+  if (__atomic_load_n(&(x->ring->magic), __ATOMIC_ACQUIRE) != EXCHANGE_MAGIC ||
+      x->ring->nslots < 1 ||
+      x->ring->slot_size < 1 ||
+      ring_length(x->ring->nslots, x->ring->slot_size) > x->length) {
+    ERROR("%s is not an exchange ring", name);
+    wavetree_exchange_destroy(x);
+    return NULL;
+  }
+
+  x->stride = sizeof(slot_t) + x->ring->slot_size;
+  return x;
+}
+
+wavetree_exchange_t *
+wavetree_exchange_create_local(int nslots,
+			       int slot_size)
+{
+  wavetree_exchange_t *x;
+  
+  if (nslots < 1 || slot_size < 1) {
+    ERROR("invalid ring size %d %d", nslots, slot_size);
+    return NULL;
+  }
+
+  slot_size = (slot_size + 63) & ~63;
+  x = exchange_map(-1, ring_length(nslots, slot_size), MAP_SHARED | MAP_ANONYMOUS);
+  if (x == NULL) {
+    return NULL;
+  }
+
+  exchange_initialise(x, nslots, slot_size);
+
+  return x;
+}
+
+void
+wavetree_exchange_destroy(wavetree_exchange_t *x)
+{
+  if (x != NULL) {
+    munmap(x->ring, x->length);
+    if (x->name != NULL) {
+      shm_unlink(x->name);
+      free(x->name);
+    }
+    free(x);
+  }
+}
+
+int
+wavetree_exchange_slot_size(const wavetree_exchange_t *x)
+{
+  return x->ring->slot_size;
+}
+
+/*
+ * The ring is a bounded multi producer/consumer queue: slot sequence
+ * numbers say whether a slot is free for a given reserve ticket
+ * (sequence == ticket), published (sequence == ticket + 1) or still in use
+ * from the previous lap. Only the head/tail counters are contended.
+ */
+void *
+wavetree_exchange_reserve(wavetree_exchange_t *x,
+			  int *slot)
+{
+  slot_t *s;
+  uint64_t pos;
+  uint64_t seq;
+  int64_t diff;
+
+  pos = __atomic_load_n(&(x->ring->head), __ATOMIC_RELAXED);
+  for (;;) {
+    s = ring_slot(x, pos % x->ring->nslots);
+    seq = __atomic_load_n(&(s->sequence), __ATOMIC_ACQUIRE);
+    diff = (int64_t)(seq - pos);
+
+    if (diff == 0) {
+      if (__atomic_compare_exchange_n(&(x->ring->head), &pos, pos + 1, 0,
+				      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+	break;
+      }
+    } else if (diff < 0) {
+      /* Full */
+      return NULL;
+    } else {
+      pos = __atomic_load_n(&(x->ring->head), __ATOMIC_RELAXED);
+    }
+  }
+
+  s->ticket = pos;
+  *slot = pos % x->ring->nslots;
+  return (char *)s + sizeof(slot_t);
+}
+
+int
+wavetree_exchange_publish(wavetree_exchange_t *x,
+			  int slot,
+			  int len)
+{
+  slot_t *s;
+
+  if (slot < 0 || slot >= x->ring->nslots ||
+      len < 0 || len > x->ring->slot_size) {
+    ERROR("invalid slot %d or length %d", slot, len);
+    return -1;
+  }
+
+  s = ring_slot(x, slot);
+  s->length = len;
+  __atomic_store_n(&(s->sequence), s->ticket + 1, __ATOMIC_RELEASE);
+
+  return 0;
+}
+
+const void *
+wavetree_exchange_acquire(wavetree_exchange_t *x,
+			  int *slot,
+			  int *len)
+{
+  slot_t *s;
+  uint64_t pos;
+  uint64_t seq;
+  int64_t diff;
+
+  pos = __atomic_load_n(&(x->ring->tail), __ATOMIC_RELAXED);
+  for (;;) {
+    s = ring_slot(x, pos % x->ring->nslots);
+    seq = __atomic_load_n(&(s->sequence), __ATOMIC_ACQUIRE);
+    diff = (int64_t)(seq - (pos + 1));
+
+    if (diff == 0) {
+      if (__atomic_compare_exchange_n(&(x->ring->tail), &pos, pos + 1, 0,
+				      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+	break;
+      }
+    } else if (diff < 0) {
+      /* Empty */
+      return NULL;
+    } else {
+      pos = __atomic_load_n(&(x->ring->tail), __ATOMIC_RELAXED);
+    }
+  }
+
+  s->ticket = pos;
+  *slot = pos % x->ring->nslots;
+  *len = s->length;
+  return (const char *)s + sizeof(slot_t);
+}
+
+int
+wavetree_exchange_release(wavetree_exchange_t *x,
+			  int slot)
+{
+  slot_t *s;
+
+  if (slot < 0 || slot >= x->ring->nslots) {
+    ERROR("invalid slot %d", slot);
+    return -1;
+  }
+
+  /* Free for the reserve ticket one lap later */
+  s = ring_slot(x, slot);
+  __atomic_store_n(&(s->sequence), s->ticket + x->ring->nslots, __ATOMIC_RELEASE);
+
+  return 0;
+}
@@ -0,0 +1,94 @@
+//
+//    Wavetree Library : A library for performed trans-dimensional tree inversion,
+//    See
+//
+//      R Hawkins and M Sambridge, "Geophysical imaging using trans-dimensional trees",
+//      Geophysical Journal International, 2015, 203:2, 972 - 1000,
+//      https://doi.org/10.1093/gji/ggv326
+//    
+//    Copyright (C) 2014 - 2018 Rhys Hawkins
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+#ifndef wavetree_exchange_h
+#define wavetree_exchange_h
+
+/*
+ * Bounded ring of fixed size slots in shared memory for handing models
+ * (eg wavetree2d_sub snapshots) between processes on the same node. Slots
+ * are filled and read in place: a producer reserves a slot, writes into it
+ * and publishes it, a consumer acquires the oldest published slot, adopts
+ * from it and releases it. Any number of producers and consumers may use
+ * a ring concurrently.
+ */
+typedef struct _wavetree_exchange wavetree_exchange_t;
+
+/*
+ * Creates a named ring (POSIX shared memory, name as for shm_open eg
+ * "/wavetree_rank0") of nslots slots holding up to slot_size bytes each.
+ * The name is removed again when the creating handle is destroyed.
+ */
+wavetree_exchange_t *
+wavetree_exchange_create(const char *name,
+			 int nslots,
+			 int slot_size);
+
+/*
+ * Attaches to a named ring created by another process
+ */
+wavetree_exchange_t *
+wavetree_exchange_open(const char *name);
+
+/*
+ * An anonymous ring shared with processes forked after its creation, a
+ * stand in for a named ring within one process tree.
+ */
+wavetree_exchange_t *
+wavetree_exchange_create_local(int nslots,
+			       int slot_size);
+
+void
+wavetree_exchange_destroy(wavetree_exchange_t *x);
+
+int
+wavetree_exchange_slot_size(const wavetree_exchange_t *x);
+
+/*
+ * Returns the next free slot to fill in place (64 byte aligned) or NULL
+ * if the ring is full. The slot must be published once written.
+ */
+void *
+wavetree_exchange_reserve(wavetree_exchange_t *x,
+			  int *slot);
+
+int
+wavetree_exchange_publish(wavetree_exchange_t *x,
+			  int slot,
+			  int len);
+
+/*
+ * Returns the oldest published slot and its length or NULL if there is
+ * none. The contents stay valid until the slot is released.
+ */
+const void *
+wavetree_exchange_acquire(wavetree_exchange_t *x,
+			  int *slot,
+			  int *len);
+
+int
+wavetree_exchange_release(wavetree_exchange_t *x,
+			  int slot);
+
+#endif /* wavetree_exchange_h */
@@ -0,0 +1,339 @@
+//
+//    Wavetree Library : A library for performed trans-dimensional tree inversion,
+//    See
+//
+//      R Hawkins and M Sambridge, "Geophysical imaging using trans-dimensional trees",
+//      Geophysical Journal International, 2015, 203:2, 972 - 1000,
+//      https://doi.org/10.1093/gji/ggv326
+//    
+//    Copyright (C) 2014 - 2018 Rhys Hawkins
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "wavetree_impulse.h"
+
+#include "slog.h"
+
+struct _wavetree_impulse {
+
+  int width;
+  int levels;
+
+  int *base;    /* [levels + 1] first entry for each no. of levels */
+  int *lo;      /* [nentries] */
+  int *hi;      /* [nentries] */
+  int *offset;  /* [nentries] */
+
+  int nvalues;
+  double *values;
+
+  int *cover_base; /* [(levels + 1) * (width + 1)] first covering entry of each position */
+  int *cover;      /* [nvalues] indices covering each position, highest first */
+  
+};
+
+static int level_count(int width, int l)
+{
+  if (l == 0) {
+    return width;
+  }
+  
+  return width >> (l - 1);
+}
+
+static int build_cover(wavetree_impulse_t *p);
+
+wavetree_impulse_t *
+wavetree_impulse_create(int width,
+			int levels,
+			wavetree_impulse_response_t response)
+{
+  wavetree_impulse_t *p;
+  double *v;
+  double *work;
+  double *values;
+  int i;
+  int l;
+  int e;
+  int n;
+  int size;
+  int nentries;
+
+  if (width < 1 || levels < 0 || (width >> levels) < 1) {
+    ERROR("invalid parameters %d %d", width, levels);
+    return NULL;
+  }
+
+  p = malloc(sizeof(wavetree_impulse_t));
+  if (p == NULL) {
+    ERROR("failed to allocate struct");
+    return NULL;
+  }
+
+  p->width = width;
+  p->levels = levels;
+  p->base = NULL;
+  p->lo = NULL;
+  p->hi = NULL;
+  p->offset = NULL;
+  p->nvalues = 0;
+  p->values = NULL;
+  p->cover_base = NULL;
+  p->cover = NULL;
+
+  v = NULL;
+  work = NULL;
+
+  p->base = malloc(sizeof(int) * (levels + 1));
+  if (p->base == NULL) {
+    ERROR("failed to allocate level bases");
+    goto fail;
+  }
+
+  nentries = 0;
+  for (l = 0; l <= levels; l ++) {
+    p->base[l] = nentries;
+    nentries += level_count(width, l);
+  }
+
+  p->lo = malloc(sizeof(int) * nentries);
+  p->hi = malloc(sizeof(int) * nentries);
+  p->offset = malloc(sizeof(int) * nentries);
+  if (p->lo == NULL || p->hi == NULL || p->offset == NULL) {
+    ERROR("failed to allocate index arrays");
+    goto fail;
+  }
+
+  v = malloc(sizeof(double) * width);
+  work = malloc(sizeof(double) * width);
+  if (v == NULL || work == NULL) {
+    ERROR("failed to allocate workspace");
+    goto fail;
+  }
+
+  size = nentries;
+  p->values = malloc(sizeof(double) * size);
+  if (p->values == NULL) {
+    ERROR("failed to allocate values");
+    goto fail;
+  }
+
+  for (l = 0; l <= levels; l ++) {
+    for (i = 0; i < level_count(width, l); i ++) {
+
+      e = p->base[l] + i;
+      
+      if (response(width, l, i, v, work, &(p->lo[e]), &(p->hi[e])) < 0) {
+	ERROR("failed to compute impulse response for %d (%d)", i, l);
+	goto fail;
+      }
+      
+      n = p->hi[e] - p->lo[e] + 1;
+      if (n < 0) {
+	n = 0;
+      }
+      
+      if (p->nvalues + n > size) {
+	while (p->nvalues + n > size) {
+	  size *= 2;
+	}
+	
+	values = realloc(p->values, sizeof(double) * size);
+	if (values == NULL) {
+	  ERROR("failed to reallocate values");
+	  goto fail;
+	}
+	p->values = values;
+      }
+      
+      p->offset[e] = p->nvalues;
+      memcpy(p->values + p->nvalues, v + p->lo[e], sizeof(double) * n);
+      p->nvalues += n;
+    }
+  }
+
+  free(v);
+  free(work);
+  v = NULL;
+  work = NULL;
+
+  if (build_cover(p) < 0) {
+    goto fail;
+  }
+
+  return p;
+
+ fail:
+  free(v);
+  free(work);
+  wavetree_impulse_destroy(p);
+  return NULL;
+}
+
+void
+wavetree_impulse_destroy(wavetree_impulse_t *p)
+{
+  if (p != NULL) {
+    free(p->base);
+    free(p->lo);
+    free(p->hi);
+    free(p->offset);
+    free(p->values);
+    free(p->cover_base);
+    free(p->cover);
+    free(p);
+  }
+}
+
+int
+wavetree_impulse_width(const wavetree_impulse_t *p)
+{
+  return p->width;
+}
+
+int
+wavetree_impulse_levels(const wavetree_impulse_t *p,
+			int index)
+{
+  int l;
+
+  l = p->levels;
+  while (l > 0 && index >= level_count(p->width, l)) {
+    l --;
+  }
+
+  return l;
+}
+
+const double *
+wavetree_impulse_get(const wavetree_impulse_t *p,
+		     int index,
+		     int levels,
+		     int *lo,
+		     int *hi)
+{
+  int e;
+  
+  if (levels < 0 || levels > p->levels ||
+      index < 0 || index >= level_count(p->width, levels)) {
+    ERROR("index out of range %d %d (%d %d)", index, levels, p->width, p->levels);
+    return NULL;
+  }
+
+  e = p->base[levels] + index;
+  *lo = p->lo[e];
+  *hi = p->hi[e];
+  return p->values + p->offset[e];
+}
+
+const int *
+wavetree_impulse_cover(const wavetree_impulse_t *p,
+		       int levels,
+		       int x,
+		       int *n,
+		       int *nexact)
+{
+  const int *c;
+  int e;
+  int threshold;
+  
+  if (levels < 0 || levels > p->levels ||
+      x < 0 || x >= p->width) {
+    ERROR("position out of range %d %d (%d %d)", x, levels, p->width, p->levels);
+    return NULL;
+  }
+
+  e = levels * (p->width + 1) + x;
+  c = p->cover + p->cover_base[e];
+  *n = p->cover_base[e + 1] - p->cover_base[e];
+
+  /*
+   * Indices at or above the next level count take part in exactly levels
+   * steps and are stored first.
+   */
+  if (levels == p->levels) {
+    *nexact = *n;
+  } else {
+    threshold = level_count(p->width, levels + 1);
+    *nexact = 0;
+    while (*nexact < *n && c[*nexact] >= threshold) {
+      (*nexact) ++;
+    }
+  }
+
+  return c;
+}
+
+static int build_cover(wavetree_impulse_t *p)
+{
+  int l;
+  int i;
+  int x;
+  int e;
+  int b;
+  int nrows;
+  int *next;
+
+  nrows = (p->levels + 1) * (p->width + 1);
+  p->cover_base = malloc(sizeof(int) * nrows);
+  p->cover = malloc(sizeof(int) * (p->nvalues > 0 ? p->nvalues : 1));
+  next = malloc(sizeof(int) * nrows);
+  if (p->cover_base == NULL || p->cover == NULL || next == NULL) {
+    ERROR("failed to allocate cover");
+    free(next);
+    return -1;
+  }
+
+  /*
+   * Counting sort of the supports, the extra entry per level holds the
+   * end of the last position so that each list is [base[e], base[e + 1]).
+   */
+  memset(next, 0, sizeof(int) * nrows);
+  for (l = 0; l <= p->levels; l ++) {
+    b = l * (p->width + 1);
+    for (i = 0; i < level_count(p->width, l); i ++) {
+      e = p->base[l] + i;
+      for (x = p->lo[e]; x <= p->hi[e]; x ++) {
+	next[b + x] ++;
+      }
+    }
+  }
+
+  e = 0;
+  for (i = 0; i < nrows; i ++) {
+    p->cover_base[i] = e;
+    e += next[i];
+    next[i] = p->cover_base[i];
+  }
+
+  for (l = 0; l <= p->levels; l ++) {
+    b = l * (p->width + 1);
+    for (i = level_count(p->width, l) - 1; i >= 0; i --) {
+      e = p->base[l] + i;
+      for (x = p->lo[e]; x <= p->hi[e]; x ++) {
+	p->cover[next[b + x]] = i;
+	next[b + x] ++;
+      }
+    }
+  }
+
+  free(next);
+  return 0;
+}
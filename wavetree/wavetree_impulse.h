@@ -0,0 +1,96 @@
+//
+//    Wavetree Library : A library for performed trans-dimensional tree inversion,
+//    See
+//
+//      R Hawkins and M Sambridge, "Geophysical imaging using trans-dimensional trees",
+//      Geophysical Journal International, 2015, 203:2, 972 - 1000,
+//      https://doi.org/10.1093/gji/ggv326
+//    
+//    Copyright (C) 2014 - 2018 Rhys Hawkins
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+
+#ifndef wavetree_impulse_h
+#define wavetree_impulse_h
+
+/*
+ * Computes the image space response of a single unit coefficient at index
+ * for a 1D inverse transform of given width using levels inverse steps. The
+ * non-zero support is returned in [lo, hi]. The signature matches
+ * cdf97_lift_impulse_response_1d and haar_lift_impulse_response_1d in the
+ * wavelet library.
+ */
+typedef int (*wavetree_impulse_response_t)(int width,
+					   int levels,
+					   int index,
+					   double *v,
+					   double *work,
+					   int *lo,
+					   int *hi);
+
+typedef struct _wavetree_impulse wavetree_impulse_t;
+
+/*
+ * Precomputes and stores the (truncated to support) 1D impulse responses
+ * along one axis for every coefficient index and every number of inverse
+ * steps from 0 up to levels. A coefficient with index i only takes part
+ * in the last wavetree_impulse_levels(p, i) steps, but in a 2D/3D pyramid
+ * transform a coefficient's response along one axis starts at the
+ * coarsest step of all its axes, hence the shorter responses are needed.
+ */
+wavetree_impulse_t *
+wavetree_impulse_create(int width,
+			int levels,
+			wavetree_impulse_response_t response);
+
+void
+wavetree_impulse_destroy(wavetree_impulse_t *p);
+
+int
+wavetree_impulse_width(const wavetree_impulse_t *p);
+
+/*
+ * The number of inverse steps that index takes part in
+ */
+int
+wavetree_impulse_levels(const wavetree_impulse_t *p,
+			int index);
+
+/*
+ * Returns the response of index after the last levels inverse steps with
+ * element 0 corresponding to *lo
+ */
+const double *
+wavetree_impulse_get(const wavetree_impulse_t *p,
+		     int index,
+		     int levels,
+		     int *lo,
+		     int *hi);
+
+/*
+ * Returns the n indices whose response after levels inverse steps has
+ * position x within its support, in decreasing order. The first nexact of these
+ * take part in exactly levels steps, ie wavetree_impulse_levels returns
+ * levels for them.
+ */
+const int *
+wavetree_impulse_cover(const wavetree_impulse_t *p,
+		       int levels,
+		       int x,
+		       int *n,
+		       int *nexact);
+
+#endif /* wavetree_impulse_h */
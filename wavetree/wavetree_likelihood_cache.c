@@ -0,0 +1,296 @@
+//
+//    Wavetree Library : A library for performed trans-dimensional tree inversion,
+//    See
+//
+//      R Hawkins and M Sambridge, "Geophysical imaging using trans-dimensional trees",
+//      Geophysical Journal International, 2015, 203:2, 972 - 1000,
+//      https://doi.org/10.1093/gji/ggv326
+//    
+//    Copyright (C) 2014 - 2018 Rhys Hawkins
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "wavetree_likelihood_cache.h"
+
+#include "slog.h"
+
+typedef struct {
+  uint64_t key;
+  double likelihood;
+
+  int prev;
+  int next;
+} entry_t;
+
+/*
+ * Entries live in a fixed array threaded onto a doubly linked list in
+ * recency order (head most recent). The slots array is an open addressed
+ * table with linear probing holding entry indices, -1 for empty, and at
+ * least twice as many slots as entries so probe sequences stay short.
+ */
+struct _wavetree_likelihood_cache {
+
+  int size;
+  int count;
+
+  entry_t *entries;
+
+  int head;
+  int tail;
+
+  int mask;
+  int *slots;
+
+  int hits;
+  int misses;
+};
+
+static int home_slot(const wavetree_likelihood_cache_t *c, uint64_t key);
+static int find_slot(const wavetree_likelihood_cache_t *c, uint64_t key);
+static void remove_slot(wavetree_likelihood_cache_t *c, int s);
+static void unlink_entry(wavetree_likelihood_cache_t *c, int e);
+static void push_front(wavetree_likelihood_cache_t *c, int e);
+
+wavetree_likelihood_cache_t *
+wavetree_likelihood_cache_create(int size)
+{
+  wavetree_likelihood_cache_t *c;
+  int nslots;
+
+  if (size <= 0) {
+    ERROR("invalid cache size %d", size);
+    return NULL;
+  }
+
+  c = malloc(sizeof(wavetree_likelihood_cache_t));
+  if (c == NULL) {
+    ERROR("failed to allocate cache");
+    return NULL;
+  }
+
+  c->size = size;
+  c->slots = NULL;
+
+  c->entries = malloc(sizeof(entry_t) * size);
+  if (c->entries == NULL) {
+    ERROR("failed to allocate entries");
+    wavetree_likelihood_cache_destroy(c);
+    return NULL;
+  }
+
+  nslots = 2;
+  while (nslots < 2*size) {
+    nslots <<= 1;
+  }
+  c->mask = nslots - 1;
+
+  c->slots = malloc(sizeof(int) * nslots);
+  if (c->slots == NULL) {
+    ERROR("failed to allocate slots");
+    wavetree_likelihood_cache_destroy(c);
+    return NULL;
+  }
+
+  wavetree_likelihood_cache_clear(c);
+
+  return c;
+}
+
+void
+wavetree_likelihood_cache_destroy(wavetree_likelihood_cache_t *c)
+{
+  if (c != NULL) {
+    free(c->entries);
+    free(c->slots);
+    free(c);
+  }
+}
+
+int
+wavetree_likelihood_cache_lookup(wavetree_likelihood_cache_t *c,
+				 uint64_t key,
+				 double *likelihood)
+{
+  int s;
+  int e;
+
+  s = find_slot(c, key);
+  e = c->slots[s];
+  if (e < 0) {
+    c->misses ++;
+    return 0;
+  }
+
+  if (e != c->head) {
+    unlink_entry(c, e);
+    push_front(c, e);
+  }
+
+  *likelihood = c->entries[e].likelihood;
+  c->hits ++;
+  return 1;
+}
+
+int
+wavetree_likelihood_cache_insert(wavetree_likelihood_cache_t *c,
+				 uint64_t key,
+				 double likelihood)
+{
+  int s;
+  int e;
+
+  s = find_slot(c, key);
+  e = c->slots[s];
+
+  if (e < 0) {
+
+    if (c->count < c->size) {
+      e = c->count;
+      c->count ++;
+    } else {
+      /* Recycle the least recently used entry */
+      e = c->tail;
+      unlink_entry(c, e);
+      remove_slot(c, find_slot(c, c->entries[e].key));
+
+      /* Removal may have shifted our empty slot */
+      s = find_slot(c, key);
+    }
+
+    c->entries[e].key = key;
+    c->slots[s] = e;
+    push_front(c, e);
+
+  } else if (e != c->head) {
+    unlink_entry(c, e);
+    push_front(c, e);
+  }
+
+  c->entries[e].likelihood = likelihood;
+  return 0;
+}
+
+void
+wavetree_likelihood_cache_clear(wavetree_likelihood_cache_t *c)
+{
+  int i;
+
+  c->count = 0;
+  c->head = -1;
+  c->tail = -1;
+  c->hits = 0;
+  c->misses = 0;
+
+  for (i = 0; i <= c->mask; i ++) {
+    c->slots[i] = -1;
+  }
+}
+
+int
+wavetree_likelihood_cache_count(const wavetree_likelihood_cache_t *c)
+{
+  return c->count;
+}
+
+void
+wavetree_likelihood_cache_stats(const wavetree_likelihood_cache_t *c,
+				int *hits,
+				int *misses)
+{
+  *hits = c->hits;
+  *misses = c->misses;
+}
+
+static int home_slot(const wavetree_likelihood_cache_t *c, uint64_t key)
+{
+  /* Fold the high bits in, keys need not be well mixed in the low bits */
+  key ^= key >> 32;
+  key *= 0x9e3779b97f4a7c15ULL;
+  return (int)(key >> 32) & c->mask;
+}
+
+/*
+ * Slot holding key or the empty slot that terminates its probe sequence.
+ */
+static int find_slot(const wavetree_likelihood_cache_t *c, uint64_t key)
+{
+  int s;
+
+  s = home_slot(c, key);
+  while (c->slots[s] >= 0 &&
+	 c->entries[c->slots[s]].key != key) {
+    s = (s + 1) & c->mask;
+  }
+
+  return s;
+}
+
+/*
+ * Backward shift deletion so that no tombstones are needed: later entries
+ * in the run are moved up unless that would put them before their home.
+ */
+static void remove_slot(wavetree_likelihood_cache_t *c, int s)
+{
+  int j;
+  int h;
+
+  j = s;
+  for (;;) {
+    j = (j + 1) & c->mask;
+    if (c->slots[j] < 0) {
+      break;
+    }
+
+    h = home_slot(c, c->entries[c->slots[j]].key);
+    if (((j - h) & c->mask) >= ((j - s) & c->mask)) {
+      c->slots[s] = c->slots[j];
+      s = j;
+    }
+  }
+
+  c->slots[s] = -1;
+}
+
+static void unlink_entry(wavetree_likelihood_cache_t *c, int e)
+{
+  if (c->entries[e].prev >= 0) {
+    c->entries[c->entries[e].prev].next = c->entries[e].next;
+  } else {
+    c->head = c->entries[e].next;
+  }
+
+  if (c->entries[e].next >= 0) {
+    c->entries[c->entries[e].next].prev = c->entries[e].prev;
+  } else {
+    c->tail = c->entries[e].prev;
+  }
+}
+
+static void push_front(wavetree_likelihood_cache_t *c, int e)
+{
+  c->entries[e].prev = -1;
+  c->entries[e].next = c->head;
+
+  if (c->head >= 0) {
+    c->entries[c->head].prev = e;
+  } else {
+    c->tail = e;
+  }
+  c->head = e;
+}
@@ -0,0 +1,73 @@
+//
+//    Wavetree Library : A library for performed trans-dimensional tree inversion,
+//    See
+//
+//      R Hawkins and M Sambridge, "Geophysical imaging using trans-dimensional trees",
+//      Geophysical Journal International, 2015, 203:2, 972 - 1000,
+//      https://doi.org/10.1093/gji/ggv326
+//    
+//    Copyright (C) 2014 - 2018 Rhys Hawkins
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+
+#ifndef wavetree_likelihood_cache_h
+#define wavetree_likelihood_cache_h
+
+#include <stdint.h>
+
+/*
+ * Bounded least recently used cache of likelihoods keyed on a model hash,
+ * e.g. wavetree2d_sub_hash. Lookup and insert are O(1). Callers whose
+ * likelihood also depends on parameters outside the tree (hierarchical
+ * noise etc) should clear the cache when those change.
+ */
+typedef struct _wavetree_likelihood_cache wavetree_likelihood_cache_t;
+
+wavetree_likelihood_cache_t *
+wavetree_likelihood_cache_create(int size);
+
+void
+wavetree_likelihood_cache_destroy(wavetree_likelihood_cache_t *c);
+
+/*
+ * Returns 1 and the cached likelihood on a hit, 0 on a miss.
+ */
+int
+wavetree_likelihood_cache_lookup(wavetree_likelihood_cache_t *c,
+				 uint64_t key,
+				 double *likelihood);
+
+/*
+ * Stores or updates the likelihood for key, evicting the least recently
+ * used entry when full.
+ */
+int
+wavetree_likelihood_cache_insert(wavetree_likelihood_cache_t *c,
+				 uint64_t key,
+				 double likelihood);
+
+void
+wavetree_likelihood_cache_clear(wavetree_likelihood_cache_t *c);
+
+int
+wavetree_likelihood_cache_count(const wavetree_likelihood_cache_t *c);
+
+void
+wavetree_likelihood_cache_stats(const wavetree_likelihood_cache_t *c,
+				int *hits,
+				int *misses);
+
+#endif /* wavetree_likelihood_cache_h */
@@ -0,0 +1,389 @@
+//
+//    Wavetree Library : A library for performed trans-dimensional tree inversion,
+//    See
+//
+//      R Hawkins and M Sambridge, "Geophysical imaging using trans-dimensional trees",
+//      Geophysical Journal International, 2015, 203:2, 972 - 1000,
+//      https://doi.org/10.1093/gji/ggv326
+//    
+//    Copyright (C) 2014 - 2018 Rhys Hawkins
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <pthread.h>
+
+#include <gsl/gsl_rng.h>
+
+#include "wavetree_pt.h"
+
+#include "slog.h"
+
+struct _wavetree_pt {
+
+  int nchains;
+
+  double *temperatures; /* [nchains] by level */
+  void **models;        /* [nchains] by chain */
+  double *likelihoods;  /* [nchains] by chain */
+
+  int *level_of;        /* [nchains] chain to level */
+  int *chain_at;        /* [nchains] level to chain */
+
+  int *proposed;        /* [nchains - 1] by lower level */
+  int *accepted;        /* [nchains - 1] by lower level */
+  int parity;
+
+  wavetree_pt_step_t step;
+  void *user;
+
+  gsl_rng *rng;
+
+  /*
+   * Round state shared with the pool. Chains are claimed with an atomic
+   * counter, the mutex and conditions only start and finish a round.
+   */
+  pthread_mutex_t mutex;
+  pthread_cond_t start;
+  pthread_cond_t done;
+  int generation;
+  int running;
+  int quit;
+
+  int next;
+  int nsteps;
+  int failed;
+};
+
+static void step_chains(wavetree_pt_t *pt);
+static void *pool_worker(void *arg);
+static void exchange(wavetree_pt_t *pt);
+
+wavetree_pt_t *
+wavetree_pt_create(int nchains,
+		   const double *temperatures,
+		   void **models,
+		   const double *likelihoods,
+		   wavetree_pt_step_t step,
+		   void *user,
+		   unsigned long int seed)
+{
+  wavetree_pt_t *pt;
+  int i;
+
+  if (nchains < 1) {
+    ERROR("invalid no. chains %d", nchains);
+    return NULL;
+  }
+
+  for (i = 0; i < nchains; i ++) {
+    if (temperatures[i] <= 0.0 ||
+	(i > 0 && temperatures[i] < temperatures[i - 1])) {
+      ERROR("temperatures must be positive and increasing (%d: %f)", i, temperatures[i]);
+      return NULL;
+    }
+  }
+
+  pt = malloc(sizeof(wavetree_pt_t));
+  if (pt == NULL) {
+    ERROR("failed to allocate struct");
+    return NULL;
+  }
+
+  pt->nchains = nchains;
+  pt->rng = NULL;
+
+  pthread_mutex_init(&(pt->mutex), NULL);
+  pthread_cond_init(&(pt->start), NULL);
+  pthread_cond_init(&(pt->done), NULL);
+
+  pt->temperatures = malloc(sizeof(double) * nchains);
+  pt->models = malloc(sizeof(void*) * nchains);
+  pt->likelihoods = malloc(sizeof(double) * nchains);
+  pt->level_of = malloc(sizeof(int) * nchains);
+  pt->chain_at = malloc(sizeof(int) * nchains);
+  pt->proposed = malloc(sizeof(int) * nchains);
+  pt->accepted = malloc(sizeof(int) * nchains);
+  if (pt->temperatures == NULL ||
+      pt->models == NULL ||
+      pt->likelihoods == NULL ||
+      pt->level_of == NULL ||
+      pt->chain_at == NULL ||
+      pt->proposed == NULL ||
+      pt->accepted == NULL) {
+    ERROR("failed to allocate arrays");
+    wavetree_pt_destroy(pt);
+    return NULL;
+  }
+
+  for (i = 0; i < nchains; i ++) {
+    pt->temperatures[i] = temperatures[i];
+    pt->models[i] = models[i];
+    pt->likelihoods[i] = likelihoods[i];
+    pt->level_of[i] = i;
+    pt->chain_at[i] = i;
+    pt->proposed[i] = 0;
+    pt->accepted[i] = 0;
+  }
+  pt->parity = 0;
+
+  pt->step = step;
+  pt->user = user;
+
+  pt->rng = gsl_rng_alloc(gsl_rng_taus);
+  if (pt->rng == NULL) {
+    ERROR("failed to create rng");
+    wavetree_pt_destroy(pt);
+    return NULL;
+  }
+  gsl_rng_set(pt->rng, seed);
+
+  return pt;
+}
+
+void
+wavetree_pt_destroy(wavetree_pt_t *pt)
+{
+  if (pt != NULL) {
+    pthread_cond_destroy(&(pt->done));
+    pthread_cond_destroy(&(pt->start));
+    pthread_mutex_destroy(&(pt->mutex));
+
+    gsl_rng_free(pt->rng);
+
+    free(pt->temperatures);
+    free(pt->models);
+    free(pt->likelihoods);
+    free(pt->level_of);
+    free(pt->chain_at);
+    free(pt->proposed);
+    free(pt->accepted);
+    free(pt);
+  }
+}
+
+int
+wavetree_pt_run(wavetree_pt_t *pt,
+		int nthreads,
+		int nrounds,
+		int nsteps)
+{
+  pthread_t *threads;
+  int nworkers;
+  int r;
+
+  if (nthreads < 1) {
+    ERROR("invalid no. threads %d", nthreads);
+    return -1;
+  }
+
+  if (nthreads > pt->nchains) {
+    nthreads = pt->nchains;
+  }
+
+  threads = malloc(sizeof(pthread_t) * nthreads);
+  if (threads == NULL) {
+    ERROR("failed to allocate threads");
+    return -1;
+  }
+
+  pt->generation = 0;
+  pt->running = 0;
+  pt->quit = 0;
+  pt->failed = 0;
+
+  nworkers = 0;
+  while (nworkers < nthreads - 1) {
+    if (pthread_create(&(threads[nworkers]), NULL, pool_worker, pt) != 0) {
+      ERROR("failed to start thread %d, continuing with %d", nworkers + 1, nworkers + 1);
+      break;
+    }
+    nworkers ++;
+  }
+
+  for (r = 0; r < nrounds && !pt->failed; r ++) {
+
+    pthread_mutex_lock(&(pt->mutex));
+    pt->next = 0;
+    pt->nsteps = nsteps;
+    pt->running = nworkers;
+    pt->generation ++;
+    pthread_cond_broadcast(&(pt->start));
+    pthread_mutex_unlock(&(pt->mutex));
+
+    step_chains(pt);
+
+    pthread_mutex_lock(&(pt->mutex));
+    while (pt->running > 0) {
+      pthread_cond_wait(&(pt->done), &(pt->mutex));
+    }
+    pthread_mutex_unlock(&(pt->mutex));
+
+    if (!pt->failed) {
+      exchange(pt);
+    }
+  }
+
+  pthread_mutex_lock(&(pt->mutex));
+  pt->quit = 1;
+  pthread_cond_broadcast(&(pt->start));
+  pthread_mutex_unlock(&(pt->mutex));
+
+  for (r = 0; r < nworkers; r ++) {
+    pthread_join(threads[r], NULL);
+  }
+  free(threads);
+
+  return pt->failed ? -1 : 0;
+}
+
+double
+wavetree_pt_chain_temperature(const wavetree_pt_t *pt, int chain)
+{
+  return pt->temperatures[pt->level_of[chain]];
+}
+
+double
+wavetree_pt_chain_likelihood(const wavetree_pt_t *pt, int chain)
+{
+  return pt->likelihoods[chain];
+}
+
+int
+wavetree_pt_chain_at(const wavetree_pt_t *pt, int level)
+{
+  if (level < 0 || level >= pt->nchains) {
+    ERROR("level out of range %d", level);
+    return -1;
+  }
+
+  return pt->chain_at[level];
+}
+
+int
+wavetree_pt_exchange_stats(const wavetree_pt_t *pt,
+			   int level,
+			   int *proposed,
+			   int *accepted)
+{
+  if (level < 0 || level >= (pt->nchains - 1)) {
+    ERROR("level out of range %d", level);
+    return -1;
+  }
+
+  *proposed = pt->proposed[level];
+  *accepted = pt->accepted[level];
+  return 0;
+}
+
+/*
+ * Claims chains until none are left. Each chain is touched by exactly one
+ * thread per round and the temperatures are only changed between rounds.
+ */
+static void step_chains(wavetree_pt_t *pt)
+{
+  int c;
+
+  for (;;) {
+    c = __atomic_fetch_add(&(pt->next), 1, __ATOMIC_RELAXED);
+    if (c >= pt->nchains) {
+      break;
+    }
+
+    if (__atomic_load_n(&(pt->failed), __ATOMIC_RELAXED)) {
+      continue;
+    }
+
+    if (pt->step(pt->user,
+		 c,
+		 pt->models[c],
+		 pt->temperatures[pt->level_of[c]],
+		 pt->nsteps,
+		 &(pt->likelihoods[c])) < 0) {
+      ERROR("failed to step chain %d", c);
+      __atomic_store_n(&(pt->failed), 1, __ATOMIC_RELAXED);
+    }
+  }
+}
+
+static void *pool_worker(void *arg)
+{
+  wavetree_pt_t *pt = (wavetree_pt_t *)arg;
+  int seen;
+
+  seen = 0;
+  for (;;) {
+    pthread_mutex_lock(&(pt->mutex));
+    while (pt->generation == seen && !pt->quit) {
+      pthread_cond_wait(&(pt->start), &(pt->mutex));
+    }
+    seen = pt->generation;
+    if (pt->quit) {
+      pthread_mutex_unlock(&(pt->mutex));
+      break;
+    }
+    pthread_mutex_unlock(&(pt->mutex));
+
+    step_chains(pt);
+
+    pthread_mutex_lock(&(pt->mutex));
+    pt->running --;
+    if (pt->running == 0) {
+      pthread_cond_signal(&(pt->done));
+    }
+    pthread_mutex_unlock(&(pt->mutex));
+  }
+
+  return NULL;
+}
+
+/*
+ * Proposes swaps of adjacent temperatures, alternating between the pairs
+ * starting at even and odd levels so that a chain can only move one level
+ * per round and every pair is independent.
+ */
+static void exchange(wavetree_pt_t *pt)
+{
+  int l;
+  int ci;
+  int cj;
+  double a;
+
+  for (l = pt->parity; l < (pt->nchains - 1); l += 2) {
+
+    ci = pt->chain_at[l];
+    cj = pt->chain_at[l + 1];
+
+    a = (pt->likelihoods[ci] - pt->likelihoods[cj]) *
+      (1.0/pt->temperatures[l] - 1.0/pt->temperatures[l + 1]);
+
+    pt->proposed[l] ++;
+    if (a >= 0.0 || log(gsl_rng_uniform(pt->rng)) < a) {
+
+      pt->chain_at[l] = cj;
+      pt->chain_at[l + 1] = ci;
+      pt->level_of[ci] = l + 1;
+      pt->level_of[cj] = l;
+
+      pt->accepted[l] ++;
+    }
+  }
+
+  pt->parity = 1 - pt->parity;
+}
@@ -0,0 +1,106 @@
+//
+//    Wavetree Library : A library for performed trans-dimensional tree inversion,
+//    See
+//
+//      R Hawkins and M Sambridge, "Geophysical imaging using trans-dimensional trees",
+//      Geophysical Journal International, 2015, 203:2, 972 - 1000,
+//      https://doi.org/10.1093/gji/ggv326
+//    
+//    Copyright (C) 2014 - 2018 Rhys Hawkins
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+
+#ifndef wavetree_pt_h
+#define wavetree_pt_h
+
+/*
+ * In process parallel tempering. Each chain owns an opaque model (e.g. a
+ * wavetree2d_sub_t with its proposals) and is advanced by a user step
+ * function on a pool of threads. Between rounds adjacent temperatures are
+ * exchanged by swapping the temperature labels of the two chains, so no
+ * model is ever copied or encoded.
+ *
+ * Likelihoods are negative log likelihoods, the tempered target of a chain
+ * at temperature T being exp(-likelihood/T).
+ */
+typedef struct _wavetree_pt wavetree_pt_t;
+
+/*
+ * Advances the model of chain by nsteps at the given temperature, updating
+ * *likelihood for the current model. Different chains are stepped
+ * concurrently so the function must only touch state owned by the chain.
+ */
+typedef int (*wavetree_pt_step_t)(void *user,
+				  int chain,
+				  void *model,
+				  double temperature,
+				  int nsteps,
+				  double *likelihood);
+
+/*
+ * Temperatures must be in increasing order, chain i starts at temperature
+ * i with models[i] and likelihoods[i].
+ */
+wavetree_pt_t *
+wavetree_pt_create(int nchains,
+		   const double *temperatures,
+		   void **models,
+		   const double *likelihoods,
+		   wavetree_pt_step_t step,
+		   void *user,
+		   unsigned long int seed);
+
+void
+wavetree_pt_destroy(wavetree_pt_t *pt);
+
+/*
+ * Runs nrounds of stepping every chain by nsteps followed by an exchange
+ * sweep over alternately the even and odd adjacent temperature pairs, on
+ * nthreads threads including the calling one.
+ */
+int
+wavetree_pt_run(wavetree_pt_t *pt,
+		int nthreads,
+		int nrounds,
+		int nsteps);
+
+/*
+ * Current temperature and likelihood of a chain.
+ */
+double
+wavetree_pt_chain_temperature(const wavetree_pt_t *pt, int chain);
+
+double
+wavetree_pt_chain_likelihood(const wavetree_pt_t *pt, int chain);
+
+/*
+ * Chain currently at the temperature with the given index, 0 is the
+ * coldest.
+ */
+int
+wavetree_pt_chain_at(const wavetree_pt_t *pt, int level);
+
+/*
+ * Exchanges proposed and accepted between temperature levels level and
+ * level + 1.
+ */
+int
+wavetree_pt_exchange_stats(const wavetree_pt_t *pt,
+			   int level,
+			   int *proposed,
+			   int *accepted);
+
+#endif /* wavetree_pt_h */
@@ -0,0 +1,312 @@
+//
+//    Wavetree Library : A library for performed trans-dimensional tree inversion,
+//    See
+//
+//      R Hawkins and M Sambridge, "Geophysical imaging using trans-dimensional trees",
+//      Geophysical Journal International, 2015, 203:2, 972 - 1000,
+//      https://doi.org/10.1093/gji/ggv326
+//    
+//    Copyright (C) 2014 - 2018 Rhys Hawkins
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "wavetree_snapshot.h"
+
+#include "slog.h"
+
+static int pad8(int n)
+{
+  return (n + 7) & ~7;
+}
+
+static int snapshot_depths(const multiset_int_double_t *S_v,
+			   const multiset_int_t *S_b,
+			   const multiset_int_t *S_d)
+{
+  int ndepths;
+  int d;
+  int n;
+
+  /* Depths up to the last non-empty one of any set */
+  ndepths = 0;
+  for (d = 0; (n = multiset_int_double_depth_count(S_v, d)) >= 0; d ++) {
+    if (n > 0) {
+      ndepths = d + 1;
+    }
+  }
+  for (d = 0; (n = multiset_int_depth_count(S_b, d)) >= 0; d ++) {
+    if (n > 0 && d >= ndepths) {
+      ndepths = d + 1;
+    }
+  }
+  for (d = 0; (n = multiset_int_depth_count(S_d, d)) >= 0; d ++) {
+    if (n > 0 && d >= ndepths) {
+      ndepths = d + 1;
+    }
+  }
+
+  return ndepths;
+}
+
+static int depth_count_v(const multiset_int_double_t *S_v, int d)
+{
+  int n = multiset_int_double_depth_count(S_v, d);
+  return n < 0 ? 0 : n;
+}
+
+static int depth_count(const multiset_int_t *S, int d)
+{
+  int n = multiset_int_depth_count(S, d);
+  return n < 0 ? 0 : n;
+}
+
+int
+wavetree_snapshot_size(const multiset_int_double_t *S_v,
+		       const multiset_int_t *S_b,
+		       const multiset_int_t *S_d)
+{
+  int ndepths;
+  int length;
+  int n;
+  int d;
+
+  ndepths = snapshot_depths(S_v, S_b, S_d);
+  
+  length = sizeof(wavetree_snapshot_header_t) + pad8(sizeof(int) * 3 * ndepths);
+  for (d = 0; d < ndepths; d ++) {
+    n = depth_count_v(S_v, d);
+    length += pad8(sizeof(int) * n) + sizeof(double) * n;
+    length += pad8(sizeof(int) * depth_count(S_b, d));
+    length += pad8(sizeof(int) * depth_count(S_d, d));
+  }
+
+  return length;
+}
+
+int
+wavetree_snapshot_write(void *buffer,
+			int size,
+			const wavetree_snapshot_header_t *header,
+			const multiset_int_double_t *S_v,
+			const multiset_int_t *S_b,
+			const multiset_int_t *S_d)
+{
+  wavetree_snapshot_header_t *h;
+  char *p;
+  int *counts;
+  int *indices;
+  double *values;
+  int length;
+  int ndepths;
+  int d;
+  int i;
+  int n;
+
+  if (((uintptr_t)buffer & 7) != 0) {
+    ERROR("snapshot buffer not aligned");
+    return -1;
+  }
+  
+  length = wavetree_snapshot_size(S_v, S_b, S_d);
+  if (length > size) {
+    ERROR("snapshot does not fit %d > %d", length, size);
+    return -1;
+  }
+  
+  ndepths = snapshot_depths(S_v, S_b, S_d);
+
+  h = (wavetree_snapshot_header_t *)buffer;
+  *h = *header;
+  memset(h->magic, 0, sizeof(h->magic));
+  memcpy(h->magic, WAVETREE_SNAPSHOT_MAGIC, strlen(WAVETREE_SNAPSHOT_MAGIC));
+  h->version = WAVETREE_SNAPSHOT_VERSION;
+  h->ndepths = ndepths;
+  h->ncoeff = multiset_int_double_total_count(S_v);
+  h->length = length;
+
+  p = (char *)buffer + sizeof(wavetree_snapshot_header_t);
+  counts = (int *)p;
+  for (d = 0; d < ndepths; d ++) {
+    counts[d] = depth_count_v(S_v, d);
+    counts[ndepths + d] = depth_count(S_b, d);
+    counts[2 * ndepths + d] = depth_count(S_d, d);
+  }
+  p += pad8(sizeof(int) * 3 * ndepths);
+
+  /*
+   * Values are read straight into place
+   */
+  for (d = 0; d < ndepths; d ++) {
+    n = counts[d];
+    indices = (int *)p;
+    values = (double *)(p + pad8(sizeof(int) * n));
+    for (i = 0; i < n; i ++) {
+      if (multiset_int_double_nth_element(S_v, d, i, &(indices[i]), &(values[i])) < 0) {
+	ERROR("failed to get coefficient %d at depth %d", i, d);
+	return -1;
+      }
+    }
+    p += pad8(sizeof(int) * n) + sizeof(double) * n;
+  }
+
+  for (d = 0; d < ndepths; d ++) {
+    n = counts[ndepths + d];
+    indices = (int *)p;
+    for (i = 0; i < n; i ++) {
+      if (multiset_int_nth_element(S_b, d, i, &(indices[i])) < 0) {
+	ERROR("failed to get birth index %d at depth %d", i, d);
+	return -1;
+      }
+    }
+    p += pad8(sizeof(int) * n);
+  }
+  
+  for (d = 0; d < ndepths; d ++) {
+    n = counts[2 * ndepths + d];
+    indices = (int *)p;
+    for (i = 0; i < n; i ++) {
+      if (multiset_int_nth_element(S_d, d, i, &(indices[i])) < 0) {
+	ERROR("failed to get death index %d at depth %d", i, d);
+	return -1;
+      }
+    }
+    p += pad8(sizeof(int) * n);
+  }
+
+  return length;
+}
+
+const wavetree_snapshot_header_t *
+wavetree_snapshot_header(const void *buffer,
+			 int len)
+{
+  const wavetree_snapshot_header_t *h;
+  const int *counts;
+  int length;
+  int d;
+
+  if (((uintptr_t)buffer & 7) != 0) {
+    ERROR("snapshot buffer not aligned");
+    return NULL;
+  }
+
+  if (len < (int)sizeof(wavetree_snapshot_header_t)) {
+    ERROR("snapshot too short for header");
+    return NULL;
+  }
+
+  h = (const wavetree_snapshot_header_t *)buffer;
+  if (strncmp(h->magic, WAVETREE_SNAPSHOT_MAGIC, sizeof(h->magic)) != 0) {
+    ERROR("not a snapshot");
+    return NULL;
+  }
+
+  if (h->version != WAVETREE_SNAPSHOT_VERSION) {
+    ERROR("unsupported snapshot version %d", h->version);
+    return NULL;
+  }
+
+  if (h->ndepths < 0 || h->length > len ||
+      sizeof(wavetree_snapshot_header_t) + pad8(sizeof(int) * 3 * h->ndepths) > h->length) {
+    ERROR("invalid snapshot length %d (%d)", h->length, len);
+    return NULL;
+  }
+
+  /*
+   * Check the arrays fit in the stated length
+   */
+  counts = (const int *)((const char *)buffer + sizeof(wavetree_snapshot_header_t));
+  length = sizeof(wavetree_snapshot_header_t) + pad8(sizeof(int) * 3 * h->ndepths);
+  for (d = 0; d < 3 * h->ndepths; d ++) {
+    if (counts[d] < 0) {
+      ERROR("invalid count %d", d);
+      return NULL;
+    }
+    length += pad8(sizeof(int) * counts[d]);
+    if (d < h->ndepths) {
+      length += sizeof(double) * counts[d];
+    }
+  }
+
+  if (length != h->length) {
+    ERROR("snapshot length mismatch %d != %d", length, h->length);
+    return NULL;
+  }
+
+  return h;
+}
+
+int
+wavetree_snapshot_adopt(const void *buffer,
+			int len,
+			multiset_int_double_t *S_v,
+			multiset_int_t *S_b,
+			multiset_int_t *S_d)
+{
+  const wavetree_snapshot_header_t *h;
+  const char *p;
+  const int *counts;
+  int ndepths;
+  int d;
+  int n;
+
+  h = wavetree_snapshot_header(buffer, len);
+  if (h == NULL) {
+    return -1;
+  }
+
+  ndepths = h->ndepths;
+  p = (const char *)buffer + sizeof(wavetree_snapshot_header_t);
+  counts = (const int *)p;
+  p += pad8(sizeof(int) * 3 * ndepths);
+
+  /*
+   * Each depth is assigned whole, depths beyond the snapshot are emptied
+   */
+  for (d = 0; d < ndepths || multiset_int_double_depth_count(S_v, d) > 0; d ++) {
+    n = (d < ndepths) ? counts[d] : 0;
+    if (multiset_int_double_assign_depth(S_v, d, (const int *)p, (const double *)(p + pad8(sizeof(int) * n)), n) < 0) {
+      ERROR("failed to assign coefficients at depth %d", d);
+      return -1;
+    }
+    p += pad8(sizeof(int) * n) + sizeof(double) * n;
+  }
+
+  for (d = 0; d < ndepths || multiset_int_depth_count(S_b, d) > 0; d ++) {
+    n = (d < ndepths) ? counts[ndepths + d] : 0;
+    if (multiset_int_assign_depth(S_b, d, (const int *)p, n) < 0) {
+      ERROR("failed to assign birth indices at depth %d", d);
+      return -1;
+    }
+    p += pad8(sizeof(int) * n);
+  }
+  
+  for (d = 0; d < ndepths || multiset_int_depth_count(S_d, d) > 0; d ++) {
+    n = (d < ndepths) ? counts[2 * ndepths + d] : 0;
+    if (multiset_int_assign_depth(S_d, d, (const int *)p, n) < 0) {
+      ERROR("failed to assign death indices at depth %d", d);
+      return -1;
+    }
+    p += pad8(sizeof(int) * n);
+  }
+
+  return 0;
+}
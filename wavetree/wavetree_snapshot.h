@@ -0,0 +1,104 @@
+//
+//    Wavetree Library : A library for performed trans-dimensional tree inversion,
+//    See
+//
+//      R Hawkins and M Sambridge, "Geophysical imaging using trans-dimensional trees",
+//      Geophysical Journal International, 2015, 203:2, 972 - 1000,
+//      https://doi.org/10.1093/gji/ggv326
+//    
+//    Copyright (C) 2014 - 2018 Rhys Hawkins
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+#ifndef wavetree_snapshot_h
+#define wavetree_snapshot_h
+
+#include "multiset_int_double.h"
+#include "multiset_int.h"
+
+/*
+ * In memory snapshot of a tree model with all three sets, laid out as
+ *
+ *   header
+ *   int counts[3][ndepths]         (S_v, S_b, S_d, padded to 8 bytes)
+ *   for each depth d:
+ *     int indices[counts[0][d]]    (padded to 8 bytes)
+ *     double values[counts[0][d]]
+ *   for each depth d:
+ *     int indices[counts[1][d]]    (padded to 8 bytes)
+ *   for each depth d:
+ *     int indices[counts[2][d]]    (padded to 8 bytes)
+ *
+ * in native byte order. Every array is kept sorted so that a snapshot is
+ * adopted by copying arrays rather than rebuilding the sets, which makes
+ * it suitable for exchanging models between processes on the same node
+ * (see wavetree_exchange). The buffer must be 8 byte aligned.
+ */
+#define WAVETREE_SNAPSHOT_MAGIC "WTSNAP"
+#define WAVETREE_SNAPSHOT_VERSION 1
+
+typedef struct {
+  char magic[8];
+  int version;
+  int dimension;
+
+  int degree[3];
+  int ndepths;
+  
+  int ncoeff;
+  int length;
+  
+  double alpha;
+} wavetree_snapshot_header_t;
+
+/*
+ * Bytes required for a snapshot of the sets
+ */
+int
+wavetree_snapshot_size(const multiset_int_double_t *S_v,
+		       const multiset_int_t *S_b,
+		       const multiset_int_t *S_d);
+
+/*
+ * Writes the sets with the header, the caller fills in dimension, degree
+ * and alpha. Returns the length written or -1 if it does not fit.
+ */
+int
+wavetree_snapshot_write(void *buffer,
+			int size,
+			const wavetree_snapshot_header_t *header,
+			const multiset_int_double_t *S_v,
+			const multiset_int_t *S_b,
+			const multiset_int_t *S_d);
+
+/*
+ * Checks the magic, version and length of a snapshot and returns its
+ * header or NULL.
+ */
+const wavetree_snapshot_header_t *
+wavetree_snapshot_header(const void *buffer,
+			 int len);
+
+/*
+ * Replaces the contents of the sets with those of the snapshot
+ */
+int
+wavetree_snapshot_adopt(const void *buffer,
+			int len,
+			multiset_int_double_t *S_v,
+			multiset_int_t *S_b,
+			multiset_int_t *S_d);
+
+#endif /* wavetree_snapshot_h */
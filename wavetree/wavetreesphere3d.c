@@ -1138,7 +1138,7 @@ int wavetreesphere3d_parent_index(wavetreesphere3d_t *t, int c)
       pi = ii;
     }
   } else {
-    pi = t->manifold->vertices[ii].parent;
+    pi = t->manifold->vparent[ii];
   }
 
   if (ik % 2 == 0) {
@@ -1253,7 +1253,7 @@ wavetreesphere3d_get_child_indices(wavetreesphere3d_t *t,
     n = 0;
     if (ii >= 2) {
       for (i = 0; i < 3; i ++) {
-	c = t->manifold->vertices[ii].children[i];
+	c = t->manifold->vchildren[ii][i];
 	if (c > 0) {
 	  child_indices[n] = wavetreesphere3d_from_sphere2dindices(t, c, 2*(ik - 1) + 1);
 	  if (child_indices[n] > 0) {
@@ -1289,7 +1289,7 @@ wavetreesphere3d_get_child_indices(wavetreesphere3d_t *t,
        * Add back vertices for lower level coeff. For these coeff, ik will be greater 
        * than 0.
        */
-      c = t->manifold->vertices[ii].children[3];
+      c = t->manifold->vchildren[ii][3];
       if (c > 0) {
 	child_indices[n] = wavetreesphere3d_from_sphere2dindices(t, c, 2*(ik - 1) + 1);
 	if (child_indices[n] > 0) {